@@ -5,6 +5,8 @@
 
 #include "Application.h"
 
+#include <vector>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -190,30 +192,7 @@ namespace Walnut {
 		VkResult err;
 
 		if (!m_StagingBuffer)
-		{
-			// Create the Upload Buffer
-			{
-				VkBufferCreateInfo buffer_info = {};
-				buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-				buffer_info.size = upload_size;
-				buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-				buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-				err = vkCreateBuffer(device, &buffer_info, nullptr, &m_StagingBuffer);
-				check_vk_result(err);
-				VkMemoryRequirements req;
-				vkGetBufferMemoryRequirements(device, m_StagingBuffer, &req);
-				m_AlignedSize = req.size;
-				VkMemoryAllocateInfo alloc_info = {};
-				alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-				alloc_info.allocationSize = req.size;
-				alloc_info.memoryTypeIndex = Utils::GetVulkanMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, req.memoryTypeBits);
-				err = vkAllocateMemory(device, &alloc_info, nullptr, &m_StagingBufferMemory);
-				check_vk_result(err);
-				err = vkBindBufferMemory(device, m_StagingBuffer, m_StagingBufferMemory, 0);
-				check_vk_result(err);
-			}
-
-		}
+			CreateStagingBuffer(upload_size);
 
 		// Upload to Buffer
 		{
@@ -274,6 +253,126 @@ namespace Walnut {
 		}
 	}
 
+	void Image::SetData(const void* data, const ImageRegion* regions, uint32_t count)
+	{
+		// Regions keep the rest of the image, so it must have been set in full before
+		if (!m_StagingBuffer)
+		{
+			SetData(data);
+			return;
+		}
+		if (count == 0)
+			return;
+
+		VkDevice device = Application::GetDevice();
+		const size_t bytes_per_pixel = Utils::BytesPerPixel(m_Format);
+		const size_t row_size = m_Width * bytes_per_pixel;
+
+		VkResult err;
+
+		// Upload the rows of the regions to the same place in the buffer, which is laid out as the image
+		std::vector<VkBufferImageCopy> copies;
+		copies.reserve(count);
+		{
+			char* map = NULL;
+			err = vkMapMemory(device, m_StagingBufferMemory, 0, m_AlignedSize, 0, (void**)(&map));
+			check_vk_result(err);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const ImageRegion& r = regions[i];
+				if (r.Width == 0 || r.Height == 0 || r.X + r.Width > m_Width || r.Y + r.Height > m_Height)
+					continue;
+
+				const size_t offset = r.Y * row_size + r.X * bytes_per_pixel;
+				for (uint32_t y = 0; y < r.Height; y++)
+					memcpy(map + offset + y * row_size, (const char*)data + offset + y * row_size, r.Width * bytes_per_pixel);
+
+				VkBufferImageCopy copy = {};
+				copy.bufferOffset = offset;
+				copy.bufferRowLength = m_Width;
+				copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				copy.imageSubresource.layerCount = 1;
+				copy.imageOffset = { (int32_t)r.X, (int32_t)r.Y, 0 };
+				copy.imageExtent = { r.Width, r.Height, 1 };
+				copies.push_back(copy);
+			}
+			VkMappedMemoryRange range[1] = {};
+			range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range[0].memory = m_StagingBufferMemory;
+			range[0].size = m_AlignedSize;
+			err = vkFlushMappedMemoryRanges(device, 1, range);
+			check_vk_result(err);
+			vkUnmapMemory(device, m_StagingBufferMemory);
+		}
+		if (copies.empty())
+			return;
+
+		// Copy to Image, from the layout it is sampled in so its other pixels are kept
+		{
+			VkCommandBuffer command_buffer = Application::GetCommandBuffer(true);
+
+			VkImageMemoryBarrier copy_barrier = {};
+			copy_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			copy_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			copy_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			copy_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			copy_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			copy_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			copy_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			copy_barrier.image = m_Image;
+			copy_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy_barrier.subresourceRange.levelCount = 1;
+			copy_barrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &copy_barrier);
+
+			vkCmdCopyBufferToImage(command_buffer, m_StagingBuffer, m_Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)copies.size(), copies.data());
+
+			VkImageMemoryBarrier use_barrier = {};
+			use_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			use_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			use_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			use_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			use_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			use_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			use_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			use_barrier.image = m_Image;
+			use_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			use_barrier.subresourceRange.levelCount = 1;
+			use_barrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &use_barrier);
+
+			Application::FlushCommandBuffer(command_buffer);
+		}
+	}
+
+	void Image::CreateStagingBuffer(size_t size)
+	{
+		VkDevice device = Application::GetDevice();
+		VkResult err;
+
+		// Create the Upload Buffer
+		{
+			VkBufferCreateInfo buffer_info = {};
+			buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_info.size = size;
+			buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+			buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			err = vkCreateBuffer(device, &buffer_info, nullptr, &m_StagingBuffer);
+			check_vk_result(err);
+			VkMemoryRequirements req;
+			vkGetBufferMemoryRequirements(device, m_StagingBuffer, &req);
+			m_AlignedSize = req.size;
+			VkMemoryAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			alloc_info.allocationSize = req.size;
+			alloc_info.memoryTypeIndex = Utils::GetVulkanMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, req.memoryTypeBits);
+			err = vkAllocateMemory(device, &alloc_info, nullptr, &m_StagingBufferMemory);
+			check_vk_result(err);
+			err = vkBindBufferMemory(device, m_StagingBuffer, m_StagingBufferMemory, 0);
+			check_vk_result(err);
+		}
+	}
+
 	void Image::Resize(uint32_t width, uint32_t height)
 	{
 		if (m_Image && m_Width == width && m_Height == height)
@@ -13,6 +13,13 @@ namespace Walnut {
 		RGBA32F
 	};
 
+	// Pixels of an image, in rows from the first of its data
+	struct ImageRegion
+	{
+		uint32_t X = 0, Y = 0;
+		uint32_t Width = 0, Height = 0;
+	};
+
 	class Image
 	{
 	public:
@@ -21,6 +28,8 @@ namespace Walnut {
 		~Image();
 
 		void SetData(const void* data);
+		// Uploads only the regions of data, which holds the whole image. The rest keeps the last data set.
+		void SetData(const void* data, const ImageRegion* regions, uint32_t count);
 
 		VkDescriptorSet GetDescriptorSet() const { return m_DescriptorSet; }
 
@@ -30,6 +39,7 @@ namespace Walnut {
 		uint32_t GetHeight() const { return m_Height; }
 	private:
 		void AllocateMemory(uint64_t size);
+		void CreateStagingBuffer(size_t size);
 		void Release();
 	private:
 		uint32_t m_Width = 0, m_Height = 0;
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <limits>
+
+struct AABB
+{
+    glm::vec3 Min{std::numeric_limits<float>::max()};
+    glm::vec3 Max{-std::numeric_limits<float>::max()};
+
+    AABB() = default;
+    AABB(const glm::vec3 &min, const glm::vec3 &max) : Min(min), Max(max) {}
+
+    void Grow(const glm::vec3 &point)
+    {
+        Min = glm::min(Min, point);
+        Max = glm::max(Max, point);
+    }
+
+    void Grow(const AABB &box)
+    {
+        Min = glm::min(Min, box.Min);
+        Max = glm::max(Max, box.Max);
+    }
+
+    bool IsEmpty() const { return Min.x > Max.x || Min.y > Max.y || Min.z > Max.z; }
+
+    glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+    glm::vec3 Extent() const { return Max - Min; }
+
+    float SurfaceArea() const
+    {
+        if (IsEmpty())
+            return 0.0f;
+        glm::vec3 e = Extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    /**
+     * @brief Slab test of a ray against the box.
+     *
+     * @param origin The ray origin.
+     * @param invDirection The component-wise reciprocal of the ray direction.
+     * @param tMin The minimum distance along the ray.
+     * @param tMax The maximum distance along the ray.
+     * @param tEntry Output parameter for the distance at which the ray enters the box.
+     * @return bool Returns true if the ray overlaps the box inside [tMin, tMax].
+     */
+    bool hit(const glm::vec3 &origin, const glm::vec3 &invDirection, float tMin, float tMax, float &tEntry) const
+    {
+        glm::vec3 t0 = (Min - origin) * invDirection;
+        glm::vec3 t1 = (Max - origin) * invDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        tEntry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+        float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+        return tEntry <= tExit;
+    }
+};
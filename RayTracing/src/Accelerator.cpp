@@ -0,0 +1,82 @@
+#include "Accelerator.h"
+
+#include "BVH.h"
+#include "CompressedBVH.h"
+#include "UniformGrid.h"
+#include "Numa.h"
+
+#include <thread>
+
+const char *GetAcceleratorName(AcceleratorType type)
+{
+    switch (type)
+    {
+    case AcceleratorType::None:
+        return "None";
+    case AcceleratorType::BVH:
+        return "BVH";
+    case AcceleratorType::CompressedBVH:
+        return "Compressed BVH";
+    case AcceleratorType::UniformGrid:
+        return "Uniform Grid";
+    }
+    return "Unknown";
+}
+
+/**
+ * @brief Builds an acceleration structure of the given type over the objects of a list.
+ *
+ * @param type The kind of acceleration structure to build.
+ * @param list The objects to build the structure over.
+ * @param maxLeafSize The maximum number of objects per leaf of hierarchies. Compressed BVH leaves hold at most
+ * `CompressedBVHNode::MaxLeafSize`, and uniform grids ignore it.
+ * @return shared_ptr<Accelerator> The new acceleration structure, or nullptr for `AcceleratorType::None`,
+ * in which case the list should be traced directly.
+ */
+shared_ptr<Accelerator> CreateAccelerator(AcceleratorType type, const HittableList &list, uint32_t maxLeafSize)
+{
+    switch (type)
+    {
+    case AcceleratorType::BVH:
+        return make_shared<BVH>(list, maxLeafSize);
+    case AcceleratorType::CompressedBVH:
+        return make_shared<CompressedBVH>(list, maxLeafSize);
+    case AcceleratorType::UniformGrid:
+        return make_shared<UniformGrid>(list);
+    case AcceleratorType::None:
+        break;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Builds one acceleration structure per NUMA node, for `Scene::AccelerationReplicas`.
+ *
+ * Each replica is built by a thread bound to its node, so the nodes of the structure are first touched, and
+ * allocated, in that node's memory. Only the structure is replicated: the objects it references are shared.
+ *
+ * @param type The kind of acceleration structure to build.
+ * @param list The objects to build the structures over.
+ * @param maxLeafSize The maximum number of objects per leaf, see `CreateAccelerator`.
+ * @return std::vector<shared_ptr<Accelerator>> One structure per node, or an empty list on machines with a
+ * single node or for `AcceleratorType::None`.
+ */
+std::vector<shared_ptr<Accelerator>> CreateAcceleratorReplicas(AcceleratorType type, const HittableList &list, uint32_t maxLeafSize)
+{
+    const int nodes = GetNumaNodeCount();
+    std::vector<shared_ptr<Accelerator>> replicas;
+    if (nodes == 1 || type == AcceleratorType::None)
+        return replicas;
+
+    replicas.resize(nodes);
+    std::vector<std::thread> builders;
+    for (int node = 0; node < nodes; node++)
+    {
+        builders.emplace_back([&, node]()
+                              { BindThreadToNumaNode(node);
+                                replicas[node] = CreateAccelerator(type, list, maxLeafSize); });
+    }
+    for (std::thread &builder : builders)
+        builder.join();
+    return replicas;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Frustum.h"
+#include "RayPacket.h"
+
+#include <memory>
+#include <vector>
+
+enum class AcceleratorType
+{
+    None = 0,
+    BVH,
+    CompressedBVH,
+    UniformGrid,
+};
+constexpr int AcceleratorTypeCount = 4;
+
+/**
+ * @brief Base class for acceleration structures built over the objects of a HittableList.
+ *
+ * Accelerators keep a reference to every object of the list they were built from and report hits with
+ * `payload.objectIndex` set to the index of the object in that list, so they can be used anywhere the
+ * list itself is used. They must be rebuilt whenever the list changes.
+ */
+class Accelerator : public Hittable
+{
+public:
+    Accelerator(const HittableList &list) : m_Objects(list.objects) {}
+
+    void ClosestHit(const Ray &ray, HitPayload &payload) const override
+    {
+        m_Objects[payload.objectIndex]->ClosestHit(ray, payload);
+    }
+
+    /**
+     * @brief Collects the nodes a bundle of rays inside the frustum can reach, for `hitFromCandidates`.
+     *
+     * @return bool Returns false if the accelerator does not support frustum culling, in which case
+     * `hitFromCandidates` must not be used.
+     */
+    virtual bool CullFrustum(const Frustum &, std::vector<uint32_t> &) const { return false; }
+
+    // Same as hit, for a ray inside the frustum the candidates were culled with
+    virtual bool hitFromCandidates(const Ray &ray, float tMin, float tMax, HitPayload &payload, const std::vector<uint32_t> &) const
+    {
+        return hit(ray, tMin, tMax, payload);
+    }
+
+    /**
+     * @brief Finds the closest hit of every active ray of a packet.
+     *
+     * The default traces each active lane on its own; accelerators that can share traversal work between
+     * coherent rays override it.
+     *
+     * @param packet The rays to trace. `HitMask`, `Hits` and `TMax` are updated for every lane that hits.
+     * @param tMin The minimum distance at which a hit can occur.
+     * @param candidates Frustum culled start nodes enclosing every active ray, or nullptr to start at the root.
+     */
+    virtual void hitPacket(RayPacket &packet, float tMin, const std::vector<uint32_t> *candidates) const
+    {
+        for (int lane = 0; lane < packet.Size; lane++)
+        {
+            if (!((packet.ActiveMask >> lane) & 1u))
+                continue;
+
+            const Ray ray = packet.GetRay(lane);
+            const bool hitAnything = candidates ? hitFromCandidates(ray, tMin, packet.TMax[lane], packet.Hits[lane], *candidates)
+                                                : hit(ray, tMin, packet.TMax[lane], packet.Hits[lane]);
+            if (hitAnything)
+            {
+                packet.TMax[lane] = packet.Hits[lane].HitDistance;
+                packet.HitMask |= 1u << lane;
+            }
+        }
+    }
+
+    /**
+     * @brief Updates the bounds of the nodes to objects that moved or changed size, keeping the hierarchy.
+     *
+     * Much cheaper than a rebuild when only transforms change, as between the frames of an animation, but the
+     * hierarchy gets slower to trace the further objects move from where it was built.
+     *
+     * @return bool Returns false if the accelerator does not support refitting, in which case it must be rebuilt.
+     */
+    virtual bool Refit() { return false; }
+
+    virtual const char *GetName() const = 0;
+    virtual size_t GetNodeCount() const = 0;
+
+    // Bytes used by the nodes and primitive references, excluding the primitives themselves.
+    virtual size_t GetMemoryUsage() const = 0;
+
+    size_t GetPrimitiveCount() const { return m_Objects.size(); }
+
+protected:
+    std::vector<shared_ptr<Hittable>> m_Objects;
+};
+
+const char *GetAcceleratorName(AcceleratorType type);
+shared_ptr<Accelerator> CreateAccelerator(AcceleratorType type, const HittableList &list, uint32_t maxLeafSize = 4);
+std::vector<shared_ptr<Accelerator>> CreateAcceleratorReplicas(AcceleratorType type, const HittableList &list, uint32_t maxLeafSize = 4);
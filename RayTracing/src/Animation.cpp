@@ -0,0 +1,494 @@
+#include "Animation.h"
+#include "Json.h"
+#include "MappedFile.h"
+#include "RenderOutput.h"
+#include "Sphere.h"
+#include "BVH.h"
+
+#include "Walnut/Timer.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    bool ReadTime(JsonReader &reader, float &time)
+    {
+        return reader.ReadFloat(time) && (time >= 0.0f || reader.Fail("times must not be negative"));
+    }
+
+    bool ReadCameraKey(JsonReader &reader, CameraKeyframe &key, bool first, bool &looksAtTargets)
+    {
+        bool position = false, direction = false, target = false;
+        const bool read = reader.ReadObject([&](const std::string &name)
+                                            {
+            if (name == "time")
+                return ReadTime(reader, key.Time);
+            if (name == "position")
+                return (position = true) && reader.ReadVec3(key.Position);
+            if (name == "direction")
+                return (direction = true) && reader.ReadVec3(key.Direction);
+            if (name == "target")
+                return (target = true) && reader.ReadVec3(key.Target);
+            if (name == "fov")
+                return reader.ReadFloat(key.VerticalFOV);
+            if (name == "aperture")
+                return reader.ReadFloat(key.Aperture);
+            if (name == "focusDistance")
+                return reader.ReadFloat(key.FocusDistance);
+            return reader.SkipValue(); });
+        if (!read)
+            return false;
+
+        if (!position || direction == target)
+            return reader.Fail("camera keys need a position, and a direction or a target");
+        if (first)
+            looksAtTargets = target;
+        if (target != looksAtTargets)
+            return reader.Fail("camera keys must all have a direction or all a target");
+        if (direction && glm::length(key.Direction) == 0.0f)
+            return reader.Fail("camera direction is zero");
+        return true;
+    }
+
+    bool ReadSphereKey(JsonReader &reader, SphereKeyframe &key)
+    {
+        bool center = false;
+        const bool read = reader.ReadObject([&](const std::string &name)
+                                            {
+            if (name == "time")
+                return ReadTime(reader, key.Time);
+            if (name == "center")
+                return (center = true) && reader.ReadVec3(key.Center);
+            if (name == "radius")
+                return reader.ReadFloat(key.Radius);
+            return reader.SkipValue(); });
+        return read && (center || reader.Fail("sphere keys need a center"));
+    }
+
+    bool ReadSphereTrack(JsonReader &reader, SphereTrack &track)
+    {
+        bool indexed = false;
+        const bool read = reader.ReadObject([&](const std::string &name)
+                                            {
+            if (name == "sphere")
+            {
+                long long index;
+                if (!reader.ReadInteger(index))
+                    return false;
+                if (index < 0 || index > std::numeric_limits<uint32_t>::max())
+                    return reader.Fail("invalid sphere index");
+                track.Sphere = static_cast<uint32_t>(index);
+                indexed = true;
+                return true;
+            }
+            if (name == "keys")
+                return reader.ReadArray([&]()
+                                        { track.Keys.emplace_back();
+                                          return ReadSphereKey(reader, track.Keys.back()); });
+            return reader.SkipValue(); });
+        return read && ((indexed && !track.Keys.empty()) || reader.Fail("sphere tracks need a sphere and keys"));
+    }
+
+    template <typename Key>
+    void SortKeys(std::vector<Key> &keys)
+    {
+        std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b)
+                         { return a.Time < b.Time; });
+    }
+
+    /**
+     * @brief Finds the keys around a time.
+     *
+     * @param keys The keys, sorted by time.
+     * @param time The time to find.
+     * @param fraction Output parameter for how far the time is from the first key to the second, 0 outside the keys.
+     * @return size_t The index of the last key at or before the time, or of the first key before it.
+     */
+    template <typename Key>
+    size_t FindKeys(const std::vector<Key> &keys, float time, float &fraction)
+    {
+        const auto next = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const Key &key)
+                                           { return t < key.Time; });
+        fraction = 0.0f;
+        if (next == keys.begin())
+            return 0;
+
+        const size_t index = static_cast<size_t>(next - keys.begin()) - 1;
+        if (next != keys.end())
+            fraction = (time - keys[index].Time) / (next->Time - keys[index].Time);
+        return index;
+    }
+
+    // Point a fraction of the way from p1 to p2 on the Catmull-Rom spline through p0 to p3
+    glm::vec3 CatmullRom(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, float t)
+    {
+        const float t2 = t * t, t3 = t2 * t;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+    // Value of a member of the keys at a time, on the spline through the keys around it
+    template <typename Key, typename Member>
+    glm::vec3 SplineAt(const std::vector<Key> &keys, size_t index, float fraction, Member member)
+    {
+        const size_t last = keys.size() - 1;
+        return CatmullRom(keys[index > 0 ? index - 1 : 0].*member, keys[index].*member,
+                          keys[std::min(index + 1, last)].*member, keys[std::min(index + 2, last)].*member, fraction);
+    }
+
+    // Value of a member of the keys at a time, keys below 0 taking the fallback
+    template <typename Key>
+    float LinearAt(const std::vector<Key> &keys, size_t index, float fraction, float Key::*member, float fallback)
+    {
+        const float a = keys[index].*member, b = keys[std::min(index + 1, keys.size() - 1)].*member;
+        return glm::mix(a < 0.0f ? fallback : a, b < 0.0f ? fallback : b, fraction);
+    }
+
+    // Output path of a frame, the first run of # replaced by its number
+    std::string GetFramePath(const std::string &pattern, uint32_t frame)
+    {
+        const size_t start = pattern.find('#');
+        const size_t end = std::min(pattern.find_first_not_of('#', start), pattern.size());
+        std::string number = std::to_string(frame);
+        if (number.size() < end - start)
+            number.insert(0, end - start - number.size(), '0');
+        return pattern.substr(0, start) + number + pattern.substr(end);
+    }
+
+    // Frames rendered by every thread of RenderAnimation, and the messages they print
+    struct AnimationProgress
+    {
+        std::atomic<uint32_t> NextFrame{0};
+        std::mutex Mutex;
+        std::condition_variable StreamTurn; // Notified when NextStreamed changes
+        uint32_t NextStreamed = 0;
+        uint32_t Rendered = 0;
+        uint32_t Skipped = 0;
+        uint32_t Failed = 0;
+    };
+
+    /**
+     * @brief Renders frames of an animation on the calling thread until none is left, with a team of threadCount render threads.
+     *
+     * The thread renders a copy of the scene whose animated spheres are its own, over a hierarchy whose nodes
+     * start shared with the scene's. Before every frame the spheres are moved and the hierarchy is refitted
+     * to them, rather than built again. Each frame samples deterministically from its own range of sample
+     * indices, so no two frames share their noise and a frame is the same whichever thread renders it.
+     *
+     * Frames finished before the frames ahead of them wait for their turn to be streamed, while the threads
+     * of the frames ahead go on rendering.
+     *
+     * @param settings The frames, image and output of the animation.
+     * @param animation The keyframes of the animation.
+     * @param scene The scene at rest, which is not changed.
+     * @param baseCamera The scene's camera, whose lens fills in the keys that leave it out.
+     * @param threadCount The threads to render each frame with.
+     * @param endFrame One past the last frame to render.
+     * @param stream The stream of the frames, or nullptr.
+     * @param progress The next frame to render and the counts of frames done, shared with the other threads.
+     */
+    void RenderAnimationFrames(const AnimationRenderSettings &settings, const Animation &animation, const Scene &scene, const Camera &baseCamera,
+                               int threadCount, uint32_t endFrame, FrameStream *stream, AnimationProgress &progress)
+    {
+        omp_set_num_threads(threadCount);
+
+        Scene frameScene = scene;
+        std::vector<Sphere *> spheres;
+        std::vector<float> radii;
+        if (!animation.Spheres.empty())
+        {
+            for (const SphereTrack &track : animation.Spheres)
+            {
+                auto sphere = make_shared<Sphere>(static_cast<const Sphere &>(*scene.Hittables.objects[track.Sphere]));
+                frameScene.Hittables.objects[track.Sphere] = sphere;
+                spheres.push_back(sphere.get());
+                radii.push_back(sphere->Radius);
+            }
+
+            // Replicas would have to be refitted one by one, the thread's own hierarchy is traced from every node instead
+            const BVH *bvh = dynamic_cast<const BVH *>(scene.AccelerationStructure.get());
+            frameScene.AccelerationStructure = bvh ? make_shared<BVH>(frameScene.Hittables, bvh->GetNodes(), bvh->GetPrimitiveIndices(), bvh->GetMaxLeafSize())
+                                                   : CreateAccelerator(AcceleratorType::BVH, frameScene.Hittables);
+            frameScene.AccelerationReplicas.clear();
+        }
+
+        Camera camera = baseCamera;
+        Renderer renderer(true);
+        SetupHeadlessRenderer(settings.Job, renderer, camera);
+        renderer.GetSettings().ThreadCount = threadCount;
+        RenderSnapshot snapshot;
+
+        for (uint32_t frame = progress.NextFrame++; frame < endFrame; frame = progress.NextFrame++)
+        {
+            // Streams need every frame, including those whose image exists
+            const std::string path = settings.OutputPath.empty() ? std::string() : GetFramePath(settings.OutputPath, frame);
+            if (!stream && std::filesystem::exists(path))
+            {
+                std::lock_guard<std::mutex> lock(progress.Mutex);
+                progress.Skipped++;
+                continue;
+            }
+
+            Walnut::Timer timer;
+            const float time = static_cast<float>(frame) / animation.FrameRate;
+            ApplyCameraAnimation(animation, time, baseCamera, camera);
+            for (size_t i = 0; i < spheres.size(); i++)
+            {
+                const std::vector<SphereKeyframe> &keys = animation.Spheres[i].Keys;
+                float fraction;
+                const size_t index = FindKeys(keys, time, fraction);
+                spheres[i]->Position = SplineAt(keys, index, fraction, &SphereKeyframe::Center);
+                spheres[i]->Radius = LinearAt(keys, index, fraction, &SphereKeyframe::Radius, radii[i]);
+            }
+            if (!spheres.empty() && !frameScene.AccelerationStructure->Refit())
+                frameScene.AccelerationStructure = CreateAccelerator(AcceleratorType::BVH, frameScene.Hittables);
+
+            renderer.SetFirstFrame(frame * settings.Job.Frames);
+            for (uint32_t sample = 0; sample < settings.Job.Frames; sample++)
+                renderer.Render(frameScene, camera);
+
+            std::string error;
+            bool written = true;
+            if (!path.empty())
+            {
+                CaptureRenderSnapshot(renderer, frameScene, camera, RenderLayerSamples, snapshot);
+                written = SaveRenderExr(path, snapshot, ExrCompression::RLE, error);
+            }
+
+            std::unique_lock<std::mutex> lock(progress.Mutex);
+            if (stream)
+            {
+                progress.StreamTurn.wait(lock, [&]()
+                                         { return progress.NextStreamed == frame; });
+                if (!stream->Submit(renderer.GetImageData(), renderer.GetWidth(), renderer.GetHeight(), false))
+                {
+                    // The frames already handed out still take their turn, and fail the same way
+                    written = false;
+                    error = "not streamed, " + stream->GetStatus();
+                    progress.NextFrame = endFrame;
+                }
+                progress.NextStreamed++;
+                progress.StreamTurn.notify_all();
+            }
+
+            if (written)
+            {
+                std::fprintf(stderr, "[frame %u] %s%s in %.1fs\n", frame, path.empty() ? "streamed" : "wrote ", path.c_str(), timer.Elapsed());
+                progress.Rendered++;
+            }
+            else
+            {
+                std::fprintf(stderr, "[frame %u] %s\n", frame, error.c_str());
+                progress.Failed++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Loads the keyframes of an animation file.
+ *
+ * Keys are sorted by time once loaded, so they may be listed in any order. Sphere indices are checked
+ * against the scene when the animation is rendered.
+ *
+ * @param path The path of the animation file, in the format described in Animation.h.
+ * @param animation Output parameter for the animation, left unchanged if loading fails.
+ * @param error Output parameter for a description of the problem, with its line, if loading fails.
+ * @return bool Returns true if the file was loaded; otherwise, returns false.
+ */
+bool LoadAnimation(const std::string &path, Animation &animation, std::string &error)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = "Cannot open " + path;
+        return false;
+    }
+
+    JsonReader reader(file.GetData(), file.GetData() + file.GetSize());
+    Animation loaded;
+    const bool read = reader.ReadObject([&](const std::string &key)
+                                        {
+        if (key == "format")
+        {
+            std::string format;
+            return reader.ReadString(format) && (format == "raytracing-animation" || reader.Fail("not an animation file"));
+        }
+        if (key == "version")
+        {
+            long long version;
+            return reader.ReadInteger(version) && (version <= AnimationFileVersion || reader.Fail("animation file from a newer version"));
+        }
+        if (key == "frameRate")
+            return reader.ReadFloat(loaded.FrameRate) && (loaded.FrameRate > 0.0f || reader.Fail("the frame rate must be positive"));
+        if (key == "frames")
+        {
+            long long frames;
+            if (!reader.ReadInteger(frames))
+                return false;
+            if (frames <= 0 || frames > std::numeric_limits<int>::max())
+                return reader.Fail("expected a positive number of frames");
+            loaded.Frames = static_cast<uint32_t>(frames);
+            return true;
+        }
+        if (key == "camera")
+            return reader.ReadArray([&]()
+                                    { loaded.Camera.emplace_back();
+                                      return ReadCameraKey(reader, loaded.Camera.back(), loaded.Camera.size() == 1, loaded.CameraLooksAtTargets); });
+        if (key == "spheres")
+            return reader.ReadArray([&]()
+                                    { loaded.Spheres.emplace_back();
+                                      if (!ReadSphereTrack(reader, loaded.Spheres.back()))
+                                          return false;
+                                      const uint32_t sphere = loaded.Spheres.back().Sphere;
+                                      // Every track replaces its sphere in the frame's scene, a second one would free the first
+                                      return std::none_of(loaded.Spheres.begin(), loaded.Spheres.end() - 1, [&](const SphereTrack &track)
+                                                          { return track.Sphere == sphere; }) ||
+                                             reader.Fail(("sphere " + std::to_string(sphere) + " has two tracks").c_str()); });
+        return reader.SkipValue(); });
+
+    if (!read || (!reader.AtEnd() && !reader.Fail("unexpected text after the animation")))
+    {
+        error = path + ", " + reader.GetError();
+        return false;
+    }
+
+    SortKeys(loaded.Camera);
+    for (SphereTrack &track : loaded.Spheres)
+        SortKeys(track.Keys);
+    animation = std::move(loaded);
+    return true;
+}
+
+/**
+ * @brief Places a camera where the animation has it at a time.
+ *
+ * @param animation The animation.
+ * @param time The time, in seconds.
+ * @param base The camera at rest, whose placement is kept without camera keys and whose lens fills in the keys that leave it out.
+ * @param camera The camera to place, already sized to the image.
+ */
+void ApplyCameraAnimation(const Animation &animation, float time, const Camera &base, Camera &camera)
+{
+    const std::vector<CameraKeyframe> &keys = animation.Camera;
+    if (keys.empty())
+    {
+        camera.SetLens(base.GetVerticalFOV(), base.getAperatureSize(), base.getFocusDistance());
+        camera.SetView(base.GetPosition(), base.GetDirection());
+        return;
+    }
+
+    float fraction;
+    const size_t index = FindKeys(keys, time, fraction);
+    camera.SetLens(LinearAt(keys, index, fraction, &CameraKeyframe::VerticalFOV, base.GetVerticalFOV()),
+                   LinearAt(keys, index, fraction, &CameraKeyframe::Aperture, base.getAperatureSize()),
+                   LinearAt(keys, index, fraction, &CameraKeyframe::FocusDistance, base.getFocusDistance()));
+
+    const glm::vec3 position = SplineAt(keys, index, fraction, &CameraKeyframe::Position);
+    glm::vec3 direction = animation.CameraLooksAtTargets ? SplineAt(keys, index, fraction, &CameraKeyframe::Target) - position
+                                                         : SplineAt(keys, index, fraction, &CameraKeyframe::Direction);
+    // A camera on its target, or a spline through opposite directions, keeps looking the way the key does
+    if (glm::length(direction) == 0.0f)
+        direction = animation.CameraLooksAtTargets ? base.GetDirection() : keys[index].Direction;
+    camera.SetView(position, direction);
+}
+
+/**
+ * @brief Renders a range of frames of an animation, writing each one as soon as it is done.
+ *
+ * Frames are rendered several at a time when the image is too small to keep every thread busy: every frame
+ * gets the threads `GetRenderThreadShare` finds worth giving it, and as many frames as that leaves threads
+ * for are rendered side by side, each on its own thread taking the next frame once it is done. Between
+ * frames only the transforms of the spheres change, so each thread refits its hierarchy instead of building
+ * a new one. Frames whose image exists are skipped, so an interrupted render goes on where it stopped,
+ * unless they are streamed, which the stream gets in order whichever thread finishes them first.
+ *
+ * @param settings The scene, animation, frames and image to render.
+ * @param status Output parameter for a summary of the frames rendered, or a description of the problem if it fails.
+ * @return bool Returns true if every frame was rendered or skipped; otherwise, returns false.
+ */
+bool RenderAnimation(const AnimationRenderSettings &settings, std::string &status)
+{
+    const RenderJobSettings &job = settings.Job;
+    if (job.Width == 0 || job.Height == 0 || job.Frames == 0)
+    {
+        status = "The image size and frames must not be 0";
+        return false;
+    }
+    if (settings.OutputPath.empty() && settings.StreamPath.empty())
+    {
+        status = "Animations need an output path or a stream";
+        return false;
+    }
+    if (!settings.OutputPath.empty() && settings.OutputPath.find('#') == std::string::npos)
+    {
+        status = "The output path needs # for the frame number";
+        return false;
+    }
+
+    Animation animation;
+    if (!LoadAnimation(settings.AnimationPath, animation, status))
+        return false;
+
+    Scene scene;
+    Camera camera = CreateDefaultCamera();
+    std::vector<std::string> materialNames;
+    if (!LoadRenderScene(settings.ScenePath, scene, camera, materialNames, status))
+        return false;
+    for (const SphereTrack &track : animation.Spheres)
+    {
+        if (track.Sphere >= scene.Hittables.objects.size() || !dynamic_cast<const Sphere *>(scene.Hittables.objects[track.Sphere].get()))
+        {
+            status = "Object " + std::to_string(track.Sphere) + " of " + settings.ScenePath + " is not a sphere";
+            return false;
+        }
+    }
+
+    const uint32_t endFrame = settings.EndFrame > 0 ? settings.EndFrame : animation.Frames;
+    if (settings.FirstFrame >= endFrame)
+    {
+        status = "No frame to render between " + std::to_string(settings.FirstFrame) + " and " + std::to_string(endFrame);
+        return false;
+    }
+
+    FrameStream stream;
+    if (!settings.StreamPath.empty() && !stream.Open(settings.StreamPath, job.Width, job.Height, settings.StreamFormat, animation.FrameRate, status))
+        return false;
+
+    SelectTunedKernels();
+    const int threadCount = settings.ThreadCount > 0 ? settings.ThreadCount : omp_get_max_threads();
+    const int frameThreads = GetRenderThreadShare(job.Width, job.Height, settings.PixelsPerThread, threadCount);
+    const uint32_t concurrentFrames = std::min(static_cast<uint32_t>(threadCount / frameThreads), endFrame - settings.FirstFrame);
+
+    AnimationProgress progress;
+    progress.NextFrame = settings.FirstFrame;
+    progress.NextStreamed = settings.FirstFrame;
+    Walnut::Timer timer;
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < concurrentFrames; i++)
+    {
+        threads.emplace_back([&]()
+                             { RenderAnimationFrames(settings, animation, scene, camera, frameThreads, endFrame, stream.IsOpen() ? &stream : nullptr, progress); });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    char summary[160];
+    std::snprintf(summary, sizeof(summary), "%u frames rendered, %u skipped, %u failed in %.1fs, %u at a time on %d threads each",
+                  progress.Rendered, progress.Skipped, progress.Failed, timer.Elapsed(), concurrentFrames, frameThreads);
+    status = summary;
+    if (stream.IsOpen())
+    {
+        stream.Close();
+        status += "\n" + stream.GetStatus();
+    }
+    return progress.Failed == 0;
+}
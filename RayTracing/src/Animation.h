@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Headless.h"
+#include "Camera.h"
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Animation files are JSON documents with keyframes of the camera and of spheres of a scene:
+ *
+ * {
+ *     "format": "raytracing-animation",
+ *     "version": 1,
+ *     "frameRate": 24,
+ *     "frames": 96,
+ *     "camera": [
+ *         {"time": 0, "position": [13, 2, 3], "target": [0, 0, 0], "fov": 20},
+ *         {"time": 2, "position": [-3, 2, 13], "target": [0, 0, 0]},
+ *         {"time": 4, "position": [-13, 4, -3], "target": [0, 1, 0], "fov": 30}
+ *     ],
+ *     "spheres": [
+ *         {"sphere": 3, "keys": [{"time": 0, "center": [4, 1, 0]}, {"time": 4, "center": [4, 3, 0], "radius": 2}]}
+ *     ]
+ * }
+ *
+ * Times are in seconds, frame f showing time f / frameRate. Positions, centers and view directions move along
+ * Catmull-Rom splines through the keys, the other values linearly between them, and everything holds still
+ * before the first key and after the last. Camera keys look in a "direction" or at a "target", all in the same
+ * way, and the lens members missing from a key keep the value of the scene's camera, as do missing radii of
+ * sphere keys. "sphere" indexes the objects of the scene, in the order of its file or cache, one track per sphere.
+ */
+
+constexpr int AnimationFileVersion = 1;
+
+struct CameraKeyframe
+{
+    float Time = 0.0f;
+    glm::vec3 Position{0.0f};
+    glm::vec3 Direction{0.0f, 0.0f, -1.0f}; // Unused in animations that look at targets
+    glm::vec3 Target{0.0f};
+    float VerticalFOV = -1.0f; // Lens values below 0 keep the scene camera's
+    float Aperture = -1.0f;
+    float FocusDistance = -1.0f;
+};
+
+struct SphereKeyframe
+{
+    float Time = 0.0f;
+    glm::vec3 Center{0.0f};
+    float Radius = -1.0f; // Below 0 keeps the sphere's radius
+};
+
+struct SphereTrack
+{
+    uint32_t Sphere = 0; // Index of the sphere in the scene's objects
+    std::vector<SphereKeyframe> Keys;
+};
+
+struct Animation
+{
+    float FrameRate = 24.0f;
+    uint32_t Frames = 1;
+    bool CameraLooksAtTargets = false; // The camera keys hold targets rather than directions
+    std::vector<CameraKeyframe> Camera; // Sorted by time, empty to keep the scene's camera
+    std::vector<SphereTrack> Spheres;
+};
+
+bool LoadAnimation(const std::string &path, Animation &animation, std::string &error);
+
+// Places the camera, lens from the base camera's, at a time of the animation
+void ApplyCameraAnimation(const Animation &animation, float time, const Camera &base, Camera &camera);
+
+// A range of frames of an animation rendered without the editor, several at a time when a frame cannot keep every thread busy
+struct AnimationRenderSettings
+{
+    std::string ScenePath;
+    std::string AnimationPath;
+    std::string OutputPath; // EXR images, the first run of # replaced by the frame number padded with zeros to its length, or empty
+    std::string StreamPath; // Stdout ("-") or named pipe getting the displayed image of every frame in order, or empty
+    FrameStreamFormat StreamFormat = FrameStreamFormat::Y4M;
+    RenderJobSettings Job;  // Frames are accumulated per animation frame, FirstFrame is unused
+    uint32_t FirstFrame = 0;
+    uint32_t EndFrame = 0;            // One past the last frame rendered, 0 for the animation's end
+    int ThreadCount = 0;              // Threads shared by the frames rendered at once, 0 for one per core
+    uint32_t PixelsPerThread = 16384; // A frame gets a thread per this many pixels
+};
+
+bool RenderAnimation(const AnimationRenderSettings &settings, std::string &status);
@@ -0,0 +1,301 @@
+#include "Autotuner.h"
+#include "Kernels.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <omp.h>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // One tunable parameter and the values tried for it
+    struct TuningDimension
+    {
+        std::vector<int> Values;
+        std::function<void(TuningParameters &, int)> Set;
+    };
+
+    std::vector<TuningDimension> GetDimensions(AcceleratorType acceleratorType)
+    {
+        std::vector<TuningDimension> dimensions;
+        dimensions.push_back({{8, 16, 32, 64}, [](TuningParameters &p, int value)
+                              { p.TileSize = static_cast<uint32_t>(value); }});
+
+        // Hyper-threads and memory bandwidth can make fewer threads than hardware threads faster
+        const int processors = omp_get_num_procs();
+        dimensions.push_back({{0, processors * 3 / 4, processors / 2, processors / 4}, [](TuningParameters &p, int value)
+                              { p.ThreadCount = value; }});
+
+        dimensions.push_back({{0, 8, 16}, [](TuningParameters &p, int value)
+                              { p.PacketSize = value; }});
+        dimensions.push_back({{0, 1 << 16, 1 << 18}, [](TuningParameters &p, int value)
+                              { p.RayBatchSize = static_cast<uint32_t>(value); }});
+
+        if (acceleratorType == AcceleratorType::BVH || acceleratorType == AcceleratorType::CompressedBVH)
+        {
+            dimensions.push_back({{1, 2, 4, 8}, [](TuningParameters &p, int value)
+                                  { p.LeafSize = static_cast<uint32_t>(value); }});
+        }
+
+        std::vector<int> isas;
+        for (int i = 0; i < KernelISACount; i++)
+        {
+            if (IsKernelISASupported(static_cast<KernelISA>(i)))
+                isas.push_back(i);
+        }
+        dimensions.push_back({isas, [](TuningParameters &p, int value)
+                              { p.ISA = value; }});
+
+        // Drop duplicate values, and thread counts of 0 standing for fractions of few processors
+        for (TuningDimension &dimension : dimensions)
+        {
+            std::vector<int> unique;
+            for (size_t i = 0; i < dimension.Values.size(); i++)
+            {
+                const int value = dimension.Values[i];
+                if ((i == 0 || value > 0) && std::find(unique.begin(), unique.end(), value) == unique.end())
+                    unique.push_back(value);
+            }
+            dimension.Values = unique;
+        }
+        return dimensions;
+    }
+
+    std::string Key(const TuningParameters &p)
+    {
+        return std::to_string(p.TileSize) + "/" + std::to_string(p.ThreadCount) + "/" + std::to_string(p.PacketSize) + "/" +
+               std::to_string(p.RayBatchSize) + "/" + std::to_string(p.LeafSize) + "/" + std::to_string(p.ISA);
+    }
+
+    void WriteParameters(std::ofstream &file, const char *prefix, const TuningParameters &p)
+    {
+        file << prefix << "TileSize=" << p.TileSize << "\n";
+        file << prefix << "ThreadCount=" << p.ThreadCount << "\n";
+        file << prefix << "PacketSize=" << p.PacketSize << "\n";
+        file << prefix << "RayBatchSize=" << p.RayBatchSize << "\n";
+        file << prefix << "LeafSize=" << p.LeafSize << "\n";
+        file << prefix << "ISA=" << p.ISA << "\n";
+    }
+
+    bool ReadParameter(const std::string &name, long value, TuningParameters &p)
+    {
+        if (name == "TileSize")
+            p.TileSize = static_cast<uint32_t>(value);
+        else if (name == "ThreadCount")
+            p.ThreadCount = static_cast<int>(value);
+        else if (name == "PacketSize")
+            p.PacketSize = static_cast<int>(value);
+        else if (name == "RayBatchSize")
+            p.RayBatchSize = static_cast<uint32_t>(value);
+        else if (name == "LeafSize")
+            p.LeafSize = static_cast<uint32_t>(value);
+        else if (name == "ISA")
+            p.ISA = static_cast<int>(value);
+        else
+            return false;
+        return true;
+    }
+}
+
+void ApplyTuningParameters(const TuningParameters &parameters, Renderer::Settings &settings)
+{
+    settings.TileSize = parameters.TileSize;
+    settings.ThreadCount = parameters.ThreadCount;
+    settings.PacketSize = parameters.PacketSize;
+    settings.RayBatchSize = parameters.RayBatchSize;
+    // The kernels are shared by every renderer, so the ones already selected are left untouched while others render with them
+    if (parameters.ISA >= 0 && static_cast<KernelISA>(parameters.ISA) != GetKernelISA())
+        SetKernelISA(static_cast<KernelISA>(parameters.ISA));
+}
+
+/**
+ * @brief Finds the fastest tunable parameters for this machine by rendering a calibration workload.
+ *
+ * The scene is rendered from the camera with the renderer's other settings (bounces, samples, antialiasing,
+ * ...) and without accumulation, keeping the fastest of a few frames for each configuration. Starting from
+ * the defaults, every parameter in turn is set to the value that renders fastest with the others fixed, and
+ * this is repeated until a whole pass changes nothing. That is far cheaper than rendering the full grid of
+ * combinations, and the parameters interact little. A new value must be at least 2% faster to be taken, so
+ * timing noise does not flip parameters back and forth.
+ *
+ * Acceleration structures are built for the scene for every leaf size tried, the scene's own is not changed.
+ * The renderer is left with its original settings and kernel ISA; apply `TuningReport::Tuned` to use the result.
+ *
+ * @param renderer The renderer to tune, with the viewport size of the workload.
+ * @param scene The scene to render.
+ * @param camera The camera to render from.
+ * @param acceleratorType The kind of acceleration structure to build for the scene.
+ * @param frames The number of timed frames rendered per configuration, after one to warm up.
+ * @return TuningReport The default and tuned parameters and their frame times.
+ */
+TuningReport Autotune(Renderer &renderer, const Scene &scene, Camera &camera, AcceleratorType acceleratorType, int frames)
+{
+    const Renderer::Settings savedSettings = renderer.GetSettings();
+    const KernelISA savedISA = GetKernelISA();
+
+    Scene calibration = scene;
+    calibration.AccelerationReplicas.clear();
+    std::map<uint32_t, shared_ptr<Accelerator>> accelerators;
+    std::map<std::string, float> times;
+
+    auto measure = [&](const TuningParameters &parameters)
+    {
+        auto known = times.find(Key(parameters));
+        if (known != times.end())
+            return known->second;
+
+        ApplyTuningParameters(parameters, renderer.GetSettings());
+        renderer.GetSettings().Accumulate = false;
+
+        shared_ptr<Accelerator> &accelerator = accelerators[parameters.LeafSize];
+        if (!accelerator)
+            accelerator = CreateAccelerator(acceleratorType, scene.Hittables, parameters.LeafSize);
+        calibration.AccelerationStructure = accelerator;
+
+        float best = std::numeric_limits<float>::max();
+        for (int frame = 0; frame <= frames; frame++)
+        {
+            renderer.ResetFrameIndex();
+            renderer.Render(calibration, camera);
+            if (frame > 0)
+                best = std::min(best, renderer.GetStatistics().RenderTime);
+        }
+        times[Key(parameters)] = best;
+        return best;
+    };
+
+    TuningReport report;
+    report.Host = GetHostName();
+    report.Default.ISA = static_cast<int>(savedISA);
+    report.DefaultTime = measure(report.Default);
+    report.Tuned = report.Default;
+    report.TunedTime = report.DefaultTime;
+
+    const std::vector<TuningDimension> dimensions = GetDimensions(acceleratorType);
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (const TuningDimension &dimension : dimensions)
+        {
+            for (int value : dimension.Values)
+            {
+                TuningParameters candidate = report.Tuned;
+                dimension.Set(candidate, value);
+                const float time = measure(candidate);
+                if (time < report.TunedTime * 0.98f)
+                {
+                    report.Tuned = candidate;
+                    report.TunedTime = time;
+                    changed = true;
+                }
+            }
+        }
+    }
+    report.Configurations = static_cast<int>(times.size());
+
+    renderer.GetSettings() = savedSettings;
+    SetKernelISA(savedISA);
+    renderer.ResetFrameIndex();
+    return report;
+}
+
+std::string GetHostName()
+{
+#if defined(_WIN32)
+    char name[MAX_COMPUTERNAME_LENGTH + 1] = {};
+    DWORD size = sizeof(name);
+    if (GetComputerNameA(name, &size))
+        return name;
+#else
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) == 0)
+        return name;
+#endif
+    return "unknown";
+}
+
+// The profile of this host in the working directory, unless RAYTRACING_TUNING_PROFILE names another file
+std::string GetTuningProfilePath()
+{
+    if (const char *path = std::getenv("RAYTRACING_TUNING_PROFILE"))
+        return path;
+    return "RayTracing." + GetHostName() + ".tuning";
+}
+
+/**
+ * @brief Writes a tuning report to a profile file, as `Key=Value` lines.
+ *
+ * @return bool Returns false if the file cannot be written.
+ */
+bool SaveTuningProfile(const std::string &path, const TuningReport &report)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << "# RayTracing tuning profile for " << report.Host << "\n";
+    WriteParameters(file, "", report.Tuned);
+    WriteParameters(file, "Default.", report.Default);
+    file << "TunedTime=" << report.TunedTime << "\n";
+    file << "DefaultTime=" << report.DefaultTime << "\n";
+    file << "Configurations=" << report.Configurations << "\n";
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief Reads a tuning report written by `SaveTuningProfile`.
+ *
+ * Unknown keys are ignored, and a kernel ISA this CPU does not support falls back to the startup one.
+ *
+ * @return bool Returns false if the file does not exist or cannot be read.
+ */
+bool LoadTuningProfile(const std::string &path, TuningReport &report)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    report = TuningReport();
+    report.Host = GetHostName();
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const size_t separator = line.find('=');
+        if (line.empty() || line[0] == '#' || separator == std::string::npos)
+            continue;
+
+        const std::string name = line.substr(0, separator);
+        const char *value = line.c_str() + separator + 1;
+        if (name == "TunedTime")
+            report.TunedTime = std::strtof(value, nullptr);
+        else if (name == "DefaultTime")
+            report.DefaultTime = std::strtof(value, nullptr);
+        else if (name == "Configurations")
+            report.Configurations = std::atoi(value);
+        else if (name.rfind("Default.", 0) == 0)
+            ReadParameter(name.substr(8), std::strtol(value, nullptr, 10), report.Default);
+        else
+            ReadParameter(name, std::strtol(value, nullptr, 10), report.Tuned);
+    }
+
+    for (TuningParameters *parameters : {&report.Tuned, &report.Default})
+    {
+        if (parameters->ISA >= KernelISACount || (parameters->ISA >= 0 && !IsKernelISASupported(static_cast<KernelISA>(parameters->ISA))))
+            parameters->ISA = -1;
+    }
+    return !file.bad();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Accelerator.h"
+#include "Camera.h"
+#include "Scene.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Renderer and acceleration structure parameters whose fastest values depend on the machine.
+ *
+ * The defaults are the values used without a tuning profile.
+ */
+struct TuningParameters
+{
+    uint32_t TileSize = 16;
+    int ThreadCount = 0; // 0 uses one thread per hardware thread
+    int PacketSize = 0;
+    uint32_t RayBatchSize = 0;
+    uint32_t LeafSize = 4; // Maximum objects per leaf of hierarchies
+    int ISA = -1;          // KernelISA of the data parallel kernels, -1 keeps the one selected at startup
+};
+
+// Default and tuned parameters, with the time per calibration frame of each
+struct TuningReport
+{
+    TuningParameters Default, Tuned;
+    float DefaultTime = 0.0f, TunedTime = 0.0f;
+    int Configurations = 0; // Configurations rendered to find Tuned
+    std::string Host;
+};
+
+// Copies the parameters into the renderer's settings and selects their kernel ISA. The leaf size is left to the caller.
+void ApplyTuningParameters(const TuningParameters &parameters, Renderer::Settings &settings);
+
+TuningReport Autotune(Renderer &renderer, const Scene &scene, Camera &camera, AcceleratorType acceleratorType, int frames = 3);
+
+std::string GetHostName();
+std::string GetTuningProfilePath();
+bool SaveTuningProfile(const std::string &path, const TuningReport &report);
+bool LoadTuningProfile(const std::string &path, TuningReport &report);
@@ -0,0 +1,564 @@
+#include "BVH.h"
+#include "Kernels.h"
+
+#include <algorithm>
+
+namespace
+{
+    constexpr int BinCount = 12;
+
+    // Cost of visiting a node relative to intersecting a primitive
+    constexpr float TraversalCost = 1.0f;
+
+    struct Bin
+    {
+        AABB Bounds;
+        uint32_t Count = 0;
+    };
+
+    // State of a hierarchy build, see BVH::Build
+    struct BVHBuilder
+    {
+        std::vector<BVHNode> &Nodes;
+        std::vector<uint32_t> &PrimitiveIndices;
+        const std::vector<AABB> &Boxes;
+        std::vector<glm::vec3> Centers;
+        uint32_t MaxLeafSize;
+
+        void Subdivide(uint32_t nodeIndex, uint32_t depth);
+    };
+
+    /**
+     * @brief Computes the bounds of a node and splits it in two if that is worthwhile.
+     *
+     * The split plane is chosen with a binned surface area heuristic over the node's primitive centroids.
+     * A node becomes a leaf when it holds at most `MaxLeafSize` primitives and splitting would not reduce
+     * the expected cost. When no useful plane exists (e.g. all centroids coincide) or the hierarchy gets too
+     * deep, the primitives are split at their median so leaves never exceed `MaxLeafSize`.
+     *
+     * @param nodeIndex The index of the node to subdivide.
+     * @param depth The depth of the node in the hierarchy.
+     */
+    void BVHBuilder::Subdivide(uint32_t nodeIndex, uint32_t depth)
+    {
+        const uint32_t first = Nodes[nodeIndex].LeftFirst;
+        const uint32_t count = Nodes[nodeIndex].Count;
+
+        AABB bounds, centroidBounds;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            bounds.Grow(Boxes[PrimitiveIndices[i]]);
+            centroidBounds.Grow(Centers[PrimitiveIndices[i]]);
+        }
+        Nodes[nodeIndex].Bounds = bounds;
+
+        if (count == 1)
+            return;
+
+        // Find the cheapest split plane among the bin boundaries of every axis
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        const glm::vec3 centroidExtent = centroidBounds.Extent();
+
+        for (int axis = 0; axis < 3 && depth < BVH::MaxDepth; axis++)
+        {
+            if (centroidExtent[axis] <= 0.0f)
+                continue;
+
+            Bin bins[BinCount];
+            const float scale = BinCount / centroidExtent[axis];
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const uint32_t objectIndex = PrimitiveIndices[i];
+                int binIndex = std::min(BinCount - 1, (int)((Centers[objectIndex][axis] - centroidBounds.Min[axis]) * scale));
+                bins[binIndex].Count++;
+                bins[binIndex].Bounds.Grow(Boxes[objectIndex]);
+            }
+
+            float leftArea[BinCount - 1], rightArea[BinCount - 1];
+            uint32_t leftCount[BinCount - 1], rightCount[BinCount - 1];
+            AABB leftBox, rightBox;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < BinCount - 1; i++)
+            {
+                leftSum += bins[i].Count;
+                leftBox.Grow(bins[i].Bounds);
+                leftCount[i] = leftSum;
+                leftArea[i] = leftBox.SurfaceArea();
+
+                rightSum += bins[BinCount - 1 - i].Count;
+                rightBox.Grow(bins[BinCount - 1 - i].Bounds);
+                rightCount[BinCount - 2 - i] = rightSum;
+                rightArea[BinCount - 2 - i] = rightBox.SurfaceArea();
+            }
+
+            for (int i = 0; i < BinCount - 1; i++)
+            {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        const float leafCost = count * bounds.SurfaceArea();
+        if (count <= MaxLeafSize && (bestAxis < 0 || bestCost + TraversalCost * bounds.SurfaceArea() >= leafCost))
+            return;
+
+        uint32_t leftCount;
+        auto begin = PrimitiveIndices.begin() + first;
+        auto end = begin + count;
+        if (bestAxis >= 0)
+        {
+            const float scale = BinCount / centroidExtent[bestAxis];
+            const float minimum = centroidBounds.Min[bestAxis];
+            auto middle = std::partition(begin, end, [&](uint32_t objectIndex)
+                                         { return std::min(BinCount - 1, (int)((Centers[objectIndex][bestAxis] - minimum) * scale)) <= bestSplit; });
+            leftCount = static_cast<uint32_t>(middle - begin);
+        }
+        else
+        {
+            // No usable plane, split at the median along the widest centroid axis
+            int axis = 0;
+            if (centroidExtent.y > centroidExtent[axis])
+                axis = 1;
+            if (centroidExtent.z > centroidExtent[axis])
+                axis = 2;
+            leftCount = count / 2;
+            std::nth_element(begin, begin + leftCount, end, [&](uint32_t a, uint32_t b)
+                             { return Centers[a][axis] < Centers[b][axis]; });
+        }
+
+        const uint32_t leftIndex = static_cast<uint32_t>(Nodes.size());
+        Nodes.push_back({AABB(), first, leftCount});
+        Nodes.push_back({AABB(), first + leftCount, count - leftCount});
+        Nodes[nodeIndex].LeftFirst = leftIndex;
+        Nodes[nodeIndex].Count = 0;
+
+        Subdivide(leftIndex, depth + 1);
+        Subdivide(leftIndex + 1, depth + 1);
+    }
+}
+
+/**
+ * @brief Builds the hierarchy over every object of the list.
+ *
+ * @param list The objects to build the hierarchy over.
+ * @param maxLeafSize The maximum number of primitives stored in a leaf.
+ */
+BVH::BVH(const HittableList &list, uint32_t maxLeafSize)
+    : Accelerator(list), m_MaxLeafSize(std::max(maxLeafSize, 1u))
+{
+    const uint32_t count = static_cast<uint32_t>(m_Objects.size());
+    if (count == 0)
+        return;
+
+    std::vector<AABB> boxes(count);
+
+#pragma omp parallel for
+    for (uint32_t i = 0; i < count; i++)
+        boxes[i] = m_Objects[i]->getBoundingBox();
+
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> primitiveIndices;
+    Build(boxes, m_MaxLeafSize, nodes, primitiveIndices);
+    m_Nodes = std::move(nodes);
+    m_PrimitiveIndices = std::move(primitiveIndices);
+
+    m_Primitives.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        m_Primitives[i] = m_Objects[m_PrimitiveIndices[i]].get();
+}
+
+/**
+ * @brief Uses a hierarchy built before over the same objects, such as one loaded from a scene cache.
+ *
+ * The nodes and primitive indices are used in place. Only the object pointers are gathered in leaf order.
+ *
+ * @param list The objects the hierarchy was built over, in the same order.
+ * @param nodes The nodes of the hierarchy, as built by `Build`.
+ * @param primitiveIndices The index of every object in the list, in leaf order.
+ * @param maxLeafSize The maximum number of primitives stored in a leaf when the hierarchy was built.
+ */
+BVH::BVH(const HittableList &list, SharedArray<BVHNode> nodes, SharedArray<uint32_t> primitiveIndices, uint32_t maxLeafSize)
+    : Accelerator(list), m_Nodes(std::move(nodes)), m_PrimitiveIndices(std::move(primitiveIndices)), m_MaxLeafSize(std::max(maxLeafSize, 1u))
+{
+    m_Primitives.resize(m_PrimitiveIndices.size());
+    for (size_t i = 0; i < m_PrimitiveIndices.size(); i++)
+        m_Primitives[i] = m_Objects[m_PrimitiveIndices[i]].get();
+}
+
+/**
+ * @brief Builds a hierarchy over a set of bounding boxes.
+ *
+ * The centroid of each box is computed once up front, then the root node covering all boxes is recursively
+ * subdivided. Used by `BVH` itself and by primitives that keep their own hierarchy over parts that are not
+ * objects, such as the triangles of a `TriangleMesh`.
+ *
+ * @param boxes The bounding box of every primitive.
+ * @param maxLeafSize The maximum number of primitives stored in a leaf.
+ * @param nodes Output parameter for the nodes, depth-first with the root first.
+ * @param primitiveIndices Output parameter for the index of every primitive in `boxes`, in leaf order.
+ */
+void BVH::Build(const std::vector<AABB> &boxes, uint32_t maxLeafSize, std::vector<BVHNode> &nodes, std::vector<uint32_t> &primitiveIndices)
+{
+    const uint32_t count = static_cast<uint32_t>(boxes.size());
+    nodes.clear();
+    primitiveIndices.resize(count);
+    if (count == 0)
+        return;
+
+    BVHBuilder builder{nodes, primitiveIndices, boxes, std::vector<glm::vec3>(count), std::max(maxLeafSize, 1u)};
+
+#pragma omp parallel for
+    for (uint32_t i = 0; i < count; i++)
+    {
+        builder.Centers[i] = boxes[i].Center();
+        primitiveIndices[i] = i;
+    }
+
+    nodes.reserve(2 * count - 1);
+    nodes.push_back({AABB(), 0, count});
+    builder.Subdivide(0, 0);
+    nodes.shrink_to_fit();
+}
+
+/**
+ * @brief Finds the closest object hit by the ray.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for information about the hit. Only modified if a hit occurs.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool BVH::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+{
+    if (m_Nodes.empty())
+        return false;
+
+    const uint32_t root = 0;
+    return Traverse(ray, tMin, tMax, payload, &root, 1);
+}
+
+/**
+ * @brief Finds the closest object hit by a ray, starting from nodes collected by `CullFrustum`.
+ *
+ * The ray must lie inside the frustum the candidates were collected with, otherwise objects outside it may
+ * be missed.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for information about the hit. Only modified if a hit occurs.
+ * @param candidates The nodes returned by `CullFrustum`.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool BVH::hitFromCandidates(const Ray &ray, float tMin, float tMax, HitPayload &payload, const std::vector<uint32_t> &candidates) const
+{
+    return Traverse(ray, tMin, tMax, payload, candidates.data(), static_cast<uint32_t>(candidates.size()));
+}
+
+/**
+ * @brief Traverses the subtrees below a set of disjoint root nodes and finds the closest hit.
+ *
+ * The hierarchy is traversed front to back with an explicit stack. The roots are tested first and pushed
+ * far to near. Then, for every interior node, both children are tested against the ray, the nearer one is
+ * visited first and the farther one is pushed together with its entry distance, so it can be skipped once
+ * a closer hit has been found.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for information about the hit. Only modified if a hit occurs.
+ * @param roots The nodes to start from, at most `MaxFrustumCandidates`.
+ * @param rootCount The number of nodes to start from.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool BVH::Traverse(const Ray &ray, float tMin, float tMax, HitPayload &payload, const uint32_t *roots, uint32_t rootCount) const
+{
+    const glm::vec3 invDirection = 1.0f / ray.Direction;
+
+    struct StackEntry
+    {
+        uint32_t NodeIndex;
+        float Distance;
+    };
+    StackEntry stack[StackSize];
+    int stackSize = 0;
+
+    for (uint32_t i = 0; i < rootCount; i++)
+    {
+        float tEntry;
+        if (!m_Nodes[roots[i]].Bounds.hit(ray.Origin, invDirection, tMin, tMax, tEntry))
+            continue;
+
+        // Insertion sort by descending entry distance
+        int j = stackSize++;
+        while (j > 0 && stack[j - 1].Distance < tEntry)
+        {
+            stack[j] = stack[j - 1];
+            j--;
+        }
+        stack[j] = {roots[i], tEntry};
+    }
+    if (stackSize == 0)
+        return false;
+
+    bool hitAnything = false;
+    float closestSoFar = tMax;
+    uint32_t nodeIndex = stack[--stackSize].NodeIndex;
+
+    while (true)
+    {
+        const BVHNode &node = m_Nodes[nodeIndex];
+        if (node.IsLeaf())
+        {
+            for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+            {
+                if (m_Primitives[i]->hit(ray, tMin, closestSoFar, payload))
+                {
+                    hitAnything = true;
+                    closestSoFar = payload.HitDistance;
+                    payload.objectIndex = m_PrimitiveIndices[i];
+                }
+            }
+        }
+        else
+        {
+            float tLeft, tRight;
+            bool hitLeft = m_Nodes[node.LeftFirst].Bounds.hit(ray.Origin, invDirection, tMin, closestSoFar, tLeft);
+            bool hitRight = m_Nodes[node.LeftFirst + 1].Bounds.hit(ray.Origin, invDirection, tMin, closestSoFar, tRight);
+
+            if (hitLeft && hitRight)
+            {
+                uint32_t nearIndex = node.LeftFirst, farIndex = node.LeftFirst + 1;
+                if (tRight < tLeft)
+                {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(tLeft, tRight);
+                }
+                stack[stackSize++] = {farIndex, tRight};
+                nodeIndex = nearIndex;
+                continue;
+            }
+            if (hitLeft || hitRight)
+            {
+                nodeIndex = hitLeft ? node.LeftFirst : node.LeftFirst + 1;
+                continue;
+            }
+        }
+
+        // Pop the next node that may still contain a closer hit
+        do
+        {
+            if (stackSize == 0)
+                return hitAnything;
+            --stackSize;
+        } while (stack[stackSize].Distance > closestSoFar);
+        nodeIndex = stack[stackSize].NodeIndex;
+    }
+}
+
+/**
+ * @brief Collects the nodes that rays inside a frustum can reach.
+ *
+ * Nodes are expanded breadth first from the root. Nodes outside the frustum are dropped, and expansion
+ * stops at leaves or once `MaxFrustumCandidates` nodes have been gathered. The result is a set of disjoint
+ * subtrees covering every object inside the frustum, from which `hitFromCandidates` starts traversal
+ * instead of the root.
+ *
+ * @param frustum The frustum enclosing the rays.
+ * @param candidates Output parameter for the collected node indices.
+ * @return bool Always returns true.
+ */
+bool BVH::CullFrustum(const Frustum &frustum, std::vector<uint32_t> &candidates) const
+{
+    candidates.clear();
+    if (m_Nodes.empty() || !frustum.Intersects(m_Nodes[0].Bounds))
+        return true;
+
+    // Interior nodes are replaced by their children inside the frustum. Children are appended at the back,
+    // so scanning from the front expands the hierarchy breadth first.
+    candidates.push_back(0);
+    size_t i = 0;
+    while (i < candidates.size() && candidates.size() < MaxFrustumCandidates)
+    {
+        const BVHNode &node = m_Nodes[candidates[i]];
+        if (node.IsLeaf())
+        {
+            i++;
+            continue;
+        }
+
+        const uint32_t left = node.LeftFirst;
+        candidates.erase(candidates.begin() + i);
+        if (frustum.Intersects(m_Nodes[left].Bounds))
+            candidates.push_back(left);
+        if (frustum.Intersects(m_Nodes[left + 1].Bounds))
+            candidates.push_back(left + 1);
+    }
+    return true;
+}
+
+/**
+ * @brief Determines if the ray hits any object between tMin and tMax.
+ *
+ * Traverses the hierarchy like `hit`, but without ordering the children or shrinking the interval, and
+ * returns at the first primitive hit.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool BVH::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    if (m_Nodes.empty())
+        return false;
+
+    const glm::vec3 invDirection = 1.0f / ray.Direction;
+
+    uint32_t stack[StackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const BVHNode &node = m_Nodes[stack[--stackSize]];
+
+        float tEntry;
+        if (!node.Bounds.hit(ray.Origin, invDirection, tMin, tMax, tEntry))
+            continue;
+
+        if (node.IsLeaf())
+        {
+            for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+            {
+                if (m_Primitives[i]->occluded(ray, tMin, tMax))
+                    return true;
+            }
+        }
+        else
+        {
+            stack[stackSize++] = node.LeftFirst + 1;
+            stack[stackSize++] = node.LeftFirst;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Finds the closest hit of every active ray of a packet with a single shared traversal.
+ *
+ * Each node popped from the stack is tested against all rays at once, and its subtree is skipped when no
+ * active ray reaches it before its current closest hit. Primitives are only tested for the rays that reached
+ * their leaf, all at once for primitives that support it (see `Hittable::hitLanes`). Children are visited
+ * in the order given by the direction of the first ray reaching the node, which is the order of every ray
+ * when the packet is coherent.
+ *
+ * @param packet The rays to trace. `HitMask`, `Hits` and `TMax` are updated for every lane that hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param candidates Frustum culled start nodes enclosing every active ray, or nullptr to start at the root.
+ */
+void BVH::hitPacket(RayPacket &packet, float tMin, const std::vector<uint32_t> *candidates) const
+{
+    if (m_Nodes.empty())
+        return;
+
+    uint32_t stack[StackSize];
+    int stackSize = 0;
+    if (candidates)
+    {
+        for (auto it = candidates->rbegin(); it != candidates->rend(); ++it)
+            stack[stackSize++] = *it;
+    }
+    else
+    {
+        stack[stackSize++] = 0;
+    }
+
+    while (stackSize > 0)
+    {
+        const BVHNode &node = m_Nodes[stack[--stackSize]];
+
+        const uint32_t mask = g_Kernels->IntersectPacketBox(packet, &node.Bounds.Min.x, &node.Bounds.Max.x, tMin);
+        if (mask == 0)
+            continue;
+
+        if (node.IsLeaf())
+        {
+            for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+            {
+                const uint32_t hitMask = m_Primitives[i]->hitLanes(packet, mask, tMin);
+                for (uint32_t lanes = hitMask; lanes != 0; lanes &= lanes - 1)
+                    packet.Hits[RayPacket::FirstLane(lanes)].objectIndex = m_PrimitiveIndices[i];
+                packet.HitMask |= hitMask;
+            }
+            continue;
+        }
+
+        // Order the children along the axis that separates them most, for the first ray reaching the node
+        const int lane = RayPacket::FirstLane(mask);
+        const glm::vec3 direction{packet.DirectionX[lane], packet.DirectionY[lane], packet.DirectionZ[lane]};
+        const glm::vec3 separation = m_Nodes[node.LeftFirst + 1].Bounds.Center() - m_Nodes[node.LeftFirst].Bounds.Center();
+        const glm::vec3 absSeparation = glm::abs(separation);
+        const int axis = absSeparation.x > absSeparation.y ? (absSeparation.x > absSeparation.z ? 0 : 2)
+                                                           : (absSeparation.y > absSeparation.z ? 1 : 2);
+        const bool leftFirst = separation[axis] * direction[axis] >= 0.0f;
+
+        stack[stackSize++] = leftFirst ? node.LeftFirst + 1 : node.LeftFirst;
+        stack[stackSize++] = leftFirst ? node.LeftFirst : node.LeftFirst + 1;
+    }
+}
+
+/**
+ * @brief Recomputes the bounds of every node from the current bounds of its objects.
+ *
+ * Children are always stored after their parent, so walking the nodes backwards updates both children of
+ * a node before the node itself, in a single pass. The nodes are copied first, since they may be shared
+ * with other hierarchies or a mapped scene cache.
+ *
+ * @return bool Returns true, as the hierarchy always supports refitting.
+ */
+bool BVH::Refit()
+{
+    std::vector<BVHNode> nodes(m_Nodes.begin(), m_Nodes.end());
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        BVHNode &node = nodes[i];
+        AABB bounds;
+        if (node.IsLeaf())
+        {
+            for (uint32_t primitive = node.LeftFirst; primitive < node.LeftFirst + node.Count; primitive++)
+                bounds.Grow(m_Primitives[primitive]->getBoundingBox());
+        }
+        else
+        {
+            bounds = nodes[node.LeftFirst].Bounds;
+            bounds.Grow(nodes[node.LeftFirst + 1].Bounds);
+        }
+        node.Bounds = bounds;
+    }
+    m_Nodes = std::move(nodes);
+    return true;
+}
+
+AABB BVH::getBoundingBox() const
+{
+    return m_Nodes.empty() ? AABB() : m_Nodes[0].Bounds;
+}
+
+size_t BVH::GetMemoryUsage() const
+{
+    return m_Nodes.size() * sizeof(BVHNode) +
+           m_PrimitiveIndices.size() * sizeof(uint32_t) +
+           m_Primitives.size() * sizeof(const Hittable *);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Accelerator.h"
+#include "AABB.h"
+#include "SharedArray.h"
+
+#include <cstdint>
+#include <vector>
+
+struct BVHNode
+{
+    AABB Bounds;
+    uint32_t LeftFirst; // Index of the left child (right child follows it), or first primitive of a leaf
+    uint32_t Count;     // Number of primitives in a leaf, 0 for interior nodes
+
+    bool IsLeaf() const { return Count > 0; }
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode should stay 32 bytes");
+
+/**
+ * @brief Binary bounding volume hierarchy with full precision node bounds.
+ *
+ * Built top-down with a binned surface area heuristic. Nodes are stored depth-first in a flat array with
+ * sibling pairs adjacent, and leaf primitives are reordered so each leaf references a contiguous range.
+ */
+class BVH : public Accelerator
+{
+public:
+    static constexpr uint32_t MaxDepth = 64;
+    static constexpr uint32_t StackSize = 192;
+    static constexpr uint32_t MaxFrustumCandidates = 32;
+
+    BVH(const HittableList &list, uint32_t maxLeafSize = 4);
+    BVH(const HittableList &list, SharedArray<BVHNode> nodes, SharedArray<uint32_t> primitiveIndices, uint32_t maxLeafSize);
+
+    bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    AABB getBoundingBox() const override;
+
+    bool CullFrustum(const Frustum &frustum, std::vector<uint32_t> &candidates) const override;
+    bool hitFromCandidates(const Ray &ray, float tMin, float tMax, HitPayload &payload, const std::vector<uint32_t> &candidates) const override;
+    void hitPacket(RayPacket &packet, float tMin, const std::vector<uint32_t> *candidates) const override;
+    bool Refit() override;
+
+    const char *GetName() const override { return "BVH"; }
+    size_t GetNodeCount() const override { return m_Nodes.size(); }
+    size_t GetMemoryUsage() const override;
+
+    static void Build(const std::vector<AABB> &boxes, uint32_t maxLeafSize, std::vector<BVHNode> &nodes, std::vector<uint32_t> &primitiveIndices);
+
+    const SharedArray<BVHNode> &GetNodes() const { return m_Nodes; }
+    const SharedArray<uint32_t> &GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+    uint32_t GetMaxLeafSize() const { return m_MaxLeafSize; }
+
+private:
+    bool Traverse(const Ray &ray, float tMin, float tMax, HitPayload &payload, const uint32_t *roots, uint32_t rootCount) const;
+
+private:
+    SharedArray<BVHNode> m_Nodes;
+    SharedArray<uint32_t> m_PrimitiveIndices;   // Object index in the source list, in leaf order
+    std::vector<const Hittable *> m_Primitives; // Object pointers, in leaf order
+    uint32_t m_MaxLeafSize;
+};
@@ -0,0 +1,77 @@
+#include "BackgroundWorker.h"
+
+BackgroundWorker::BackgroundWorker()
+{
+    m_Thread = std::thread(&BackgroundWorker::Loop, this);
+}
+
+// Finishes the job being run, if any, before stopping the thread
+BackgroundWorker::~BackgroundWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Condition.notify_all();
+    m_Thread.join();
+}
+
+/**
+ * @brief Starts a job on the worker thread.
+ *
+ * @param job The job to run. The string it returns becomes the worker's status.
+ * @return bool Returns false, without waiting, if the previous job is still running.
+ */
+bool BackgroundWorker::Run(std::function<std::string()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Busy)
+            return false;
+        m_Job = std::move(job);
+        m_Busy = true;
+    }
+    m_Condition.notify_all();
+    return true;
+}
+
+bool BackgroundWorker::IsBusy() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Busy;
+}
+
+// Blocks until the job being run, if any, is done
+void BackgroundWorker::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Condition.wait(lock, [this]()
+                     { return !m_Busy; });
+}
+
+std::string BackgroundWorker::GetStatus() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Status;
+}
+
+void BackgroundWorker::Loop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true)
+    {
+        m_Condition.wait(lock, [this]()
+                         { return m_Busy || m_Stop; });
+        if (!m_Busy)
+            return;
+
+        std::function<std::string()> job = std::move(m_Job);
+        lock.unlock();
+        std::string status = job();
+        lock.lock();
+
+        m_Status = std::move(status);
+        m_Busy = false;
+        m_Condition.notify_all();
+    }
+}
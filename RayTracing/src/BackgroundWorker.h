@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Thread running one job at a time, such as writing a file, while rendering goes on.
+ *
+ * Jobs return a status message, kept until the next job finishes. Jobs are submitted from a single thread,
+ * which prepares their data while the worker is idle and must not touch it again until the job is done.
+ */
+class BackgroundWorker
+{
+public:
+    BackgroundWorker();
+    ~BackgroundWorker();
+
+    BackgroundWorker(const BackgroundWorker &) = delete;
+    BackgroundWorker &operator=(const BackgroundWorker &) = delete;
+
+    bool Run(std::function<std::string()> job);
+    bool IsBusy() const;
+    void Wait();
+
+    // Status returned by the last job finished
+    std::string GetStatus() const;
+
+private:
+    void Loop();
+
+private:
+    std::thread m_Thread;
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    std::function<std::string()> m_Job;
+    std::string m_Status;
+    bool m_Busy = false;
+    bool m_Stop = false;
+};
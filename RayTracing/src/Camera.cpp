@@ -2,10 +2,11 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
 #include "Walnut/Input/Input.h"
-#include "Utils.h"
+#include "Kernels.h"
 
 using namespace Walnut;
 
@@ -125,6 +126,41 @@ void Camera::OnResize(uint32_t width, uint32_t height)
     RecalculateRayDirections();
 }
 
+/**
+ * @brief Places the camera, as when it is moved by the user.
+ *
+ * @param position The new position of the camera.
+ * @param direction The direction the camera looks in. Need not be normalized.
+ */
+void Camera::SetView(const glm::vec3 &position, const glm::vec3 &direction)
+{
+    m_Position = position;
+    m_ForwardDirection = glm::normalize(direction);
+
+    RecalculateView();
+    RecalculateRayDirections();
+}
+
+/**
+ * @brief Sets the field of view and the depth of field of the camera.
+ *
+ * @param verticalFOV The vertical field of view in degrees.
+ * @param aperatureSize The radius of the lens, 0 for a pinhole camera without depth of field.
+ * @param focusDistance The distance at which objects are in focus.
+ */
+void Camera::SetLens(float verticalFOV, float aperatureSize, float focusDistance)
+{
+    m_VerticalFOV = verticalFOV;
+    m_AperureSize = aperatureSize;
+    m_FocusDistance = focusDistance;
+
+    if (m_ViewportWidth > 0 && m_ViewportHeight > 0)
+    {
+        RecalculateProjection();
+        RecalculateRayDirections();
+    }
+}
+
 float Camera::GetRotationSpeed()
 {
     return 0.3f;
@@ -184,6 +220,8 @@ void Camera::RecalculateView()
  * range from -1 to 1) to world space using the inverse view and projection matrices. The resulting
  * vector is the direction of the ray in world space.
  *
+ * Each row is computed by the `ComputeRayDirections` kernel for the selected instruction set.
+ *
  * The function stores the ray directions in the `m_RayDirections` vector, which is used by the
  * `CastRay` function to cast rays from the camera.
  */
@@ -192,58 +230,80 @@ void Camera::RecalculateRayDirections()
     m_RayDirections.resize(m_ViewportWidth * m_ViewportHeight);
 
     for (uint32_t y = 0; y < m_ViewportHeight; y++)
-    {
-        for (uint32_t x = 0; x < m_ViewportWidth; x++)
-        {
-            glm::vec2 coord = {(float)x / (float)m_ViewportWidth, (float)y / (float)m_ViewportHeight};
-            coord = coord * 2.0f - 1.0f; // -1 -> 1
-
-            glm::vec4 target = m_InverseProjection * glm::vec4(coord.x, coord.y, 1, 1);
-            glm::vec3 rayDirection = glm::vec3(m_InverseView * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0)); // World space
-
-            m_RayDirections[x + y * m_ViewportWidth] = rayDirection;
-        }
-    }
+        g_Kernels->ComputeRayDirections(glm::value_ptr(m_InverseProjection), glm::value_ptr(m_InverseView), m_ViewportWidth, m_ViewportHeight, y,
+                                        glm::value_ptr(m_RayDirections[y * m_ViewportWidth]));
 }
 
-void Camera::GetRayDirectionNearCurrentPosition(uint32_t x, uint32_t y)
+/**
+ * @brief Calculates the direction of a ray cast through a point near a pixel, for antialiasing.
+ *
+ * The pixel coordinates are normalized to the range 0 to 1 by dividing by the viewport width and
+ * height, and moved by the jitter, then transformed to world space by `CalculateRayDirection`. The
+ * caller draws the jitter, so rays stay independent of the thread tracing them.
+ *
+ * @param x The x-coordinate of the pixel in the viewport.
+ * @param y The y-coordinate of the pixel in the viewport.
+ * @param jitter The offset from the pixel, in [0, 1) of the pixel size on each axis.
+ * @return glm::vec3 The direction of the ray in world space.
+ */
+glm::vec3 Camera::GetJitteredRayDirection(uint32_t x, uint32_t y, glm::vec2 jitter) const
 {
     glm::vec2 coord = {x / (float)m_ViewportWidth, y / (float)m_ViewportHeight};
     float pixelSize = 1.0f / glm::min(m_ViewportWidth, m_ViewportHeight);
-    float offsetX = (Utils::UInt() % 100) / 100.0f * pixelSize;
-    float offsetY = (Utils::UInt() % 100) / 100.0f * pixelSize;
+    coord += jitter * pixelSize;
 
-    coord.x += offsetX;
-    coord.y += offsetY;
+    return CalculateRayDirection(coord);
+}
 
+/**
+ * @brief Calculates the world space direction of the camera ray through a viewport position.
+ *
+ * @param coord The position in the viewport, normalized to the range 0 to 1.
+ * @return glm::vec3 The direction of the ray in world space.
+ */
+glm::vec3 Camera::CalculateRayDirection(glm::vec2 coord) const
+{
     coord = coord * 2.0f - 1.0f; // -1 -> 1
 
     glm::vec4 target = m_InverseProjection * glm::vec4(coord.x, coord.y, 1, 1);
-    glm::vec3 rayDirection = glm::vec3(m_InverseView * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0)); // World space
-
-    m_RayRandomDirection = rayDirection;
+    return glm::vec3(m_InverseView * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0)); // World space
 }
 
 /**
- * @brief Calculates the direction of a ray that is cast from a pixel near the current position.
- *
- * This function calculates the direction of a ray that is cast from a pixel near the current position
- * of the camera. The pixel is specified by its x and y coordinates in the viewport.
- *
- * The function first normalizes the pixel coordinates to the range 0 to 1 by dividing by the viewport
- * width and height. It then adds a random offset to the coordinates to simulate the effect of
- * antialiasing.
+ * @brief Calculates the frustum enclosing the camera rays of a rectangle of pixels.
  *
- * The function then transforms the pixel coordinates to the range -1 to 1, and uses the inverse
- * projection and view matrices to transform the coordinates to world space. The resulting vector is
- * the direction of the ray in world space.
+ * The four side planes pass through the camera position and the rays through the rectangle corners. The
+ * rectangle is given in (possibly fractional) pixel coordinates, so callers can pad it to account for ray
+ * jitter.
  *
- * The function stores the ray direction in the `m_RayRandomDirection` member variable, which can be
- * used by other functions to cast the ray.
- *
- * @param x The x-coordinate of the pixel in the viewport.
- * @param y The y-coordinate of the pixel in the viewport.
+ * @param x0 The left edge of the rectangle in pixels.
+ * @param y0 The bottom edge of the rectangle in pixels.
+ * @param x1 The right edge of the rectangle in pixels.
+ * @param y1 The top edge of the rectangle in pixels.
+ * @return Frustum The frustum with its apex at the camera position.
  */
+Frustum Camera::GetTileFrustum(float x0, float y0, float x1, float y1) const
+{
+    const glm::vec2 viewport{(float)m_ViewportWidth, (float)m_ViewportHeight};
+    const glm::vec3 corners[4] = {
+        CalculateRayDirection(glm::vec2(x0, y0) / viewport),
+        CalculateRayDirection(glm::vec2(x1, y0) / viewport),
+        CalculateRayDirection(glm::vec2(x1, y1) / viewport),
+        CalculateRayDirection(glm::vec2(x0, y1) / viewport),
+    };
+    const glm::vec3 center = CalculateRayDirection(glm::vec2(x0 + x1, y0 + y1) * 0.5f / viewport);
+
+    Frustum frustum;
+    for (int i = 0; i < 4; i++)
+    {
+        glm::vec3 normal = glm::normalize(glm::cross(corners[i], corners[(i + 1) % 4]));
+        if (glm::dot(normal, center) < 0.0f)
+            normal = -normal;
+        frustum.Planes[i] = glm::vec4(normal, -glm::dot(normal, m_Position));
+    }
+    return frustum;
+}
+
 bool Camera::RenderCameraOptions()
 {
     bool changed = false;
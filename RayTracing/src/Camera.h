@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include "imgui.h"
+#include "Frustum.h"
 #include <vector>
 
 class Camera
@@ -25,23 +26,26 @@ public:
     const uint32_t GetViewportWidth() const { return m_ViewportWidth; }
     const uint32_t GetViewportHeight() const { return m_ViewportHeight; }
 
-    void GetRayDirectionNearCurrentPosition(uint32_t x, uint32_t y);
-    const glm::vec3 &GetRandomRayDirection(uint32_t x, uint32_t y)
-    {
-        GetRayDirectionNearCurrentPosition(x, y);
-        return m_RayRandomDirection;
-    }
+    // Direction of the ray through pixel (x, y) moved by `jitter`, in [0, 1) of the pixel size on each axis
+    glm::vec3 GetJitteredRayDirection(uint32_t x, uint32_t y, glm::vec2 jitter) const;
+
+    Frustum GetTileFrustum(float x0, float y0, float x1, float y1) const;
 
     float GetRotationSpeed();
     bool RenderCameraOptions();
 
     const float &getAperatureSize() const { return m_AperureSize; }
     const float &getFocusDistance() const { return m_FocusDistance; }
+    float GetVerticalFOV() const { return m_VerticalFOV; }
+
+    void SetView(const glm::vec3 &position, const glm::vec3 &direction);
+    void SetLens(float verticalFOV, float aperatureSize, float focusDistance);
 
 private:
     void RecalculateProjection();
     void RecalculateView();
     void RecalculateRayDirections();
+    glm::vec3 CalculateRayDirection(glm::vec2 coord) const;
 
 private:
     glm::mat4 m_Projection{1.0f};
@@ -62,9 +66,6 @@ private:
     // Cached ray directions
     std::vector<glm::vec3> m_RayDirections;
 
-    // Random directions for antialiasing
-    glm::vec3 m_RayRandomDirection;
-
     glm::vec2 m_LastMousePosition{0.0f, 0.0f};
 
     uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
@@ -0,0 +1,452 @@
+#include "Checkpoint.h"
+#include "MappedFile.h"
+#include "Sphere.h"
+#include "TriangleMesh.h"
+
+#include "Walnut/Timer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char CheckpointMagic[8] = {'R', 'T', 'C', 'H', 'E', 'C', 'K', 'P'};
+    constexpr uint32_t ByteOrderMark = 0x01020304;
+
+    // The accumulation buffer starts at this offset, so it is aligned wherever the file is mapped
+    constexpr uint64_t DataOffset = 64;
+
+    struct CheckpointHeader
+    {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t ByteOrder;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t Frames;
+        uint32_t SamplesPerFrame;
+        uint64_t SceneHash;
+        uint64_t ViewHash;
+        uint64_t FileSize;
+    };
+    static_assert(sizeof(CheckpointHeader) <= DataOffset, "checkpoint header overlaps the accumulation buffer");
+
+    constexpr uint64_t HashSeed = 0xcbf29ce484222325ull;
+
+    // Mixes bytes into a hash, a 64 bit word at a time, so hashing the triangles of large meshes stays cheap
+    uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+            hash ^= hash >> 32;
+        }
+        for (; i < size; i++)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        return hash;
+    }
+
+    template <typename T>
+    uint64_t HashValue(uint64_t hash, const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be hashed by their bytes");
+        return HashBytes(hash, &value, sizeof(T));
+    }
+
+    template <typename T>
+    uint64_t HashArray(uint64_t hash, const SharedArray<T> &array)
+    {
+        hash = HashValue(hash, static_cast<uint64_t>(array.size()));
+        return HashBytes(hash, array.data(), array.size() * sizeof(T));
+    }
+
+    // Flushes a written file to disk, so a checkpoint renamed into place survives a crash of the machine
+    bool SyncFile(FILE *file)
+    {
+        if (fflush(file) != 0)
+            return false;
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    /**
+     * @brief Maps a checkpoint file and checks it is a complete checkpoint of this version and byte order.
+     *
+     * @param path The path of the checkpoint file.
+     * @param file The file to map.
+     * @param header Output parameter for the checkpoint's header.
+     * @param error Output parameter for a description of the problem if the file is not a usable checkpoint.
+     * @return bool Returns true if the checkpoint can be read; otherwise, returns false.
+     */
+    bool OpenCheckpoint(const std::string &path, MappedFile &file, CheckpointHeader &header, std::string &error)
+    {
+        if (!file.Open(path))
+        {
+            error = "Cannot open " + path;
+            return false;
+        }
+
+        if (file.GetSize() < DataOffset)
+        {
+            error = path + " is not a checkpoint";
+            return false;
+        }
+        std::memcpy(&header, file.GetData(), sizeof(header));
+        if (std::memcmp(header.Magic, CheckpointMagic, sizeof(CheckpointMagic)) != 0)
+        {
+            error = path + " is not a checkpoint";
+            return false;
+        }
+        if (header.Version != CheckpointVersion || header.ByteOrder != ByteOrderMark)
+        {
+            error = path + " was written by another version or machine";
+            return false;
+        }
+        if (header.FileSize != file.GetSize() || header.FileSize != DataOffset + static_cast<uint64_t>(header.Width) * header.Height * sizeof(glm::vec4))
+        {
+            error = path + " is truncated";
+            return false;
+        }
+        return true;
+    }
+}
+
+/**
+ * @brief Computes a hash of everything in a scene that changes the rendered image.
+ *
+ * Spheres and triangle meshes are hashed by their geometry and material, and other objects by their type and
+ * bounds, along with the material table and the sky color. Checkpoints store it to refuse resuming a render
+ * of another scene.
+ *
+ * @param scene The scene to hash.
+ * @return uint64_t The hash of the scene.
+ */
+uint64_t HashScene(const Scene &scene)
+{
+    uint64_t hash = HashValue(HashSeed, scene.SkyColor);
+    hash = HashValue(hash, static_cast<uint64_t>(scene.MaterialTable.size()));
+    for (const MaterialData &material : scene.MaterialTable)
+    {
+        hash = HashValue(hash, material.Albedo);
+        hash = HashValue(hash, material.Type);
+        hash = HashValue(hash, material.Roughness);
+        hash = HashValue(hash, material.Fuzz);
+        hash = HashValue(hash, material.IndexOfRefraction);
+    }
+
+    hash = HashValue(hash, static_cast<uint64_t>(scene.Hittables.objects.size()));
+    for (const shared_ptr<Hittable> &object : scene.Hittables.objects)
+    {
+        if (const Sphere *sphere = dynamic_cast<const Sphere *>(object.get()))
+        {
+            hash = HashValue(hash, sphere->Position);
+            hash = HashValue(hash, sphere->Radius);
+            hash = HashValue(hash, sphere->MaterialIndex);
+        }
+        else if (const TriangleMesh *mesh = dynamic_cast<const TriangleMesh *>(object.get()))
+        {
+            hash = HashValue(hash, mesh->MaterialIndex);
+            hash = HashArray(hash, mesh->GetTriangles());
+            hash = HashArray(hash, mesh->GetNormalIndices());
+            hash = HashArray(hash, mesh->GetNormals());
+        }
+        else
+        {
+            const char *typeName = object->getTypeName();
+            const AABB bounds = object->getBoundingBox();
+            hash = HashBytes(hash, typeName, std::strlen(typeName));
+            hash = HashValue(hash, bounds.Min);
+            hash = HashValue(hash, bounds.Max);
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Computes a hash of the camera's placement and lens, which with the image size fix every primary ray.
+ *
+ * @param camera The camera to hash.
+ * @return uint64_t The hash of the camera.
+ */
+uint64_t HashCamera(const Camera &camera)
+{
+    uint64_t hash = HashValue(HashSeed, camera.GetPosition());
+    hash = HashValue(hash, camera.GetDirection());
+    hash = HashValue(hash, camera.GetVerticalFOV());
+    hash = HashValue(hash, camera.getAperatureSize());
+    return HashValue(hash, camera.getFocusDistance());
+}
+
+/**
+ * @brief Computes a hash of the camera, image size and renderer settings that change the rendered image.
+ *
+ * Performance settings, such as tiles, packets and threads, render the same image and are left out, so they
+ * can be changed between a checkpoint and resuming from it.
+ *
+ * @param camera The camera to hash.
+ * @param renderer The renderer whose image size and settings to hash.
+ * @return uint64_t The hash of the view.
+ */
+uint64_t HashView(const Camera &camera, const Renderer &renderer)
+{
+    const Renderer::Settings &settings = renderer.GetSettings();
+
+    uint64_t hash = HashValue(HashCamera(camera), renderer.GetWidth());
+    hash = HashValue(hash, renderer.GetHeight());
+    hash = HashValue(hash, renderer.m_Bounces);
+    hash = HashValue(hash, settings.EnableAntialiasing);
+    hash = HashValue(hash, settings.AmbientOcclusion);
+    hash = HashValue(hash, settings.AmbientOcclusion ? settings.AmbientOcclusionDistance : 0.0f);
+    return hash;
+}
+
+/**
+ * @brief Computes a hash identifying the frames a renderer accumulates: their scene, view and samples.
+ *
+ * With deterministic sampling, renders of the same hash draw the same samples frame by frame, so the sums of
+ * one can be resumed to get exactly the image of a longer render. The scene hash is passed in, as `HashScene`
+ * costs a pass over the scene that callers rendering a scene many times only make once.
+ *
+ * @param sceneHash The `HashScene` of the scene rendered.
+ * @param camera The camera the scene is rendered with.
+ * @param renderer The renderer whose image size, settings and sampling to hash.
+ * @return uint64_t The hash of the render.
+ */
+uint64_t HashRender(uint64_t sceneHash, const Camera &camera, const Renderer &renderer)
+{
+    uint64_t hash = HashValue(HashView(camera, renderer), sceneHash);
+    hash = HashValue(hash, renderer.m_Samples);
+    hash = HashValue(hash, renderer.GetSettings().DeterministicSampling);
+    return HashValue(hash, renderer.GetFirstFrame());
+}
+
+/**
+ * @brief Copies the renderer's accumulated frames, and the hashes of what they show, into a checkpoint.
+ *
+ * This is the only part of checkpointing that has to wait for rendering to stop, so the copy is made in
+ * parallel and the checkpoint's buffer is reused when it is already large enough.
+ *
+ * The random number generators of the render threads are seeded independently on every run, or by frame
+ * with deterministic sampling, so a resumed render draws new samples instead of repeating the saved ones,
+ * and the number of frames is all of the sampler's position that needs saving.
+ *
+ * @param renderer The renderer to copy the accumulation buffer of.
+ * @param scene The scene being rendered.
+ * @param camera The camera the scene is being rendered with.
+ * @param checkpoint Output parameter for the checkpoint.
+ * @return bool Returns false if the renderer has not accumulated any frame yet.
+ */
+bool CaptureCheckpoint(const Renderer &renderer, const Scene &scene, const Camera &camera, RenderCheckpoint &checkpoint)
+{
+    return renderer.GetAccumulatedFrames() > 0 && CaptureCheckpoint(renderer, HashScene(scene), camera, checkpoint);
+}
+
+// Same as above, with the scene's `HashScene` computed already
+bool CaptureCheckpoint(const Renderer &renderer, uint64_t sceneHash, const Camera &camera, RenderCheckpoint &checkpoint)
+{
+    const uint32_t frames = renderer.GetAccumulatedFrames();
+    if (frames == 0)
+        return false;
+
+    checkpoint.Width = renderer.GetWidth();
+    checkpoint.Height = renderer.GetHeight();
+    checkpoint.Frames = frames;
+    checkpoint.SamplesPerFrame = static_cast<uint32_t>(glm::max(renderer.m_Samples, 1));
+    checkpoint.SceneHash = sceneHash;
+    checkpoint.ViewHash = HashView(camera, renderer);
+
+    const uint32_t width = checkpoint.Width;
+    const glm::vec4 *accumulation = renderer.GetAccumulationData();
+    checkpoint.Accumulation.resize(static_cast<size_t>(width) * checkpoint.Height);
+    glm::vec4 *copy = checkpoint.Accumulation.data();
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < static_cast<int>(checkpoint.Height); y++)
+    {
+        const size_t offset = static_cast<size_t>(y) * width;
+        std::memcpy(copy + offset, accumulation + offset, width * sizeof(glm::vec4));
+    }
+    return true;
+}
+
+/**
+ * @brief Writes a checkpoint to a file.
+ *
+ * The file is a header followed by the raw accumulation buffer. It is written under a temporary name,
+ * flushed to disk and renamed when complete, so a crash while saving leaves the previous checkpoint intact.
+ *
+ * @param path The path of the checkpoint file.
+ * @param checkpoint The checkpoint to write.
+ * @param error Output parameter for a description of the problem if writing fails.
+ * @return bool Returns true if the checkpoint was written; otherwise, returns false.
+ */
+bool SaveCheckpoint(const std::string &path, const RenderCheckpoint &checkpoint, std::string &error)
+{
+    CheckpointHeader header = {};
+    std::memcpy(header.Magic, CheckpointMagic, sizeof(CheckpointMagic));
+    header.Version = CheckpointVersion;
+    header.ByteOrder = ByteOrderMark;
+    header.Width = checkpoint.Width;
+    header.Height = checkpoint.Height;
+    header.Frames = checkpoint.Frames;
+    header.SamplesPerFrame = checkpoint.SamplesPerFrame;
+    header.SceneHash = checkpoint.SceneHash;
+    header.ViewHash = checkpoint.ViewHash;
+    header.FileSize = DataOffset + checkpoint.Accumulation.size() * sizeof(glm::vec4);
+
+    const std::string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+    {
+        error = "Cannot write " + temporaryPath;
+        return false;
+    }
+
+    const char padding[DataOffset] = {};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(padding, DataOffset - sizeof(header), 1, file) == 1;
+    written = written && fwrite(checkpoint.Accumulation.data(), sizeof(glm::vec4), checkpoint.Accumulation.size(), file) == checkpoint.Accumulation.size();
+    written = SyncFile(file) && written;
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        std::remove(temporaryPath.c_str());
+        error = "Cannot write " + temporaryPath;
+        return false;
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        error = "Cannot rename " + temporaryPath + " to " + path;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads what a checkpoint file holds, its image size, frames and hashes, without its accumulation.
+ *
+ * @param path The path of the checkpoint file.
+ * @param info Output parameter for the checkpoint, its Accumulation left empty.
+ * @param error Output parameter for a description of the problem if the file is not a usable checkpoint.
+ * @return bool Returns true if the checkpoint was read; otherwise, returns false.
+ */
+bool ReadCheckpointInfo(const std::string &path, RenderCheckpoint &info, std::string &error)
+{
+    MappedFile file;
+    CheckpointHeader header;
+    if (!OpenCheckpoint(path, file, header, error))
+        return false;
+
+    info.Width = header.Width;
+    info.Height = header.Height;
+    info.Frames = header.Frames;
+    info.SamplesPerFrame = header.SamplesPerFrame;
+    info.SceneHash = header.SceneHash;
+    info.ViewHash = header.ViewHash;
+    info.Accumulation.clear();
+    return true;
+}
+
+/**
+ * @brief Restores the accumulated frames of a checkpoint into the renderer, so progressive rendering resumes.
+ *
+ * Checkpoints of another scene, camera view, image size, samples per frame or image affecting settings are refused, since
+ * adding new frames to them would blend two different images. The file is mapped and copied straight
+ * into the renderer's accumulation buffer.
+ *
+ * @param path The path of the checkpoint file.
+ * @param renderer The renderer to restore the frames into, already resized to the image size to resume.
+ * @param scene The scene being rendered.
+ * @param camera The camera the scene is being rendered with.
+ * @param error Output parameter for a description of the problem if the checkpoint cannot be resumed.
+ * @return bool Returns true if the frames were restored; otherwise, returns false, leaving the renderer unchanged.
+ */
+bool ResumeCheckpoint(const std::string &path, Renderer &renderer, const Scene &scene, const Camera &camera, std::string &error)
+{
+    return ResumeCheckpoint(path, renderer, HashScene(scene), camera, error);
+}
+
+// Same as above, with the scene's `HashScene` computed already
+bool ResumeCheckpoint(const std::string &path, Renderer &renderer, uint64_t sceneHash, const Camera &camera, std::string &error)
+{
+    MappedFile file;
+    CheckpointHeader header;
+    if (!OpenCheckpoint(path, file, header, error))
+        return false;
+
+    const uint32_t width = renderer.GetWidth(), height = renderer.GetHeight();
+    if (header.Width != width || header.Height != height)
+    {
+        error = "The checkpoint is " + std::to_string(header.Width) + "x" + std::to_string(header.Height) +
+                ", the image is " + std::to_string(width) + "x" + std::to_string(height);
+        return false;
+    }
+    if (header.SceneHash != sceneHash)
+    {
+        error = "The checkpoint is of another scene";
+        return false;
+    }
+    if (header.ViewHash != HashView(camera, renderer))
+    {
+        error = "The checkpoint is of another camera view or render settings";
+        return false;
+    }
+    const uint32_t samplesPerFrame = static_cast<uint32_t>(glm::max(renderer.m_Samples, 1));
+    if (header.SamplesPerFrame != samplesPerFrame)
+    {
+        // Its frames would count as frames of the new sample count, misreporting the samples of the image
+        error = "The checkpoint has " + std::to_string(header.SamplesPerFrame) + " samples per frame, the render " + std::to_string(samplesPerFrame);
+        return false;
+    }
+
+    const glm::vec4 *data = reinterpret_cast<const glm::vec4 *>(file.GetData() + DataOffset);
+    if (!renderer.RestoreAccumulation(data, header.Width, header.Height, header.Frames))
+    {
+        error = "Accumulation must be enabled to resume a checkpoint";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Captures a checkpoint of the renderer and queues it to be written in the background.
+ *
+ * Only the copy of the accumulation buffer made by `CaptureCheckpoint` delays the caller. A checkpoint is
+ * written at a time, and its buffer is kept for the next one.
+ *
+ * @param path The path of the checkpoint file.
+ * @param renderer The renderer to checkpoint.
+ * @param scene The scene being rendered.
+ * @param camera The camera the scene is being rendered with.
+ * @return bool Returns false, without waiting, if the previous checkpoint is still being written or nothing has been accumulated.
+ */
+bool CheckpointWriter::Submit(const std::string &path, const Renderer &renderer, const Scene &scene, const Camera &camera)
+{
+    // The worker does not touch the checkpoint while it is idle
+    if (m_Worker.IsBusy() || !CaptureCheckpoint(renderer, scene, camera, m_Checkpoint))
+        return false;
+
+    return m_Worker.Run([this, path]()
+                        {
+        Walnut::Timer timer;
+        std::string error;
+        if (!SaveCheckpoint(path, m_Checkpoint, error))
+            return error;
+        return "Saved " + std::to_string(m_Checkpoint.Frames) + " frames in " + std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms"; });
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "BackgroundWorker.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Increased whenever the layout of checkpoint files changes
+constexpr uint32_t CheckpointVersion = 1;
+
+// Progressive render state saved by a checkpoint
+struct RenderCheckpoint
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t Frames = 0;          // Frames summed in Accumulation, each one sample per pixel or the average of SamplesPerFrame
+    uint32_t SamplesPerFrame = 1;
+    uint64_t SceneHash = 0;       // HashScene of the scene rendered
+    uint64_t ViewHash = 0;        // HashView of the camera and renderer settings rendered with
+    std::vector<glm::vec4> Accumulation;
+};
+
+// Hash of everything in the scene that changes the rendered image
+uint64_t HashScene(const Scene &scene);
+// Hash of the camera's placement and lens
+uint64_t HashCamera(const Camera &camera);
+// Hash of the camera, image size and renderer settings that change the rendered image
+uint64_t HashView(const Camera &camera, const Renderer &renderer);
+// Hash of the scene (its HashScene), view and sampling of a render, the same for renders drawing the same samples
+uint64_t HashRender(uint64_t sceneHash, const Camera &camera, const Renderer &renderer);
+
+// The overloads taking a sceneHash skip hashing the scene again
+bool CaptureCheckpoint(const Renderer &renderer, const Scene &scene, const Camera &camera, RenderCheckpoint &checkpoint);
+bool CaptureCheckpoint(const Renderer &renderer, uint64_t sceneHash, const Camera &camera, RenderCheckpoint &checkpoint);
+bool SaveCheckpoint(const std::string &path, const RenderCheckpoint &checkpoint, std::string &error);
+bool ReadCheckpointInfo(const std::string &path, RenderCheckpoint &info, std::string &error);
+bool ResumeCheckpoint(const std::string &path, Renderer &renderer, const Scene &scene, const Camera &camera, std::string &error);
+bool ResumeCheckpoint(const std::string &path, Renderer &renderer, uint64_t sceneHash, const Camera &camera, std::string &error);
+
+/**
+ * @brief Writes checkpoints on a background thread, so rendering goes on while they are saved.
+ */
+class CheckpointWriter
+{
+public:
+    bool Submit(const std::string &path, const Renderer &renderer, const Scene &scene, const Camera &camera);
+    bool IsBusy() const { return m_Worker.IsBusy(); }
+    void Wait() { m_Worker.Wait(); }
+
+    // Result of the last checkpoint written
+    std::string GetStatus() const { return m_Worker.GetStatus(); }
+
+private:
+    RenderCheckpoint m_Checkpoint; // Only touched by the worker while it is busy
+    BackgroundWorker m_Worker;     // Declared last, so it finishes writing before the checkpoint is destroyed
+};
@@ -0,0 +1,531 @@
+#include "CommandLine.h"
+#include "Animation.h"
+#include "Distributed.h"
+#include "JobQueue.h"
+#include "PartialRender.h"
+#include "RenderEngine.h"
+#include "RenderService.h"
+#include "TextParsing.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const char *const Usage =
+        "Usage:\n"
+        "  RayTracing --render --scene PATH --output PATH [job options] [--first-frame N] [stream options]\n"
+        "      Renders frames N to N + frames in this process. An output ending in .exr gets the image, any\n"
+        "      other the partial render of the frames, whose sums add up with other frames' with --merge.\n"
+        "      A stream gets the image after every frame, and --output can be left out.\n"
+        "      --stream-rate FPS          Frame rate of the stream (24)\n"
+        "  RayTracing --merge OUTPUT INPUT...\n"
+        "      Adds up partial renders of other frames of the same image into OUTPUT, the image if it ends\n"
+        "      in .exr and another partial render otherwise.\n"
+        "  RayTracing --queue PATH [--threads N] [--pixels-per-thread N] [--checkpoint-interval SECONDS]\n"
+        "      Renders the jobs of a manifest, or of every manifest in a directory, whose image does not exist\n"
+        "      yet. Small jobs run side by side, a thread per N pixels (16384) out of all cores or --threads.\n"
+        "      Jobs are checkpointed every 60 seconds and on Ctrl+C, and resumed when the queue runs again.\n"
+        "  RayTracing --animate PATH --scene PATH --output PATH [--start N] [--end N] [--threads N]\n"
+        "             [--pixels-per-thread N] [job options] [stream options]\n"
+        "      Renders frames N to the end, or to --end, of an animation file into one image per frame, the\n"
+        "      first run of # in the output replaced by the frame number. Small images render several frames\n"
+        "      side by side. Frames whose image exists are skipped, unless streamed; --output can be left out\n"
+        "      when streaming. --frames sets the frames accumulated per pixel of every image.\n"
+        "  RayTracing --coordinator ADDRESS --scene PATH --output PATH.exr [job options]\n"
+        "      Renders an image across the workers connecting to ADDRESS.\n"
+        "      --tile-size N              Width and height of the tiles handed to workers (128)\n"
+        "      --timeout SECONDS          Drop workers silent for this long (60)\n"
+        "  RayTracing --worker ADDRESS [--connect-timeout SECONDS]\n"
+        "      Renders tiles for the coordinator at ADDRESS, retrying the connection for 10 seconds.\n"
+        "  RayTracing --engine ADDRESS --scene PATH [job options] [--tile-size N]\n"
+        "      Renders progressively in this process for editors attached to ADDRESS (Settings > Engine), which\n"
+        "      show the image from shared memory and send camera and option edits. The render goes on while no\n"
+        "      editor is attached. --frames N idles after N frames until the next edit (never); --tile-size sets\n"
+        "      the tiles editors upload when they change (32). ADDRESS is a Unix socket or on loopback, :port\n"
+        "      for 127.0.0.1. Runs until Ctrl+C or an editor stops it.\n"
+        "  RayTracing --serve ADDRESS [--threads N] [--pixels-per-thread N] [--cached-scenes N]\n"
+        "                            [--cache DIR] [--cache-size MB]\n"
+        "      Renders the requests of the clients connecting to ADDRESS (RenderService.h), streaming back\n"
+        "      their images as they refine. ADDRESS is a Unix socket or on loopback, :port for 127.0.0.1, and\n"
+        "      scene paths must stay under the working directory. Requests share all cores or --threads\n"
+        "      fairly, each a thread per N pixels (16384) or more. Loaded scenes are shared, and the last N no\n"
+        "      request renders kept (8). --cache keeps the frames rendered in DIR, up to MB megabytes (4096),\n"
+        "      answering the same scene, view and sampling from them and rendering on from them for more\n"
+        "      samples. Runs until Ctrl+C.\n"
+        "Job options:\n"
+        "  --width N, --height N          Image size (1280x720)\n"
+        "  --frames N                     Frames accumulated per pixel (16)\n"
+        "  --samples N                    Samples averaged per frame (1)\n"
+        "  --bounces N                    Bounces per path (5)\n"
+        "  --no-antialiasing              Trace every sample through the pixel center\n"
+        "Stream options:\n"
+        "  --stream PATH                  Stream the displayed image of every frame to a named pipe, or - for stdout\n"
+        "  --stream-format y4m|rgba       YUV4MPEG2, or raw 8 bit RGBA frames (y4m)\n"
+        "ADDRESS is host:port, or unix:path for a Unix domain socket.\n";
+
+    // Reads the value following an option, advancing past it
+    bool ReadValue(int argc, char **argv, int &i, const char *&value)
+    {
+        if (i + 1 >= argc)
+        {
+            std::fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return false;
+        }
+        value = argv[++i];
+        return true;
+    }
+
+    template <typename T>
+    bool ReadNumber(int argc, char **argv, int &i, T &value)
+    {
+        const char *text;
+        if (!ReadValue(argc, argv, i, text))
+            return false;
+
+        const char *end = text + std::strlen(text);
+        long long number;
+        if (!ParseInteger(text, end, number) || text != end || number < 0)
+        {
+            std::fprintf(stderr, "Invalid value %s for %s\n", argv[i], argv[i - 1]);
+            return false;
+        }
+        value = static_cast<T>(number);
+        return true;
+    }
+
+    // Reads an option of the frame stream, returning false if the option is not one
+    bool ReadStreamOption(int argc, char **argv, int &i, std::string &path, FrameStreamFormat &format, bool &valid)
+    {
+        const std::string option = argv[i];
+        const char *text = nullptr;
+        if (option == "--stream")
+            valid = ReadValue(argc, argv, i, text) && !(path = text).empty();
+        else if (option == "--stream-format")
+        {
+            valid = ReadValue(argc, argv, i, text);
+            if (valid && std::strcmp(text, "y4m") == 0)
+                format = FrameStreamFormat::Y4M;
+            else if (valid && std::strcmp(text, "rgba") == 0)
+                format = FrameStreamFormat::RGBA;
+            else if (valid)
+            {
+                std::fprintf(stderr, "Unknown stream format %s\n", text);
+                valid = false;
+            }
+        }
+        else
+            return false;
+        return true;
+    }
+
+    // Reads an option of the job settings, returning false if the option is not one
+    bool ReadJobOption(int argc, char **argv, int &i, RenderJobSettings &job, bool &valid)
+    {
+        const std::string option = argv[i];
+        if (option == "--width")
+            valid = ReadNumber(argc, argv, i, job.Width);
+        else if (option == "--height")
+            valid = ReadNumber(argc, argv, i, job.Height);
+        else if (option == "--frames")
+            valid = ReadNumber(argc, argv, i, job.Frames);
+        else if (option == "--samples")
+            valid = ReadNumber(argc, argv, i, job.Samples);
+        else if (option == "--bounces")
+            valid = ReadNumber(argc, argv, i, job.Bounces);
+        else if (option == "--no-antialiasing")
+            job.Antialiasing = false;
+        else
+            return false;
+        return true;
+    }
+
+    int RunRenderMode(int argc, char **argv)
+    {
+        RenderJobSettings job;
+        std::string scenePath, outputPath, streamPath;
+        FrameStreamFormat streamFormat = FrameStreamFormat::Y4M;
+        int streamRate = 24;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            const char *text = nullptr;
+            bool valid = true;
+            if (option == "--scene")
+                valid = ReadValue(argc, argv, i, text) && !(scenePath = text).empty();
+            else if (option == "--output")
+                valid = ReadValue(argc, argv, i, text) && !(outputPath = text).empty();
+            else if (option == "--first-frame")
+                valid = ReadNumber(argc, argv, i, job.FirstFrame);
+            else if (option == "--stream-rate")
+                valid = ReadNumber(argc, argv, i, streamRate);
+            else if (option != "--render" && !ReadJobOption(argc, argv, i, job, valid) &&
+                     !ReadStreamOption(argc, argv, i, streamPath, streamFormat, valid))
+            {
+                std::fprintf(stderr, "Unknown option %s\n%s", argv[i], Usage);
+                return 2;
+            }
+            if (!valid)
+                return 2;
+        }
+
+        if (scenePath.empty() || (outputPath.empty() && streamPath.empty()))
+        {
+            std::fprintf(stderr, "--render needs --scene, and --output or --stream\n%s", Usage);
+            return 2;
+        }
+
+        std::string status;
+        FrameStream stream;
+        if (!streamPath.empty() && !stream.Open(streamPath, job.Width, job.Height, streamFormat, static_cast<float>(streamRate), status))
+        {
+            std::fprintf(stderr, "%s\n", status.c_str());
+            return 1;
+        }
+
+        const bool rendered = RenderHeadless(scenePath, job, outputPath, &stream, status);
+        std::fprintf(stderr, "%s\n", status.c_str());
+        if (stream.IsOpen())
+        {
+            stream.Close();
+            std::fprintf(stderr, "%s\n", stream.GetStatus().c_str());
+        }
+        return rendered ? 0 : 1;
+    }
+
+    int RunMergeMode(int argc, char **argv)
+    {
+        std::vector<std::string> paths;
+        for (int i = 1; i < argc; i++)
+        {
+            if (std::strcmp(argv[i], "--merge") != 0)
+                paths.push_back(argv[i]);
+        }
+        if (paths.size() < 2)
+        {
+            std::fprintf(stderr, "--merge needs an output and inputs\n%s", Usage);
+            return 2;
+        }
+
+        const std::string output = paths.front();
+        paths.erase(paths.begin());
+        std::string status;
+        const bool merged = MergePartialRenders(paths, output, status);
+        std::fprintf(stderr, "%s\n", status.c_str());
+        return merged ? 0 : 1;
+    }
+
+    int RunQueueMode(int argc, char **argv)
+    {
+        JobQueueSettings settings;
+        std::vector<RenderJob> jobs;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            const char *text = nullptr;
+            int seconds = 0;
+            bool valid = true;
+            if (option == "--queue")
+            {
+                std::string error;
+                valid = ReadValue(argc, argv, i, text);
+                if (valid && !LoadJobQueue(text, jobs, error))
+                {
+                    std::fprintf(stderr, "%s\n", error.c_str());
+                    return 1;
+                }
+            }
+            else if (option == "--threads")
+                valid = ReadNumber(argc, argv, i, settings.ThreadCount);
+            else if (option == "--pixels-per-thread")
+                valid = ReadNumber(argc, argv, i, settings.PixelsPerThread);
+            else if (option == "--checkpoint-interval")
+            {
+                valid = ReadNumber(argc, argv, i, seconds);
+                settings.CheckpointInterval = static_cast<float>(seconds);
+            }
+            else
+            {
+                std::fprintf(stderr, "Unknown option %s\n%s", argv[i], Usage);
+                return 2;
+            }
+            if (!valid)
+                return 2;
+        }
+
+        std::string status;
+        const bool rendered = RunJobQueue(std::move(jobs), settings, status);
+        std::fprintf(stderr, "%s\n", status.c_str());
+        return rendered ? 0 : 1;
+    }
+
+    int RunAnimateMode(int argc, char **argv)
+    {
+        AnimationRenderSettings settings;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            const char *text = nullptr;
+            bool valid = true;
+            if (option == "--animate")
+                valid = ReadValue(argc, argv, i, text) && !(settings.AnimationPath = text).empty();
+            else if (option == "--scene")
+                valid = ReadValue(argc, argv, i, text) && !(settings.ScenePath = text).empty();
+            else if (option == "--output")
+                valid = ReadValue(argc, argv, i, text) && !(settings.OutputPath = text).empty();
+            else if (option == "--start")
+                valid = ReadNumber(argc, argv, i, settings.FirstFrame);
+            else if (option == "--end")
+                valid = ReadNumber(argc, argv, i, settings.EndFrame);
+            else if (option == "--threads")
+                valid = ReadNumber(argc, argv, i, settings.ThreadCount);
+            else if (option == "--pixels-per-thread")
+                valid = ReadNumber(argc, argv, i, settings.PixelsPerThread);
+            else if (!ReadJobOption(argc, argv, i, settings.Job, valid) &&
+                     !ReadStreamOption(argc, argv, i, settings.StreamPath, settings.StreamFormat, valid))
+            {
+                std::fprintf(stderr, "Unknown option %s\n%s", argv[i], Usage);
+                return 2;
+            }
+            if (!valid)
+                return 2;
+        }
+
+        if (settings.ScenePath.empty() || (settings.OutputPath.empty() && settings.StreamPath.empty()))
+        {
+            std::fprintf(stderr, "--animate needs --scene, and --output or --stream\n%s", Usage);
+            return 2;
+        }
+
+        std::string status;
+        const bool rendered = RenderAnimation(settings, status);
+        std::fprintf(stderr, "%s\n", status.c_str());
+        return rendered ? 0 : 1;
+    }
+
+    int RunCoordinatorMode(int argc, char **argv)
+    {
+        CoordinatorSettings settings;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            const char *text = nullptr;
+            int seconds = 0;
+            bool valid = true;
+            if (option == "--coordinator")
+                valid = ReadValue(argc, argv, i, text) && !(settings.Address = text).empty();
+            else if (option == "--scene")
+                valid = ReadValue(argc, argv, i, text) && !(settings.ScenePath = text).empty();
+            else if (option == "--output")
+                valid = ReadValue(argc, argv, i, text) && !(settings.OutputPath = text).empty();
+            else if (option == "--tile-size")
+                valid = ReadNumber(argc, argv, i, settings.TileSize);
+            else if (option == "--timeout")
+            {
+                valid = ReadNumber(argc, argv, i, seconds);
+                settings.TimeoutMs = seconds * 1000;
+            }
+            else if (!ReadJobOption(argc, argv, i, settings.Job, valid))
+            {
+                std::fprintf(stderr, "Unknown option %s\n%s", argv[i], Usage);
+                return 2;
+            }
+            if (!valid)
+                return 2;
+        }
+
+        if (settings.ScenePath.empty() || settings.OutputPath.empty())
+        {
+            std::fprintf(stderr, "--coordinator needs --scene and --output\n%s", Usage);
+            return 2;
+        }
+
+        std::string error;
+        if (!RunCoordinator(settings, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    int RunWorkerMode(int argc, char **argv)
+    {
+        const char *address = nullptr;
+        int connectTimeout = 10;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            bool valid;
+            if (option == "--worker")
+                valid = ReadValue(argc, argv, i, address);
+            else if (option == "--connect-timeout")
+                valid = ReadNumber(argc, argv, i, connectTimeout);
+            else
+            {
+                std::fprintf(stderr, "Unknown option %s\n%s", argv[i], Usage);
+                return 2;
+            }
+            if (!valid)
+                return 2;
+        }
+
+        std::string error;
+        if (!RunWorker(address, connectTimeout * 1000, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    int RunEngineMode(int argc, char **argv)
+    {
+        RenderEngineSettings settings;
+        settings.Job.Frames = 0;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            const char *text = nullptr;
+            bool valid = true;
+            if (option == "--engine")
+                valid = ReadValue(argc, argv, i, text) && !(settings.Address = text).empty();
+            else if (option == "--scene")
+                valid = ReadValue(argc, argv, i, text) && !(settings.ScenePath = text).empty();
+            else if (option == "--tile-size")
+                valid = ReadNumber(argc, argv, i, settings.TileSize);
+            else if (!ReadJobOption(argc, argv, i, settings.Job, valid))
+            {
+                std::fprintf(stderr, "Unknown option %s\n%s", argv[i], Usage);
+                return 2;
+            }
+            if (!valid)
+                return 2;
+        }
+
+        if (settings.Address.empty() || settings.ScenePath.empty())
+        {
+            std::fprintf(stderr, "--engine needs an address and --scene\n%s", Usage);
+            return 2;
+        }
+
+        std::string error;
+        if (!RunRenderEngine(settings, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    int RunServeMode(int argc, char **argv)
+    {
+        RenderServiceSettings settings;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string option = argv[i];
+            const char *text = nullptr;
+            bool valid = true;
+            if (option == "--serve")
+                valid = ReadValue(argc, argv, i, text) && !(settings.Address = text).empty();
+            else if (option == "--threads")
+                valid = ReadNumber(argc, argv, i, settings.ThreadCount);
+            else if (option == "--pixels-per-thread")
+                valid = ReadNumber(argc, argv, i, settings.PixelsPerThread);
+            else if (option == "--cached-scenes")
+                valid = ReadNumber(argc, argv, i, settings.CachedScenes);
+            else if (option == "--cache")
+                valid = ReadValue(argc, argv, i, text) && !(settings.CacheDirectory = text).empty();
+            else if (option == "--cache-size")
+            {
+                uint64_t megabytes = 0;
+                valid = ReadNumber(argc, argv, i, megabytes);
+                settings.CacheSize = megabytes << 20;
+            }
+            else
+            {
+                std::fprintf(stderr, "Unknown option %s\n%s", argv[i], Usage);
+                return 2;
+            }
+            if (!valid)
+                return 2;
+        }
+
+        std::string error;
+        if (!RunRenderService(settings, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return 0;
+    }
+}
+
+/**
+ * @brief Runs the mode selected by the command line, if it selects one.
+ *
+ * `--render` and `--merge` render without opening a window, in one process or split into ranges of frames
+ * rendered apart, `--queue` renders a batch of jobs, `--animate` the frames of an animation, and
+ * `--coordinator` and `--worker` split into tiles rendered by several processes, `--engine` renders for editors
+ * attached to it, and `--serve` renders the requests of other programs. Without them, the editor starts as usual.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments, starting with the executable.
+ * @param exitCode Output parameter for the exit code of the mode that ran.
+ * @return bool Returns true if a mode ran and the process should exit with `exitCode`; otherwise, returns false.
+ */
+bool RunCommandLine(int argc, char **argv, int &exitCode)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--render") == 0)
+        {
+            exitCode = RunRenderMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--merge") == 0)
+        {
+            exitCode = RunMergeMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--queue") == 0)
+        {
+            exitCode = RunQueueMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--animate") == 0)
+        {
+            exitCode = RunAnimateMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--coordinator") == 0)
+        {
+            exitCode = RunCoordinatorMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--worker") == 0)
+        {
+            exitCode = RunWorkerMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--engine") == 0)
+        {
+            exitCode = RunEngineMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--serve") == 0)
+        {
+            exitCode = RunServeMode(argc, argv);
+            return true;
+        }
+        if (std::strcmp(argv[i], "--help") == 0)
+        {
+            std::printf("%s", Usage);
+            exitCode = 0;
+            return true;
+        }
+    }
+    return false;
+}
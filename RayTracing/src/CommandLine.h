@@ -0,0 +1,4 @@
+#pragma once
+
+// Runs the modes of the executable that render without the editor, returning false to start the editor instead
+bool RunCommandLine(int argc, char **argv, int &exitCode);
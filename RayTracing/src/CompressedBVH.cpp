@@ -0,0 +1,335 @@
+#include "CompressedBVH.h"
+#include "BVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+    // Slab distances computed from decoded bounds are scaled by this factor so that rounding in the
+    // decode never culls a box the ray actually touches.
+    constexpr float RobustExitScale = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+
+    float ExponentToScale(int exponent)
+    {
+        return glm::uintBitsToFloat(static_cast<uint32_t>(exponent + 127) << 23);
+    }
+
+    int8_t ComputeExponent(float origin, float maximum)
+    {
+        float extent = maximum - origin;
+        int exponent = extent > 0.0f ? (int)std::ceil(std::log2(extent / 255.0f)) : -126;
+        exponent = glm::clamp(exponent, -126, 127);
+        while (exponent < 127 && origin + 255.0f * ExponentToScale(exponent) < maximum)
+            exponent++;
+        return static_cast<int8_t>(exponent);
+    }
+
+    uint8_t QuantizeMin(float value, float origin, float scale)
+    {
+        int q = glm::clamp((int)std::floor((value - origin) / scale), 0, 255);
+        while (q > 0 && origin + q * scale > value)
+            q--;
+        return static_cast<uint8_t>(q);
+    }
+
+    uint8_t QuantizeMax(float value, float origin, float scale)
+    {
+        int q = glm::clamp((int)std::ceil((value - origin) / scale), 0, 255);
+        while (q < 255 && origin + q * scale < value)
+            q++;
+        return static_cast<uint8_t>(q);
+    }
+}
+
+/**
+ * @brief Builds the compressed hierarchy over every object of the list.
+ *
+ * A binary SAH BVH is built first and then collapsed breadth first into 8-wide nodes: starting from the
+ * two children of a binary node, the interior child with the largest surface area is repeatedly replaced
+ * by its own two children until the node has 8 children or only leaves are left. Each child box is then
+ * quantized conservatively relative to the union of the children.
+ *
+ * @param list The objects to build the hierarchy over.
+ * @param maxLeafSize The maximum number of primitives stored in a leaf, clamped to
+ * `CompressedBVHNode::MaxLeafSize`.
+ */
+CompressedBVH::CompressedBVH(const HittableList &list, uint32_t maxLeafSize)
+    : Accelerator(list)
+{
+    BVH binary(list, std::min(maxLeafSize, CompressedBVHNode::MaxLeafSize));
+    const SharedArray<BVHNode> &binaryNodes = binary.GetNodes();
+    const SharedArray<uint32_t> &binaryIndices = binary.GetPrimitiveIndices();
+    if (binaryNodes.empty())
+        return;
+
+    m_Bounds = binaryNodes[0].Bounds;
+    m_Nodes.reserve(binaryNodes.size() / 4 + 1);
+    m_PrimitiveIndices.reserve(binaryIndices.size());
+
+    // Pairs of (compressed node index, binary node index) still to be collapsed, in breadth first order
+    std::vector<std::pair<uint32_t, uint32_t>> pending;
+    pending.push_back({0, 0});
+    m_Nodes.emplace_back();
+
+    for (size_t p = 0; p < pending.size(); p++)
+    {
+        const auto [nodeIndex, binaryIndex] = pending[p];
+
+        uint32_t children[CompressedBVHNode::Width];
+        int childCount = 0;
+        if (binaryNodes[binaryIndex].IsLeaf())
+        {
+            children[childCount++] = binaryIndex;
+        }
+        else
+        {
+            children[childCount++] = binaryNodes[binaryIndex].LeftFirst;
+            children[childCount++] = binaryNodes[binaryIndex].LeftFirst + 1;
+        }
+
+        while (childCount < CompressedBVHNode::Width)
+        {
+            int largest = -1;
+            float largestArea = -1.0f;
+            for (int i = 0; i < childCount; i++)
+            {
+                const BVHNode &child = binaryNodes[children[i]];
+                if (!child.IsLeaf() && child.Bounds.SurfaceArea() > largestArea)
+                {
+                    largest = i;
+                    largestArea = child.Bounds.SurfaceArea();
+                }
+            }
+            if (largest < 0)
+                break;
+
+            const uint32_t expanded = children[largest];
+            children[largest] = binaryNodes[expanded].LeftFirst;
+            children[childCount++] = binaryNodes[expanded].LeftFirst + 1;
+        }
+
+        CompressedBVHNode node{};
+        AABB bounds;
+        for (int i = 0; i < childCount; i++)
+            bounds.Grow(binaryNodes[children[i]].Bounds);
+
+        node.Origin = bounds.Min;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            node.Exponent[axis] = ComputeExponent(bounds.Min[axis], bounds.Max[axis]);
+            scale[axis] = ExponentToScale(node.Exponent[axis]);
+        }
+
+        node.ChildBaseIndex = static_cast<uint32_t>(m_Nodes.size());
+        node.PrimitiveBaseIndex = static_cast<uint32_t>(m_PrimitiveIndices.size());
+
+        uint32_t interiorCount = 0;
+        uint32_t primitiveOffset = 0;
+        for (int i = 0; i < childCount; i++)
+        {
+            const BVHNode &child = binaryNodes[children[i]];
+            node.QuantizedMinX[i] = QuantizeMin(child.Bounds.Min.x, node.Origin.x, scale.x);
+            node.QuantizedMinY[i] = QuantizeMin(child.Bounds.Min.y, node.Origin.y, scale.y);
+            node.QuantizedMinZ[i] = QuantizeMin(child.Bounds.Min.z, node.Origin.z, scale.z);
+            node.QuantizedMaxX[i] = QuantizeMax(child.Bounds.Max.x, node.Origin.x, scale.x);
+            node.QuantizedMaxY[i] = QuantizeMax(child.Bounds.Max.y, node.Origin.y, scale.y);
+            node.QuantizedMaxZ[i] = QuantizeMax(child.Bounds.Max.z, node.Origin.z, scale.z);
+
+            if (child.IsLeaf())
+            {
+                node.Meta[i] = static_cast<uint8_t>((child.Count << 5) | primitiveOffset);
+                for (uint32_t j = child.LeftFirst; j < child.LeftFirst + child.Count; j++)
+                    m_PrimitiveIndices.push_back(binaryIndices[j]);
+                primitiveOffset += child.Count;
+            }
+            else
+            {
+                node.Meta[i] = static_cast<uint8_t>(interiorCount);
+                node.InteriorMask |= 1u << i;
+                pending.push_back({node.ChildBaseIndex + interiorCount, children[i]});
+                interiorCount++;
+            }
+        }
+
+        m_Nodes.resize(m_Nodes.size() + interiorCount);
+        m_Nodes[nodeIndex] = node;
+    }
+
+    m_Nodes.shrink_to_fit();
+
+    m_Primitives.resize(m_PrimitiveIndices.size());
+    for (size_t i = 0; i < m_PrimitiveIndices.size(); i++)
+        m_Primitives[i] = m_Objects[m_PrimitiveIndices[i]].get();
+}
+
+/**
+ * @brief Finds the closest object hit by the ray.
+ *
+ * For every visited node the eight child boxes are decoded on the fly: the node frame is folded into the
+ * ray once (`(origin - rayOrigin) / direction` and `scale / direction`), so each quantized plane costs a
+ * single multiply-add. Leaf children are intersected immediately, interior children are pushed far to
+ * near so the nearest one is visited next.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for information about the hit. Only modified if a hit occurs.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool CompressedBVH::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+{
+    if (m_Nodes.empty())
+        return false;
+
+    const glm::vec3 invDirection = 1.0f / ray.Direction;
+
+    struct StackEntry
+    {
+        uint32_t NodeIndex;
+        float Distance;
+    };
+    StackEntry stack[StackSize];
+    int stackSize = 0;
+    stack[stackSize++] = {0, tMin};
+
+    bool hitAnything = false;
+    float closestSoFar = tMax;
+
+    while (stackSize > 0)
+    {
+        const StackEntry entry = stack[--stackSize];
+        if (entry.Distance > closestSoFar)
+            continue;
+
+        const CompressedBVHNode &node = m_Nodes[entry.NodeIndex];
+        const glm::vec3 scale{ExponentToScale(node.Exponent[0]), ExponentToScale(node.Exponent[1]), ExponentToScale(node.Exponent[2])};
+        const glm::vec3 scaledInvDirection = scale * invDirection;
+        const glm::vec3 offset = (node.Origin - ray.Origin) * invDirection;
+
+        StackEntry interiorHits[CompressedBVHNode::Width];
+        int interiorHitCount = 0;
+
+        for (int i = 0; i < CompressedBVHNode::Width; i++)
+        {
+            const bool interior = (node.InteriorMask >> i) & 1u;
+            if (!interior && node.Meta[i] == 0)
+                continue;
+
+            glm::vec3 t0 = glm::vec3(node.QuantizedMinX[i], node.QuantizedMinY[i], node.QuantizedMinZ[i]) * scaledInvDirection + offset;
+            glm::vec3 t1 = glm::vec3(node.QuantizedMaxX[i], node.QuantizedMaxY[i], node.QuantizedMaxZ[i]) * scaledInvDirection + offset;
+            glm::vec3 tNear = glm::min(t0, t1);
+            glm::vec3 tFar = glm::max(t0, t1);
+
+            float tEntry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+            float tExit = glm::min(glm::min(tFar.x, tFar.y), tFar.z) * RobustExitScale;
+            if (tEntry > glm::min(tExit, closestSoFar))
+                continue;
+
+            if (interior)
+            {
+                // Insertion sort by descending entry distance
+                int j = interiorHitCount++;
+                while (j > 0 && interiorHits[j - 1].Distance < tEntry)
+                {
+                    interiorHits[j] = interiorHits[j - 1];
+                    j--;
+                }
+                interiorHits[j] = {node.ChildBaseIndex + node.Meta[i], tEntry};
+            }
+            else
+            {
+                const uint32_t first = node.PrimitiveBaseIndex + (node.Meta[i] & 31u);
+                const uint32_t count = node.Meta[i] >> 5;
+                for (uint32_t k = first; k < first + count; k++)
+                {
+                    if (m_Primitives[k]->hit(ray, tMin, closestSoFar, payload))
+                    {
+                        hitAnything = true;
+                        closestSoFar = payload.HitDistance;
+                        payload.objectIndex = m_PrimitiveIndices[k];
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < interiorHitCount; i++)
+            stack[stackSize++] = interiorHits[i];
+    }
+
+    return hitAnything;
+}
+
+/**
+ * @brief Determines if the ray hits any object between tMin and tMax.
+ *
+ * Decodes child boxes exactly like `hit`, but visits interior children in storage order and returns at
+ * the first primitive hit.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool CompressedBVH::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    if (m_Nodes.empty())
+        return false;
+
+    const glm::vec3 invDirection = 1.0f / ray.Direction;
+
+    uint32_t stack[StackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const CompressedBVHNode &node = m_Nodes[stack[--stackSize]];
+        const glm::vec3 scale{ExponentToScale(node.Exponent[0]), ExponentToScale(node.Exponent[1]), ExponentToScale(node.Exponent[2])};
+        const glm::vec3 scaledInvDirection = scale * invDirection;
+        const glm::vec3 offset = (node.Origin - ray.Origin) * invDirection;
+
+        for (int i = 0; i < CompressedBVHNode::Width; i++)
+        {
+            const bool interior = (node.InteriorMask >> i) & 1u;
+            if (!interior && node.Meta[i] == 0)
+                continue;
+
+            glm::vec3 t0 = glm::vec3(node.QuantizedMinX[i], node.QuantizedMinY[i], node.QuantizedMinZ[i]) * scaledInvDirection + offset;
+            glm::vec3 t1 = glm::vec3(node.QuantizedMaxX[i], node.QuantizedMaxY[i], node.QuantizedMaxZ[i]) * scaledInvDirection + offset;
+            glm::vec3 tNear = glm::min(t0, t1);
+            glm::vec3 tFar = glm::max(t0, t1);
+
+            float tEntry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+            float tExit = glm::min(glm::min(tFar.x, tFar.y), tFar.z) * RobustExitScale;
+            if (tEntry > glm::min(tExit, tMax))
+                continue;
+
+            if (interior)
+            {
+                stack[stackSize++] = node.ChildBaseIndex + node.Meta[i];
+            }
+            else
+            {
+                const uint32_t first = node.PrimitiveBaseIndex + (node.Meta[i] & 31u);
+                const uint32_t count = node.Meta[i] >> 5;
+                for (uint32_t k = first; k < first + count; k++)
+                {
+                    if (m_Primitives[k]->occluded(ray, tMin, tMax))
+                        return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+size_t CompressedBVH::GetMemoryUsage() const
+{
+    return m_Nodes.size() * sizeof(CompressedBVHNode) +
+           m_PrimitiveIndices.size() * sizeof(uint32_t) +
+           m_Primitives.size() * sizeof(const Hittable *);
+}
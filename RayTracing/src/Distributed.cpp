@@ -0,0 +1,598 @@
+#include "Distributed.h"
+#include "Checkpoint.h"
+#include "RenderOutput.h"
+#include "Socket.h"
+
+#include "Walnut/Timer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr char ProtocolMagic[4] = {'R', 'T', 'D', 'W'};
+    constexpr uint32_t ByteOrderMark = 0x01020304;
+
+    // How often waiting threads check whether the image is complete
+    constexpr int PollIntervalMs = 100;
+    // How long a worker told the image is complete gets to stop, which it does between two frames
+    constexpr int StopTimeoutMs = 2000;
+
+    enum class MessageType : uint32_t
+    {
+        Hello = 1,  // Worker to coordinator: HelloMessage
+        Job,        // Coordinator to worker: JobMessage, then the scene path
+        Ready,      // Worker to coordinator: ReadyMessage, once the scene is loaded
+        Error,      // Either way: a description of the problem, before closing the connection
+        Tile,       // Coordinator to worker: TileMessage
+        TileResult, // Worker to coordinator: TileMessage, then the tile's averaged RGBA float pixels row by row
+        Done,       // Coordinator to worker: the image is complete
+    };
+
+    // Messages are sent in the byte order of the machines, which the handshake checks to be the same
+    struct HelloMessage
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t ByteOrder;
+    };
+
+    struct JobMessage
+    {
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t Frames;
+        int32_t Samples;
+        int32_t Bounces;
+        uint32_t Antialiasing;
+    };
+
+    // Hashes of what the worker loaded, compared with the coordinator's own so every tile shows the same scene
+    struct ReadyMessage
+    {
+        uint64_t SceneHash;
+        uint64_t CameraHash;
+    };
+
+    struct TileMessage
+    {
+        uint32_t Id;
+        uint32_t X0, Y0, X1, Y1;
+    };
+
+    /**
+     * @brief Hands out the tiles of an image to the workers rendering it, as they ask for more.
+     *
+     * Tiles nobody renders yet are handed out first, in row order. Once there are none left, a worker without
+     * work gets a copy of the tile rendered the longest by another worker, so a slow or stalled worker does
+     * not hold up the end of the render; the first result of a tile is kept and the later ones dropped. The
+     * tiles of a worker that fails go back to the front of the queue.
+     */
+    class TileScheduler
+    {
+    public:
+        TileScheduler(uint32_t width, uint32_t height, uint32_t tileSize)
+        {
+            for (uint32_t y = 0; y < height; y += tileSize)
+            {
+                for (uint32_t x = 0; x < width; x += tileSize)
+                {
+                    m_Pending.push_back(static_cast<uint32_t>(m_Tiles.size()));
+                    m_Tiles.push_back({x, y, glm::min(x + tileSize, width), glm::min(y + tileSize, height)});
+                }
+            }
+        }
+
+        TileMessage GetTile(uint32_t id) const
+        {
+            const Tile &tile = m_Tiles[id];
+            return {id, tile.X0, tile.Y0, tile.X1, tile.Y1};
+        }
+
+        size_t GetTileCount() const { return m_Tiles.size(); }
+
+        // Picks the next tile for a worker already rendering `held`, or returns false if it has to wait
+        bool Acquire(const std::deque<uint32_t> &held, uint32_t &id)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!m_Pending.empty())
+            {
+                id = m_Pending.front();
+                m_Pending.pop_front();
+            }
+            else if (!held.empty() || !FindStraggler(id))
+                return false;
+
+            Tile &tile = m_Tiles[id];
+            if (tile.Workers++ == 0)
+                tile.Started = std::chrono::steady_clock::now();
+            return true;
+        }
+
+        // Records the result of a tile, returning true if it is the first one to arrive
+        bool Complete(uint32_t id)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            Tile &tile = m_Tiles[id];
+            tile.Workers--;
+            if (tile.Done)
+                return false;
+            tile.Done = true;
+            m_Completed++;
+            m_Condition.notify_all();
+            return true;
+        }
+
+        // Gives back a tile a failed worker will not render
+        void Release(uint32_t id)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            Tile &tile = m_Tiles[id];
+            if (--tile.Workers == 0 && !tile.Done)
+                m_Pending.push_front(id);
+            m_Condition.notify_all();
+        }
+
+        size_t GetCompletedCount() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Completed;
+        }
+
+        bool IsFinished() const { return GetCompletedCount() == m_Tiles.size(); }
+
+        // Waits for a tile to complete or come back, or the timeout
+        void WaitForChange(int timeoutMs)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Condition.wait_for(lock, std::chrono::milliseconds(timeoutMs));
+        }
+
+    private:
+        // Speculative copies go to idle workers only, one per tile, so they spread over the slowest tiles
+        bool FindStraggler(uint32_t &id) const
+        {
+            const Tile *oldest = nullptr;
+            for (const Tile &tile : m_Tiles)
+            {
+                if (!tile.Done && tile.Workers == 1 && (!oldest || tile.Started < oldest->Started))
+                    oldest = &tile;
+            }
+            if (oldest)
+                id = static_cast<uint32_t>(oldest - m_Tiles.data());
+            return oldest != nullptr;
+        }
+
+    private:
+        struct Tile
+        {
+            uint32_t X0, Y0, X1, Y1;
+            uint32_t Workers = 0; // Workers rendering the tile
+            bool Done = false;
+            std::chrono::steady_clock::time_point Started{}; // When its oldest running copy was handed out
+        };
+
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_Condition;
+        std::vector<Tile> m_Tiles;
+        std::deque<uint32_t> m_Pending;
+        size_t m_Completed = 0;
+    };
+
+    // State shared by the coordinator's connection threads
+    struct Coordinator
+    {
+        const CoordinatorSettings &Settings;
+        TileScheduler Scheduler;
+        ReadyMessage Expected;
+        std::vector<glm::vec4> Image;
+        std::atomic<uint32_t> ConnectedWorkers{0};
+    };
+
+    void Log(const char *format, const std::string &message)
+    {
+        std::fprintf(stderr, format, message.c_str());
+        std::fprintf(stderr, "\n");
+    }
+
+    /**
+     * @brief Sends the job to a newly connected worker and checks it loaded the same scene as the coordinator.
+     *
+     * @return bool Returns false, with a description of the problem in `error`, if the worker cannot be used.
+     */
+    bool StartWorker(Coordinator &coordinator, Socket &socket, std::string &error)
+    {
+        MessageType type;
+        std::vector<char> payload;
+        HelloMessage hello;
+        if (!ReceiveMessage(socket, type, payload) || type != MessageType::Hello || !ReadPayload(payload, hello) ||
+            std::memcmp(hello.Magic, ProtocolMagic, sizeof(ProtocolMagic)) != 0)
+        {
+            error = "not a render worker";
+            return false;
+        }
+        if (hello.Version != DistributedProtocolVersion || hello.ByteOrder != ByteOrderMark)
+        {
+            error = "protocol version " + std::to_string(hello.Version) + " or byte order differs from the coordinator's";
+            SendMessage(socket, MessageType::Error, error.data(), error.size());
+            return false;
+        }
+
+        const RenderJobSettings &job = coordinator.Settings.Job;
+        const JobMessage message{job.Width, job.Height, job.Frames, job.Samples, job.Bounces, job.Antialiasing ? 1u : 0u};
+        const std::string &scenePath = coordinator.Settings.ScenePath;
+        if (!SendMessage(socket, MessageType::Job, &message, sizeof(message), scenePath.data(), scenePath.size()) ||
+            !ReceiveMessage(socket, type, payload))
+        {
+            error = "connection lost while loading the scene";
+            return false;
+        }
+
+        ReadyMessage ready;
+        if (type == MessageType::Error || type != MessageType::Ready || !ReadPayload(payload, ready))
+        {
+            error = type == MessageType::Error ? PayloadText(payload) : "unexpected reply to the job";
+            return false;
+        }
+        if (ready.SceneHash != coordinator.Expected.SceneHash || ready.CameraHash != coordinator.Expected.CameraHash)
+        {
+            error = "the worker's copy of " + scenePath + " differs from the coordinator's";
+            SendMessage(socket, MessageType::Error, error.data(), error.size());
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Keeps a worker busy with tiles until the image is complete, storing the results in the image.
+     *
+     * The worker is sent TilesInFlight tiles ahead, so it starts the next one as soon as it sends a result.
+     * It renders them in order, so results come back in the order the tiles were sent.
+     *
+     * @return bool Returns false, with a description of the problem in `error`, if the worker fails or times out.
+     */
+    bool ServeWorker(Coordinator &coordinator, Socket &socket, std::deque<uint32_t> &held, std::string &error)
+    {
+        TileScheduler &scheduler = coordinator.Scheduler;
+        const uint32_t width = coordinator.Settings.Job.Width;
+        MessageType type;
+        std::vector<char> payload;
+
+        while (!scheduler.IsFinished())
+        {
+            uint32_t id;
+            while (held.size() < glm::max(coordinator.Settings.TilesInFlight, 1u) && scheduler.Acquire(held, id))
+            {
+                held.push_back(id);
+                const TileMessage tile = scheduler.GetTile(id);
+                if (!SendMessage(socket, MessageType::Tile, &tile, sizeof(tile)))
+                {
+                    error = "connection lost";
+                    return false;
+                }
+            }
+
+            if (held.empty())
+            {
+                scheduler.WaitForChange(PollIntervalMs);
+                continue;
+            }
+
+            // Wait in short steps, to stop as soon as other workers complete the image
+            int waited = 0;
+            while (!socket.WaitReadable(PollIntervalMs))
+            {
+                if (scheduler.IsFinished())
+                    return true;
+                waited += PollIntervalMs;
+                if (waited >= coordinator.Settings.TimeoutMs)
+                {
+                    error = "no result for " + std::to_string(waited / 1000) + "s";
+                    return false;
+                }
+            }
+
+            TileMessage result;
+            if (!ReceiveMessage(socket, type, payload))
+            {
+                error = "connection lost";
+                return false;
+            }
+            if (type == MessageType::Error)
+            {
+                error = PayloadText(payload);
+                return false;
+            }
+
+            const TileMessage expected = scheduler.GetTile(held.front());
+            const size_t pixelCount = static_cast<size_t>(expected.X1 - expected.X0) * (expected.Y1 - expected.Y0);
+            if (type != MessageType::TileResult || !ReadPayload(payload, result) || std::memcmp(&result, &expected, sizeof(result)) != 0 ||
+                payload.size() != sizeof(result) + pixelCount * sizeof(glm::vec4))
+            {
+                error = "invalid tile result";
+                return false;
+            }
+
+            held.pop_front();
+            // Only the first copy of a tile is written, so no two threads write the same pixels
+            if (scheduler.Complete(result.Id))
+            {
+                const uint32_t tileWidth = result.X1 - result.X0;
+                const char *pixels = payload.data() + sizeof(result);
+                for (uint32_t y = result.Y0; y < result.Y1; y++, pixels += tileWidth * sizeof(glm::vec4))
+                    std::memcpy(&coordinator.Image[static_cast<size_t>(y) * width + result.X0], pixels, tileWidth * sizeof(glm::vec4));
+            }
+        }
+        return true;
+    }
+
+    void RunConnection(Coordinator &coordinator, Socket socket)
+    {
+        std::string error;
+        socket.SetReceiveTimeout(coordinator.Settings.TimeoutMs);
+        if (!StartWorker(coordinator, socket, error))
+        {
+            Log("Refused a worker: %s", error);
+            return;
+        }
+
+        const uint32_t worker = ++coordinator.ConnectedWorkers;
+        Log("Worker %s connected", std::to_string(worker));
+
+        std::deque<uint32_t> held;
+        if (ServeWorker(coordinator, socket, held, error))
+        {
+            // Closing with a result still unread would reset the connection before the worker reads Done
+            if (SendMessage(socket, MessageType::Done))
+            {
+                socket.ShutdownSend();
+                std::vector<char> payload;
+                MessageType type;
+                while (socket.WaitReadable(StopTimeoutMs) && ReceiveMessage(socket, type, payload))
+                    continue;
+            }
+            return;
+        }
+
+        Log("Dropped a worker: %s", error);
+        for (uint32_t id : held)
+            coordinator.Scheduler.Release(id);
+    }
+
+    enum class WorkerStatus
+    {
+        Rendering,
+        Finished, // The coordinator completed the image
+        Failed,
+    };
+
+    /**
+     * @brief Adds the tiles the coordinator sent to a worker's queue, until none are left to read.
+     *
+     * @param wait Whether to wait for a message when none has arrived yet.
+     * @return WorkerStatus Rendering to go on with the queue, Finished once Done is read, or Failed with `error` set.
+     */
+    WorkerStatus ReceiveTiles(Socket &socket, const RenderJobSettings &job, std::deque<TileMessage> &queue, bool wait, std::string &error)
+    {
+        MessageType type;
+        std::vector<char> payload;
+        while (wait || socket.WaitReadable(0))
+        {
+            wait = false;
+            TileMessage tile;
+            if (!ReceiveMessage(socket, type, payload))
+            {
+                error = "Connection to the coordinator lost";
+                return WorkerStatus::Failed;
+            }
+            if (type == MessageType::Done)
+                return WorkerStatus::Finished;
+            if (type != MessageType::Tile || !ReadPayload(payload, tile))
+            {
+                error = type == MessageType::Error ? PayloadText(payload) : "Unexpected message from the coordinator";
+                return WorkerStatus::Failed;
+            }
+            if (tile.X0 >= tile.X1 || tile.Y0 >= tile.Y1 || tile.X1 > job.Width || tile.Y1 > job.Height)
+            {
+                error = "Invalid tile";
+                SendMessage(socket, MessageType::Error, error.data(), error.size());
+                return WorkerStatus::Failed;
+            }
+            queue.push_back(tile);
+        }
+        return WorkerStatus::Rendering;
+    }
+}
+
+/**
+ * @brief Renders an image across the worker processes that connect to an address, and writes it to an EXR file.
+ *
+ * The coordinator loads the scene itself only to check that every worker loaded the same one. Workers can
+ * join at any time, and a worker that disconnects, reports an error or stays silent for the timeout is
+ * dropped, with its tiles handed to the others. The call returns once every tile has been rendered.
+ *
+ * @param settings The scene, job and address of the render.
+ * @param error Output parameter for a description of the problem if the render fails.
+ * @return bool Returns true if the image was rendered and written; otherwise, returns false.
+ */
+bool RunCoordinator(const CoordinatorSettings &settings, std::string &error)
+{
+    const RenderJobSettings &job = settings.Job;
+    if (job.Width == 0 || job.Height == 0 || job.Frames == 0 || settings.TileSize == 0)
+    {
+        error = "The image size, frames and tile size must not be 0";
+        return false;
+    }
+
+    Scene scene;
+    Camera camera = CreateDefaultCamera();
+    std::vector<std::string> materialNames;
+    if (!LoadRenderScene(settings.ScenePath, scene, camera, materialNames, error))
+        return false;
+
+    Socket listener = Socket::Listen(settings.Address, error);
+    if (!listener.IsValid())
+        return false;
+
+    Coordinator coordinator{settings, TileScheduler(job.Width, job.Height, settings.TileSize), {HashScene(scene), HashCamera(camera)}, {}};
+    coordinator.Image.resize(static_cast<size_t>(job.Width) * job.Height);
+    Log("Waiting for workers on %s", settings.Address);
+
+    Walnut::Timer timer;
+    std::vector<std::thread> connections;
+    const size_t tileCount = coordinator.Scheduler.GetTileCount();
+    size_t reportedTenths = 0;
+    while (!coordinator.Scheduler.IsFinished())
+    {
+        if (listener.WaitReadable(PollIntervalMs))
+        {
+            Socket socket = listener.Accept();
+            if (socket.IsValid())
+                connections.emplace_back(RunConnection, std::ref(coordinator), std::move(socket));
+        }
+
+        const size_t completed = coordinator.Scheduler.GetCompletedCount();
+        if (completed * 10 / tileCount > reportedTenths)
+        {
+            reportedTenths = completed * 10 / tileCount;
+            Log("%s", std::to_string(completed) + " of " + std::to_string(tileCount) + " tiles rendered");
+        }
+    }
+    listener.Close();
+
+    for (std::thread &connection : connections)
+        connection.join();
+
+    RenderSnapshot snapshot;
+    snapshot.Width = job.Width;
+    snapshot.Height = job.Height;
+    snapshot.Layers = RenderLayerSamples;
+    snapshot.Samples = job.Frames * static_cast<uint32_t>(glm::max(job.Samples, 1));
+    snapshot.Color = std::move(coordinator.Image);
+    if (!SaveRenderExr(settings.OutputPath, snapshot, ExrCompression::RLE, error))
+        return false;
+
+    Log("%s", "Rendered " + settings.OutputPath + " with " + std::to_string(coordinator.ConnectedWorkers.load()) + " workers in " +
+                  std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms");
+    return true;
+}
+
+/**
+ * @brief Connects to a coordinator and renders the tiles it sends until the image is complete.
+ *
+ * Every tile is rendered from a cleared accumulation buffer for the job's number of frames, and sent back as
+ * the average of its frames. The renderer keeps a buffer of the whole image, so tiles land at their place in
+ * it and are sampled exactly as they would be in a single process render.
+ *
+ * @param address The coordinator's address, "host:port" or "unix:path".
+ * @param connectTimeoutMs How long to retry connecting, so workers can be started before the coordinator.
+ * @param error Output parameter for a description of the problem if the worker fails.
+ * @return bool Returns true if the worker rendered until the coordinator finished; otherwise, returns false.
+ */
+bool RunWorker(const std::string &address, int connectTimeoutMs, std::string &error)
+{
+    Walnut::Timer connectTimer;
+    Socket socket;
+    while (!(socket = Socket::Connect(address, error)).IsValid())
+    {
+        if (connectTimer.ElapsedMillis() >= connectTimeoutMs)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    HelloMessage hello{};
+    std::memcpy(hello.Magic, ProtocolMagic, sizeof(ProtocolMagic));
+    hello.Version = DistributedProtocolVersion;
+    hello.ByteOrder = ByteOrderMark;
+
+    MessageType type;
+    std::vector<char> payload;
+    JobMessage message;
+    if (!SendMessage(socket, MessageType::Hello, &hello, sizeof(hello)) || !ReceiveMessage(socket, type, payload) ||
+        (type == MessageType::Job && !ReadPayload(payload, message)))
+    {
+        error = "Connection to " + address + " lost";
+        return false;
+    }
+    if (type != MessageType::Job)
+    {
+        error = type == MessageType::Error ? PayloadText(payload) : "Unexpected message from the coordinator";
+        return false;
+    }
+
+    RenderJobSettings job;
+    job.Width = message.Width;
+    job.Height = message.Height;
+    job.Frames = message.Frames;
+    job.Samples = message.Samples;
+    job.Bounces = message.Bounces;
+    job.Antialiasing = message.Antialiasing != 0;
+    const std::string scenePath = PayloadText(payload, sizeof(message));
+
+    Scene scene;
+    Camera camera = CreateDefaultCamera();
+    std::vector<std::string> materialNames;
+    if (job.Width == 0 || job.Height == 0 || !LoadRenderScene(scenePath, scene, camera, materialNames, error))
+    {
+        if (job.Width == 0 || job.Height == 0)
+            error = "Empty image";
+        SendMessage(socket, MessageType::Error, error.data(), error.size());
+        return false;
+    }
+
+    Renderer renderer(true);
+    SetupHeadlessRenderer(job, renderer, camera);
+    const ReadyMessage ready{HashScene(scene), HashCamera(camera)};
+    if (!SendMessage(socket, MessageType::Ready, &ready, sizeof(ready)))
+    {
+        error = "Connection to " + address + " lost";
+        return false;
+    }
+
+    std::deque<TileMessage> queue;
+    std::vector<glm::vec4> pixels;
+    while (true)
+    {
+        // Tiles arrive ahead of their turn; Done stops the worker even in the middle of a tile
+        const WorkerStatus status = ReceiveTiles(socket, job, queue, queue.empty(), error);
+        if (status != WorkerStatus::Rendering)
+            return status == WorkerStatus::Finished;
+        if (queue.empty())
+            continue;
+
+        const TileMessage tile = queue.front();
+        renderer.ResetFrameIndex();
+        for (uint32_t frame = 0; frame < job.Frames; frame++)
+        {
+            renderer.RenderRegion(scene, camera, tile.X0, tile.Y0, tile.X1, tile.Y1);
+            const WorkerStatus status = ReceiveTiles(socket, job, queue, false, error);
+            if (status != WorkerStatus::Rendering)
+                return status == WorkerStatus::Finished;
+        }
+        queue.pop_front();
+
+        const uint32_t tileWidth = tile.X1 - tile.X0;
+        const float scale = 1.0f / static_cast<float>(glm::max(renderer.GetAccumulatedFrames(), 1u));
+        const glm::vec4 *accumulation = renderer.GetAccumulationData();
+        pixels.resize(static_cast<size_t>(tileWidth) * (tile.Y1 - tile.Y0));
+        for (uint32_t y = tile.Y0; y < tile.Y1; y++)
+        {
+            const glm::vec4 *row = accumulation + static_cast<size_t>(y) * job.Width + tile.X0;
+            for (uint32_t x = 0; x < tileWidth; x++)
+                pixels[static_cast<size_t>(y - tile.Y0) * tileWidth + x] = row[x] * scale;
+        }
+
+        if (!SendMessage(socket, MessageType::TileResult, &tile, sizeof(tile), pixels.data(), pixels.size() * sizeof(glm::vec4)))
+        {
+            error = "Connection to " + address + " lost";
+            return false;
+        }
+    }
+}
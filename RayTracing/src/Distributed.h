@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Headless.h"
+
+#include <cstdint>
+#include <string>
+
+// Increased whenever the messages exchanged between coordinators and workers change
+constexpr uint32_t DistributedProtocolVersion = 1;
+
+// A render split into tiles across the workers connecting to a coordinator
+struct CoordinatorSettings
+{
+    std::string Address;    // "host:port" or "unix:path" to listen on
+    std::string ScenePath;  // Scene file or cache, loaded from the same path by every worker
+    std::string OutputPath; // EXR image written once every tile is rendered
+    RenderJobSettings Job;
+    uint32_t TileSize = 128;     // Width and height of the tiles handed to workers
+    uint32_t TilesInFlight = 2;  // Tiles sent to a worker ahead of its results, so it never waits for the next one
+    int TimeoutMs = 60000;       // A worker silent for this long is dropped and its tiles handed to others
+};
+
+bool RunCoordinator(const CoordinatorSettings &settings, std::string &error);
+// Renders tiles for the coordinator at an address until the image is complete, retrying the connection for connectTimeoutMs
+bool RunWorker(const std::string &address, int connectTimeoutMs, std::string &error);
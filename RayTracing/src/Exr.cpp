@@ -0,0 +1,266 @@
+#include "Exr.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    constexpr uint32_t ExrMagic = 20000630;
+    constexpr uint32_t ExrVersion = 2; // Single part scanline image, with names of up to 31 characters
+    constexpr size_t MaxNameLength = 31;
+
+    // Bounds of the runs of the RLE compression, from the OpenEXR specification
+    constexpr ptrdiff_t MinRunLength = 3;
+    constexpr ptrdiff_t MaxRunLength = 127;
+
+    // EXR files are little endian whatever the byte order of the machine writing them
+    void AppendUInt32(std::vector<char> &out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+
+    void AppendUInt64(std::vector<char> &out, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+            out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+
+    void AppendFloat(std::vector<char> &out, float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        AppendUInt32(out, bits);
+    }
+
+    void AppendString(std::vector<char> &out, const std::string &value)
+    {
+        out.insert(out.end(), value.begin(), value.end());
+        out.push_back('\0');
+    }
+
+    // Starts a header attribute, whose value of `size` bytes must be appended next
+    void AppendAttribute(std::vector<char> &out, const char *name, const char *type, uint32_t size)
+    {
+        AppendString(out, name);
+        AppendString(out, type);
+        AppendUInt32(out, size);
+    }
+
+    void AppendBox(std::vector<char> &out, const char *name, uint32_t width, uint32_t height)
+    {
+        AppendAttribute(out, name, "box2i", 16);
+        AppendUInt32(out, 0);
+        AppendUInt32(out, 0);
+        AppendUInt32(out, width - 1);
+        AppendUInt32(out, height - 1);
+    }
+
+    std::vector<char> BuildHeader(uint32_t width, uint32_t height, const std::vector<ExrChannel> &channels, ExrCompression compression)
+    {
+        std::vector<char> header;
+        AppendUInt32(header, ExrMagic);
+        AppendUInt32(header, ExrVersion);
+
+        uint32_t channelListSize = 1;
+        for (const ExrChannel &channel : channels)
+            channelListSize += static_cast<uint32_t>(channel.Name.size()) + 1 + 16;
+        AppendAttribute(header, "channels", "chlist", channelListSize);
+        for (const ExrChannel &channel : channels)
+        {
+            AppendString(header, channel.Name);
+            AppendUInt32(header, static_cast<uint32_t>(channel.Type));
+            AppendUInt32(header, 0); // pLinear and reserved bytes
+            AppendUInt32(header, 1); // x sampling
+            AppendUInt32(header, 1); // y sampling
+        }
+        header.push_back('\0');
+
+        AppendAttribute(header, "compression", "compression", 1);
+        header.push_back(static_cast<char>(compression));
+        AppendBox(header, "dataWindow", width, height);
+        AppendBox(header, "displayWindow", width, height);
+        AppendAttribute(header, "lineOrder", "lineOrder", 1);
+        header.push_back(0); // Increasing y
+        AppendAttribute(header, "pixelAspectRatio", "float", 4);
+        AppendFloat(header, 1.0f);
+        AppendAttribute(header, "screenWindowCenter", "v2f", 8);
+        AppendFloat(header, 0.0f);
+        AppendFloat(header, 0.0f);
+        AppendAttribute(header, "screenWindowWidth", "float", 4);
+        AppendFloat(header, 1.0f);
+        header.push_back('\0');
+        return header;
+    }
+
+    // Writes row y of every channel, one channel after the other, as the uncompressed data of a scanline
+    void GatherLine(const std::vector<ExrChannel> &channels, uint32_t width, uint32_t y, std::vector<char> &line)
+    {
+        line.clear();
+        for (const ExrChannel &channel : channels)
+        {
+            const char *row = static_cast<const char *>(channel.Data) + static_cast<size_t>(y) * width * channel.Stride;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, row + x * channel.Stride, sizeof(bits));
+                AppendUInt32(line, bits);
+            }
+        }
+    }
+
+    /**
+     * @brief Compresses a scanline the way OpenEXR's RLE compressor does.
+     *
+     * The bytes are split into even and odd ones and delta encoded, which turns smooth float data into runs
+     * of small values, then runs of 3 or more equal bytes are stored as a count and a byte, and other bytes
+     * as a negative count followed by the bytes.
+     *
+     * @param in The uncompressed scanline.
+     * @param scratch Buffer for the reordered bytes.
+     * @param out Output buffer for the compressed scanline.
+     */
+    void CompressRLE(const std::vector<char> &in, std::vector<char> &scratch, std::vector<char> &out)
+    {
+        const size_t size = in.size();
+        scratch.resize(size);
+        char *first = scratch.data();
+        char *second = scratch.data() + (size + 1) / 2;
+        for (size_t i = 0; i < size; i++)
+            *(i % 2 == 0 ? first++ : second++) = in[i];
+
+        unsigned char previous = static_cast<unsigned char>(scratch[0]);
+        for (size_t i = 1; i < size; i++)
+        {
+            const unsigned char current = static_cast<unsigned char>(scratch[i]);
+            scratch[i] = static_cast<char>(current - previous + (128 + 256));
+            previous = current;
+        }
+
+        out.clear();
+        const char *end = scratch.data() + size;
+        const char *runStart = scratch.data();
+        const char *runEnd = runStart + 1;
+        while (runStart < end)
+        {
+            while (runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < MaxRunLength)
+                runEnd++;
+
+            if (runEnd - runStart >= MinRunLength)
+            {
+                out.push_back(static_cast<char>(runEnd - runStart - 1));
+                out.push_back(*runStart);
+                runStart = runEnd;
+            }
+            else
+            {
+                while (runEnd < end && ((runEnd + 1 >= end || *runEnd != *(runEnd + 1)) || (runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2))) &&
+                       runEnd - runStart < MaxRunLength)
+                    runEnd++;
+
+                out.push_back(static_cast<char>(runStart - runEnd));
+                out.insert(out.end(), runStart, runEnd);
+                runStart = runEnd;
+            }
+            runEnd++;
+        }
+    }
+}
+
+/**
+ * @brief Writes an image to an OpenEXR file, as one scanline per chunk.
+ *
+ * Only the parts of the format needed for render outputs are supported: a single part scanline image, with
+ * 32 bit float and unsigned int channels, uncompressed or RLE compressed. Chunks that RLE does not make
+ * smaller are stored uncompressed, as the format allows. Channels are stored sorted by name, as the format
+ * requires, whatever their order in `channels`.
+ *
+ * The file is written under a temporary name and renamed when complete.
+ *
+ * @param path The path of the file.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param channels The channels of the image, each with width * height pixels in row order.
+ * @param compression The compression of the scanlines.
+ * @param error Output parameter for a description of the problem if writing fails.
+ * @return bool Returns true if the image was written; otherwise, returns false.
+ */
+bool WriteExr(const std::string &path, uint32_t width, uint32_t height, std::vector<ExrChannel> channels, ExrCompression compression, std::string &error)
+{
+    if (width == 0 || height == 0 || channels.empty())
+    {
+        error = "Cannot write an empty image";
+        return false;
+    }
+    for (const ExrChannel &channel : channels)
+    {
+        if (channel.Name.empty() || channel.Name.size() > MaxNameLength)
+        {
+            error = "Invalid EXR channel name \"" + channel.Name + "\"";
+            return false;
+        }
+    }
+    std::sort(channels.begin(), channels.end(), [](const ExrChannel &a, const ExrChannel &b)
+              { return a.Name < b.Name; });
+
+    const std::vector<char> header = BuildHeader(width, height, channels, compression);
+
+    const std::string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+    {
+        error = "Cannot write " + temporaryPath;
+        return false;
+    }
+
+    // The table of chunk offsets follows the header, and is filled in once the chunks are written
+    std::vector<char> offsetTable(static_cast<size_t>(height) * sizeof(uint64_t));
+    bool written = fwrite(header.data(), 1, header.size(), file) == header.size();
+    written = written && fwrite(offsetTable.data(), 1, offsetTable.size(), file) == offsetTable.size();
+
+    std::vector<uint64_t> offsets(height);
+    std::vector<char> line, scratch, compressed, chunk;
+    uint64_t position = header.size() + offsetTable.size();
+    for (uint32_t y = 0; y < height && written; y++)
+    {
+        GatherLine(channels, width, y, line);
+        const std::vector<char> *data = &line;
+        if (compression == ExrCompression::RLE)
+        {
+            CompressRLE(line, scratch, compressed);
+            if (compressed.size() < line.size())
+                data = &compressed;
+        }
+
+        chunk.clear();
+        AppendUInt32(chunk, y);
+        AppendUInt32(chunk, static_cast<uint32_t>(data->size()));
+        written = fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size() &&
+                  fwrite(data->data(), 1, data->size(), file) == data->size();
+
+        offsets[y] = position;
+        position += chunk.size() + data->size();
+    }
+
+    offsetTable.clear();
+    for (uint64_t offset : offsets)
+        AppendUInt64(offsetTable, offset);
+    written = written && fseek(file, static_cast<long>(header.size()), SEEK_SET) == 0;
+    written = written && fwrite(offsetTable.data(), 1, offsetTable.size(), file) == offsetTable.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        std::remove(temporaryPath.c_str());
+        error = "Cannot write " + temporaryPath;
+        return false;
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        error = "Cannot rename " + temporaryPath + " to " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Pixel types of EXR channels, with their values in the file format
+enum class ExrPixelType : int32_t
+{
+    UInt = 0,
+    Float = 2,
+};
+
+// Compression of EXR scanlines, with their values in the file format
+enum class ExrCompression : uint8_t
+{
+    None = 0,
+    RLE = 1, // Lossless run length encoding, fast and effective on flat regions such as depth and normals
+};
+
+// A channel of an EXR image, read from Data with Stride bytes between consecutive pixels of a row
+struct ExrChannel
+{
+    std::string Name; // "R", "G", "B", "A" and "Z" for the main layer, "layer.channel" for the others
+    ExrPixelType Type = ExrPixelType::Float;
+    const void *Data = nullptr;
+    size_t Stride = sizeof(float);
+};
+
+bool WriteExr(const std::string &path, uint32_t width, uint32_t height, std::vector<ExrChannel> channels, ExrCompression compression, std::string &error);
@@ -0,0 +1,225 @@
+#include "FrameStream.h"
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+namespace
+{
+    // BT.601 studio range luma and chroma of 8 bit RGB, in 8 bit fixed point as encoders expect by default
+    uint8_t Luma(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    uint8_t ChromaBlue(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+
+    uint8_t ChromaRed(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+    /**
+     * @brief Converts RGBA pixels, as packed by `Utils::ConvertToRGBA`, to Y, U and V planes with 4:2:0 chroma.
+     *
+     * Every chroma sample is the chroma of the average color of a 2x2 block, centered between its pixels as
+     * in JPEG. Blocks past the right or bottom edge of an image of odd size repeat the last column or row.
+     *
+     * @param pixels The pixels, in row order.
+     * @param width The width of the image.
+     * @param height The height of the image.
+     * @param planes Output buffer for the Y plane followed by the U and V planes.
+     */
+    void ConvertToYUV420(const uint32_t *pixels, uint32_t width, uint32_t height, std::vector<uint8_t> &planes)
+    {
+        const uint32_t chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+        const size_t lumaSize = static_cast<size_t>(width) * height, chromaSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+        planes.resize(lumaSize + 2 * chromaSize);
+        uint8_t *y = planes.data();
+        uint8_t *u = y + lumaSize;
+        uint8_t *v = u + chromaSize;
+
+        for (size_t i = 0; i < lumaSize; i++)
+        {
+            const uint32_t pixel = pixels[i];
+            y[i] = Luma(pixel & 0xFF, (pixel >> 8) & 0xFF, (pixel >> 16) & 0xFF);
+        }
+
+        for (uint32_t cy = 0; cy < chromaHeight; cy++)
+        {
+            const uint32_t *row0 = pixels + static_cast<size_t>(2 * cy) * width;
+            const uint32_t *row1 = pixels + static_cast<size_t>(glm::min(2 * cy + 1, height - 1)) * width;
+            for (uint32_t cx = 0; cx < chromaWidth; cx++)
+            {
+                const uint32_t x0 = 2 * cx, x1 = glm::min(2 * cx + 1, width - 1);
+                const uint32_t block[4] = {row0[x0], row0[x1], row1[x0], row1[x1]};
+                int r = 2, g = 2, b = 2;
+                for (uint32_t pixel : block)
+                {
+                    r += pixel & 0xFF;
+                    g += (pixel >> 8) & 0xFF;
+                    b += (pixel >> 16) & 0xFF;
+                }
+                r /= 4;
+                g /= 4;
+                b /= 4;
+
+                const size_t index = static_cast<size_t>(cy) * chromaWidth + cx;
+                u[index] = ChromaBlue(r, g, b);
+                v[index] = ChromaRed(r, g, b);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Starts streaming frames of a size to a file, named pipe or stdout.
+ *
+ * The file is opened by the first frame's write, on the writer thread, so the caller goes on rendering while
+ * a named pipe waits for the encoder to open it. A reader closing its end of a pipe makes writes fail rather
+ * than killing the process, as SIGPIPE is ignored from then on.
+ *
+ * @param path The path to write to, "-" for stdout.
+ * @param width The width of the frames.
+ * @param height The height of the frames.
+ * @param format The format of the stream.
+ * @param frameRate The frames per second written in the Y4M header.
+ * @param error Output parameter for a description of the problem if the stream cannot be started.
+ * @return bool Returns true if the stream was started; otherwise, returns false.
+ */
+bool FrameStream::Open(const std::string &path, uint32_t width, uint32_t height, FrameStreamFormat format, float frameRate, std::string &error)
+{
+    Close();
+    if (path.empty() || width == 0 || height == 0 || !(frameRate > 0.0f))
+    {
+        error = "Streams need a path, a size and a frame rate";
+        return false;
+    }
+
+#ifndef _WIN32
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    m_Path = path;
+    m_Width = width;
+    m_Height = height;
+    m_Format = format;
+    m_FrameRate = frameRate;
+    m_Failed = false;
+    m_FramesWritten = 0;
+    m_NextFrame = 0;
+    for (std::vector<uint32_t> &frame : m_Frames)
+        frame.resize(static_cast<size_t>(width) * height);
+    m_Open = true;
+    return true;
+}
+
+/**
+ * @brief Queues a frame to be written, copying it so the caller can render the next one into the same image.
+ *
+ * The copy goes to the buffer the writer is not using. Then, if the writer is still busy with the previous
+ * frame, the frame is dropped or the caller waits for it, so at most one frame is written while another is
+ * being prepared.
+ *
+ * @param pixels The tonemapped image of the frame, such as `Renderer::GetImageData`.
+ * @param width The width of the image, which must match the stream's.
+ * @param height The height of the image, which must match the stream's.
+ * @param dropWhenBusy True to drop the frame, rather than wait, if the writer is behind, as for previews.
+ * @return bool Returns true if the frame was queued; otherwise, returns false.
+ */
+bool FrameStream::Submit(const uint32_t *pixels, uint32_t width, uint32_t height, bool dropWhenBusy)
+{
+    if (!m_Open || m_Failed || !pixels || width != m_Width || height != m_Height)
+        return false;
+    if (dropWhenBusy && m_Worker.IsBusy())
+        return false;
+
+    std::vector<uint32_t> &frame = m_Frames[m_NextFrame];
+    std::memcpy(frame.data(), pixels, frame.size() * sizeof(uint32_t));
+    m_Worker.Wait();
+    m_NextFrame ^= 1;
+    return m_Worker.Run([this, &frame]()
+                        { return WriteFrame(frame); });
+}
+
+// Waits for the frames queued to be written, then closes the file
+void FrameStream::Close()
+{
+    if (!m_Open)
+        return;
+
+    m_Worker.Wait();
+    if (m_File == stdout)
+        std::fflush(m_File);
+    else if (m_File)
+        std::fclose(m_File);
+    m_File = nullptr;
+    m_Open = false;
+}
+
+/**
+ * @brief Writes a frame to the stream, on the writer thread, opening it and writing the header first if needed.
+ *
+ * @param pixels The frame's pixels.
+ * @return std::string The count of frames written, or a description of the problem that ended the stream.
+ */
+std::string FrameStream::WriteFrame(const std::vector<uint32_t> &pixels)
+{
+    if (!m_File)
+    {
+        if (m_Path == "-")
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            m_File = stdout;
+        }
+        else
+            m_File = std::fopen(m_Path.c_str(), "wb");
+
+        if (!m_File)
+        {
+            m_Failed = true;
+            return "Cannot open " + m_Path;
+        }
+
+        if (m_Format == FrameStreamFormat::Y4M)
+        {
+            // Rates like 29.97 are written as fractions of 1000, reduced when they are whole numbers
+            const uint32_t numerator = static_cast<uint32_t>(std::lround(m_FrameRate * 1000.0f));
+            const uint32_t divisor = std::gcd(numerator, 1000u);
+            std::fprintf(m_File, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n", m_Width, m_Height, numerator / divisor, 1000u / divisor);
+        }
+    }
+
+    bool written;
+    if (m_Format == FrameStreamFormat::Y4M)
+    {
+        ConvertToYUV420(pixels.data(), m_Width, m_Height, m_Planes);
+        written = std::fputs("FRAME\n", m_File) >= 0 && std::fwrite(m_Planes.data(), 1, m_Planes.size(), m_File) == m_Planes.size();
+    }
+    else
+        written = std::fwrite(pixels.data(), sizeof(uint32_t), pixels.size(), m_File) == pixels.size();
+
+    // The encoder gets every frame as soon as it is written, rather than when the buffer fills up
+    if (!written || std::fflush(m_File) != 0)
+    {
+        m_Failed = true;
+        return "Stopped streaming to " + m_Path + " after " + std::to_string(m_FramesWritten) + " frames, the reader went away or the disk is full";
+    }
+
+    m_FramesWritten++;
+    return "Streamed " + std::to_string(m_FramesWritten) + " frames to " + (m_Path == "-" ? std::string("stdout") : m_Path);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "BackgroundWorker.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum class FrameStreamFormat
+{
+    RGBA, // Raw 8 bit RGBA frames, as ffmpeg's "-f rawvideo -pix_fmt rgba -video_size WxH"
+    Y4M,  // YUV4MPEG2 with 4:2:0 chroma, which encoders read without being told the size or rate
+};
+
+/**
+ * @brief Streams the displayed image of every frame to stdout or a named pipe, for a video encoder to read.
+ *
+ * Frames are copied into one of two buffers and written from the other on a background thread, so the
+ * renderer only waits for the pipe when the encoder falls a whole frame behind, or never when frames may
+ * be dropped. The stream is opened by the writer thread too, as opening a named pipe waits for its reader.
+ */
+class FrameStream
+{
+public:
+    ~FrameStream() { Close(); }
+
+    // Starts a stream of frames of a size to a path, "-" for stdout
+    bool Open(const std::string &path, uint32_t width, uint32_t height, FrameStreamFormat format, float frameRate, std::string &error);
+    bool Submit(const uint32_t *pixels, uint32_t width, uint32_t height, bool dropWhenBusy);
+    void Close();
+
+    bool IsOpen() const { return m_Open; }
+    uint32_t GetWidth() const { return m_Width; }
+    uint32_t GetHeight() const { return m_Height; }
+
+    // Frames written so far, or the error that ended the stream
+    std::string GetStatus() const { return m_Worker.GetStatus(); }
+
+private:
+    std::string WriteFrame(const std::vector<uint32_t> &pixels);
+
+private:
+    std::string m_Path;
+    uint32_t m_Width = 0, m_Height = 0;
+    FrameStreamFormat m_Format = FrameStreamFormat::Y4M;
+    float m_FrameRate = 24.0f;
+    bool m_Open = false;
+
+    // Only touched by the worker while the stream is open
+    FILE *m_File = nullptr;
+    std::atomic<bool> m_Failed{false}; // Set by the worker once a write fails, read by Submit
+    uint64_t m_FramesWritten = 0;
+    std::vector<uint8_t> m_Planes; // Y, U and V planes of the frame being written
+
+    std::vector<uint32_t> m_Frames[2]; // The worker writes one while the other takes the next frame
+    uint32_t m_NextFrame = 0;
+    BackgroundWorker m_Worker; // Declared last, so it finishes writing before the buffers are destroyed
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "AABB.h"
+
+#include <glm/glm.hpp>
+
+/**
+ * @brief Pyramid of rays sharing one origin, bounded by four side planes.
+ *
+ * Each plane is stored as (normal, offset) with the normal pointing inwards, so a point p is inside the
+ * frustum when dot(normal, p) + offset >= 0 for every plane. There are no near or far planes.
+ */
+struct Frustum
+{
+    glm::vec4 Planes[4];
+
+    /**
+     * @brief Conservative box test.
+     *
+     * @return bool Returns false only if the box lies entirely outside one of the planes. Boxes near the
+     * frustum corners may be reported as intersecting even though they are not.
+     */
+    bool Intersects(const AABB &box) const
+    {
+        for (const glm::vec4 &plane : Planes)
+        {
+            glm::vec3 normal(plane);
+            glm::vec3 farthest = glm::mix(box.Min, box.Max, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+            if (glm::dot(normal, farthest) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
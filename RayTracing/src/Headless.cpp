@@ -0,0 +1,181 @@
+#include "Headless.h"
+#include "Autotuner.h"
+#include "Kernels.h"
+#include "PartialRender.h"
+#include "RenderOutput.h"
+#include "SceneCache.h"
+#include "SceneFile.h"
+
+#include "Walnut/Timer.h"
+
+Camera CreateDefaultCamera()
+{
+    return Camera(20.0f, 0.1f, 100.0f, glm::vec3{13.0f, 2.0f, 3.0f});
+}
+
+/**
+ * @brief Loads the scene to render without the editor, from a scene file or a scene cache.
+ *
+ * Paths ending in .json are read as scene files, which also place the camera; anything else as a scene
+ * cache, whose prebuilt hierarchy is used as it is. Scene files get a BVH built with the leaf size of this
+ * machine's tuning profile.
+ *
+ * @param path The path of the scene file or cache.
+ * @param scene The scene to replace.
+ * @param camera The camera to place, left unchanged by scene caches.
+ * @param materialNames Output parameter for the names of the materials.
+ * @param error Output parameter for a description of the problem if loading fails.
+ * @return bool Returns true if the scene was loaded; otherwise, returns false.
+ */
+bool LoadRenderScene(const std::string &path, Scene &scene, Camera &camera, std::vector<std::string> &materialNames, std::string &error)
+{
+    const bool sceneFile = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (!sceneFile)
+        return LoadSceneCache(path, scene, materialNames, error);
+
+    if (!LoadSceneFile(path, scene, &camera, materialNames, error))
+        return false;
+    BuildRenderAccelerator(scene);
+    return true;
+}
+
+/**
+ * @brief Builds the BVH of a scene read from a scene document, with the leaf size of this machine's tuning profile.
+ *
+ * @param scene The scene, whose acceleration structure is replaced.
+ */
+void BuildRenderAccelerator(Scene &scene)
+{
+    TuningReport report;
+    const uint32_t leafSize = LoadTuningProfile(GetTuningProfilePath(), report) ? report.Tuned.LeafSize : TuningParameters().LeafSize;
+    scene.UpdateTriangleCount();
+    scene.AccelerationStructure = CreateAccelerator(AcceleratorType::BVH, scene.Hittables, leafSize);
+    scene.AccelerationReplicas.clear();
+}
+
+/**
+ * @brief Selects the kernels of this machine's tuning profile, if it has one.
+ *
+ * The kernels are shared by every renderer. `ApplyTuningParameters` leaves them alone when they are already
+ * selected, so renderers set up on several threads after this find nothing to change while others render.
+ */
+void SelectTunedKernels()
+{
+    TuningReport report;
+    if (LoadTuningProfile(GetTuningProfilePath(), report) && report.Tuned.ISA >= 0)
+        SetKernelISA(static_cast<KernelISA>(report.Tuned.ISA));
+}
+
+/**
+ * @brief Finds how many threads a render of an image of this size keeps busy.
+ *
+ * Every frame ends with the threads waiting for the last tiles, which costs a small image rendered by many
+ * threads most of its time. Giving it fewer threads, and the others to other images rendered side by side,
+ * keeps every core working.
+ *
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param pixelsPerThread The pixels of the image per thread.
+ * @param threadCount The threads available.
+ * @return int The number of threads, between 1 and threadCount.
+ */
+int GetRenderThreadShare(uint32_t width, uint32_t height, uint32_t pixelsPerThread, int threadCount)
+{
+    const uint64_t threads = static_cast<uint64_t>(width) * height / glm::max(pixelsPerThread, 1u);
+    return static_cast<int>(glm::clamp<uint64_t>(threads, 1, static_cast<uint64_t>(glm::max(threadCount, 1))));
+}
+
+/**
+ * @brief Prepares a headless renderer and its camera to render a job.
+ *
+ * The performance parameters come from this machine's tuning profile, as in the editor, so every process of
+ * a distributed render runs at the speed of its own host. Sampling is deterministic, so the frames of the
+ * job draw the same samples whatever the process, host or kernels rendering them.
+ *
+ * @param job The image size, sampling and settings to render with.
+ * @param renderer The renderer to set up.
+ * @param camera The camera to size to the image.
+ */
+void SetupHeadlessRenderer(const RenderJobSettings &job, Renderer &renderer, Camera &camera)
+{
+    TuningReport report;
+    if (LoadTuningProfile(GetTuningProfilePath(), report))
+        ApplyTuningParameters(report.Tuned, renderer.GetSettings());
+
+    renderer.m_Bounces = job.Bounces;
+    renderer.m_Samples = job.Samples;
+    renderer.GetSettings().EnableAntialiasing = job.Antialiasing;
+    renderer.GetSettings().Accumulate = true;
+    renderer.GetSettings().DeterministicSampling = true;
+    renderer.OnResize(job.Width, job.Height);
+    camera.OnResize(job.Width, job.Height);
+    renderer.SetFirstFrame(job.FirstFrame);
+}
+
+/**
+ * @brief Renders the frames of a job in this process and writes the result.
+ *
+ * The image is the average of the frames. The partial render keeps their sums and counts instead, to add up
+ * with renders of other frames of the same job by `MergePartialRenders`. A stream gets the displayed image
+ * after every frame, showing the render converge; no frame is dropped, but the next frame renders while the
+ * last one is written.
+ *
+ * @param scenePath The scene file or cache to render.
+ * @param job The image size, frames and settings to render with.
+ * @param outputPath The path of the image (.exr) or of the partial render (any other extension), or empty to only stream.
+ * @param stream The stream of the frames, or nullptr. Left open, so its status can be read once closed.
+ * @param status Output parameter for a summary of the render, or a description of the problem if it fails.
+ * @return bool Returns true if the result was written; otherwise, returns false.
+ */
+bool RenderHeadless(const std::string &scenePath, const RenderJobSettings &job, const std::string &outputPath, FrameStream *stream, std::string &status)
+{
+    if (job.Width == 0 || job.Height == 0 || job.Frames == 0)
+    {
+        status = "The image size and frames must not be 0";
+        return false;
+    }
+
+    Scene scene;
+    Camera camera = CreateDefaultCamera();
+    std::vector<std::string> materialNames;
+    if (!LoadRenderScene(scenePath, scene, camera, materialNames, status))
+        return false;
+
+    Renderer renderer(true);
+    SetupHeadlessRenderer(job, renderer, camera);
+
+    Walnut::Timer timer;
+    for (uint32_t frame = 0; frame < job.Frames; frame++)
+    {
+        renderer.Render(scene, camera);
+        if (stream && stream->IsOpen())
+            stream->Submit(renderer.GetImageData(), renderer.GetWidth(), renderer.GetHeight(), false);
+    }
+    const float renderTime = timer.ElapsedMillis();
+
+    const bool image = outputPath.size() >= 4 && outputPath.compare(outputPath.size() - 4, 4, ".exr") == 0;
+    if (outputPath.empty())
+    {
+        status = "Rendered frames " + std::to_string(job.FirstFrame) + " to " + std::to_string(job.FirstFrame + job.Frames) + " in " +
+                 std::to_string(static_cast<int>(renderTime)) + "ms";
+        return true;
+    }
+    if (image)
+    {
+        RenderSnapshot snapshot;
+        CaptureRenderSnapshot(renderer, scene, camera, RenderLayerSamples, snapshot);
+        if (!SaveRenderExr(outputPath, snapshot, ExrCompression::RLE, status))
+            return false;
+    }
+    else
+    {
+        PartialRender partial;
+        CapturePartialRender(renderer, scene, camera, partial);
+        if (!SavePartialRender(outputPath, partial, status))
+            return false;
+    }
+
+    status = "Rendered frames " + std::to_string(job.FirstFrame) + " to " + std::to_string(job.FirstFrame + job.Frames) + " into " +
+             outputPath + " in " + std::to_string(static_cast<int>(renderTime)) + "ms";
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "FrameStream.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Image size, sampling and renderer settings of a render run without the editor
+struct RenderJobSettings
+{
+    uint32_t Width = 1280;
+    uint32_t Height = 720;
+    uint32_t Frames = 16;    // Frames accumulated per pixel
+    uint32_t FirstFrame = 0; // Index of the first frame, to render the samples of other frames than another process
+    int Samples = 1;      // Samples averaged per frame
+    int Bounces = 5;
+    bool Antialiasing = true;
+};
+
+// Camera at the editor's starting view, used by scenes that do not place one
+Camera CreateDefaultCamera();
+
+// Loads a scene file (.json) or a scene cache, ready to render with a built acceleration structure
+bool LoadRenderScene(const std::string &path, Scene &scene, Camera &camera, std::vector<std::string> &materialNames, std::string &error);
+// Builds the acceleration structure of a scene read from a scene document, as LoadRenderScene does for scene files
+void BuildRenderAccelerator(Scene &scene);
+
+// Selects the kernels of this machine's tuning profile, before starting renderers on several threads that would each select them
+void SelectTunedKernels();
+
+// Threads worth giving a render of this size, one per pixelsPerThread pixels up to threadCount, so small images can share the machine
+int GetRenderThreadShare(uint32_t width, uint32_t height, uint32_t pixelsPerThread, int threadCount);
+
+// Sizes a headless renderer and camera for a job, with the parameters tuned for this machine if it has a profile
+void SetupHeadlessRenderer(const RenderJobSettings &job, Renderer &renderer, Camera &camera);
+
+// Renders a job in this process, writing the image (.exr), the partial render of its frames (any other extension) or nothing (empty),
+// and streaming the image after every frame if stream is open
+bool RenderHeadless(const std::string &scenePath, const RenderJobSettings &job, const std::string &outputPath, FrameStream *stream, std::string &status);
@@ -0,0 +1,27 @@
+#include "Hittable.h"
+#include "RayPacket.h"
+
+/**
+ * @brief Finds the hits of several rays of a packet with this object, one ray at a time.
+ *
+ * Objects that can intersect a whole packet at once override this.
+ *
+ * @param packet The packet holding the rays. `Hits` and `TMax` are updated for every lane hit.
+ * @param mask The lanes to test.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @return uint32_t The mask of lanes that hit the object closer than their previous `TMax`.
+ */
+uint32_t Hittable::hitLanes(RayPacket &packet, uint32_t mask, float tMin) const
+{
+    uint32_t hitMask = 0;
+    for (uint32_t lanes = mask; lanes != 0; lanes &= lanes - 1)
+    {
+        const int lane = RayPacket::FirstLane(lanes);
+        if (hit(packet.GetRay(lane), tMin, packet.TMax[lane], packet.Hits[lane]))
+        {
+            packet.TMax[lane] = packet.Hits[lane].HitDistance;
+            hitMask |= 1u << lane;
+        }
+    }
+    return hitMask;
+}
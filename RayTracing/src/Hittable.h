@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Ray.h"
+#include "AABB.h"
 #include <vector>
 #include <string>
 
@@ -12,6 +13,7 @@ struct HitPayload
     glm::vec3 normal;
 
     int objectIndex;
+    int primitiveIndex; // Index of the hit object inside an instanced object, see Instance
     int materialIndex;
 
     void setFaceNormal(const Ray &r, const glm::vec3 &outward_normal)
@@ -24,6 +26,8 @@ struct HitPayload
     }
 };
 
+struct RayPacket;
+
 class Hittable
 {
 public:
@@ -33,6 +37,19 @@ public:
 
     virtual void ClosestHit(const Ray &ray, HitPayload &payload) const = 0;
 
+    // Any-hit query: returns true as soon as some hit in (tMin, tMax) is found, without filling a payload.
+    virtual bool occluded(const Ray &ray, float tMin, float tMax) const
+    {
+        HitPayload payload;
+        return hit(ray, tMin, tMax, payload);
+    }
+
+    // Closest hit query for the lanes of a packet in `mask`; updates Hits and TMax of the lanes hit and returns their mask.
+    virtual uint32_t hitLanes(RayPacket &packet, uint32_t mask, float tMin) const;
+
+    virtual AABB getBoundingBox() const = 0;
+
+    virtual const char *getTypeName() const { return "Object"; }
     virtual bool RenderObjectOptions(std::vector<std::string> &materialNames) { return false; }
     virtual void setMaterialIndex(int newMaterialIndex) {}
     virtual int getMaterialIndex() { return -1; }
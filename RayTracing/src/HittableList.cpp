@@ -36,6 +36,27 @@ bool HittableList::hit(const Ray &ray, float tMin, float tMax, HitPayload &paylo
     return hit_anything;
 }
 
+/**
+ * @brief Determines if a ray hits any object in the list between tMin and tMax.
+ *
+ * Unlike `hit`, this function stops at the first object hit instead of searching for the closest one, and
+ * it does not produce any hit information. It is meant for visibility queries such as shadow rays.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @return bool Returns true if the ray hits any object in the list; otherwise, returns false.
+ */
+bool HittableList::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    for (const auto &object : objects)
+    {
+        if (object->occluded(ray, tMin, tMax))
+            return true;
+    }
+    return false;
+}
+
 /**
  * @brief Determines the closest hit point on the object hit by the ray.
  *
@@ -54,3 +75,16 @@ void HittableList::ClosestHit(const Ray &ray, HitPayload &payload) const
 {
     objects[payload.objectIndex]->ClosestHit(ray, payload);
 }
+
+/**
+ * @brief Computes the bounding box enclosing every object in the list.
+ *
+ * @return AABB The union of the bounding boxes of all objects. Empty if the list is empty.
+ */
+AABB HittableList::getBoundingBox() const
+{
+    AABB bounds;
+    for (const auto &object : objects)
+        bounds.Grow(object->getBoundingBox());
+    return bounds;
+}
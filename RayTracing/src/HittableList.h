@@ -24,6 +24,17 @@ public:
         objects.push_back(object);
     }
 
+    // Adds every object of a contiguous block. The objects share the block's allocation instead of each having its own.
+    template <typename T>
+    void addBlock(const shared_ptr<std::vector<T>> &block)
+    {
+        objects.reserve(objects.size() + block->size());
+        for (T &object : *block)
+            objects.push_back(shared_ptr<Hittable>(block, &object));
+    }
+
     bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    bool occluded(const Ray &ray, float tMin, float tMax) const override;
     void ClosestHit(const Ray &ray, HitPayload &payload) const override;
+    AABB getBoundingBox() const override;
 };
@@ -0,0 +1,136 @@
+#include "Instance.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <imgui.h>
+
+Instance::Instance(std::shared_ptr<Hittable> object)
+    : m_Object(std::move(object))
+{
+    UpdateTransform();
+}
+
+/**
+ * @brief Recomputes the instance matrices and world space bounds from its translation, rotation and scale.
+ *
+ * The object to world matrix applies scale, then rotation (X, then Y, then Z), then translation. Its inverse
+ * is used to bring rays into object space, and its inverse transpose to bring normals back to world space.
+ * The world bounds enclose the eight transformed corners of the object's bounding box.
+ */
+void Instance::UpdateTransform()
+{
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), Translation);
+    transform = glm::rotate(transform, glm::radians(Rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    transform = glm::rotate(transform, glm::radians(Rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    transform = glm::rotate(transform, glm::radians(Rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    transform = glm::scale(transform, Scale);
+
+    m_ObjectToWorld = transform;
+    m_WorldToObject = glm::inverse(transform);
+    m_NormalToWorld = glm::transpose(glm::mat3(m_WorldToObject));
+
+    m_Bounds = AABB();
+    const AABB objectBounds = m_Object->getBoundingBox();
+    if (objectBounds.IsEmpty())
+        return;
+
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point{(corner & 1) ? objectBounds.Max.x : objectBounds.Min.x,
+                        (corner & 2) ? objectBounds.Max.y : objectBounds.Min.y,
+                        (corner & 4) ? objectBounds.Max.z : objectBounds.Min.z};
+        m_Bounds.Grow(glm::vec3(m_ObjectToWorld * glm::vec4(point, 1.0f)));
+    }
+}
+
+/**
+ * @brief Determines if a ray hits the instanced object.
+ *
+ * The ray is transformed into object space without renormalizing its direction, so hit distances are the
+ * same in both spaces and can be compared directly with hits on other instances.
+ *
+ * @param ray The ray to check for hits, in world space.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for information about the hit. Only modified if a hit occurs.
+ * @return bool Returns true if the ray hits the instanced object; otherwise, returns false.
+ */
+bool Instance::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+{
+    if (!m_Object->hit(ToObjectSpace(ray), tMin, tMax, payload))
+        return false;
+
+    // The shared object reports the index of its own object hit, which the caller overwrites with ours
+    payload.primitiveIndex = payload.objectIndex;
+    return true;
+}
+
+bool Instance::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    return m_Object->occluded(ToObjectSpace(ray), tMin, tMax);
+}
+
+/**
+ * @brief Computes the world space hit information for a hit found by `hit`.
+ *
+ * The shared object computes the hit in object space, after which the normal is brought back to world
+ * space with the inverse transpose of the instance transform and reoriented against the world space ray.
+ *
+ * @param ray The ray that hit the instance, in world space.
+ * @param payload The hit payload containing information about the hit. Modified by this function.
+ */
+void Instance::ClosestHit(const Ray &ray, HitPayload &payload) const
+{
+    HitPayload local = payload;
+    local.objectIndex = payload.primitiveIndex;
+    m_Object->ClosestHit(ToObjectSpace(ray), local);
+
+    const glm::vec3 outwardNormal = local.frontFace ? local.normal : -local.normal;
+    payload.position = ray.Origin + ray.Direction * payload.HitDistance;
+    payload.setFaceNormal(ray, glm::normalize(m_NormalToWorld * outwardNormal));
+    payload.materialIndex = MaterialIndex >= 0 ? MaterialIndex : local.materialIndex;
+}
+
+/**
+ * @brief Renders the GUI options for the instance.
+ *
+ * The user can change the translation, rotation and scale of the instance and override the materials of
+ * the shared object with a single material.
+ *
+ * @param materialNames A vector of names of available materials.
+ * @return bool Returns true if any of the options were changed by the user; otherwise, returns false.
+ */
+bool Instance::RenderObjectOptions(std::vector<std::string> &materialNames)
+{
+    int optionChanged = 0;
+    optionChanged += ImGui::DragFloat3("Translation", &Translation.x, 0.1f);
+    optionChanged += ImGui::DragFloat3("Rotation", &Rotation.x, 1.0f);
+    optionChanged += ImGui::DragFloat3("Scale", &Scale.x, 0.05f, 0.001f, 1000.0f);
+
+    const char *combo_preview_value = MaterialIndex >= 0 ? materialNames.at(MaterialIndex).c_str() : "Object materials";
+    if (ImGui::BeginCombo("Material", combo_preview_value))
+    {
+        if (ImGui::Selectable("Object materials", MaterialIndex < 0))
+        {
+            MaterialIndex = -1;
+            optionChanged += 1;
+        }
+        for (int n = 0; n < materialNames.size(); n++)
+        {
+            const bool is_selected = (MaterialIndex == n);
+            if (ImGui::Selectable(materialNames.at(n).c_str(), is_selected))
+            {
+                MaterialIndex = n;
+                optionChanged += 1;
+            }
+
+            if (is_selected)
+                ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+    }
+
+    if (optionChanged > 0)
+        UpdateTransform();
+
+    return optionChanged > 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Hittable.h"
+
+#include <glm/glm.hpp>
+#include <memory>
+
+/**
+ * @brief Places a shared object in the scene with its own affine transform.
+ *
+ * The referenced object (typically an acceleration structure over a cluster of spheres, i.e. a bottom
+ * level structure) is stored once and shared by every instance, so memory grows with the unique geometry
+ * rather than with the number of placements. The scene's acceleration structure built over instances acts
+ * as the top level structure.
+ *
+ * Rays are transformed into object space for intersection and hits are transformed back into world space.
+ * The index of the object hit inside the shared object is kept in `payload.primitiveIndex` between `hit`
+ * and `ClosestHit`, so instances cannot be nested.
+ */
+class Instance : public Hittable
+{
+public:
+    glm::vec3 Translation{0.0f};
+    glm::vec3 Rotation{0.0f}; // Euler angles in degrees
+    glm::vec3 Scale{1.0f};
+
+    int MaterialIndex = -1; // Overrides the materials of the shared object unless negative
+
+    Instance(std::shared_ptr<Hittable> object);
+
+    // Must be called after changing Translation, Rotation or Scale
+    void UpdateTransform();
+
+    bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    void ClosestHit(const Ray &ray, HitPayload &payload) const override;
+    AABB getBoundingBox() const override { return m_Bounds; }
+
+    const char *getTypeName() const override { return "Instance"; }
+    bool RenderObjectOptions(std::vector<std::string> &materialNames) override;
+
+    void setMaterialIndex(int newMaterialIndex) override { MaterialIndex = newMaterialIndex; }
+    int getMaterialIndex() override { return MaterialIndex; }
+
+    const std::shared_ptr<Hittable> &GetObject() const { return m_Object; }
+    const glm::mat4 &GetObjectToWorld() const { return m_ObjectToWorld; }
+
+private:
+    Ray ToObjectSpace(const Ray &ray) const
+    {
+        Ray local;
+        local.Origin = glm::vec3(m_WorldToObject * glm::vec4(ray.Origin, 1.0f));
+        local.Direction = glm::mat3(m_WorldToObject) * ray.Direction;
+        return local;
+    }
+
+private:
+    std::shared_ptr<Hittable> m_Object;
+    glm::mat4 m_ObjectToWorld{1.0f};
+    glm::mat4 m_WorldToObject{1.0f};
+    glm::mat3 m_NormalToWorld{1.0f};
+    AABB m_Bounds;
+};
@@ -0,0 +1,407 @@
+#include "JobQueue.h"
+#include "Checkpoint.h"
+#include "Json.h"
+#include "MappedFile.h"
+#include "RenderOutput.h"
+
+#include "Walnut/Timer.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    // Set by SIGINT and SIGTERM, polled by the queue and its jobs between frames
+    volatile std::sig_atomic_t s_StopRequested = 0;
+
+    void RequestStop(int)
+    {
+        s_StopRequested = 1;
+    }
+
+    enum class JobResult
+    {
+        Finished,
+        Interrupted,
+        Failed
+    };
+
+    bool ReadJob(JsonReader &reader, const std::filesystem::path &directory, RenderJob &job)
+    {
+        uint32_t samples = 1, samplesPerFrame = 1, bounces = static_cast<uint32_t>(job.Settings.Bounces);
+        std::string scene, output;
+        const bool read = reader.ReadObject([&](const std::string &key)
+                                            {
+            if (key == "name")
+                return reader.ReadString(job.Name);
+            if (key == "scene")
+                return reader.ReadString(scene);
+            if (key == "output")
+                return reader.ReadString(output);
+            if (key == "width")
+                return reader.ReadCount(job.Settings.Width);
+            if (key == "height")
+                return reader.ReadCount(job.Settings.Height);
+            if (key == "samples")
+                return reader.ReadCount(samples);
+            if (key == "samplesPerFrame")
+                return reader.ReadCount(samplesPerFrame);
+            if (key == "bounces")
+                return reader.ReadCount(bounces);
+            if (key == "antialiasing")
+                return reader.ReadBool(job.Settings.Antialiasing);
+            if (key == "priority")
+            {
+                long long priority;
+                if (!reader.ReadInteger(priority))
+                    return false;
+                job.Priority = static_cast<int>(glm::clamp<long long>(priority, std::numeric_limits<int>::min(), std::numeric_limits<int>::max()));
+                return true;
+            }
+            if (key == "camera")
+                return ReadJobCamera(reader, job);
+            return reader.SkipValue(); });
+        if (!read)
+            return false;
+
+        if (scene.empty() || output.empty())
+            return reader.Fail("jobs need a scene and an output");
+        if ((job.CameraMembers & JobCameraDirection) && glm::length(job.CameraDirection) == 0.0f)
+            return reader.Fail("camera direction is zero");
+
+        // Appending an absolute path replaces the directory
+        job.ScenePath = (directory / scene).lexically_normal().string();
+        job.OutputPath = (directory / output).lexically_normal().string();
+        if (job.Name.empty())
+            job.Name = output;
+
+        job.Settings.Samples = static_cast<int>(samplesPerFrame);
+        job.Settings.Frames = (samples + samplesPerFrame - 1) / samplesPerFrame;
+        job.Settings.Bounces = static_cast<int>(bounces);
+        return true;
+    }
+
+    /**
+     * @brief Appends the jobs of a manifest.
+     *
+     * @param path The path of the manifest.
+     * @param jobs The jobs to append to, left unchanged if loading fails.
+     * @param foreign Output parameter set to true if the file is another kind of JSON document, such as a scene file.
+     * @param error Output parameter for a description of the problem, with its line, if loading fails.
+     * @return bool Returns true if the manifest was loaded; otherwise, returns false.
+     */
+    bool LoadJobManifest(const std::string &path, std::vector<RenderJob> &jobs, bool &foreign, std::string &error)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+        {
+            error = "Cannot open " + path;
+            return false;
+        }
+
+        const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        JsonReader reader(file.GetData(), file.GetData() + file.GetSize());
+        std::vector<RenderJob> loaded;
+        foreign = false;
+
+        const bool read = reader.ReadObject([&](const std::string &key)
+                                            {
+            if (key == "format")
+            {
+                std::string format;
+                if (!reader.ReadString(format))
+                    return false;
+                foreign = format != "raytracing-jobs";
+                return !foreign || reader.Fail("not a job manifest");
+            }
+            if (key == "version")
+            {
+                long long version;
+                return reader.ReadInteger(version) && (version <= JobManifestVersion || reader.Fail("job manifest from a newer version"));
+            }
+            if (key == "jobs")
+                return reader.ReadArray([&]()
+                                        { loaded.emplace_back();
+                                          return ReadJob(reader, directory, loaded.back()); });
+            return reader.SkipValue(); });
+
+        if (!read || (!reader.AtEnd() && !reader.Fail("unexpected text after the jobs")))
+        {
+            error = path + ", " + reader.GetError();
+            return false;
+        }
+
+        jobs.insert(jobs.end(), std::make_move_iterator(loaded.begin()), std::make_move_iterator(loaded.end()));
+        return true;
+    }
+
+    /**
+     * @brief Renders a job on the calling thread, with a team of threadCount render threads.
+     *
+     * A checkpoint of the job is written in the background every interval, and when the queue is asked to stop,
+     * after which the job is left for the next run to resume. The frames resumed from a checkpoint continue the
+     * job's deterministic sample sequence, so the image is the same as if it had never been interrupted.
+     *
+     * @param job The job to render.
+     * @param threadCount The threads to render with.
+     * @param checkpointInterval The seconds between checkpoints.
+     * @param status Output parameter for a summary of the job, or a description of the problem if it fails.
+     * @return JobResult Whether the job's image was written, the job was stopped, or it failed.
+     */
+    JobResult RunJob(const RenderJob &job, int threadCount, float checkpointInterval, std::string &status)
+    {
+        // Every thread has its own team size, which also limits the scene's build and the buffer copies
+        omp_set_num_threads(threadCount);
+
+        Scene scene;
+        Camera camera = CreateDefaultCamera();
+        std::vector<std::string> materialNames;
+        if (!LoadRenderScene(job.ScenePath, scene, camera, materialNames, status))
+            return JobResult::Failed;
+        ApplyJobCamera(job, camera);
+
+        Renderer renderer(true);
+        SetupHeadlessRenderer(job.Settings, renderer, camera);
+        renderer.GetSettings().ThreadCount = threadCount;
+
+        // A checkpoint of another scene, camera or settings is started over
+        const std::string checkpointPath = GetJobCheckpointPath(job);
+        std::string resumeStatus;
+        if (std::filesystem::exists(checkpointPath) && !ResumeCheckpoint(checkpointPath, renderer, scene, camera, resumeStatus))
+            resumeStatus = "started over, " + resumeStatus;
+        else if (renderer.GetAccumulatedFrames() > 0)
+            resumeStatus = "resumed at frame " + std::to_string(renderer.GetAccumulatedFrames());
+
+        CheckpointWriter checkpointWriter;
+        Walnut::Timer timer, checkpointTimer;
+        while (renderer.GetAccumulatedFrames() < job.Settings.Frames)
+        {
+            if (s_StopRequested)
+            {
+                status = "stopped at frame " + std::to_string(renderer.GetAccumulatedFrames()) + " of " + std::to_string(job.Settings.Frames);
+                checkpointWriter.Wait();
+                if (checkpointWriter.Submit(checkpointPath, renderer, scene, camera))
+                {
+                    checkpointWriter.Wait();
+                    status += ", " + checkpointWriter.GetStatus();
+                }
+                return JobResult::Interrupted;
+            }
+
+            renderer.Render(scene, camera);
+            if (checkpointTimer.Elapsed() >= checkpointInterval && checkpointWriter.Submit(checkpointPath, renderer, scene, camera))
+                checkpointTimer.Reset();
+        }
+        const float renderTime = timer.Elapsed();
+        checkpointWriter.Wait();
+
+        RenderSnapshot snapshot;
+        CaptureRenderSnapshot(renderer, scene, camera, RenderLayerSamples, snapshot);
+        if (!SaveRenderExr(job.OutputPath, snapshot, ExrCompression::RLE, status))
+            return JobResult::Failed;
+        std::remove(checkpointPath.c_str());
+
+        char summary[128];
+        std::snprintf(summary, sizeof(summary), "%u samples per pixel in %.1fs on %d threads", snapshot.Samples, renderTime, threadCount);
+        status = "wrote " + job.OutputPath + ", " + summary;
+        if (!resumeStatus.empty())
+            status += ", " + resumeStatus;
+        return JobResult::Finished;
+    }
+}
+
+/**
+ * @brief Reads the "camera" member of a job, whose members replace those of the scene's camera.
+ *
+ * @param reader The reader, at the camera object.
+ * @param job The job to store the camera members in, marked in `CameraMembers`.
+ * @return bool Returns true if the camera was read; otherwise, returns false with the reader's error set.
+ */
+bool ReadJobCamera(JsonReader &reader, RenderJob &job)
+{
+    // Marks a member as replacing the scene camera's, before reading it
+    auto replaces = [&](uint32_t member)
+    {
+        job.CameraMembers |= member;
+        return true;
+    };
+    return reader.ReadObject([&](const std::string &key)
+                             {
+        if (key == "position")
+            return replaces(JobCameraPosition) && reader.ReadVec3(job.CameraPosition);
+        if (key == "direction")
+            return replaces(JobCameraDirection) && reader.ReadVec3(job.CameraDirection);
+        if (key == "fov")
+            return replaces(JobCameraFOV) && reader.ReadFloat(job.VerticalFOV);
+        if (key == "aperture")
+            return replaces(JobCameraAperture) && reader.ReadFloat(job.Aperture);
+        if (key == "focusDistance")
+            return replaces(JobCameraFocusDistance) && reader.ReadFloat(job.FocusDistance);
+        return reader.SkipValue(); });
+}
+
+/**
+ * @brief Replaces the members of a scene's camera that a job gives, leaving the others as the scene placed them.
+ *
+ * @param job The job, with its camera members read by `ReadJobCamera`.
+ * @param camera The scene's camera.
+ */
+void ApplyJobCamera(const RenderJob &job, Camera &camera)
+{
+    if (job.CameraMembers & (JobCameraFOV | JobCameraAperture | JobCameraFocusDistance))
+    {
+        camera.SetLens(job.CameraMembers & JobCameraFOV ? job.VerticalFOV : camera.GetVerticalFOV(),
+                       job.CameraMembers & JobCameraAperture ? job.Aperture : camera.getAperatureSize(),
+                       job.CameraMembers & JobCameraFocusDistance ? job.FocusDistance : camera.getFocusDistance());
+    }
+    if (job.CameraMembers & (JobCameraPosition | JobCameraDirection))
+    {
+        camera.SetView(job.CameraMembers & JobCameraPosition ? job.CameraPosition : camera.GetPosition(),
+                       job.CameraMembers & JobCameraDirection ? job.CameraDirection : camera.GetDirection());
+    }
+}
+
+/**
+ * @brief Appends the jobs of a manifest, or of every manifest in a directory.
+ *
+ * The manifests of a directory are the files ending in .json, loaded in the order of their names so the
+ * jobs of the same priority run in a predictable order. Other JSON documents in the directory, such as the
+ * scene files of the jobs, are skipped.
+ *
+ * @param path The path of a manifest, in the format described in JobQueue.h, or of a directory of manifests.
+ * @param jobs The jobs to append to.
+ * @param error Output parameter for a description of the problem if loading fails.
+ * @return bool Returns true if every manifest was loaded; otherwise, returns false.
+ */
+bool LoadJobQueue(const std::string &path, std::vector<RenderJob> &jobs, std::string &error)
+{
+    std::error_code code;
+    bool foreign;
+    if (!std::filesystem::is_directory(path, code))
+        return LoadJobManifest(path, jobs, foreign, error);
+
+    std::vector<std::string> manifests;
+    for (const auto &entry : std::filesystem::directory_iterator(path, code))
+    {
+        if (entry.is_regular_file(code) && entry.path().extension() == ".json")
+            manifests.push_back(entry.path().string());
+    }
+    if (code)
+    {
+        error = "Cannot list " + path + ": " + code.message();
+        return false;
+    }
+
+    std::sort(manifests.begin(), manifests.end());
+    for (const std::string &manifest : manifests)
+    {
+        if (!LoadJobManifest(manifest, jobs, foreign, error) && !foreign)
+            return false;
+    }
+    return true;
+}
+
+std::string GetJobCheckpointPath(const RenderJob &job)
+{
+    return job.OutputPath + ".checkpoint";
+}
+
+/**
+ * @brief Renders a queue of jobs, several at a time when they are small.
+ *
+ * Jobs run in order of priority. Each one gets a share of the threads that grows with its pixel count, up to
+ * all of them, and runs on its own thread with an OpenMP team of that size. Jobs are started as long as the
+ * threads they need are free, so a small image that would leave most cores waiting at every frame's end
+ * shares the machine with other jobs instead. A job waiting for threads holds back the jobs after it, which
+ * keeps large jobs from being starved by a stream of small ones.
+ *
+ * Progress is kept on disk: a job whose image exists is done and skipped, and a running job is checkpointed
+ * next to its image, so running the queue again after a crash or SIGINT resumes the unfinished jobs where
+ * their last checkpoint left off. On SIGINT or SIGTERM, running jobs are checkpointed and no new job starts.
+ *
+ * @param jobs The jobs to render.
+ * @param settings The threads and checkpoint interval of the queue.
+ * @param status Output parameter for a summary of the jobs run.
+ * @return bool Returns true if every job was rendered or skipped; otherwise, returns false.
+ */
+bool RunJobQueue(std::vector<RenderJob> jobs, const JobQueueSettings &settings, std::string &status)
+{
+    std::stable_sort(jobs.begin(), jobs.end(), [](const RenderJob &a, const RenderJob &b)
+                     { return a.Priority > b.Priority; });
+
+    SelectTunedKernels();
+
+    const int threadCount = settings.ThreadCount > 0 ? settings.ThreadCount : omp_get_max_threads();
+    int freeThreads = threadCount;
+    uint32_t finished = 0, skipped = 0, failed = 0, interrupted = 0;
+    std::mutex mutex;
+    std::condition_variable jobDone;
+    std::vector<std::thread> threads;
+
+    s_StopRequested = 0;
+    auto previousInterrupt = std::signal(SIGINT, RequestStop);
+    auto previousTerminate = std::signal(SIGTERM, RequestStop);
+
+    for (size_t i = 0; i < jobs.size() && !s_StopRequested; i++)
+    {
+        const RenderJob &job = jobs[i];
+        if (std::filesystem::exists(job.OutputPath))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::fprintf(stderr, "[%s] skipped, %s exists\n", job.Name.c_str(), job.OutputPath.c_str());
+            skipped++;
+            continue;
+        }
+        if (job.Settings.Width == 0 || job.Settings.Height == 0 || job.Settings.Frames == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::fprintf(stderr, "[%s] failed, the image size and samples must not be 0\n", job.Name.c_str());
+            failed++;
+            continue;
+        }
+
+        // Signals cannot wake the condition, so waiting stops to check for them
+        const int jobThreads = GetRenderThreadShare(job.Settings.Width, job.Settings.Height, settings.PixelsPerThread, threadCount);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (freeThreads < jobThreads && !s_StopRequested)
+            jobDone.wait_for(lock, std::chrono::milliseconds(100));
+        if (s_StopRequested)
+            break;
+
+        freeThreads -= jobThreads;
+        std::fprintf(stderr, "[%s] started on %d threads\n", job.Name.c_str(), jobThreads);
+        threads.emplace_back([&, jobThreads]()
+                             {
+            std::string jobStatus;
+            const JobResult result = RunJob(job, jobThreads, settings.CheckpointInterval, jobStatus);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            std::fprintf(stderr, "[%s] %s\n", job.Name.c_str(), jobStatus.c_str());
+            finished += result == JobResult::Finished;
+            interrupted += result == JobResult::Interrupted;
+            failed += result == JobResult::Failed;
+            freeThreads += jobThreads;
+            jobDone.notify_all(); });
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    std::signal(SIGINT, previousInterrupt);
+    std::signal(SIGTERM, previousTerminate);
+
+    const size_t unstarted = jobs.size() - finished - skipped - failed - interrupted;
+    status = std::to_string(finished) + " rendered, " + std::to_string(skipped) + " skipped, " + std::to_string(failed) + " failed";
+    if (interrupted + unstarted > 0)
+        status += ", " + std::to_string(interrupted + unstarted) + " left for the next run";
+    return failed == 0 && interrupted + unstarted == 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Headless.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JsonReader;
+
+/*
+ * Job manifests are JSON documents listing the stills to render:
+ *
+ * {
+ *     "format": "raytracing-jobs",
+ *     "version": 1,
+ *     "jobs": [
+ *         {"name": "hero", "scene": "hero.json", "output": "hero.exr", "width": 1920, "height": 1080, "samples": 1024, "priority": 10},
+ *         {"scene": "hero.cache", "output": "thumbs/hero.exr", "width": 320, "height": 180, "samples": 256,
+ *          "samplesPerFrame": 4, "bounces": 8, "antialiasing": true, "camera": {"position": [13, 2, 3], "fov": 30}}
+ *     ]
+ * }
+ *
+ * "scene" and "output" are required, relative paths are relative to the manifest. "samples" is the target of
+ * samples per pixel, rendered in frames of "samplesPerFrame" samples. Jobs of higher "priority" run first, and
+ * jobs of the same priority in the order listed. The members of "camera", as in scene files, replace those of
+ * the scene's camera. Other members default to the job settings of `--render`, and unknown ones are skipped.
+ */
+
+constexpr int JobManifestVersion = 1;
+
+// Members of the scene's camera replaced by a job
+enum JobCameraMember : uint32_t
+{
+    JobCameraPosition = 1 << 0,
+    JobCameraDirection = 1 << 1,
+    JobCameraFOV = 1 << 2,
+    JobCameraAperture = 1 << 3,
+    JobCameraFocusDistance = 1 << 4,
+};
+
+// A still rendered by the job queue
+struct RenderJob
+{
+    std::string Name; // Shown in the queue's messages, the output path unless named
+    std::string ScenePath;
+    std::string OutputPath; // EXR image, with the job's checkpoint next to it while it runs
+    RenderJobSettings Settings;
+    int Priority = 0;
+
+    uint32_t CameraMembers = 0; // JobCameraMember mask of the camera settings below replacing the scene's
+    glm::vec3 CameraPosition{0.0f};
+    glm::vec3 CameraDirection{0.0f, 0.0f, -1.0f};
+    float VerticalFOV = 45.0f;
+    float Aperture = 0.0f;
+    float FocusDistance = 10.0f;
+};
+
+struct JobQueueSettings
+{
+    int ThreadCount = 0;              // Threads shared by the running jobs, 0 for one per core
+    uint32_t PixelsPerThread = 16384; // A job gets a thread per this many pixels, so small jobs run side by side
+    float CheckpointInterval = 60.0f; // Seconds between checkpoints of a running job
+};
+
+// Reads the "camera" member of a job, or of another document using the same members, such as a render request
+bool ReadJobCamera(JsonReader &reader, RenderJob &job);
+void ApplyJobCamera(const RenderJob &job, Camera &camera);
+
+// Appends the jobs of a manifest, or of every manifest (*.json) in a directory
+bool LoadJobQueue(const std::string &path, std::vector<RenderJob> &jobs, std::string &error);
+
+// Renders the jobs whose output does not exist yet, resuming the ones interrupted, until all are done or SIGINT/SIGTERM
+bool RunJobQueue(std::vector<RenderJob> jobs, const JobQueueSettings &settings, std::string &status);
+
+// Path of the checkpoint kept while a job runs
+std::string GetJobCheckpointPath(const RenderJob &job);
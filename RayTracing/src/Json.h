@@ -0,0 +1,346 @@
+#pragma once
+
+#include "TextParsing.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+
+// Nesting of skipped values deeper than this is rejected rather than risking the stack
+constexpr int MaxJsonSkipDepth = 256;
+
+/**
+ * @brief Pull parser reading JSON values straight from text, without building a document tree.
+ *
+ * Objects and arrays are read by calling back for every member or element, so values are stored into
+ * their final place as they are parsed. The first error is kept with its line number, and every read
+ * fails after it.
+ */
+class JsonReader
+{
+public:
+    JsonReader(const char *begin, const char *end) : m_Begin(begin), m_Position(begin), m_End(end) {}
+
+    const std::string &GetError() const { return m_Error; }
+
+    bool Fail(const char *message)
+    {
+        if (m_Error.empty())
+        {
+            const long line = 1 + static_cast<long>(std::count(m_Begin, m_Position, '\n'));
+            m_Error = "line " + std::to_string(line) + ": " + message;
+        }
+        return false;
+    }
+
+    char Peek()
+    {
+        while (m_Position < m_End && (*m_Position == ' ' || *m_Position == '\n' || *m_Position == '\r' || *m_Position == '\t'))
+            m_Position++;
+        return m_Position < m_End ? *m_Position : '\0';
+    }
+
+    bool Consume(char c)
+    {
+        if (Peek() != c)
+            return false;
+        m_Position++;
+        return true;
+    }
+
+    bool Expect(char c)
+    {
+        if (Consume(c))
+            return true;
+        const char message[] = {'e', 'x', 'p', 'e', 'c', 't', 'e', 'd', ' ', '\'', c, '\'', '\0'};
+        return Fail(message);
+    }
+
+    bool AtEnd()
+    {
+        return Peek() == '\0' && m_Position == m_End;
+    }
+
+    // Start of the next value, so the text of a value can be kept by skipping it between two calls
+    const char *GetPosition()
+    {
+        Peek();
+        return m_Position;
+    }
+
+    // Calls member(key) for every member of an object, which must read the member's value
+    template <typename Member>
+    bool ReadObject(Member &&member)
+    {
+        if (!Expect('{'))
+            return false;
+        if (Consume('}'))
+            return true;
+        do
+        {
+            if (!ReadString(m_Key) || !Expect(':') || !member(m_Key))
+                return false;
+        } while (Consume(','));
+        return Expect('}');
+    }
+
+    // Calls element() for every element of an array, which must read the element
+    template <typename Element>
+    bool ReadArray(Element &&element)
+    {
+        if (!Expect('['))
+            return false;
+        if (Consume(']'))
+            return true;
+        do
+        {
+            if (!element())
+                return false;
+        } while (Consume(','));
+        return Expect(']');
+    }
+
+    bool ReadString(std::string &value)
+    {
+        if (!Expect('"'))
+            return false;
+        value.clear();
+        while (true)
+        {
+            const char *start = m_Position;
+            while (m_Position < m_End && *m_Position != '"' && *m_Position != '\\')
+                m_Position++;
+            value.append(start, m_Position);
+            if (m_Position >= m_End)
+                return Fail("unterminated string");
+            if (*m_Position++ == '"')
+                return true;
+            if (m_Position >= m_End)
+                return Fail("unterminated string");
+
+            const char escape = *m_Position++;
+            switch (escape)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                value += escape;
+                break;
+            case 'b':
+                value += '\b';
+                break;
+            case 'f':
+                value += '\f';
+                break;
+            case 'n':
+                value += '\n';
+                break;
+            case 'r':
+                value += '\r';
+                break;
+            case 't':
+                value += '\t';
+                break;
+            case 'u':
+            {
+                unsigned int code = 0;
+                if (m_End - m_Position < 4 || std::from_chars(m_Position, m_Position + 4, code, 16).ptr != m_Position + 4)
+                    return Fail("invalid \\u escape");
+                m_Position += 4;
+                // Characters outside the basic multilingual plane are written as two separate surrogates
+                if (code < 0x80)
+                    value += static_cast<char>(code);
+                else if (code < 0x800)
+                {
+                    value += static_cast<char>(0xC0 | (code >> 6));
+                    value += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    value += static_cast<char>(0xE0 | (code >> 12));
+                    value += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    value += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return Fail("invalid escape in string");
+            }
+        }
+    }
+
+    bool ReadFloat(float &value)
+    {
+        Peek();
+        return ParseFloat(m_Position, m_End, value) || Fail("expected a number");
+    }
+
+    bool ReadInteger(long long &value)
+    {
+        Peek();
+        if (!ParseInteger(m_Position, m_End, value))
+            return Fail("expected an integer");
+        if (m_Position < m_End && (*m_Position == '.' || *m_Position == 'e' || *m_Position == 'E'))
+            return Fail("expected an integer");
+        return true;
+    }
+
+    // Reads a count, such as a size or a number of samples: an integer from 1 to INT_MAX
+    bool ReadCount(uint32_t &value)
+    {
+        long long number;
+        if (!ReadInteger(number))
+            return false;
+        if (number <= 0 || number > std::numeric_limits<int>::max())
+            return Fail("expected a positive integer");
+        value = static_cast<uint32_t>(number);
+        return true;
+    }
+
+    bool ReadBool(bool &value)
+    {
+        value = Peek() == 't';
+        return ReadLiteral(value ? "true" : "false");
+    }
+
+    bool ReadVec3(glm::vec3 &value)
+    {
+        return Expect('[') && ReadFloat(value.x) && Expect(',') && ReadFloat(value.y) && Expect(',') && ReadFloat(value.z) && Expect(']');
+    }
+
+    // Skips a value of any type, such as the value of an unknown member
+    bool SkipValue(int depth = 0)
+    {
+        if (depth > MaxJsonSkipDepth)
+            return Fail("values nested too deeply");
+
+        switch (Peek())
+        {
+        case '{':
+            return ReadObject([&](const std::string &)
+                              { return SkipValue(depth + 1); });
+        case '[':
+            return ReadArray([&]()
+                             { return SkipValue(depth + 1); });
+        case '"':
+        {
+            std::string ignored;
+            return ReadString(ignored);
+        }
+        case 't':
+            return ReadLiteral("true");
+        case 'f':
+            return ReadLiteral("false");
+        case 'n':
+            return ReadLiteral("null");
+        default:
+        {
+            float ignored;
+            return ReadFloat(ignored);
+        }
+        }
+    }
+
+private:
+    bool ReadLiteral(const char *literal)
+    {
+        const size_t length = std::strlen(literal);
+        if (static_cast<size_t>(m_End - m_Position) < length || std::memcmp(m_Position, literal, length) != 0)
+            return Fail("unexpected value");
+        m_Position += length;
+        return true;
+    }
+
+private:
+    const char *m_Begin;
+    const char *m_Position;
+    const char *m_End;
+    std::string m_Key;
+    std::string m_Error;
+};
+
+// Buffered writer of JSON text, formatting numbers with the shortest text that reads back the same
+class JsonWriter
+{
+public:
+    explicit JsonWriter(FILE *file) : m_File(file) { m_Buffer.reserve(BufferSize + 256); }
+    ~JsonWriter() { Flush(); }
+
+    JsonWriter &operator<<(const char *text)
+    {
+        m_Buffer += text;
+        return FlushIfFull();
+    }
+
+    JsonWriter &operator<<(float value)
+    {
+        char number[32];
+        const auto result = std::to_chars(number, number + sizeof(number), value);
+        m_Buffer.append(number, result.ptr);
+        return FlushIfFull();
+    }
+
+    JsonWriter &operator<<(long long value)
+    {
+        char number[32];
+        const auto result = std::to_chars(number, number + sizeof(number), value);
+        m_Buffer.append(number, result.ptr);
+        return FlushIfFull();
+    }
+
+    JsonWriter &operator<<(const glm::vec3 &value)
+    {
+        return *this << "[" << value.x << ", " << value.y << ", " << value.z << "]";
+    }
+
+    void WriteString(const std::string &value)
+    {
+        m_Buffer += '"';
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                m_Buffer += '\\';
+                m_Buffer += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                m_Buffer += escape;
+            }
+            else
+                m_Buffer += c;
+        }
+        m_Buffer += '"';
+        FlushIfFull();
+    }
+
+    bool Flush()
+    {
+        const bool written = fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File) == m_Buffer.size();
+        m_Buffer.clear();
+        m_Failed |= !written;
+        return !m_Failed;
+    }
+
+private:
+    static constexpr size_t BufferSize = 1 << 20;
+
+    JsonWriter &FlushIfFull()
+    {
+        if (m_Buffer.size() >= BufferSize)
+            Flush();
+        return *this;
+    }
+
+private:
+    FILE *m_File;
+    std::string m_Buffer;
+    bool m_Failed = false;
+};
@@ -0,0 +1,173 @@
+#include "Kernels.h"
+
+#include <glm/glm.hpp>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+
+#if defined(RAYTRACING_X86_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Exported by the per ISA builds of Kernels/KernelsImpl.cpp
+extern const KernelTable BaselineKernels;
+#ifdef RAYTRACING_X86_KERNELS
+extern const KernelTable SSE42Kernels;
+extern const KernelTable AVX2Kernels;
+extern const KernelTable AVX512Kernels;
+#endif
+
+const KernelTable *g_Kernels = &BaselineKernels;
+
+// The kernels read glm vectors and matrices as plain floats
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float) && sizeof(glm::vec4) == 4 * sizeof(float), "glm vectors must be tightly packed");
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "glm matrices must be tightly packed");
+
+namespace
+{
+    KernelISA s_KernelISA = KernelISA::Baseline;
+
+    const KernelTable *GetKernelTable(KernelISA isa)
+    {
+        switch (isa)
+        {
+#ifdef RAYTRACING_X86_KERNELS
+        case KernelISA::SSE42:
+            return &SSE42Kernels;
+        case KernelISA::AVX2:
+            return &AVX2Kernels;
+        case KernelISA::AVX512:
+            return &AVX512Kernels;
+#endif
+        default:
+            return &BaselineKernels;
+        }
+    }
+
+#if defined(RAYTRACING_X86_KERNELS) && defined(_MSC_VER)
+    bool HasCPUFeatures(KernelISA isa)
+    {
+        int info[4];
+        __cpuid(info, 1);
+        const bool sse42 = (info[2] & (1 << 20)) && (info[2] & (1 << 23)); // SSE4.2, POPCNT
+        const bool fma = info[2] & (1 << 12);
+        const bool osxsave = info[2] & (1 << 27);
+        if (isa == KernelISA::SSE42)
+            return sse42;
+        if (!osxsave)
+            return false;
+
+        // The OS must save the AVX (and AVX-512) register state on context switches
+        const unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        if (isa == KernelISA::AVX2)
+            return (xcr0 & 0x06) == 0x06 && (info[1] & (1 << 5)) && fma;
+
+        const int avx512 = (1 << 16) | (1 << 17) | (1 << 30) | (1 << 31); // F, DQ, BW, VL
+        return (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 5)) && fma && (info[1] & avx512) == avx512;
+    }
+#elif defined(RAYTRACING_X86_KERNELS)
+    bool HasCPUFeatures(KernelISA isa)
+    {
+        __builtin_cpu_init();
+        switch (isa)
+        {
+        case KernelISA::SSE42:
+            return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+        case KernelISA::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case KernelISA::AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+                   __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") &&
+                   __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        default:
+            return true;
+        }
+    }
+#endif
+
+    /**
+     * @brief Picks the kernels for this process: the ISA named by RAYTRACING_ISA if the CPU supports it,
+     * otherwise the best supported one.
+     */
+    bool SelectStartupKernels()
+    {
+        if (const char *requested = std::getenv("RAYTRACING_ISA"))
+        {
+            std::string name = requested;
+            for (char &c : name)
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+            const char *names[KernelISACount] = {"baseline", "sse4.2", "avx2", "avx512"};
+            for (int i = 0; i < KernelISACount; i++)
+            {
+                if (name == names[i] && SetKernelISA(static_cast<KernelISA>(i)))
+                    return true;
+            }
+        }
+
+        for (int i = KernelISACount - 1; i > 0; i--)
+        {
+            if (SetKernelISA(static_cast<KernelISA>(i)))
+                return true;
+        }
+        return SetKernelISA(KernelISA::Baseline);
+    }
+
+    const bool s_StartupKernelsSelected = SelectStartupKernels();
+}
+
+const char *GetKernelISAName(KernelISA isa)
+{
+    switch (isa)
+    {
+    case KernelISA::Baseline:
+#ifdef RAYTRACING_X86_KERNELS
+        return "SSE2";
+#else
+        return "Baseline";
+#endif
+    case KernelISA::SSE42:
+        return "SSE4.2";
+    case KernelISA::AVX2:
+        return "AVX2";
+    case KernelISA::AVX512:
+        return "AVX-512";
+    }
+    return "Unknown";
+}
+
+bool IsKernelISASupported(KernelISA isa)
+{
+    if (isa == KernelISA::Baseline)
+        return true;
+
+#ifdef RAYTRACING_X86_KERNELS
+    return HasCPUFeatures(isa);
+#else
+    return false;
+#endif
+}
+
+KernelISA GetKernelISA()
+{
+    return s_KernelISA;
+}
+
+/**
+ * @brief Switches every kernel to the build for the given instruction set.
+ *
+ * Must not be called while rendering.
+ *
+ * @param isa The instruction set to use.
+ * @return bool Returns false, leaving the kernels unchanged, if the CPU (or this build) does not support it.
+ */
+bool SetKernelISA(KernelISA isa)
+{
+    if (!IsKernelISASupported(isa))
+        return false;
+
+    s_KernelISA = isa;
+    g_Kernels = GetKernelTable(isa);
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "RayPacketLanes.h"
+
+#include <cstdint>
+
+enum class KernelISA
+{
+    Baseline = 0, // SSE2 on x86-64
+    SSE42,
+    AVX2,
+    AVX512,
+};
+constexpr int KernelISACount = 4;
+
+/**
+ * @brief Data parallel kernels built once per instruction set.
+ *
+ * `Kernels/KernelsImpl.cpp` is compiled separately for every ISA level with the matching compiler flags
+ * (see RayTracing/CMakeLists.txt), and each build exports one of these tables. At startup the best table
+ * supported by the CPU is selected, unless the `RAYTRACING_ISA` environment variable names another one
+ * (baseline, sse4.2, avx2 or avx512). It can also be changed at runtime with `SetKernelISA`.
+ *
+ * The kernels take plain floats rather than glm types, so the per ISA builds include no header with inline
+ * functions. The linker keeps one copy of each inline function for the whole program, and it could be the
+ * copy compiled for AVX-512 that the rest of the program calls. Vectors are passed as their components, 3
+ * floats for a glm::vec3 and 4 for a glm::vec4, and matrices as the 16 floats of their columns, as glm stores
+ * them.
+ */
+struct KernelTable
+{
+    // Mask of the active lanes overlapping the box from boxMin to boxMax inside [tMin, TMax[lane]]
+    uint32_t (*IntersectPacketBox)(const RayPacketLanes &packet, const float *boxMin, const float *boxMax, float tMin);
+
+    // Mask of the lanes in `mask` hitting the sphere inside (tMin, TMax[lane]), with their hit distances in `distances`
+    uint32_t (*IntersectPacketSphere)(const RayPacketLanes &packet, uint32_t mask, const float *center, float radius, float tMin, float *distances);
+
+    // Camera ray directions (vec3) through the pixels of row `y` of the viewport
+    void (*ComputeRayDirections)(const float *inverseProjection, const float *inverseView, uint32_t width, uint32_t height, uint32_t y, float *directions);
+
+    // Adds a span of new samples (vec4) to the accumulation buffer, if accumulating, and writes the resolved pixels
+    void (*ResolveSpan)(const float *colors, float *accumulation, uint32_t *image, uint32_t count, uint32_t frameIndex, bool accumulate);
+};
+
+// The table of the selected ISA
+extern const KernelTable *g_Kernels;
+
+const char *GetKernelISAName(KernelISA isa);
+bool IsKernelISASupported(KernelISA isa);
+KernelISA GetKernelISA();
+bool SetKernelISA(KernelISA isa);
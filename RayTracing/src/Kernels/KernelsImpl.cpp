@@ -0,0 +1,127 @@
+// Compiled once per instruction set, see Kernels.h. KERNEL_TABLE names the table exported by this build.
+// Only plain data headers may be included here: an inline function used in this file could be the copy the
+// linker keeps for the whole program, and run on CPUs without the instruction set.
+#include "Kernels.h"
+
+#include <math.h>
+
+#ifndef KERNEL_TABLE
+#error "KERNEL_TABLE must be defined to the name of the kernel table to export"
+#endif
+
+namespace
+{
+    // Lanes are processed in fixed size loops so they vectorize to the full width of the target ISA.
+    // Unused lanes hold zeros and are masked off afterwards.
+
+    // Same as glm::min and glm::max, including which operand a NaN gives back
+    float Min(float x, float y) { return y < x ? y : x; }
+    float Max(float x, float y) { return x < y ? y : x; }
+
+    uint32_t PackLanes(const bool *lanes)
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < RayPacketLanes::MaxSize; i++)
+            mask |= uint32_t(lanes[i]) << i;
+        return mask;
+    }
+
+    uint32_t IntersectPacketBox(const RayPacketLanes &packet, const float *boxMin, const float *boxMax, float tMin)
+    {
+        bool hits[RayPacketLanes::MaxSize];
+        for (int i = 0; i < RayPacketLanes::MaxSize; i++)
+        {
+            float t0x = (boxMin[0] - packet.OriginX[i]) * packet.InvDirectionX[i], t1x = (boxMax[0] - packet.OriginX[i]) * packet.InvDirectionX[i];
+            float t0y = (boxMin[1] - packet.OriginY[i]) * packet.InvDirectionY[i], t1y = (boxMax[1] - packet.OriginY[i]) * packet.InvDirectionY[i];
+            float t0z = (boxMin[2] - packet.OriginZ[i]) * packet.InvDirectionZ[i], t1z = (boxMax[2] - packet.OriginZ[i]) * packet.InvDirectionZ[i];
+
+            float tEntry = Max(Max(Min(t0x, t1x), Min(t0y, t1y)), Max(Min(t0z, t1z), tMin));
+            float tExit = Min(Min(Max(t0x, t1x), Max(t0y, t1y)), Min(Max(t0z, t1z), packet.TMax[i]));
+            hits[i] = tEntry <= tExit;
+        }
+        return PackLanes(hits) & packet.ActiveMask;
+    }
+
+    // Same quadratic as Sphere::hit, solved for every lane at once
+    uint32_t IntersectPacketSphere(const RayPacketLanes &packet, uint32_t mask, const float *center, float radius, float tMin, float *distances)
+    {
+        bool hits[RayPacketLanes::MaxSize];
+        for (int i = 0; i < RayPacketLanes::MaxSize; i++)
+        {
+            float ox = packet.OriginX[i] - center[0], oy = packet.OriginY[i] - center[1], oz = packet.OriginZ[i] - center[2];
+            float dx = packet.DirectionX[i], dy = packet.DirectionY[i], dz = packet.DirectionZ[i];
+
+            float a = dx * dx + dy * dy + dz * dz;
+            float b = 2.0f * (ox * dx + oy * dy + oz * dz);
+            float c = ox * ox + oy * oy + oz * oz - radius * radius;
+            float discriminant = b * b - 4.0f * a * c;
+
+            float root = sqrtf(Max(discriminant, 0.0f));
+            float tNear = (-b - root) / (2.0f * a);
+            float tFar = (-b + root) / (2.0f * a);
+
+            bool hitNear = discriminant >= 0.0f && tNear > tMin && tNear < packet.TMax[i];
+            bool hitFar = discriminant >= 0.0f && tFar > tMin && tFar < packet.TMax[i];
+            distances[i] = hitNear ? tNear : tFar;
+            hits[i] = hitNear || hitFar;
+        }
+        return PackLanes(hits) & mask;
+    }
+
+    // Component `row` of a column major 4x4 matrix times a vector, summed in the order glm sums it
+    float TransformRow(const float *matrix, int row, float x, float y, float z, float w)
+    {
+        return (matrix[row] * x + matrix[4 + row] * y) + (matrix[8 + row] * z + matrix[12 + row] * w);
+    }
+
+    // Same as Camera::CalculateRayDirection, for a whole row
+    void ComputeRayDirections(const float *inverseProjection, const float *inverseView, uint32_t width, uint32_t height, uint32_t y, float *directions)
+    {
+        const float coordY = (float)y / (float)height * 2.0f - 1.0f;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const float coordX = (float)x / (float)width * 2.0f - 1.0f;
+
+            float target[4];
+            for (int row = 0; row < 4; row++)
+                target[row] = TransformRow(inverseProjection, row, coordX, coordY, 1.0f, 1.0f);
+            const float px = target[0] / target[3], py = target[1] / target[3], pz = target[2] / target[3];
+            const float scale = 1.0f / sqrtf(px * px + py * py + pz * pz);
+            const float nx = px * scale, ny = py * scale, nz = pz * scale;
+
+            float *direction = directions + 3 * x; // World space
+            for (int row = 0; row < 3; row++)
+                direction[row] = TransformRow(inverseView, row, nx, ny, nz, 0.0f);
+        }
+    }
+
+    // Same as Utils::ConvertToRGBA, after clamping the color
+    void ResolveSpan(const float *colors, float *accumulation, uint32_t *image, uint32_t count, uint32_t frameIndex, bool accumulate)
+    {
+        const float scale = 1.0f / (float)frameIndex;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t channels[4];
+            for (int c = 0; c < 4; c++)
+            {
+                float color = colors[4 * i + c];
+                if (accumulate)
+                {
+                    accumulation[4 * i + c] += color;
+                    color = accumulation[4 * i + c] * scale;
+                }
+
+                color = Min(Max(color, 0.0f), 1.0f);
+                channels[c] = (uint8_t)(powf(color, 1.0f / 2.2f) * 255.0f);
+            }
+            image[i] = (channels[3] << 24) | (channels[2] << 16) | (channels[1] << 8) | channels[0];
+        }
+    }
+}
+
+extern const KernelTable KERNEL_TABLE = {
+    IntersectPacketBox,
+    IntersectPacketSphere,
+    ComputeRayDirections,
+    ResolveSpan,
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Read only memory mapping of a whole file.
+ *
+ * Pages are read from disk on first access and shared with the OS file cache, so large files can be parsed
+ * in place, by several threads at once, without copying them into memory first.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool Open(const std::string &path);
+    void Close();
+
+    bool IsOpen() const { return m_Open; }
+    const char *GetData() const { return static_cast<const char *>(m_Data); }
+    size_t GetSize() const { return m_Size; }
+
+private:
+    void *m_Data = nullptr;
+    size_t m_Size = 0;
+    bool m_Open = false;
+#ifdef _WIN32
+    void *m_File = nullptr;
+    void *m_Mapping = nullptr;
+#endif
+};
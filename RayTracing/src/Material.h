@@ -6,11 +6,119 @@
 
 #include "Utils.h"
 
+enum class MaterialType : uint32_t
+{
+    Lambertian = 0,
+    Metal,
+    Dielectric,
+};
+
+/**
+ * @brief Flattened parameters of a material, as read by the renderer.
+ *
+ * Every material of a scene is copied into a tightly packed table of these (see `Scene::MaterialTable`), so
+ * shading a hit is an indexed load and a switch on `Type` instead of a pointer chase and a virtual call.
+ * Parameters that do not apply to `Type` are ignored.
+ */
+struct MaterialData
+{
+    glm::vec3 Albedo{1.0f};
+    MaterialType Type = MaterialType::Lambertian;
+    float Roughness = 1.0f;
+    float Fuzz = 0.0f;
+    float IndexOfRefraction = 1.5f;
+    float Padding = 0.0f;
+
+    // True if scatter reflects deterministically, so coherent incoming rays stay coherent after the bounce
+    bool IsSpecular() const { return Type == MaterialType::Metal && Fuzz == 0.0f; }
+};
+static_assert(sizeof(MaterialData) == 32, "MaterialData should stay 32 bytes");
+
+/**
+ * @brief Uses Schlick's approximation for the reflectance of a dielectric.
+ */
+inline float SchlickReflectance(float cosine, float refIdx)
+{
+    auto r0 = (1 - refIdx) / (1 + refIdx);
+    r0 = r0 * r0;
+    return r0 + (1 - r0) * pow((1 - cosine), 5);
+}
+
+/**
+ * @brief Determines how a ray scatters when it hits an object with the given material.
+ *
+ * Lambertian materials scatter around the normal at the hit point: the scattered direction is the normal
+ * plus a random unit vector scaled by the roughness, or the normal itself if that sum is close to zero.
+ *
+ * Metal materials reflect the incoming direction about the normal and add a random vector within a unit
+ * sphere scaled by the fuzziness. The ray is absorbed if the result points below the surface.
+ *
+ * Dielectric materials refract the ray following Snell's law, or reflect it if it cannot refract or
+ * with a probability given by their reflectance. They never attenuate the ray.
+ *
+ * @tparam DiffuseOnly If true, every material is assumed to be Lambertian and the other cases compile out.
+ * @param material The material of the object hit.
+ * @param rayIn The incoming ray.
+ * @param payload The hit payload containing information about the hit.
+ * @param attenuation Output parameter for the attenuation of the ray's color.
+ * @param scatteredDirection Output parameter for the direction of the scattered ray.
+ * @return bool Returns true if the ray is scattered; otherwise (the ray is absorbed), returns false.
+ */
+template <bool DiffuseOnly = false>
+inline bool ScatterMaterial(const MaterialData &material, const Ray &rayIn, const HitPayload &payload, glm::vec3 &attenuation, glm::vec3 &scatteredDirection)
+{
+    switch (DiffuseOnly ? MaterialType::Lambertian : material.Type)
+    {
+    case MaterialType::Lambertian:
+    {
+        glm::vec3 scatteredDirectionTemp = payload.normal + material.Roughness * Utils::UnitVector();
+        if (glm::all(glm::lessThan(glm::abs(scatteredDirectionTemp), glm::vec3(1e-8))))
+        {
+            scatteredDirectionTemp = payload.normal;
+        }
+        scatteredDirection = scatteredDirectionTemp;
+        attenuation = material.Albedo;
+        return true;
+    }
+    case MaterialType::Metal:
+    {
+        glm::vec3 reflected = glm::reflect(glm::normalize(rayIn.Direction), payload.normal);
+        scatteredDirection = material.Fuzz > 0.0f ? reflected + material.Fuzz * Utils::InUnitSphere() : reflected;
+        attenuation = material.Albedo;
+        return glm::dot(scatteredDirection, payload.normal) > 0;
+    }
+    case MaterialType::Dielectric:
+    {
+        attenuation = glm::vec3(1.0, 1.0, 1.0);
+        float refraction_ratio = payload.frontFace ? (1.0 / material.IndexOfRefraction) : material.IndexOfRefraction;
+
+        glm::vec3 unit_direction = glm::normalize(rayIn.Direction);
+        float cos_theta = fmin(glm::dot(-unit_direction, payload.normal), 1.0);
+        float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+
+        bool cannot_refract = refraction_ratio * sin_theta > 1.0;
+
+        if (cannot_refract || SchlickReflectance(cos_theta, refraction_ratio) > Utils::RandomFloat())
+            scatteredDirection = glm::reflect(unit_direction, payload.normal);
+        else
+            scatteredDirection = glm::refract(unit_direction, payload.normal, refraction_ratio);
+        return true;
+    }
+    }
+    return false;
+}
+
+/**
+ * @brief Editable material, shown in the UI.
+ *
+ * Materials are only edited through these classes. The renderer reads their flattened copies in the scene's
+ * material table, which must be updated with `Scene::UpdateMaterial` whenever a material changes.
+ */
 class Material
 {
 public:
     virtual ~Material() = default;
-    virtual bool scatter(Ray rayIn, HitPayload &payload, glm::vec3 &attenuation, glm::vec3 &scatteredDirection) const = 0;
+    virtual MaterialData GetData() const = 0;
     virtual bool RenderObjectOptions() { return false; }
     std::string Name;
 };
@@ -20,36 +128,13 @@ class Lambertian : public Material
 public:
     Lambertian(const std::string &name) : Name(name){};
 
-    /**
-     * @brief Determines how a ray scatters when it hits an object with this material.
-     *
-     * This function is called when a ray hits an object with this material. It calculates the direction
-     * in which the ray is scattered and the attenuation of the ray's color.
-     *
-     * The direction of the scattered ray is determined by adding a random unit vector (scaled by the
-     * material's roughness) to the normal of the hit point. If the resulting direction is too close to
-     * zero, the normal is used as the direction.
-     *
-     * The color of the scattered ray is determined by the material's albedo.
-     *
-     * @param rayIn The incoming ray.
-     * @param payload The hit payload containing information about the hit.
-     * @param attenuation Output parameter for the attenuation of the ray's color.
-     * @param scatteredDirection Output parameter for the direction of the scattered ray.
-     * @return bool Always returns true, indicating that the ray is always scattered.
-     */
-    bool scatter(Ray rayIn, HitPayload &payload, glm::vec3 &attenuation, glm::vec3 &scatteredDirection) const override
+    MaterialData GetData() const override
     {
-
-        glm::vec3 scatteredDirectionTemp = payload.normal + Roughness * Utils::UnitVector();
-        if (glm::all(glm::lessThan(glm::abs(scatteredDirectionTemp), glm::vec3(1e-8))))
-        {
-            scatteredDirectionTemp = payload.normal;
-        }
-        scatteredDirection = scatteredDirectionTemp;
-
-        attenuation = Albedo;
-        return true;
+        MaterialData data;
+        data.Type = MaterialType::Lambertian;
+        data.Albedo = Albedo;
+        data.Roughness = Roughness;
+        return data;
     }
 
     bool RenderObjectOptions() override
@@ -70,33 +155,13 @@ class Metal : public Material
 public:
     Metal(const std::string &name) : Name(name){};
 
-    /**
-     * @brief Determines how a ray scatters when it hits an object with this material.
-     *
-     * This function is called when a ray hits an object with this material. It calculates the direction
-     * in which the ray is scattered and the attenuation of the ray's color. This implementation handles
-     * reflection based on the material's fuzziness.
-     *
-     * The direction of the scattered ray is determined by reflecting the incoming ray's direction about
-     * the normal at the hit point, then adding a random vector within a unit sphere scaled by the
-     * material's fuzziness.
-     *
-     * The color of the scattered ray is determined by the material's albedo.
-     *
-     * @param rayIn The incoming ray.
-     * @param payload The hit payload containing information about the hit.
-     * @param attenuation Output parameter for the attenuation of the ray's color. Set to the material's albedo.
-     * @param scatteredDirection Output parameter for the direction of the scattered ray.
-     * @return bool Returns true if the scattered ray is in the same hemisphere as the normal at the hit point; otherwise, returns false.
-     */
-    bool scatter(Ray rayIn, HitPayload &payload, glm::vec3 &attenuation, glm::vec3 &scatteredDirection)
-        const override
+    MaterialData GetData() const override
     {
-        glm::vec3 reflected = glm::reflect(glm::normalize(rayIn.Direction), payload.normal);
-        glm::vec3 scatteredDirectionTemp = reflected + Fuzz * Utils::InUnitSphere();
-        scatteredDirection = scatteredDirectionTemp;
-        attenuation = Albedo;
-        return glm::dot(scatteredDirection, payload.normal) > 0;
+        MaterialData data;
+        data.Type = MaterialType::Metal;
+        data.Albedo = Albedo;
+        data.Fuzz = Fuzz;
+        return data;
     }
 
     bool RenderObjectOptions() override
@@ -116,45 +181,12 @@ class Dielectric : public Material
 public:
     Dielectric(const std::string &name) : Name(name){};
 
-    /**
-     * @brief Determines how a ray scatters when it hits an object with this material.
-     *
-     * This function is called when a ray hits an object with this material. It calculates the direction
-     * in which the ray is scattered and the attenuation of the ray's color. This implementation handles
-     * refraction and reflection based on the material's index of refraction.
-     *
-     * The direction of the scattered ray is determined by whether the ray can refract (based on Snell's law)
-     * and the reflectance of the material. If the ray cannot refract or the reflectance is greater than a
-     * random value, the ray is reflected; otherwise, it is refracted.
-     *
-     * The color of the scattered ray is always white (i.e., no color attenuation).
-     *
-     * @param rayIn The incoming ray.
-     * @param payload The hit payload containing information about the hit.
-     * @param attenuation Output parameter for the attenuation of the ray's color. Always set to white.
-     * @param scatteredDirection Output parameter for the direction of the scattered ray.
-     * @return bool Always returns true, indicating that the ray is always scattered.
-     */
-    bool scatter(Ray rayIn, HitPayload &payload, glm::vec3 &attenuation, glm::vec3 &scatteredDirection)
-        const override
+    MaterialData GetData() const override
     {
-        attenuation = glm::vec3(1.0, 1.0, 1.0);
-        float refraction_ratio = payload.frontFace ? (1.0 / IndexOfRefraction) : IndexOfRefraction;
-
-        glm::vec3 unit_direction = glm::normalize(rayIn.Direction);
-        float cos_theta = fmin(glm::dot(-unit_direction, payload.normal), 1.0);
-        float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
-
-        bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-        glm::vec3 direction;
-
-        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > Utils::RandomFloat())
-            direction = glm::reflect(unit_direction, payload.normal);
-        else
-            direction = glm::refract(unit_direction, payload.normal, refraction_ratio);
-
-        scatteredDirection = direction;
-        return true;
+        MaterialData data;
+        data.Type = MaterialType::Dielectric;
+        data.IndexOfRefraction = IndexOfRefraction;
+        return data;
     }
 
     bool RenderObjectOptions() override
@@ -166,13 +198,4 @@ public:
 
     std::string Name;
     float IndexOfRefraction = 1.5f;
-
-private:
-    static float reflectance(float cosine, float ref_idx)
-    {
-        // Use Schlick's approximation for reflectance.
-        auto r0 = (1 - ref_idx) / (1 + ref_idx);
-        r0 = r0 * r0;
-        return r0 + (1 - r0) * pow((1 - cosine), 5);
-    }
 };
@@ -0,0 +1,729 @@
+#include "MeshLoader.h"
+#include "MappedFile.h"
+#include "TextParsing.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    // Bytes of text parsed by one task. Big enough to amortize scheduling, small enough to balance threads.
+    constexpr size_t ChunkSize = 1 << 20;
+
+    // Normal index of OBJ face vertices without a normal
+    constexpr uint32_t MissingIndex = 0xFFFFFFFF;
+
+    bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char *SkipSpaces(const char *p, const char *end)
+    {
+        while (p < end && IsSpace(*p))
+            p++;
+        return p;
+    }
+
+    const char *NextLine(const char *p, const char *end)
+    {
+        const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        return newline ? newline + 1 : end;
+    }
+
+    // Splits text into chunks of about ChunkSize bytes that start at the beginning of a line
+    std::vector<size_t> SplitLines(const char *data, size_t size)
+    {
+        std::vector<size_t> starts{0};
+        for (size_t position = ChunkSize; position < size; position += ChunkSize)
+        {
+            position = NextLine(data + position, data + size) - data;
+            if (position >= size)
+                break;
+            starts.push_back(position);
+        }
+        starts.push_back(size);
+        return starts;
+    }
+
+    // Converts a one-based or negative (relative to the last defined) OBJ index to a zero-based one
+    bool ResolveIndex(long long index, size_t defined, size_t total, uint32_t &resolved)
+    {
+        const long long zeroBased = index > 0 ? index - 1 : static_cast<long long>(defined) + index;
+        if (index == 0 || zeroBased < 0 || zeroBased >= static_cast<long long>(total))
+            return false;
+        resolved = static_cast<uint32_t>(zeroBased);
+        return true;
+    }
+
+    // Element counts of a chunk of an OBJ file, then the index of its first element of each kind
+    struct OBJChunk
+    {
+        size_t Positions = 0, Normals = 0, Triangles = 0;
+        size_t FirstPosition = 0, FirstNormal = 0, FirstTriangle = 0;
+        bool MissingNormals = false;
+        std::string Error;
+    };
+
+    void CountOBJChunk(const char *p, const char *end, OBJChunk &chunk)
+    {
+        while (p < end)
+        {
+            const char *line = SkipSpaces(p, end);
+            p = NextLine(line, end);
+            if (end - line < 2)
+                continue;
+
+            if (line[0] == 'v' && IsSpace(line[1]))
+                chunk.Positions++;
+            else if (line[0] == 'v' && line[1] == 'n' && line + 2 < end && IsSpace(line[2]))
+                chunk.Normals++;
+            else if (line[0] == 'f' && IsSpace(line[1]))
+            {
+                size_t vertices = 0;
+                for (const char *s = line + 1; s < p && *s != '\n'; s++)
+                    vertices += IsSpace(s[-1]) && !IsSpace(*s) && *s != '\n';
+                if (vertices >= 3)
+                    chunk.Triangles += vertices - 2;
+            }
+        }
+    }
+
+    void ParseOBJChunk(const char *p, const char *end, OBJChunk &chunk, MeshBuffers &mesh, size_t totalNormals)
+    {
+        size_t position = chunk.FirstPosition, normal = chunk.FirstNormal, triangle = chunk.FirstTriangle;
+        const size_t totalPositions = mesh.Positions.size();
+
+        while (p < end)
+        {
+            const char *line = SkipSpaces(p, end);
+            const char *lineEnd = NextLine(line, end);
+            p = lineEnd;
+            if (lineEnd - line < 2)
+                continue;
+
+            if (line[0] == 'v' && (IsSpace(line[1]) || (line[1] == 'n' && line + 2 < lineEnd && IsSpace(line[2]))))
+            {
+                const bool isNormal = line[1] == 'n';
+                glm::vec3 value;
+                const char *s = line + (isNormal ? 2 : 1);
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    s = SkipSpaces(s, lineEnd);
+                    if (!ParseFloat(s, lineEnd, value[axis]))
+                    {
+                        chunk.Error = isNormal ? "Invalid vertex normal" : "Invalid vertex position";
+                        return;
+                    }
+                }
+                if (isNormal)
+                    mesh.Normals[normal++] = value;
+                else
+                    mesh.Positions[position++] = value;
+            }
+            else if (line[0] == 'f' && IsSpace(line[1]))
+            {
+                // Face vertices are `v`, `v/vt`, `v//vn` or `v/vt/vn`, split into a fan around the first one
+                uint32_t first[2], previous[2];
+                int vertexCount = 0;
+                const char *s = SkipSpaces(line + 1, lineEnd);
+                while (s < lineEnd && *s != '\n')
+                {
+                    long long index;
+                    uint32_t vertex[2] = {0, MissingIndex};
+                    if (!ParseInteger(s, lineEnd, index) || !ResolveIndex(index, position, totalPositions, vertex[0]))
+                    {
+                        chunk.Error = "Invalid face vertex index";
+                        return;
+                    }
+                    if (s < lineEnd && *s == '/')
+                    {
+                        s++;
+                        ParseInteger(s, lineEnd, index); // Texture coordinates are not used
+                        if (s < lineEnd && *s == '/')
+                        {
+                            s++;
+                            if (!ParseInteger(s, lineEnd, index) || !ResolveIndex(index, normal, totalNormals, vertex[1]))
+                            {
+                                chunk.Error = "Invalid face normal index";
+                                return;
+                            }
+                        }
+                    }
+                    while (s < lineEnd && !IsSpace(*s) && *s != '\n')
+                        s++;
+                    s = SkipSpaces(s, lineEnd);
+
+                    if (vertexCount == 0)
+                        std::memcpy(first, vertex, sizeof(vertex));
+                    else if (vertexCount >= 2)
+                    {
+                        uint32_t *indices = &mesh.Indices[3 * triangle];
+                        indices[0] = first[0];
+                        indices[1] = previous[0];
+                        indices[2] = vertex[0];
+                        if (!mesh.NormalIndices.empty())
+                        {
+                            uint32_t *normalIndices = &mesh.NormalIndices[3 * triangle];
+                            normalIndices[0] = first[1];
+                            normalIndices[1] = previous[1];
+                            normalIndices[2] = vertex[1];
+                            chunk.MissingNormals |= first[1] == MissingIndex || previous[1] == MissingIndex || vertex[1] == MissingIndex;
+                        }
+                        triangle++;
+                    }
+                    std::memcpy(previous, vertex, sizeof(vertex));
+                    vertexCount++;
+                }
+            }
+        }
+    }
+
+    enum class PLYType
+    {
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Float32,
+        Float64,
+    };
+
+    struct PLYProperty
+    {
+        std::string Name;
+        PLYType Type = PLYType::Float32; // Type of the value, or of the list items
+        bool IsList = false;
+        PLYType CountType = PLYType::UInt8;
+    };
+
+    struct PLYElement
+    {
+        std::string Name;
+        size_t Count = 0;
+        std::vector<PLYProperty> Properties;
+    };
+
+    bool ParsePLYType(const std::string &name, PLYType &type)
+    {
+        static const std::pair<const char *, PLYType> names[] = {
+            {"char", PLYType::Int8}, {"int8", PLYType::Int8}, {"uchar", PLYType::UInt8}, {"uint8", PLYType::UInt8},
+            {"short", PLYType::Int16}, {"int16", PLYType::Int16}, {"ushort", PLYType::UInt16}, {"uint16", PLYType::UInt16},
+            {"int", PLYType::Int32}, {"int32", PLYType::Int32}, {"uint", PLYType::UInt32}, {"uint32", PLYType::UInt32},
+            {"float", PLYType::Float32}, {"float32", PLYType::Float32}, {"double", PLYType::Float64}, {"float64", PLYType::Float64}};
+        for (const auto &entry : names)
+        {
+            if (name == entry.first)
+            {
+                type = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t GetPLYTypeSize(PLYType type)
+    {
+        switch (type)
+        {
+        case PLYType::Int8:
+        case PLYType::UInt8:
+            return 1;
+        case PLYType::Int16:
+        case PLYType::UInt16:
+            return 2;
+        case PLYType::Int32:
+        case PLYType::UInt32:
+        case PLYType::Float32:
+            return 4;
+        case PLYType::Float64:
+            return 8;
+        }
+        return 0;
+    }
+
+    // Reads one binary value, swapping its bytes if the file's byte order differs from the machine's
+    double ReadPLYValue(const char *data, PLYType type, bool swapBytes)
+    {
+        unsigned char bytes[8];
+        const size_t size = GetPLYTypeSize(type);
+        std::memcpy(bytes, data, size);
+        if (swapBytes)
+            std::reverse(bytes, bytes + size);
+
+        switch (type)
+        {
+        case PLYType::Int8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+        case PLYType::UInt8: { uint8_t v; std::memcpy(&v, bytes, 1); return v; }
+        case PLYType::Int16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PLYType::UInt16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PLYType::Int32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PLYType::UInt32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PLYType::Float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+        case PLYType::Float64: { double v; std::memcpy(&v, bytes, 8); return v; }
+        }
+        return 0.0;
+    }
+
+    // Reads one vertex index of a face, MissingIndex if the value is negative, NaN or too large to be an index.
+    // Casting such a value straight to an integer is undefined, the check after loading reports MissingIndex.
+    uint32_t ReadPLYIndex(const char *data, PLYType type, bool swapBytes)
+    {
+        const double index = ReadPLYValue(data, type, swapBytes);
+        return index >= 0.0 && index < static_cast<double>(MissingIndex) ? static_cast<uint32_t>(index) : MissingIndex;
+    }
+
+    // Size of one record of an element without list properties, 0 if it has lists
+    size_t GetPLYRecordSize(const PLYElement &element)
+    {
+        size_t size = 0;
+        for (const PLYProperty &property : element.Properties)
+        {
+            if (property.IsList)
+                return 0;
+            size += GetPLYTypeSize(property.Type);
+        }
+        return size;
+    }
+
+    bool ParsePLYHeader(const char *data, size_t size, std::vector<PLYElement> &elements, bool &bigEndian, size_t &headerSize, std::string &error)
+    {
+        const char *marker = "end_header";
+        const char *end = data + size;
+        const char *headerEnd = std::search(data, end, marker, marker + std::strlen(marker));
+        if (size < 4 || std::strncmp(data, "ply", 3) != 0 || headerEnd == end)
+        {
+            error = "Not a PLY file";
+            return false;
+        }
+        headerSize = NextLine(headerEnd, end) - data;
+
+        std::istringstream header(std::string(data, headerEnd));
+        std::string line;
+        bool hasFormat = false;
+        while (std::getline(header, line))
+        {
+            std::istringstream words(line);
+            std::string keyword;
+            words >> keyword;
+            if (keyword == "format")
+            {
+                std::string format;
+                words >> format;
+                if (format == "ascii")
+                {
+                    error = "ASCII PLY files are not supported, convert the model to binary PLY or OBJ";
+                    return false;
+                }
+                if (format != "binary_little_endian" && format != "binary_big_endian")
+                {
+                    error = "Unknown PLY format " + format;
+                    return false;
+                }
+                bigEndian = format == "binary_big_endian";
+                hasFormat = true;
+            }
+            else if (keyword == "element")
+            {
+                PLYElement element;
+                words >> element.Name >> element.Count;
+                elements.push_back(element);
+            }
+            else if (keyword == "property")
+            {
+                PLYProperty property;
+                std::string type;
+                words >> type;
+                if (elements.empty())
+                {
+                    error = "PLY property outside of an element";
+                    return false;
+                }
+                if (type == "list")
+                {
+                    std::string countType;
+                    words >> countType >> type;
+                    property.IsList = true;
+                    if (!ParsePLYType(countType, property.CountType))
+                        type.clear();
+                }
+                words >> property.Name;
+                if (!ParsePLYType(type, property.Type))
+                {
+                    error = "Unknown type of PLY property " + property.Name;
+                    return false;
+                }
+                elements.back().Properties.push_back(property);
+            }
+        }
+        if (!hasFormat)
+            error = "Missing PLY format";
+        return hasFormat;
+    }
+
+    int FindPLYProperty(const PLYElement &element, const char *name)
+    {
+        for (size_t i = 0; i < element.Properties.size(); i++)
+        {
+            if (element.Properties[i].Name == name)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+}
+
+/**
+ * @brief Loads the triangles of a Wavefront OBJ or binary PLY file, chosen by the file extension.
+ *
+ * Polygons are split into triangle fans. Texture coordinates, materials and groups are ignored.
+ *
+ * @param path The path of the model.
+ * @param error Output parameter for a description of the problem if loading fails.
+ * @return std::shared_ptr<MeshBuffers> The buffers of the mesh, or nullptr if the file cannot be loaded.
+ */
+std::shared_ptr<MeshBuffers> LoadMesh(const std::string &path, std::string &error)
+{
+    std::string extension = path.substr(std::min(path.size(), path.find_last_of('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == ".obj")
+        return LoadOBJ(path, error);
+    if (extension == ".ply")
+        return LoadPLY(path, error);
+
+    error = "Unsupported model format, expected .obj or .ply";
+    return nullptr;
+}
+
+/**
+ * @brief Loads the triangles and vertex normals of a Wavefront OBJ file.
+ *
+ * The file is memory mapped and split into chunks at line boundaries, which are parsed in parallel in two
+ * passes. The first pass counts the vertices, normals and triangles of every chunk. Their prefix sums give
+ * the position of each chunk's elements in the buffers and the number of vertices defined before it, which
+ * negative indices refer to, so the second pass parses every chunk straight into its place.
+ *
+ * Normals are kept only if every face vertex references one.
+ *
+ * @param path The path of the model.
+ * @param error Output parameter for a description of the problem if loading fails.
+ * @return std::shared_ptr<MeshBuffers> The buffers of the mesh, or nullptr if the file cannot be loaded.
+ */
+std::shared_ptr<MeshBuffers> LoadOBJ(const std::string &path, std::string &error)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = "Cannot open " + path;
+        return nullptr;
+    }
+
+    const char *data = file.GetData();
+    const std::vector<size_t> starts = SplitLines(data, file.GetSize());
+    const int64_t chunkCount = static_cast<int64_t>(starts.size()) - 1;
+    std::vector<OBJChunk> chunks(chunkCount);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0; i < chunkCount; i++)
+        CountOBJChunk(data + starts[i], data + starts[i + 1], chunks[i]);
+
+    size_t positions = 0, normals = 0, triangles = 0;
+    for (OBJChunk &chunk : chunks)
+    {
+        chunk.FirstPosition = positions;
+        chunk.FirstNormal = normals;
+        chunk.FirstTriangle = triangles;
+        positions += chunk.Positions;
+        normals += chunk.Normals;
+        triangles += chunk.Triangles;
+    }
+    if (triangles == 0)
+    {
+        error = "No faces in " + path;
+        return nullptr;
+    }
+    if (positions > MissingIndex || triangles > MissingIndex / 3)
+    {
+        error = "Too many vertices or triangles in " + path;
+        return nullptr;
+    }
+
+    auto mesh = std::make_shared<MeshBuffers>();
+    mesh->Positions.resize(positions);
+    mesh->Indices.resize(3 * triangles);
+    if (normals > 0)
+    {
+        mesh->Normals.resize(normals);
+        mesh->NormalIndices.resize(3 * triangles);
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0; i < chunkCount; i++)
+        ParseOBJChunk(data + starts[i], data + starts[i + 1], chunks[i], *mesh, normals);
+
+    bool missingNormals = false;
+    for (const OBJChunk &chunk : chunks)
+    {
+        if (!chunk.Error.empty())
+        {
+            error = chunk.Error + " in " + path;
+            return nullptr;
+        }
+        missingNormals |= chunk.MissingNormals;
+    }
+    if (missingNormals)
+    {
+        mesh->Normals.clear();
+        mesh->NormalIndices.clear();
+    }
+    return mesh;
+}
+
+/**
+ * @brief Loads the triangles and vertex normals of a binary PLY file.
+ *
+ * The file is memory mapped and the vertex and face elements are decoded from it in parallel. Vertices
+ * have a fixed size, so every thread can find its own. Faces are lists, so when every face is a triangle
+ * (checked in parallel) their size is fixed too. Otherwise the faces are first scanned once to find where
+ * each one starts and how many triangles precede it, then split into fans in parallel.
+ *
+ * @param path The path of the model.
+ * @param error Output parameter for a description of the problem if loading fails.
+ * @return std::shared_ptr<MeshBuffers> The buffers of the mesh, or nullptr if the file cannot be loaded.
+ */
+std::shared_ptr<MeshBuffers> LoadPLY(const std::string &path, std::string &error)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = "Cannot open " + path;
+        return nullptr;
+    }
+
+    const char *data = file.GetData();
+    const size_t size = file.GetSize();
+    std::vector<PLYElement> elements;
+    bool bigEndian = false;
+    size_t offset = 0;
+    if (!ParsePLYHeader(data, size, elements, bigEndian, offset, error))
+        return nullptr;
+
+    const uint16_t one = 1;
+    const bool littleEndianMachine = *reinterpret_cast<const uint8_t *>(&one) == 1;
+    const bool swapBytes = bigEndian == littleEndianMachine;
+
+    auto mesh = std::make_shared<MeshBuffers>();
+    bool hasVertices = false, hasFaces = false;
+
+    for (const PLYElement &element : elements)
+    {
+        if (hasVertices && hasFaces)
+            break;
+
+        const int64_t count = static_cast<int64_t>(element.Count);
+        if (element.Name == "vertex")
+        {
+            const size_t stride = GetPLYRecordSize(element);
+            int propertyOffsets[6];
+            PLYType propertyTypes[6];
+            const char *names[6] = {"x", "y", "z", "nx", "ny", "nz"};
+            for (int i = 0; i < 6; i++)
+            {
+                propertyOffsets[i] = -1;
+                size_t propertyOffset = 0;
+                for (const PLYProperty &property : element.Properties)
+                {
+                    if (property.Name == names[i])
+                    {
+                        propertyOffsets[i] = static_cast<int>(propertyOffset);
+                        propertyTypes[i] = property.Type;
+                    }
+                    propertyOffset += GetPLYTypeSize(property.Type);
+                }
+            }
+            if (stride == 0 || propertyOffsets[0] < 0 || propertyOffsets[1] < 0 || propertyOffsets[2] < 0)
+            {
+                error = "PLY vertices need x, y and z and no list properties";
+                return nullptr;
+            }
+            if (element.Count > MissingIndex || element.Count > (size - offset) / stride)
+            {
+                error = "PLY file is truncated";
+                return nullptr;
+            }
+
+            const bool hasNormals = propertyOffsets[3] >= 0 && propertyOffsets[4] >= 0 && propertyOffsets[5] >= 0;
+            mesh->Positions.resize(count);
+            if (hasNormals)
+                mesh->Normals.resize(count);
+
+            const char *vertices = data + offset;
+#pragma omp parallel for
+            for (int64_t i = 0; i < count; i++)
+            {
+                const char *vertex = vertices + i * stride;
+                for (int axis = 0; axis < 3; axis++)
+                    mesh->Positions[i][axis] = static_cast<float>(ReadPLYValue(vertex + propertyOffsets[axis], propertyTypes[axis], swapBytes));
+                if (hasNormals)
+                {
+                    for (int axis = 0; axis < 3; axis++)
+                        mesh->Normals[i][axis] = static_cast<float>(ReadPLYValue(vertex + propertyOffsets[3 + axis], propertyTypes[3 + axis], swapBytes));
+                }
+            }
+            offset += element.Count * stride;
+            hasVertices = true;
+        }
+        else if (element.Name == "face")
+        {
+            int listIndex = FindPLYProperty(element, "vertex_indices");
+            if (listIndex < 0)
+                listIndex = FindPLYProperty(element, "vertex_index");
+
+            // Bytes of the fixed size properties before and after the list of vertex indices
+            size_t prefix = 0, suffix = 0;
+            for (int i = 0; i < static_cast<int>(element.Properties.size()); i++)
+            {
+                const PLYProperty &property = element.Properties[i];
+                if (i != listIndex && property.IsList)
+                    listIndex = -1;
+                if (listIndex < 0)
+                    break;
+                (i < listIndex ? prefix : suffix) += i == listIndex ? 0 : GetPLYTypeSize(property.Type);
+            }
+            if (listIndex < 0)
+            {
+                error = "PLY faces need a vertex_indices list and no other list properties";
+                return nullptr;
+            }
+
+            const PLYProperty &list = element.Properties[listIndex];
+            const size_t countSize = GetPLYTypeSize(list.CountType);
+            const size_t indexSize = GetPLYTypeSize(list.Type);
+            const char *faces = data + offset;
+
+            // Every face takes at least its fixed size properties and vertex count, whatever its vertices
+            if (element.Count > MissingIndex || element.Count > (size - offset) / (prefix + countSize + suffix))
+            {
+                error = "PLY file is truncated";
+                return nullptr;
+            }
+
+            // Offset of every face in the file and index of its first triangle, unless all faces are triangles
+            const size_t triangleStride = prefix + countSize + 3 * indexSize + suffix;
+            bool allTriangles = element.Count <= (size - offset) / triangleStride;
+            if (allTriangles)
+            {
+#pragma omp parallel for reduction(&& : allTriangles)
+                for (int64_t i = 0; i < count; i++)
+                    allTriangles = allTriangles && ReadPLYValue(faces + i * triangleStride + prefix, list.CountType, swapBytes) == 3.0;
+            }
+
+            std::vector<size_t> faceOffsets, firstTriangles;
+            size_t triangles = 0;
+            if (allTriangles)
+            {
+                triangles = element.Count;
+                offset += element.Count * triangleStride;
+            }
+            else
+            {
+                faceOffsets.resize(count);
+                firstTriangles.resize(count);
+                for (int64_t i = 0; i < count; i++)
+                {
+                    // Vertex counts are checked here once, the fans below read them again
+                    if (offset + prefix + countSize + suffix > size)
+                    {
+                        error = "PLY file is truncated";
+                        return nullptr;
+                    }
+                    const double listCount = ReadPLYValue(data + offset + prefix, list.CountType, swapBytes);
+                    if (!(listCount >= 0.0))
+                    {
+                        error = "PLY face has a negative vertex count";
+                        return nullptr;
+                    }
+                    if (listCount > static_cast<double>((size - offset - prefix - countSize - suffix) / indexSize))
+                    {
+                        error = "PLY file is truncated";
+                        return nullptr;
+                    }
+                    const size_t vertexCount = static_cast<size_t>(listCount);
+                    faceOffsets[i] = offset;
+                    firstTriangles[i] = triangles;
+                    triangles += vertexCount >= 3 ? vertexCount - 2 : 0;
+                    offset += prefix + countSize + vertexCount * indexSize + suffix;
+                }
+            }
+            if (triangles > MissingIndex / 3)
+            {
+                error = "Too many triangles in " + path;
+                return nullptr;
+            }
+
+            mesh->Indices.resize(3 * triangles);
+#pragma omp parallel for
+            for (int64_t i = 0; i < count; i++)
+            {
+                const char *face = allTriangles ? faces + i * triangleStride : data + faceOffsets[i];
+                const char *items = face + prefix + countSize;
+                const size_t vertexCount = allTriangles ? 3 : static_cast<size_t>(ReadPLYValue(face + prefix, list.CountType, swapBytes));
+                if (vertexCount < 3)
+                    continue;
+                uint32_t *indices = &mesh->Indices[3 * (allTriangles ? size_t(i) : firstTriangles[i])];
+
+                const uint32_t first = ReadPLYIndex(items, list.Type, swapBytes);
+                uint32_t previous = ReadPLYIndex(items + indexSize, list.Type, swapBytes);
+                for (size_t j = 2; j < vertexCount; j++)
+                {
+                    const uint32_t vertex = ReadPLYIndex(items + j * indexSize, list.Type, swapBytes);
+                    *indices++ = first;
+                    *indices++ = previous;
+                    *indices++ = vertex;
+                    previous = vertex;
+                }
+            }
+            hasFaces = true;
+        }
+        else
+        {
+            const size_t stride = GetPLYRecordSize(element);
+            if (stride == 0 && element.Count > 0 && !element.Properties.empty())
+            {
+                error = "Unsupported PLY element " + element.Name;
+                return nullptr;
+            }
+            if (stride > 0 && element.Count > (size - offset) / stride)
+            {
+                error = "PLY file is truncated";
+                return nullptr;
+            }
+            offset += element.Count * stride;
+        }
+    }
+
+    if (!hasVertices || mesh->Indices.empty())
+    {
+        error = "No vertices or faces in " + path;
+        return nullptr;
+    }
+
+    const int64_t indexCount = static_cast<int64_t>(mesh->Indices.size());
+    const uint32_t vertexCount = static_cast<uint32_t>(mesh->Positions.size());
+    bool validIndices = true;
+#pragma omp parallel for reduction(&& : validIndices)
+    for (int64_t i = 0; i < indexCount; i++)
+        validIndices = validIndices && mesh->Indices[i] < vertexCount;
+    if (!validIndices)
+    {
+        error = "PLY face references a missing vertex";
+        return nullptr;
+    }
+    return mesh;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "TriangleMesh.h"
+
+#include <memory>
+#include <string>
+
+// Loads a Wavefront OBJ or binary PLY model, chosen by the file extension. Returns nullptr and sets error on failure.
+std::shared_ptr<MeshBuffers> LoadMesh(const std::string &path, std::string &error);
+
+std::shared_ptr<MeshBuffers> LoadOBJ(const std::string &path, std::string &error);
+std::shared_ptr<MeshBuffers> LoadPLY(const std::string &path, std::string &error);
@@ -0,0 +1,217 @@
+#include "Numa.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    thread_local int t_NumaNode = -1;
+
+#if defined(_WIN32)
+    std::vector<ULONGLONG> ReadNodeMasks()
+    {
+        std::vector<ULONGLONG> masks;
+        ULONG highestNode = 0;
+        if (!GetNumaHighestNodeNumber(&highestNode))
+            return masks;
+
+        for (ULONG node = 0; node <= highestNode; node++)
+        {
+            ULONGLONG mask = 0;
+            if (GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask) && mask != 0)
+                masks.push_back(mask);
+        }
+        return masks;
+    }
+
+    const std::vector<ULONGLONG> &GetNodeMasks()
+    {
+        static const std::vector<ULONGLONG> masks = ReadNodeMasks();
+        return masks;
+    }
+#elif defined(__linux__)
+    // Parses a sysfs CPU or node list such as "0-15,32-47"
+    std::vector<int> ParseCPUList(const char *list)
+    {
+        std::vector<int> cpus;
+        const char *p = list;
+        while (*p)
+        {
+            char *end;
+            long first = std::strtol(p, &end, 10);
+            if (end == p)
+                break;
+            long last = first;
+            p = end;
+            if (*p == '-')
+            {
+                last = std::strtol(p + 1, &end, 10);
+                p = end;
+            }
+            for (long cpu = first; cpu <= last; cpu++)
+                cpus.push_back(static_cast<int>(cpu));
+            if (*p == ',')
+                p++;
+        }
+        return cpus;
+    }
+
+    std::vector<int> ReadList(const std::string &path)
+    {
+        FILE *file = std::fopen(path.c_str(), "r");
+        if (!file)
+            return {};
+
+        char buffer[4096] = {};
+        const bool read = std::fgets(buffer, sizeof(buffer), file) != nullptr;
+        std::fclose(file);
+        return read ? ParseCPUList(buffer) : std::vector<int>();
+    }
+
+    std::vector<std::vector<int>> ReadNodeCPUs()
+    {
+        std::vector<std::vector<int>> nodes;
+        for (int node : ReadList("/sys/devices/system/node/online"))
+        {
+            std::vector<int> cpus = ReadList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!cpus.empty()) // Memory only nodes cannot run threads
+                nodes.push_back(std::move(cpus));
+        }
+        return nodes;
+    }
+
+    const std::vector<std::vector<int>> &GetNodeCPUs()
+    {
+        static const std::vector<std::vector<int>> nodes = ReadNodeCPUs();
+        return nodes;
+    }
+#endif
+
+#if defined(_WIN32)
+    thread_local DWORD_PTR t_OriginalAffinity = 0;
+#elif defined(__linux__)
+    thread_local cpu_set_t t_OriginalAffinity;
+#endif
+}
+
+int GetNumaNodeCount()
+{
+#if defined(_WIN32)
+    return GetNodeMasks().empty() ? 1 : static_cast<int>(GetNodeMasks().size());
+#elif defined(__linux__)
+    return GetNodeCPUs().empty() ? 1 : static_cast<int>(GetNodeCPUs().size());
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief Restricts the calling thread to the CPUs of a NUMA node.
+ *
+ * Threads bound this way keep running (and allocating first touched pages) on that node. Binding a thread
+ * to the node it is already bound to does nothing, so this is cheap to call at the start of every parallel
+ * region. On machines with a single node the thread is left free to run anywhere.
+ *
+ * @param node The index of the node, between 0 and `GetNumaNodeCount() - 1`, or -1 to restore the
+ * affinity the thread had before it was first bound.
+ * @return bool Returns true if the thread now runs on the node.
+ */
+bool BindThreadToNumaNode(int node)
+{
+    if (node < -1 || node >= GetNumaNodeCount())
+        return false;
+    if (node == t_NumaNode)
+        return true;
+
+    const bool wasBound = t_NumaNode >= 0;
+    t_NumaNode = node;
+    if (GetNumaNodeCount() == 1)
+        return true;
+
+#if defined(_WIN32)
+    if (node < 0)
+        return SetThreadAffinityMask(GetCurrentThread(), t_OriginalAffinity) != 0;
+
+    DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(GetNodeMasks()[node]));
+    if (!wasBound)
+        t_OriginalAffinity = previous;
+    return previous != 0;
+#elif defined(__linux__)
+    if (node < 0)
+        return pthread_setaffinity_np(pthread_self(), sizeof(t_OriginalAffinity), &t_OriginalAffinity) == 0;
+    if (!wasBound)
+        pthread_getaffinity_np(pthread_self(), sizeof(t_OriginalAffinity), &t_OriginalAffinity);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : GetNodeCPUs()[node])
+    {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+int GetThreadNumaNode()
+{
+    return t_NumaNode;
+}
+
+/**
+ * @brief Reserves memory directly from the OS, leaving the physical pages unallocated until first written.
+ *
+ * @param bytes The size of the allocation.
+ * @param hugePages If true, transparent huge pages are requested for the range on Linux. Windows large
+ * pages need a privilege the renderer does not have, so this is ignored there.
+ * @return void* The memory, or nullptr on failure. Must be released with `FreePages` and the same size.
+ */
+void *AllocatePages(size_t bytes, bool hugePages)
+{
+    if (bytes == 0)
+        return nullptr;
+
+#if defined(_WIN32)
+    return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(__linux__)
+    void *pages = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED)
+        return nullptr;
+#ifdef MADV_HUGEPAGE
+    if (hugePages)
+        madvise(pages, bytes, MADV_HUGEPAGE);
+#endif
+    return pages;
+#else
+    return std::malloc(bytes);
+#endif
+}
+
+void FreePages(void *pages, size_t bytes)
+{
+    if (!pages)
+        return;
+
+#if defined(_WIN32)
+    VirtualFree(pages, 0, MEM_RELEASE);
+#elif defined(__linux__)
+    munmap(pages, bytes);
+#else
+    std::free(pages);
+#endif
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief Minimal NUMA support for multi-socket render nodes, without depending on libnuma.
+ *
+ * The topology is read once, from /sys/devices/system/node on Linux or the NUMA API on Windows. Machines
+ * (or builds) without NUMA information report a single node holding every CPU, so all of this degrades to
+ * plain allocations and unpinned threads.
+ */
+
+// Number of NUMA nodes with CPUs, at least 1
+int GetNumaNodeCount();
+
+// Pins the calling thread to the CPUs of a node, so its first touches allocate memory there. -1 unbinds it.
+bool BindThreadToNumaNode(int node);
+
+// Node the calling thread is bound to with BindThreadToNumaNode, -1 if it is not bound
+int GetThreadNumaNode();
+
+// Page aligned memory that is only committed on first touch, so it lands on the node of the touching thread
+void *AllocatePages(size_t bytes, bool hugePages);
+void FreePages(void *pages, size_t bytes);
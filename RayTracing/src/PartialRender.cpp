@@ -0,0 +1,338 @@
+#include "PartialRender.h"
+#include "Checkpoint.h"
+#include "MappedFile.h"
+
+#include "Walnut/Timer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+    constexpr char PartialRenderMagic[8] = {'R', 'T', 'P', 'A', 'R', 'T', 'I', 'A'};
+    constexpr uint32_t ByteOrderMark = 0x01020304;
+
+    // The sums start at this offset, so they are aligned wherever the file is mapped, and the counts follow them
+    constexpr uint64_t DataOffset = 64;
+
+    struct PartialRenderHeader
+    {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t ByteOrder;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t SamplesPerFrame;
+        uint32_t FirstFrame;
+        uint32_t EndFrame;
+        uint32_t Reserved;
+        uint64_t SceneHash;
+        uint64_t ViewHash;
+    };
+    static_assert(sizeof(PartialRenderHeader) <= DataOffset, "partial render header overlaps the sums");
+
+    uint64_t GetFileSize(uint32_t width, uint32_t height)
+    {
+        return DataOffset + static_cast<uint64_t>(width) * height * (sizeof(glm::vec4) + sizeof(uint32_t));
+    }
+
+    bool IsExrPath(const std::string &path)
+    {
+        return path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0;
+    }
+
+    // A partial render file mapped in memory, read in place
+    struct MappedPartialRender
+    {
+        std::string Path;
+        MappedFile File;
+        PartialRenderHeader Header;
+
+        const glm::vec4 *GetSums() const { return reinterpret_cast<const glm::vec4 *>(File.GetData() + DataOffset); }
+        const uint32_t *GetCounts() const
+        {
+            return reinterpret_cast<const uint32_t *>(File.GetData() + DataOffset + static_cast<size_t>(Header.Width) * Header.Height * sizeof(glm::vec4));
+        }
+    };
+
+    bool OpenPartialRender(const std::string &path, MappedPartialRender &partial, std::string &error)
+    {
+        partial.Path = path;
+        if (!partial.File.Open(path))
+        {
+            error = "Cannot open " + path;
+            return false;
+        }
+
+        PartialRenderHeader &header = partial.Header;
+        if (partial.File.GetSize() < DataOffset)
+        {
+            error = path + " is not a partial render";
+            return false;
+        }
+        std::memcpy(&header, partial.File.GetData(), sizeof(header));
+        if (std::memcmp(header.Magic, PartialRenderMagic, sizeof(PartialRenderMagic)) != 0)
+        {
+            error = path + " is not a partial render";
+            return false;
+        }
+        if (header.Version != PartialRenderVersion || header.ByteOrder != ByteOrderMark)
+        {
+            error = path + " was written by another version or machine";
+            return false;
+        }
+        if (partial.File.GetSize() != GetFileSize(header.Width, header.Height))
+        {
+            error = path + " is truncated";
+            return false;
+        }
+        return true;
+    }
+}
+
+/**
+ * @brief Copies the renderer's accumulated sums and frame counts, and the hashes of what they show, into a partial render.
+ *
+ * The buffers of the partial render are reused when they are already large enough.
+ *
+ * @param renderer The renderer to copy the accumulation of.
+ * @param scene The scene being rendered.
+ * @param camera The camera the scene is being rendered with.
+ * @param partial Output parameter for the partial render.
+ * @return bool Returns false if the renderer has not accumulated any frame yet.
+ */
+bool CapturePartialRender(const Renderer &renderer, const Scene &scene, const Camera &camera, PartialRender &partial)
+{
+    const uint32_t frames = renderer.GetAccumulatedFrames();
+    if (frames == 0)
+        return false;
+
+    partial.Width = renderer.GetWidth();
+    partial.Height = renderer.GetHeight();
+    partial.SamplesPerFrame = static_cast<uint32_t>(glm::max(renderer.m_Samples, 1));
+    partial.FirstFrame = renderer.GetFirstFrame();
+    partial.EndFrame = partial.FirstFrame + frames;
+    partial.SceneHash = HashScene(scene);
+    partial.ViewHash = HashView(camera, renderer);
+
+    const size_t pixelCount = static_cast<size_t>(partial.Width) * partial.Height;
+    partial.Sums.resize(pixelCount);
+    partial.Counts.resize(pixelCount);
+    renderer.ExportAccumulation(partial.Sums.data(), partial.Counts.data());
+    return true;
+}
+
+/**
+ * @brief Writes a partial render to a file.
+ *
+ * The file is a header followed by the raw sums and counts. It is written under a temporary name and
+ * renamed when complete.
+ *
+ * @param path The path of the file.
+ * @param partial The partial render to write.
+ * @param error Output parameter for a description of the problem if writing fails.
+ * @return bool Returns true if the partial render was written; otherwise, returns false.
+ */
+bool SavePartialRender(const std::string &path, const PartialRender &partial, std::string &error)
+{
+    PartialRenderHeader header = {};
+    std::memcpy(header.Magic, PartialRenderMagic, sizeof(PartialRenderMagic));
+    header.Version = PartialRenderVersion;
+    header.ByteOrder = ByteOrderMark;
+    header.Width = partial.Width;
+    header.Height = partial.Height;
+    header.SamplesPerFrame = partial.SamplesPerFrame;
+    header.FirstFrame = partial.FirstFrame;
+    header.EndFrame = partial.EndFrame;
+    header.SceneHash = partial.SceneHash;
+    header.ViewHash = partial.ViewHash;
+
+    const std::string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+    {
+        error = "Cannot write " + temporaryPath;
+        return false;
+    }
+
+    const char padding[DataOffset] = {};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(padding, DataOffset - sizeof(header), 1, file) == 1;
+    written = written && fwrite(partial.Sums.data(), sizeof(glm::vec4), partial.Sums.size(), file) == partial.Sums.size();
+    written = written && fwrite(partial.Counts.data(), sizeof(uint32_t), partial.Counts.size(), file) == partial.Counts.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        std::remove(temporaryPath.c_str());
+        error = "Cannot write " + temporaryPath;
+        return false;
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        error = "Cannot rename " + temporaryPath + " to " + path;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a partial render written by `SavePartialRender`.
+ *
+ * @param path The path of the file.
+ * @param partial Output parameter for the partial render.
+ * @param error Output parameter for a description of the problem if reading fails.
+ * @return bool Returns true if the partial render was read; otherwise, returns false.
+ */
+bool LoadPartialRender(const std::string &path, PartialRender &partial, std::string &error)
+{
+    MappedPartialRender mapped;
+    if (!OpenPartialRender(path, mapped, error))
+        return false;
+
+    const PartialRenderHeader &header = mapped.Header;
+    partial.Width = header.Width;
+    partial.Height = header.Height;
+    partial.SamplesPerFrame = header.SamplesPerFrame;
+    partial.FirstFrame = header.FirstFrame;
+    partial.EndFrame = header.EndFrame;
+    partial.SceneHash = header.SceneHash;
+    partial.ViewHash = header.ViewHash;
+
+    const size_t pixelCount = static_cast<size_t>(header.Width) * header.Height;
+    partial.Sums.assign(mapped.GetSums(), mapped.GetSums() + pixelCount);
+    partial.Counts.assign(mapped.GetCounts(), mapped.GetCounts() + pixelCount);
+    return true;
+}
+
+/**
+ * @brief Averages the sums of a partial render into a snapshot's color, the way `CaptureRenderSnapshot` averages the renderer's.
+ *
+ * Pixels without any frame are black. The samples layer gets the samples of each pixel.
+ *
+ * @param partial The partial render to average.
+ * @param snapshot Output parameter for the snapshot, with its color and sample counts.
+ */
+void ResolvePartialRender(const PartialRender &partial, RenderSnapshot &snapshot)
+{
+    const size_t pixelCount = static_cast<size_t>(partial.Width) * partial.Height;
+    snapshot.Width = partial.Width;
+    snapshot.Height = partial.Height;
+    snapshot.Layers = RenderLayerSamples;
+    snapshot.Color.resize(pixelCount);
+    snapshot.SampleCounts.resize(pixelCount);
+    snapshot.Depth.clear();
+    snapshot.Normals.clear();
+    snapshot.Albedo.clear();
+
+    uint32_t maxCount = 0;
+#pragma omp parallel for schedule(static) reduction(max : maxCount)
+    for (int64_t i = 0; i < static_cast<int64_t>(pixelCount); i++)
+    {
+        const uint32_t count = partial.Counts[i];
+        snapshot.Color[i] = count > 0 ? partial.Sums[i] * (1.0f / static_cast<float>(count)) : glm::vec4(0.0f);
+        snapshot.SampleCounts[i] = count * partial.SamplesPerFrame;
+        maxCount = glm::max(maxCount, count);
+    }
+    snapshot.Samples = maxCount * partial.SamplesPerFrame;
+}
+
+/**
+ * @brief Adds up partial renders of the same image, each rendering other frames, into the render of all of them.
+ *
+ * With deterministic sampling, a frame draws the same samples in any process, so the merge of renders of
+ * [0, S) and [S, 2S) has the samples of a single render of [0, 2S), and differs from it only by the rounding
+ * of the float sums added in another order. The inputs are mapped and added in order of their first frame.
+ * Inputs of another scene, view, size or samples per frame are refused, as are overlapping frame ranges,
+ * which would count their samples twice. Gaps between the ranges are allowed, and leave fewer samples.
+ *
+ * @param inputs The paths of the partial renders.
+ * @param output The path of the merged image, written as EXR if it ends in .exr and as a partial render otherwise.
+ * @param status Output parameter for a summary of the merge, or a description of the problem if it fails.
+ * @return bool Returns true if the merge was written; otherwise, returns false.
+ */
+bool MergePartialRenders(const std::vector<std::string> &inputs, const std::string &output, std::string &status)
+{
+    Walnut::Timer timer;
+    if (inputs.empty())
+    {
+        status = "No partial render to merge";
+        return false;
+    }
+
+    std::vector<std::unique_ptr<MappedPartialRender>> parts;
+    for (const std::string &input : inputs)
+    {
+        parts.push_back(std::make_unique<MappedPartialRender>());
+        if (!OpenPartialRender(input, *parts.back(), status))
+            return false;
+    }
+    std::sort(parts.begin(), parts.end(), [](const std::unique_ptr<MappedPartialRender> &a, const std::unique_ptr<MappedPartialRender> &b)
+              { return a->Header.FirstFrame < b->Header.FirstFrame; });
+
+    const PartialRenderHeader &first = parts.front()->Header;
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        const PartialRenderHeader &header = parts[i]->Header;
+        if (header.Width != first.Width || header.Height != first.Height || header.SamplesPerFrame != first.SamplesPerFrame)
+        {
+            status = parts[i]->Path + " has another image size or samples per frame than " + parts.front()->Path;
+            return false;
+        }
+        if (header.SceneHash != first.SceneHash || header.ViewHash != first.ViewHash)
+        {
+            status = parts[i]->Path + " is a render of another scene, view or settings than " + parts.front()->Path;
+            return false;
+        }
+        if (header.FirstFrame < parts[i - 1]->Header.EndFrame)
+        {
+            status = "The frames of " + parts[i]->Path + " overlap those of " + parts[i - 1]->Path;
+            return false;
+        }
+    }
+
+    PartialRender merged;
+    merged.Width = first.Width;
+    merged.Height = first.Height;
+    merged.SamplesPerFrame = first.SamplesPerFrame;
+    merged.FirstFrame = first.FirstFrame;
+    merged.EndFrame = parts.back()->Header.EndFrame;
+    merged.SceneHash = first.SceneHash;
+    merged.ViewHash = first.ViewHash;
+
+    const size_t pixelCount = static_cast<size_t>(merged.Width) * merged.Height;
+    merged.Sums.resize(pixelCount);
+    merged.Counts.resize(pixelCount);
+
+    // Inputs are added in frame order, so the merge does not depend on the order they were given in
+#pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < static_cast<int64_t>(pixelCount); i++)
+    {
+        glm::vec4 sum = parts[0]->GetSums()[i];
+        uint32_t count = parts[0]->GetCounts()[i];
+        for (size_t part = 1; part < parts.size(); part++)
+        {
+            sum += parts[part]->GetSums()[i];
+            count += parts[part]->GetCounts()[i];
+        }
+        merged.Sums[i] = sum;
+        merged.Counts[i] = count;
+    }
+
+    if (IsExrPath(output))
+    {
+        RenderSnapshot snapshot;
+        ResolvePartialRender(merged, snapshot);
+        if (!SaveRenderExr(output, snapshot, ExrCompression::RLE, status))
+            return false;
+    }
+    else if (!SavePartialRender(output, merged, status))
+        return false;
+
+    status = "Merged " + std::to_string(parts.size()) + " partial renders of frames " + std::to_string(merged.FirstFrame) + " to " +
+             std::to_string(merged.EndFrame) + " into " + output + " in " + std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms";
+    return true;
+}
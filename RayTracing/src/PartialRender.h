@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "RenderOutput.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Increased whenever the layout of partial render files changes
+constexpr uint32_t PartialRenderVersion = 1;
+
+// Unaveraged output of a render of a range of frames, which adds up with renders of other frames of the same image
+struct PartialRender
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t SamplesPerFrame = 1;
+    uint32_t FirstFrame = 0; // Frames rendered are within [FirstFrame, EndFrame)
+    uint32_t EndFrame = 0;
+    uint64_t SceneHash = 0;  // HashScene of the scene rendered
+    uint64_t ViewHash = 0;   // HashView of the camera and renderer settings rendered with
+    std::vector<glm::vec4> Sums;  // Sums of the frames' colors
+    std::vector<uint32_t> Counts; // Frames summed in each pixel
+};
+
+bool CapturePartialRender(const Renderer &renderer, const Scene &scene, const Camera &camera, PartialRender &partial);
+bool SavePartialRender(const std::string &path, const PartialRender &partial, std::string &error);
+bool LoadPartialRender(const std::string &path, PartialRender &partial, std::string &error);
+
+// Averages the sums into the color of a snapshot, with the samples of each pixel
+void ResolvePartialRender(const PartialRender &partial, RenderSnapshot &snapshot);
+
+// Adds up partial renders of disjoint frame ranges, writing the image (.exr) or another partial render (any other extension)
+bool MergePartialRenders(const std::vector<std::string> &inputs, const std::string &output, std::string &status);
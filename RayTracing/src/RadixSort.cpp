@@ -0,0 +1,80 @@
+#include "RadixSort.h"
+
+#include <algorithm>
+#include <omp.h>
+
+namespace
+{
+    constexpr uint32_t RadixBits = 8;
+    constexpr uint32_t RadixSize = 1u << RadixBits;
+
+    // Below this many keys, the sort runs on the calling thread only
+    constexpr size_t ParallelThreshold = 1 << 16;
+}
+
+/**
+ * @brief Sorts key/value pairs by key with a parallel least significant digit radix sort.
+ *
+ * Must be called from outside an OpenMP parallel region. The sort is stable, and only the lowest `keyBits`
+ * bits of the keys are compared.
+ *
+ * Every pass sorts by the next 8 bit digit. The keys are split into one contiguous chunk per thread; each
+ * thread counts the digits of its chunk, the counts are turned into output offsets ordered by digit and then
+ * by thread, and each thread scatters its chunk to its offsets. This keeps every pass stable.
+ *
+ * @param keys The keys to sort by. Sorted on return.
+ * @param values The values to reorder along with their keys. Must be the same size as `keys`.
+ * @param scratchKeys Scratch storage, reused between calls to avoid allocations.
+ * @param scratchValues Scratch storage, reused between calls to avoid allocations.
+ * @param keyBits The number of significant key bits.
+ */
+void RadixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values,
+               std::vector<uint32_t> &scratchKeys, std::vector<uint32_t> &scratchValues, uint32_t keyBits)
+{
+    const size_t count = keys.size();
+    scratchKeys.resize(count);
+    scratchValues.resize(count);
+
+    std::vector<size_t> offsets(static_cast<size_t>(omp_get_max_threads()) * RadixSize);
+
+    for (uint32_t shift = 0; shift < keyBits; shift += RadixBits)
+    {
+#pragma omp parallel if (count >= ParallelThreshold)
+        {
+            const size_t thread = omp_get_thread_num();
+            const size_t threadCount = omp_get_num_threads();
+            const size_t begin = count * thread / threadCount;
+            const size_t end = count * (thread + 1) / threadCount;
+
+            size_t *histogram = &offsets[thread * RadixSize];
+            std::fill(histogram, histogram + RadixSize, 0);
+            for (size_t i = begin; i < end; i++)
+                histogram[(keys[i] >> shift) & (RadixSize - 1)]++;
+
+#pragma omp barrier
+#pragma omp single
+            {
+                size_t sum = 0;
+                for (uint32_t digit = 0; digit < RadixSize; digit++)
+                {
+                    for (size_t t = 0; t < threadCount; t++)
+                    {
+                        const size_t digitCount = offsets[t * RadixSize + digit];
+                        offsets[t * RadixSize + digit] = sum;
+                        sum += digitCount;
+                    }
+                }
+            }
+
+            for (size_t i = begin; i < end; i++)
+            {
+                const size_t destination = histogram[(keys[i] >> shift) & (RadixSize - 1)]++;
+                scratchKeys[destination] = keys[i];
+                scratchValues[destination] = values[i];
+            }
+        }
+
+        keys.swap(scratchKeys);
+        values.swap(scratchValues);
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Stable parallel sort of key/value pairs by the lowest keyBits bits of the keys
+void RadixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values,
+               std::vector<uint32_t> &scratchKeys, std::vector<uint32_t> &scratchValues, uint32_t keyBits = 32);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Hittable.h"
+#include "Ray.h"
+#include "RayPacketLanes.h"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <limits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+ * @brief A bundle of up to 16 rays traced together through an acceleration structure.
+ *
+ * Ray data is stored as a structure of arrays (`RayPacketLanes`) so per lane loops (see the packet kernels
+ * in Kernels.h) vectorize. Lanes outside `ActiveMask` are ignored by traversal. Tracing fills `Hits` for every lane in `HitMask` the same way
+ * `Hittable::hit` fills a payload, and shrinks `TMax` to the closest hit distance.
+ */
+struct RayPacket : RayPacketLanes
+{
+    int Size = 0;
+    uint32_t HitMask = 0;
+
+    HitPayload Hits[MaxSize];
+
+    void SetRay(int lane, const Ray &ray, float tMax = std::numeric_limits<float>::max())
+    {
+        OriginX[lane] = ray.Origin.x;
+        OriginY[lane] = ray.Origin.y;
+        OriginZ[lane] = ray.Origin.z;
+        DirectionX[lane] = ray.Direction.x;
+        DirectionY[lane] = ray.Direction.y;
+        DirectionZ[lane] = ray.Direction.z;
+        InvDirectionX[lane] = 1.0f / ray.Direction.x;
+        InvDirectionY[lane] = 1.0f / ray.Direction.y;
+        InvDirectionZ[lane] = 1.0f / ray.Direction.z;
+        TMax[lane] = tMax;
+    }
+
+    // Index of the lowest set bit of a non-zero lane mask
+    static int FirstLane(uint32_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int)index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    Ray GetRay(int lane) const
+    {
+        Ray ray;
+        ray.Origin = {OriginX[lane], OriginY[lane], OriginZ[lane]};
+        ray.Direction = {DirectionX[lane], DirectionY[lane], DirectionZ[lane]};
+        return ray;
+    }
+
+    /**
+     * @brief Checks whether the active rays are similar enough to be worth tracing together.
+     *
+     * @param minCosine The minimum cosine of the angle between any active direction and their mean.
+     * @return bool Returns true if all active rays point into the same octant and are within the angle.
+     */
+    bool IsCoherent(float minCosine) const
+    {
+        glm::vec3 mean(0.0f);
+        int signs = -1;
+        for (int i = 0; i < Size; i++)
+        {
+            if (!((ActiveMask >> i) & 1u))
+                continue;
+
+            glm::vec3 direction = glm::normalize(glm::vec3(DirectionX[i], DirectionY[i], DirectionZ[i]));
+            int octant = (direction.x < 0.0f) | ((direction.y < 0.0f) << 1) | ((direction.z < 0.0f) << 2);
+            if (signs >= 0 && octant != signs)
+                return false;
+            signs = octant;
+            mean += direction;
+        }
+        if (signs < 0)
+            return true;
+
+        mean = glm::normalize(mean);
+        for (int i = 0; i < Size; i++)
+        {
+            if (((ActiveMask >> i) & 1u) &&
+                glm::dot(mean, glm::normalize(glm::vec3(DirectionX[i], DirectionY[i], DirectionZ[i]))) < minCosine)
+                return false;
+        }
+        return true;
+    }
+};
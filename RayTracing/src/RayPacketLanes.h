@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief The per lane ray data of a `RayPacket`, as plain arrays of floats.
+ *
+ * Kept apart from `RayPacket` because the per ISA builds of the kernels (see Kernels.h) read it, and those
+ * builds must not include headers with inline functions: the linker keeps a single copy of every inline
+ * function, which could be the one compiled for an instruction set the CPU does not have.
+ */
+struct RayPacketLanes
+{
+    static constexpr int MaxSize = 16;
+
+    uint32_t ActiveMask = 0;
+
+    float OriginX[MaxSize] = {}, OriginY[MaxSize] = {}, OriginZ[MaxSize] = {};
+    float DirectionX[MaxSize] = {}, DirectionY[MaxSize] = {}, DirectionZ[MaxSize] = {};
+    float InvDirectionX[MaxSize] = {}, InvDirectionY[MaxSize] = {}, InvDirectionZ[MaxSize] = {};
+    float TMax[MaxSize] = {};
+};
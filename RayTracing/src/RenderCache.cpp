@@ -0,0 +1,190 @@
+#include "RenderCache.h"
+#include "Checkpoint.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace
+{
+    constexpr const char *EntryExtension = ".checkpoint";
+    constexpr size_t KeyDigits = 16;
+}
+
+/**
+ * @brief Opens a cache directory, indexing the entries it holds, from the least to the most recently used.
+ *
+ * Files that are not entries are left alone, and entries that cannot be read are removed.
+ *
+ * @param directory The directory of the cache, created if it does not exist.
+ * @param capacityBytes The bytes the entries may take, beyond which the least recently used are removed.
+ * @param error Output parameter for a description of the problem if the directory cannot be used.
+ * @return bool Returns true if the cache is open; otherwise, returns false.
+ */
+bool RenderCache::Open(const std::string &directory, uint64_t capacityBytes, std::string &error)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::error_code code;
+    std::filesystem::create_directories(directory, code);
+    if (code)
+    {
+        error = "Cannot create " + directory + ": " + code.message();
+        return false;
+    }
+
+    struct Found
+    {
+        uint64_t Key;
+        std::filesystem::file_time_type Modified;
+    };
+    std::vector<Found> found;
+    for (const auto &file : std::filesystem::directory_iterator(directory, code))
+    {
+        const std::string name = file.path().filename().string();
+        uint64_t key = 0;
+        if (name.size() != KeyDigits + std::strlen(EntryExtension) || name.compare(KeyDigits, std::string::npos, EntryExtension) != 0 ||
+            std::from_chars(name.data(), name.data() + KeyDigits, key, 16).ptr != name.data() + KeyDigits)
+            continue;
+        std::error_code timeCode;
+        found.push_back({key, file.last_write_time(timeCode)});
+    }
+    if (code)
+    {
+        error = "Cannot list " + directory + ": " + code.message();
+        return false;
+    }
+
+    m_Directory = directory;
+    m_Capacity = capacityBytes;
+    m_Size = 0;
+    m_Entries.clear();
+    std::sort(found.begin(), found.end(), [](const Found &a, const Found &b)
+              { return a.Modified < b.Modified; });
+    for (const Found &file : found)
+    {
+        const std::string path = GetPath(file.Key);
+        RenderCheckpoint info;
+        std::string infoError;
+        if (!ReadCheckpointInfo(path, info, infoError))
+        {
+            std::remove(path.c_str());
+            continue;
+        }
+        Entry &entry = m_Entries[file.Key];
+        entry.Frames = info.Frames;
+        entry.Size = std::filesystem::file_size(path, code);
+        entry.LastUse = ++m_Uses;
+        m_Size += entry.Size;
+    }
+    Evict(0);
+    return true;
+}
+
+/**
+ * @brief Resumes a render from the frames of its entry, if there is one with no more frames than the render needs.
+ *
+ * An entry with more frames than maxFrames is left alone, as its image is not the one asked for; restoring
+ * one with exactly maxFrames gives the finished image without rendering anything.
+ *
+ * @param renderer The renderer, sized and set up for the render.
+ * @param sceneHash The `HashScene` of the scene rendered.
+ * @param camera The camera the scene is rendered with.
+ * @param maxFrames The frames the render accumulates.
+ * @return uint32_t The frames restored, 0 if the render starts from scratch.
+ */
+uint32_t RenderCache::Restore(Renderer &renderer, uint64_t sceneHash, const Camera &camera, uint32_t maxFrames)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const uint64_t key = HashRender(sceneHash, camera, renderer);
+    auto entry = m_Entries.find(key);
+    if (entry == m_Entries.end() || entry->second.Frames > maxFrames)
+        return 0;
+
+    const std::string path = GetPath(key);
+    std::string error;
+    if (!ResumeCheckpoint(path, renderer, sceneHash, camera, error))
+    {
+        // Another scene or view with the same hash, or a damaged file, is replaced by the next store
+        Remove(entry);
+        return 0;
+    }
+
+    std::error_code code;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), code);
+    entry->second.LastUse = ++m_Uses;
+    return renderer.GetAccumulatedFrames();
+}
+
+/**
+ * @brief Stores the frames a renderer accumulated as the entry of its render, replacing an entry with fewer.
+ *
+ * @param renderer The renderer, with the frames to store.
+ * @param sceneHash The `HashScene` of the scene rendered.
+ * @param camera The camera the scene was rendered with.
+ * @param error Output parameter for a description of the problem if the entry cannot be written.
+ * @return bool Returns true if the frames were stored or an entry had as many already; otherwise, returns false.
+ */
+bool RenderCache::Store(const Renderer &renderer, uint64_t sceneHash, const Camera &camera, std::string &error)
+{
+    const uint64_t key = HashRender(sceneHash, camera, renderer);
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto entry = m_Entries.find(key);
+        if (entry != m_Entries.end() && entry->second.Frames >= renderer.GetAccumulatedFrames())
+            return true;
+    }
+
+    RenderCheckpoint checkpoint;
+    if (!CaptureCheckpoint(renderer, sceneHash, camera, checkpoint))
+        return true;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const std::string path = GetPath(key);
+    if (!SaveCheckpoint(path, checkpoint, error))
+        return false;
+
+    Entry &entry = m_Entries[key];
+    std::error_code code;
+    m_Size -= entry.Size;
+    entry.Frames = checkpoint.Frames;
+    entry.Size = std::filesystem::file_size(path, code);
+    entry.LastUse = ++m_Uses;
+    m_Size += entry.Size;
+    Evict(key);
+    return true;
+}
+
+std::string RenderCache::GetPath(uint64_t key) const
+{
+    char name[KeyDigits + 1];
+    std::snprintf(name, sizeof(name), "%016" PRIx64, key);
+    return (std::filesystem::path(m_Directory) / (name + std::string(EntryExtension))).string();
+}
+
+void RenderCache::Remove(std::map<uint64_t, Entry>::iterator entry)
+{
+    std::remove(GetPath(entry->first).c_str());
+    m_Size -= entry->second.Size;
+    m_Entries.erase(entry);
+}
+
+// Removes the least recently used entries, other than keep, until the entries fit the capacity
+void RenderCache::Evict(uint64_t keep)
+{
+    while (m_Size > m_Capacity)
+    {
+        auto oldest = m_Entries.end();
+        for (auto entry = m_Entries.begin(); entry != m_Entries.end(); ++entry)
+        {
+            if (entry->first != keep && (oldest == m_Entries.end() || entry->second.LastUse < oldest->second.LastUse))
+                oldest = entry;
+        }
+        if (oldest == m_Entries.end())
+            return;
+        Remove(oldest);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Camera.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Accumulated frames of past renders kept on disk, so the same render is answered again without rendering it.
+ *
+ * Entries are checkpoints named after the `HashRender` of their scene, view and sampling, so a render finds
+ * its entry from what it renders rather than from where its scene came from. With deterministic sampling, a
+ * render resumed from an entry draws the samples a render from scratch would, so the image it ends with is
+ * the same whether it started from the entry or not. The least recently used entries are removed once the
+ * directory outgrows its capacity; files are touched when used, so the order survives restarts.
+ *
+ * The cache may be shared by the threads of a process, one call at a time, but not by processes.
+ */
+class RenderCache
+{
+public:
+    // Opens a cache directory, creating it if missing, and removes old entries beyond capacityBytes
+    bool Open(const std::string &directory, uint64_t capacityBytes, std::string &error);
+    bool IsOpen() const { return !m_Directory.empty(); }
+
+    // Restores the frames of a render's entry if it has at most maxFrames, returning the frames restored or 0
+    uint32_t Restore(Renderer &renderer, uint64_t sceneHash, const Camera &camera, uint32_t maxFrames);
+    // Stores the frames a renderer accumulated, unless its entry already has as many
+    bool Store(const Renderer &renderer, uint64_t sceneHash, const Camera &camera, std::string &error);
+
+private:
+    struct Entry
+    {
+        uint32_t Frames = 0;
+        uint64_t Size = 0; // Bytes of the file
+        uint64_t LastUse = 0;
+    };
+
+    std::string GetPath(uint64_t key) const;
+    void Remove(std::map<uint64_t, Entry>::iterator entry);
+    void Evict(uint64_t keep);
+
+private:
+    std::string m_Directory;
+    uint64_t m_Capacity = 0;
+    uint64_t m_Size = 0; // Bytes of all entries
+    uint64_t m_Uses = 0;
+    std::map<uint64_t, Entry> m_Entries; // By HashRender
+    std::mutex m_Mutex;
+};
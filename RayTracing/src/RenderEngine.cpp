@@ -0,0 +1,519 @@
+#include "RenderEngine.h"
+
+#include "Walnut/Timer.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+    constexpr char ProtocolMagic[4] = {'R', 'T', 'E', 'V'};
+    constexpr uint32_t ByteOrderMark = 0x01020304;
+
+    // How long a new connection gets to say hello, and a message that started arriving gets to arrive
+    constexpr int HandshakeTimeoutMs = 2000;
+    constexpr int MessageTimeoutMs = 5000;
+    // How often an idle engine checks for viewers and their edits
+    constexpr int IdlePollMs = 20;
+    constexpr uint32_t MaxImageSize = 16384;
+
+    // Set by SIGINT and SIGTERM, polled by the engine between frames
+    volatile std::sig_atomic_t s_StopRequested = 0;
+
+    void RequestStop(int)
+    {
+        s_StopRequested = 1;
+    }
+
+    enum class MessageType : uint32_t
+    {
+        Hello = 1,   // Viewer to engine: HelloMessage
+        Framebuffer, // Engine to viewer: the name of the shared framebuffer, after Hello and after every resize
+        State,       // Engine to viewer: StateMessage, after Hello and after another viewer's edits
+        Camera,      // Viewer to engine: CameraMessage
+        Options,     // Viewer to engine: OptionsMessage
+        Resize,      // Viewer to engine: ResizeMessage
+        Reset,       // Viewer to engine: restart accumulation
+        Stop,        // Viewer to engine: exit
+        Error,       // Engine to viewer: a description of the problem, before closing the connection
+    };
+
+    // Messages are sent in the byte order of the machines, which the handshake checks to be the same
+    struct HelloMessage
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t ByteOrder;
+    };
+
+    struct CameraMessage
+    {
+        float Position[3];
+        float Direction[3];
+        float VerticalFOV;
+        float Aperture;
+        float FocusDistance;
+    };
+
+    struct OptionsMessage
+    {
+        int32_t Bounces;
+        int32_t Samples;
+        uint32_t Antialiasing;
+        uint32_t Accumulate;
+        uint32_t AmbientOcclusion;
+        float AmbientOcclusionDistance;
+    };
+
+    struct StateMessage
+    {
+        CameraMessage Camera;
+        OptionsMessage Options;
+    };
+
+    struct ResizeMessage
+    {
+        uint32_t Width;
+        uint32_t Height;
+    };
+
+    CameraMessage GetCameraMessage(const Camera &camera)
+    {
+        CameraMessage message;
+        std::memcpy(message.Position, &camera.GetPosition().x, sizeof(message.Position));
+        std::memcpy(message.Direction, &camera.GetDirection().x, sizeof(message.Direction));
+        message.VerticalFOV = camera.GetVerticalFOV();
+        message.Aperture = camera.getAperatureSize();
+        message.FocusDistance = camera.getFocusDistance();
+        return message;
+    }
+
+    bool ApplyCameraMessage(const CameraMessage &message, Camera &camera)
+    {
+        const glm::vec3 position(message.Position[0], message.Position[1], message.Position[2]);
+        const glm::vec3 direction(message.Direction[0], message.Direction[1], message.Direction[2]);
+        if (glm::any(glm::isnan(position)) || glm::any(glm::isnan(direction)) || !(glm::length(direction) > 0.0f) ||
+            !(message.VerticalFOV > 0.0f && message.VerticalFOV < 180.0f) || !(message.Aperture >= 0.0f) || !(message.FocusDistance > 0.0f))
+            return false;
+        camera.SetView(position, direction);
+        camera.SetLens(message.VerticalFOV, message.Aperture, message.FocusDistance);
+        return true;
+    }
+
+    OptionsMessage GetOptionsMessage(const Renderer &renderer)
+    {
+        const Renderer::Settings &settings = renderer.GetSettings();
+        return {renderer.m_Bounces, renderer.m_Samples, settings.EnableAntialiasing ? 1u : 0u, settings.Accumulate ? 1u : 0u,
+                settings.AmbientOcclusion ? 1u : 0u, settings.AmbientOcclusionDistance};
+    }
+
+    void ApplyOptionsMessage(const OptionsMessage &message, Renderer &renderer)
+    {
+        Renderer::Settings &settings = renderer.GetSettings();
+        renderer.m_Bounces = glm::clamp(message.Bounces, 1, 64);
+        renderer.m_Samples = glm::clamp(message.Samples, 1, 100);
+        settings.EnableAntialiasing = message.Antialiasing != 0;
+        settings.Accumulate = message.Accumulate != 0;
+        settings.AmbientOcclusion = message.AmbientOcclusion != 0;
+        settings.AmbientOcclusionDistance = glm::max(message.AmbientOcclusionDistance, 0.01f);
+    }
+
+    // A connection that has not said hello yet
+    struct PendingViewer
+    {
+        Socket Connection;
+        Walnut::Timer Age;
+    };
+
+    // The render of an engine and the viewers attached to it
+    struct Engine
+    {
+        explicit Engine(const RenderEngineSettings &settings) : Settings(settings) {}
+
+        const RenderEngineSettings &Settings;
+        Scene RenderScene;
+        Camera RenderCamera = CreateDefaultCamera();
+        Renderer ImageRenderer{true};
+        SharedFramebuffer Framebuffer;
+        uint32_t Generation = 0; // Framebuffers created, each with a new name
+        std::vector<Socket> Viewers;
+        std::vector<PendingViewer> Pending;
+        bool StopRequested = false; // A viewer stopped the engine
+    };
+
+    void Log(const char *format, const std::string &message)
+    {
+        std::fprintf(stderr, format, message.c_str());
+        std::fprintf(stderr, "\n");
+    }
+
+    bool SendState(Engine &engine, Socket &viewer)
+    {
+        const StateMessage state{GetCameraMessage(engine.RenderCamera), GetOptionsMessage(engine.ImageRenderer)};
+        return SendMessage(viewer, MessageType::State, &state, sizeof(state));
+    }
+
+    bool SendFramebuffer(Engine &engine, Socket &viewer)
+    {
+        const std::string &name = engine.Framebuffer.GetName();
+        return SendMessage(viewer, MessageType::Framebuffer, name.data(), name.size());
+    }
+
+    /**
+     * @brief Checks a new connection whose hello arrived is a viewer of this version, and tells it where to find the image.
+     *
+     * @return bool Returns false, with a description of the problem in `error`, if the connection is not a usable viewer.
+     */
+    bool AttachViewer(Engine &engine, Socket &viewer, std::string &error)
+    {
+        MessageType type;
+        std::vector<char> payload;
+        HelloMessage hello;
+        viewer.SetReceiveTimeout(MessageTimeoutMs);
+        if (!ReceiveMessage(viewer, type, payload) || type != MessageType::Hello || !ReadPayload(payload, hello) ||
+            std::memcmp(hello.Magic, ProtocolMagic, sizeof(ProtocolMagic)) != 0)
+        {
+            error = "not a viewer";
+            return false;
+        }
+        if (hello.Version != RenderEngineProtocolVersion || hello.ByteOrder != ByteOrderMark)
+        {
+            error = "protocol version " + std::to_string(hello.Version) + " or byte order differs from the engine's";
+            SendMessage(viewer, MessageType::Error, error.data(), error.size());
+            return false;
+        }
+
+        if (!SendFramebuffer(engine, viewer) || !SendState(engine, viewer))
+        {
+            error = "connection lost";
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Attaches the new connections whose hello arrived, and drops those that sent none in time.
+     *
+     * Only connections with data waiting are read, so a connection that never says hello cannot stall the render.
+     */
+    void AttachPendingViewers(Engine &engine)
+    {
+        for (size_t i = 0; i < engine.Pending.size();)
+        {
+            PendingViewer &pending = engine.Pending[i];
+            std::string attachError;
+            if (pending.Connection.WaitReadable(0))
+            {
+                if (AttachViewer(engine, pending.Connection, attachError))
+                {
+                    engine.Viewers.push_back(std::move(pending.Connection));
+                    std::fprintf(stderr, "Viewer attached\n");
+                }
+                else
+                    Log("Refused a viewer: %s", attachError);
+            }
+            else if (pending.Age.ElapsedMillis() > HandshakeTimeoutMs)
+                Log("Refused a viewer: %s", "no hello in time");
+            else
+            {
+                i++;
+                continue;
+            }
+            engine.Pending.erase(engine.Pending.begin() + i);
+        }
+    }
+
+    /**
+     * @brief Applies the edits a viewer sent since the last frame, passing them on to the other viewers.
+     *
+     * @return bool Returns false, with a description of the problem in `error`, once the viewer has to be detached.
+     */
+    bool ServeViewer(Engine &engine, size_t index, std::string &error)
+    {
+        Socket &viewer = engine.Viewers[index];
+        Renderer &renderer = engine.ImageRenderer;
+        MessageType type;
+        std::vector<char> payload;
+        while (viewer.WaitReadable(0))
+        {
+            if (!ReceiveMessage(viewer, type, payload))
+            {
+                error = "disconnected";
+                return false;
+            }
+
+            bool stateChanged = false;
+            CameraMessage camera;
+            OptionsMessage options;
+            ResizeMessage size;
+            if (type == MessageType::Camera && ReadPayload(payload, camera))
+            {
+                stateChanged = ApplyCameraMessage(camera, engine.RenderCamera);
+                renderer.ResetFrameIndex();
+            }
+            else if (type == MessageType::Options && ReadPayload(payload, options))
+            {
+                ApplyOptionsMessage(options, renderer);
+                renderer.ResetFrameIndex();
+                stateChanged = true;
+            }
+            else if (type == MessageType::Resize && ReadPayload(payload, size))
+            {
+                if (size.Width == 0 || size.Height == 0 || size.Width > MaxImageSize || size.Height > MaxImageSize)
+                    continue;
+                if (size.Width == renderer.GetWidth() && size.Height == renderer.GetHeight())
+                    continue;
+
+                // Viewers keep showing the last image until they attach to the new framebuffer
+                std::string resizeError;
+                if (!engine.Framebuffer.Create(++engine.Generation, size.Width, size.Height, engine.Settings.TileSize, resizeError))
+                {
+                    Log("Cannot resize: %s", resizeError);
+                    engine.StopRequested = true;
+                    return true;
+                }
+                renderer.OnResize(size.Width, size.Height);
+                engine.RenderCamera.OnResize(size.Width, size.Height);
+                for (Socket &other : engine.Viewers)
+                    SendFramebuffer(engine, other);
+                Log("Resized to %s", std::to_string(size.Width) + "x" + std::to_string(size.Height));
+            }
+            else if (type == MessageType::Reset)
+                renderer.ResetFrameIndex();
+            else if (type == MessageType::Stop)
+            {
+                engine.StopRequested = true;
+                return true;
+            }
+            else
+            {
+                error = "unexpected message";
+                SendMessage(viewer, MessageType::Error, error.data(), error.size());
+                return false;
+            }
+
+            // A viewer that fails to receive its copy is detached when reading from it fails
+            if (stateChanged)
+            {
+                for (size_t other = 0; other < engine.Viewers.size(); other++)
+                {
+                    if (other != index)
+                        SendState(engine, engine.Viewers[other]);
+                }
+            }
+        }
+        return true;
+    }
+}
+
+/**
+ * @brief Renders a scene progressively, publishing the image in shared memory for the viewers attached to an address.
+ *
+ * Viewers are editors showing the image and sending edits of the camera and of the render options, which
+ * restart accumulation. Edits that arrive while a frame renders are all applied before the next one. The
+ * engine renders whether or not viewers are attached, idling once it accumulated the job's frames, so
+ * viewers can come and go without losing the render. It stops on SIGINT, SIGTERM or a viewer's request.
+ *
+ * @param settings The scene, image size, sampling and address of the engine.
+ * @param error Output parameter for a description of the problem if the engine cannot start.
+ * @return bool Returns true if the engine ran until it was stopped; otherwise, returns false.
+ */
+bool RunRenderEngine(const RenderEngineSettings &settings, std::string &error)
+{
+    const RenderJobSettings &job = settings.Job;
+    if (job.Width == 0 || job.Height == 0 || job.Width > MaxImageSize || job.Height > MaxImageSize || settings.TileSize == 0)
+    {
+        error = "The image size must be between 1 and " + std::to_string(MaxImageSize) + ", and the tile size not 0";
+        return false;
+    }
+
+    Engine engine(settings);
+    std::vector<std::string> materialNames;
+    if (!LoadRenderScene(settings.ScenePath, engine.RenderScene, engine.RenderCamera, materialNames, error))
+        return false;
+    SetupHeadlessRenderer(job, engine.ImageRenderer, engine.RenderCamera);
+    if (!engine.Framebuffer.Create(++engine.Generation, job.Width, job.Height, settings.TileSize, error))
+        return false;
+
+    // The image is only shared with viewers on this machine, and viewers may stop and resize the render
+    Socket listener = Socket::Listen(settings.Address, error, true);
+    if (!listener.IsValid())
+        return false;
+
+    s_StopRequested = 0;
+    auto previousInterrupt = std::signal(SIGINT, RequestStop);
+    auto previousTerminate = std::signal(SIGTERM, RequestStop);
+    Log("Rendering, viewers can attach on %s", settings.Address);
+
+    Renderer &renderer = engine.ImageRenderer;
+    while (!s_StopRequested && !engine.StopRequested)
+    {
+        while (listener.WaitReadable(0))
+        {
+            Socket viewer = listener.Accept();
+            if (!viewer.IsValid())
+                break;
+            engine.Pending.push_back({std::move(viewer), Walnut::Timer()});
+        }
+        AttachPendingViewers(engine);
+
+        for (size_t i = 0; i < engine.Viewers.size() && !engine.StopRequested;)
+        {
+            std::string viewerError;
+            if (ServeViewer(engine, i, viewerError))
+            {
+                i++;
+                continue;
+            }
+            engine.Viewers.erase(engine.Viewers.begin() + i);
+            Log("Viewer detached: %s", viewerError);
+        }
+        if (engine.StopRequested)
+            break;
+
+        if (job.Frames > 0 && renderer.GetSettings().Accumulate && renderer.GetAccumulatedFrames() >= job.Frames)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(IdlePollMs));
+            continue;
+        }
+
+        Walnut::Timer timer;
+        renderer.Render(engine.RenderScene, engine.RenderCamera);
+        engine.Framebuffer.Publish(renderer.GetImageData(), renderer.GetAccumulatedFrames(), timer.ElapsedMillis());
+    }
+
+    std::signal(SIGINT, previousInterrupt);
+    std::signal(SIGTERM, previousTerminate);
+    Log("Stopped after %s accumulated frames", std::to_string(renderer.GetAccumulatedFrames()));
+    return true;
+}
+
+/**
+ * @brief Attaches to the engine listening on an address.
+ *
+ * The engine's reply, with its framebuffer, camera and options, is read by the following calls to `Update`.
+ *
+ * @param address The engine's address, "host:port" or "unix:path".
+ * @param error Output parameter for a description of the problem if the engine cannot be reached.
+ * @return bool Returns true if connected; otherwise, returns false.
+ */
+bool RenderEngineClient::Connect(const std::string &address, std::string &error)
+{
+    Disconnect();
+    m_Socket = Socket::Connect(address, error);
+    if (!m_Socket.IsValid())
+        return false;
+
+    HelloMessage hello{};
+    std::memcpy(hello.Magic, ProtocolMagic, sizeof(ProtocolMagic));
+    hello.Version = RenderEngineProtocolVersion;
+    hello.ByteOrder = ByteOrderMark;
+    if (!SendMessage(m_Socket, MessageType::Hello, &hello, sizeof(hello)))
+    {
+        error = "Connection to " + address + " lost";
+        Disconnect();
+        return false;
+    }
+    m_Socket.SetReceiveTimeout(MessageTimeoutMs);
+    return true;
+}
+
+void RenderEngineClient::Disconnect()
+{
+    m_Socket.Close();
+    m_Framebuffer.Close();
+    m_Image.clear();
+    m_TileSequences.clear();
+    m_State.clear();
+}
+
+/**
+ * @brief Reads the messages the engine sent, then copies the tiles of its image that changed since the last call.
+ *
+ * A new framebuffer, after the engine is resized, replaces the image, and all of its tiles are copied as
+ * they get published.
+ *
+ * @param changed Output parameter for the tiles of the image copied.
+ * @param error Output parameter for a description of the problem if the engine is lost.
+ * @return bool Returns true while attached; otherwise, returns false, detached.
+ */
+bool RenderEngineClient::Update(std::vector<FramebufferTile> &changed, std::string &error)
+{
+    changed.clear();
+    MessageType type;
+    std::vector<char> payload;
+    while (m_Socket.IsValid() && m_Socket.WaitReadable(0))
+    {
+        if (!ReceiveMessage(m_Socket, type, payload))
+            error = "Connection to the engine lost";
+        else if (type == MessageType::Framebuffer)
+        {
+            if (m_Framebuffer.Attach(PayloadText(payload), error))
+            {
+                m_Image.assign(static_cast<size_t>(GetWidth()) * GetHeight(), 0);
+                m_TileSequences.clear();
+                continue;
+            }
+        }
+        else if (type == MessageType::State && payload.size() == sizeof(StateMessage))
+        {
+            m_State = payload;
+            continue;
+        }
+        else
+            error = type == MessageType::Error ? PayloadText(payload) : "Unexpected message from the engine";
+
+        Disconnect();
+        return false;
+    }
+
+    if (!m_Socket.IsValid())
+    {
+        error = "Not attached to an engine";
+        return false;
+    }
+    m_Framebuffer.ReadChangedTiles(m_Image.data(), m_TileSequences, changed);
+    return true;
+}
+
+bool RenderEngineClient::TakeState(Camera &camera, Renderer &renderer)
+{
+    StateMessage state;
+    if (!ReadPayload(m_State, state))
+        return false;
+    m_State.clear();
+    ApplyCameraMessage(state.Camera, camera);
+    ApplyOptionsMessage(state.Options, renderer);
+    return true;
+}
+
+bool RenderEngineClient::SendCamera(const Camera &camera)
+{
+    const CameraMessage message = GetCameraMessage(camera);
+    return SendMessage(m_Socket, MessageType::Camera, &message, sizeof(message));
+}
+
+bool RenderEngineClient::SendOptions(const Renderer &renderer)
+{
+    const OptionsMessage message = GetOptionsMessage(renderer);
+    return SendMessage(m_Socket, MessageType::Options, &message, sizeof(message));
+}
+
+bool RenderEngineClient::SendResize(uint32_t width, uint32_t height)
+{
+    const ResizeMessage message{width, height};
+    return SendMessage(m_Socket, MessageType::Resize, &message, sizeof(message));
+}
+
+bool RenderEngineClient::SendReset()
+{
+    return SendMessage(m_Socket, MessageType::Reset);
+}
+
+bool RenderEngineClient::SendStop()
+{
+    return SendMessage(m_Socket, MessageType::Stop);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Headless.h"
+#include "SharedFramebuffer.h"
+#include "Socket.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Increased whenever the messages exchanged between engines and viewers change
+constexpr uint32_t RenderEngineProtocolVersion = 1;
+
+// A progressive render in its own process, shown and steered by the editors attached to it
+struct RenderEngineSettings
+{
+    std::string Address;   // "unix:path", or a loopback "host:port" (":port" for 127.0.0.1) viewers connect to
+    std::string ScenePath; // Scene file or cache to render
+    RenderJobSettings Job; // Frames are the frames accumulated before the engine idles until the next edit, 0 to never idle
+    uint32_t TileSize = 32; // Width and height of the tiles viewers copy and upload when they change
+};
+
+// Renders until a viewer or a signal stops the engine
+bool RunRenderEngine(const RenderEngineSettings &settings, std::string &error);
+
+/**
+ * @brief The editor's side of an attached render engine: the engine's image, and the edits sent to it.
+ *
+ * The image is read from the engine's shared framebuffer, a tile at a time as they change, so the editor only
+ * uploads those. The engine renders on whether or not a viewer is attached, and a viewer that attaches takes
+ * the engine's camera and options, so restarting the editor never restarts the render.
+ */
+class RenderEngineClient
+{
+public:
+    bool Connect(const std::string &address, std::string &error);
+    // Detaches from the engine, which goes on rendering
+    void Disconnect();
+    bool IsConnected() const { return m_Socket.IsValid(); }
+
+    // Handles the engine's messages and copies the tiles it published since the last call
+    bool Update(std::vector<FramebufferTile> &changed, std::string &error);
+    // Applies the camera and options the engine sent, once, returning false if none arrived since the last call
+    bool TakeState(Camera &camera, Renderer &renderer);
+
+    // The engine's image, as displayed, row by row from the bottom like `Renderer::GetImageData`
+    const uint32_t *GetImageData() const { return m_Image.data(); }
+    uint32_t GetWidth() const { return m_Framebuffer.GetWidth(); }
+    uint32_t GetHeight() const { return m_Framebuffer.GetHeight(); }
+    uint32_t GetTileCount() const { return m_Framebuffer.GetTileCount(); }
+    uint32_t GetAccumulatedFrames() const { return m_Framebuffer.GetAccumulatedFrames(); }
+    float GetFrameTime() const { return m_Framebuffer.GetFrameTime(); }
+
+    bool SendCamera(const Camera &camera);
+    bool SendOptions(const Renderer &renderer);
+    bool SendResize(uint32_t width, uint32_t height);
+    bool SendReset();
+    // Stops the engine, which exits after its current frame
+    bool SendStop();
+
+private:
+    Socket m_Socket;
+    SharedFramebuffer m_Framebuffer;
+    std::vector<uint32_t> m_Image;
+    std::vector<uint32_t> m_TileSequences; // Sequence number of every tile copied into m_Image
+    std::vector<char> m_State; // Payload of the last state the engine sent, until taken
+};
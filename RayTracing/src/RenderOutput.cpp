@@ -0,0 +1,134 @@
+#include "RenderOutput.h"
+
+#include "Walnut/Timer.h"
+
+/**
+ * @brief Copies the renderer's accumulated color, and renders the requested layers, into a snapshot.
+ *
+ * The color is the average of the accumulated frames, in linear HDR without the clamping of the displayed
+ * image. The depth, normal and albedo layers are rendered by `Renderer::RenderAOVs`, which costs one ray
+ * per pixel. The snapshot's buffers are reused when they are already large enough.
+ *
+ * @param renderer The renderer to copy the output of.
+ * @param scene The scene being rendered.
+ * @param camera The camera the scene is being rendered with.
+ * @param layers The RenderLayer mask of the layers to add to the color.
+ * @param snapshot Output parameter for the snapshot.
+ * @return bool Returns false if the renderer has not accumulated any frame yet, since only accumulated color is kept in floating point.
+ */
+bool CaptureRenderSnapshot(Renderer &renderer, const Scene &scene, const Camera &camera, uint32_t layers, RenderSnapshot &snapshot)
+{
+    const uint32_t width = renderer.GetWidth();
+    const uint32_t height = renderer.GetHeight();
+    const uint32_t frames = renderer.GetAccumulatedFrames();
+    if (frames == 0 || camera.GetRayDirections().size() != static_cast<size_t>(width) * height)
+        return false;
+
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    snapshot.Width = width;
+    snapshot.Height = height;
+    snapshot.Layers = layers;
+    snapshot.Samples = frames * static_cast<uint32_t>(glm::max(renderer.m_Samples, 1));
+    snapshot.SampleCounts.clear();
+
+    snapshot.Color.resize(pixelCount);
+    const glm::vec4 *accumulation = renderer.GetAccumulationData();
+    glm::vec4 *color = snapshot.Color.data();
+    const float scale = 1.0f / static_cast<float>(frames);
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < static_cast<int>(height); y++)
+    {
+        const size_t offset = static_cast<size_t>(y) * width;
+        for (uint32_t x = 0; x < width; x++)
+            color[offset + x] = accumulation[offset + x] * scale;
+    }
+
+    snapshot.Depth.resize(layers & RenderLayerDepth ? pixelCount : 0);
+    snapshot.Normals.resize(layers & RenderLayerNormal ? pixelCount : 0);
+    snapshot.Albedo.resize(layers & RenderLayerAlbedo ? pixelCount : 0);
+    if (layers & (RenderLayerDepth | RenderLayerNormal | RenderLayerAlbedo))
+    {
+        renderer.RenderAOVs(scene, camera, snapshot.Depth.empty() ? nullptr : snapshot.Depth.data(),
+                            snapshot.Normals.empty() ? nullptr : snapshot.Normals.data(),
+                            snapshot.Albedo.empty() ? nullptr : snapshot.Albedo.data());
+    }
+    return true;
+}
+
+/**
+ * @brief Writes a snapshot to an EXR file, with the color in the main RGBA layer and the other layers after it.
+ *
+ * @param path The path of the file.
+ * @param snapshot The snapshot to write.
+ * @param compression The compression of the scanlines.
+ * @param error Output parameter for a description of the problem if writing fails.
+ * @return bool Returns true if the image was written; otherwise, returns false.
+ */
+bool SaveRenderExr(const std::string &path, const RenderSnapshot &snapshot, ExrCompression compression, std::string &error)
+{
+    std::vector<ExrChannel> channels;
+    const char *color = reinterpret_cast<const char *>(snapshot.Color.data());
+    channels.push_back({"R", ExrPixelType::Float, color, sizeof(glm::vec4)});
+    channels.push_back({"G", ExrPixelType::Float, color + sizeof(float), sizeof(glm::vec4)});
+    channels.push_back({"B", ExrPixelType::Float, color + 2 * sizeof(float), sizeof(glm::vec4)});
+    channels.push_back({"A", ExrPixelType::Float, color + 3 * sizeof(float), sizeof(glm::vec4)});
+
+    if (!snapshot.Depth.empty())
+        channels.push_back({"Z", ExrPixelType::Float, snapshot.Depth.data(), sizeof(float)});
+    if (!snapshot.Normals.empty())
+    {
+        const char *normals = reinterpret_cast<const char *>(snapshot.Normals.data());
+        channels.push_back({"normal.X", ExrPixelType::Float, normals, sizeof(glm::vec3)});
+        channels.push_back({"normal.Y", ExrPixelType::Float, normals + sizeof(float), sizeof(glm::vec3)});
+        channels.push_back({"normal.Z", ExrPixelType::Float, normals + 2 * sizeof(float), sizeof(glm::vec3)});
+    }
+    if (!snapshot.Albedo.empty())
+    {
+        const char *albedo = reinterpret_cast<const char *>(snapshot.Albedo.data());
+        channels.push_back({"albedo.R", ExrPixelType::Float, albedo, sizeof(glm::vec3)});
+        channels.push_back({"albedo.G", ExrPixelType::Float, albedo + sizeof(float), sizeof(glm::vec3)});
+        channels.push_back({"albedo.B", ExrPixelType::Float, albedo + 2 * sizeof(float), sizeof(glm::vec3)});
+    }
+
+    // Without per pixel counts every pixel has the same number of samples, so the channel reads the same value over and over
+    if (snapshot.Layers & RenderLayerSamples)
+    {
+        if (!snapshot.SampleCounts.empty())
+            channels.push_back({"samples", ExrPixelType::UInt, snapshot.SampleCounts.data(), sizeof(uint32_t)});
+        else
+            channels.push_back({"samples", ExrPixelType::UInt, &snapshot.Samples, 0});
+    }
+
+    return WriteExr(path, snapshot.Width, snapshot.Height, std::move(channels), compression, error);
+}
+
+/**
+ * @brief Captures a snapshot of the renderer's output and queues it to be written to an EXR file in the background.
+ *
+ * Only `CaptureRenderSnapshot` delays the caller; encoding and writing the file happen on the worker thread.
+ * An image is written at a time, and the snapshot's buffers are kept for the next one.
+ *
+ * @param path The path of the file.
+ * @param renderer The renderer to write the output of.
+ * @param scene The scene being rendered.
+ * @param camera The camera the scene is being rendered with.
+ * @param layers The RenderLayer mask of the layers to add to the color.
+ * @param compression The compression of the scanlines.
+ * @return bool Returns false, without waiting, if the previous image is still being written or nothing has been accumulated.
+ */
+bool RenderOutputWriter::Submit(const std::string &path, Renderer &renderer, const Scene &scene, const Camera &camera, uint32_t layers, ExrCompression compression)
+{
+    // The worker does not touch the snapshot while it is idle
+    if (m_Worker.IsBusy() || !CaptureRenderSnapshot(renderer, scene, camera, layers, m_Snapshot))
+        return false;
+
+    return m_Worker.Run([this, path, compression]()
+                        {
+        Walnut::Timer timer;
+        std::string error;
+        if (!SaveRenderExr(path, m_Snapshot, compression, error))
+            return error;
+        return "Saved " + path + " (" + std::to_string(m_Snapshot.Samples) + " samples per pixel) in " +
+               std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms"; });
+}
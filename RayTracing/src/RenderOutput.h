@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "Exr.h"
+#include "BackgroundWorker.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Layers written along with the color, combined into a mask
+enum RenderLayer : uint32_t
+{
+    RenderLayerDepth = 1 << 0,   // "Z"
+    RenderLayerNormal = 1 << 1,  // "normal.X", "normal.Y" and "normal.Z"
+    RenderLayerAlbedo = 1 << 2,  // "albedo.R", "albedo.G" and "albedo.B"
+    RenderLayerSamples = 1 << 3, // "samples", per pixel
+};
+
+// Copy of the renderer's output, written to a file while rendering goes on
+struct RenderSnapshot
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t Layers = 0;
+    uint32_t Samples = 0;               // Samples per pixel averaged in Color
+    std::vector<uint32_t> SampleCounts; // Samples of each pixel, in place of Samples when they differ between pixels
+    std::vector<glm::vec4> Color;       // Linear HDR color, unclamped
+    std::vector<float> Depth;
+    std::vector<glm::vec3> Normals;
+    std::vector<glm::vec3> Albedo;
+};
+
+bool CaptureRenderSnapshot(Renderer &renderer, const Scene &scene, const Camera &camera, uint32_t layers, RenderSnapshot &snapshot);
+bool SaveRenderExr(const std::string &path, const RenderSnapshot &snapshot, ExrCompression compression, std::string &error);
+
+/**
+ * @brief Writes render outputs to EXR files on a background thread, so rendering goes on while they are encoded.
+ */
+class RenderOutputWriter
+{
+public:
+    bool Submit(const std::string &path, Renderer &renderer, const Scene &scene, const Camera &camera, uint32_t layers, ExrCompression compression);
+    bool IsBusy() const { return m_Worker.IsBusy(); }
+    void Wait() { m_Worker.Wait(); }
+
+    // Result of the last image written
+    std::string GetStatus() const { return m_Worker.GetStatus(); }
+
+private:
+    RenderSnapshot m_Snapshot; // Only touched by the worker while it is busy
+    BackgroundWorker m_Worker; // Declared last, so it finishes writing before the snapshot is destroyed
+};
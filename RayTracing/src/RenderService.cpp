@@ -0,0 +1,719 @@
+#include "RenderService.h"
+#include "Checkpoint.h"
+#include "Headless.h"
+#include "JobQueue.h"
+#include "Json.h"
+#include "RenderCache.h"
+#include "SceneFile.h"
+#include "Socket.h"
+
+#include "Walnut/Timer.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr char ProtocolMagic[4] = {'R', 'T', 'S', 'V'};
+    constexpr uint32_t ByteOrderMark = 0x01020304;
+
+    // How long a new connection gets to say hello, and a message that started arriving gets to arrive
+    constexpr int HandshakeTimeoutMs = 2000;
+    constexpr int MessageTimeoutMs = 5000;
+    // How often connections check for requests, for replies to send and for the service stopping
+    constexpr int PollMs = 10;
+    // Seconds a request renders before the threads go to the request that rendered least
+    constexpr float TimeSlice = 0.1f;
+    constexpr uint32_t MaxImageSize = 16384;
+
+    // Set by SIGINT and SIGTERM, polled by the connections and the render threads
+    volatile std::sig_atomic_t s_StopRequested = 0;
+
+    void RequestStop(int)
+    {
+        s_StopRequested = 1;
+    }
+
+    // Whether a scene path stays in the service's working directory: relative, and never going up with ".."
+    bool IsServedPath(const std::string &path)
+    {
+        const std::filesystem::path scenePath(path);
+        if (scenePath.has_root_name() || scenePath.has_root_directory())
+            return false;
+        return std::none_of(scenePath.begin(), scenePath.end(), [](const std::filesystem::path &part)
+                            { return part == ".."; });
+    }
+
+    // A request as read from its JSON text
+    struct RequestSettings
+    {
+        RenderJob Job;         // The scene path, image, sampling and camera, the scene path empty for inline scenes
+        std::string SceneText; // Inline scene document
+        float UpdateInterval = 0.5f;
+    };
+
+    bool ReadRequest(const char *begin, const char *end, RequestSettings &request, std::string &error)
+    {
+        RenderJob &job = request.Job;
+        JsonReader reader(begin, end);
+        uint32_t samples = 1, samplesPerFrame = 1, bounces = static_cast<uint32_t>(job.Settings.Bounces);
+        const bool read = reader.ReadObject([&](const std::string &key)
+                                            {
+            if (key == "format")
+            {
+                std::string format;
+                return reader.ReadString(format) && (format == "raytracing-request" || reader.Fail("not a render request"));
+            }
+            if (key == "version")
+            {
+                long long version;
+                return reader.ReadInteger(version) && (version <= RenderRequestVersion || reader.Fail("request from a newer version"));
+            }
+            if (key == "scene")
+            {
+                if (reader.Peek() == '"')
+                    return reader.ReadString(job.ScenePath);
+                if (reader.Peek() != '{')
+                    return reader.Fail("expected a scene path or document");
+                // Kept as text, parsed only if the scene is not loaded already
+                const char *start = reader.GetPosition();
+                if (!reader.SkipValue())
+                    return false;
+                request.SceneText.assign(start, reader.GetPosition());
+                return true;
+            }
+            if (key == "camera")
+                return ReadJobCamera(reader, job);
+            if (key == "width")
+                return reader.ReadCount(job.Settings.Width);
+            if (key == "height")
+                return reader.ReadCount(job.Settings.Height);
+            if (key == "samples")
+                return reader.ReadCount(samples);
+            if (key == "samplesPerFrame")
+                return reader.ReadCount(samplesPerFrame);
+            if (key == "bounces")
+                return reader.ReadCount(bounces);
+            if (key == "antialiasing")
+                return reader.ReadBool(job.Settings.Antialiasing);
+            if (key == "updateInterval")
+                return reader.ReadFloat(request.UpdateInterval) && (request.UpdateInterval >= 0.0f || reader.Fail("negative update interval"));
+            return reader.SkipValue(); });
+
+        bool valid = read && (reader.AtEnd() || reader.Fail("unexpected text after the request"));
+        if (valid && job.ScenePath.empty() && request.SceneText.empty())
+            valid = reader.Fail("requests need a scene");
+        if (valid && !job.ScenePath.empty() && !IsServedPath(job.ScenePath))
+            valid = reader.Fail("scene paths must be relative to the service's directory, without ..");
+        if (valid && (job.CameraMembers & JobCameraDirection) && glm::length(job.CameraDirection) == 0.0f)
+            valid = reader.Fail("camera direction is zero");
+        if (valid && (job.Settings.Width > MaxImageSize || job.Settings.Height > MaxImageSize))
+            valid = reader.Fail("image larger than the service renders");
+        // Images are sent whole, in a single message
+        if (valid && sizeof(RenderServiceImage) + static_cast<uint64_t>(job.Settings.Width) * job.Settings.Height * sizeof(uint32_t) > MaxMessageSize)
+            valid = reader.Fail("image larger than the service sends");
+        if (!valid)
+        {
+            error = "Request, " + reader.GetError();
+            return false;
+        }
+
+        job.Name = job.ScenePath.empty() ? "inline scene" : job.ScenePath;
+        job.Settings.Samples = static_cast<int>(samplesPerFrame);
+        job.Settings.Frames = (samples + samplesPerFrame - 1) / samplesPerFrame;
+        job.Settings.Bounces = static_cast<int>(bounces);
+        return true;
+    }
+
+    // A scene loaded for requests, shared by all the requests rendering it
+    struct LoadedScene
+    {
+        Scene RenderScene;
+        Camera SceneCamera = CreateDefaultCamera();
+        uint64_t Hash = 0; // HashScene, hashed once for the render cache
+        std::string Error; // Why loading failed, with nothing to render
+    };
+
+    /**
+     * @brief Scenes loaded for requests, kept for the next requests of the same scene file or inline document.
+     *
+     * A scene loads once however many requests ask for it at the same time: the first one loads it, and the
+     * others wait for the result. Scene files are loaded again once modified, while the requests rendering
+     * the old version finish with it. Besides the scenes requests render, the most recently used are kept up
+     * to a capacity.
+     */
+    class SceneLibrary
+    {
+    public:
+        explicit SceneLibrary(size_t capacity) : m_Capacity(capacity) {}
+
+        std::shared_ptr<const LoadedScene> Acquire(const RequestSettings &request);
+
+    private:
+        struct Entry
+        {
+            std::shared_future<std::shared_ptr<const LoadedScene>> Scene;
+            std::filesystem::file_time_type Modified; // Of a scene file, when it was loaded
+            uint64_t Load = 0;                        // Identifies the load, to tell a failed one from its replacement
+            uint64_t LastUse = 0;
+        };
+
+        void Evict();
+
+    private:
+        std::mutex m_Mutex;
+        std::map<std::string, Entry> m_Entries; // By the absolute path of a scene file, or the text of an inline scene
+        size_t m_Capacity;
+        uint64_t m_Uses = 0;
+    };
+
+    /**
+     * @brief Finds the scene of a request, loading it unless it is already loaded or loading.
+     *
+     * @param request The request, with the path of its scene or the scene inline.
+     * @return std::shared_ptr<const LoadedScene> The scene, with a description of the problem in `Error` if it failed to load.
+     */
+    std::shared_ptr<const LoadedScene> SceneLibrary::Acquire(const RequestSettings &request)
+    {
+        const bool inlineScene = !request.SceneText.empty();
+        std::string key;
+        std::filesystem::file_time_type modified{};
+        if (inlineScene)
+            key = "inline:" + request.SceneText;
+        else
+        {
+            std::error_code code;
+            const std::filesystem::path path = std::filesystem::absolute(request.Job.ScenePath, code).lexically_normal();
+            key = "file:" + path.string();
+            modified = std::filesystem::last_write_time(path, code);
+        }
+
+        std::promise<std::shared_ptr<const LoadedScene>> promise;
+        std::shared_future<std::shared_ptr<const LoadedScene>> scene;
+        uint64_t load = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            auto entry = m_Entries.find(key);
+            if (entry != m_Entries.end() && entry->second.Modified == modified)
+            {
+                entry->second.LastUse = ++m_Uses;
+                scene = entry->second.Scene;
+            }
+            else
+            {
+                scene = promise.get_future().share();
+                load = ++m_Uses;
+                m_Entries[key] = Entry{scene, modified, load, load};
+            }
+        }
+        if (load == 0)
+            return scene.get();
+
+        auto loaded = std::make_shared<LoadedScene>();
+        std::vector<std::string> materialNames;
+        Walnut::Timer timer;
+        if (inlineScene)
+        {
+            const char *text = request.SceneText.data();
+            if (ReadSceneText(text, text + request.SceneText.size(), "Inline scene", loaded->RenderScene, &loaded->SceneCamera, materialNames, loaded->Error))
+                BuildRenderAccelerator(loaded->RenderScene);
+        }
+        else
+            LoadRenderScene(request.Job.ScenePath, loaded->RenderScene, loaded->SceneCamera, materialNames, loaded->Error);
+        if (loaded->Error.empty())
+            loaded->Hash = HashScene(loaded->RenderScene);
+        promise.set_value(loaded);
+        if (loaded->Error.empty())
+            std::fprintf(stderr, "Loaded %s in %.2fs\n", inlineScene ? "an inline scene" : request.Job.ScenePath.c_str(), timer.Elapsed());
+
+        // A failed load is forgotten, so the next request tries again
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto entry = m_Entries.find(key);
+        if (!loaded->Error.empty() && entry != m_Entries.end() && entry->second.Load == load)
+            m_Entries.erase(entry);
+        Evict();
+        return loaded;
+    }
+
+    // Forgets the least recently used scenes no request renders, beyond the capacity. Called with the mutex locked.
+    void SceneLibrary::Evict()
+    {
+        while (true)
+        {
+            size_t unused = 0;
+            auto oldest = m_Entries.end();
+            for (auto entry = m_Entries.begin(); entry != m_Entries.end(); ++entry)
+            {
+                const auto &scene = entry->second.Scene;
+                if (scene.wait_for(std::chrono::seconds(0)) != std::future_status::ready || scene.get().use_count() > 1)
+                    continue;
+                unused++;
+                if (oldest == m_Entries.end() || entry->second.LastUse < oldest->second.LastUse)
+                    oldest = entry;
+            }
+            if (unused <= m_Capacity)
+                return;
+            m_Entries.erase(oldest);
+        }
+    }
+
+    struct Reply
+    {
+        RenderServiceMessage Type;
+        uint32_t Id;
+        std::vector<char> Payload;
+    };
+
+    // A client's connection, with the replies waiting for its thread to send them
+    struct Connection
+    {
+        uint32_t Number = 0; // Counts the connections, to tell clients apart in the log
+        Socket Client;       // Only used by the connection's thread
+        std::mutex Mutex;
+        std::vector<Reply> Replies;
+        std::atomic<bool> Finished{false}; // The connection's thread is done, and can be joined
+    };
+
+    // Queues a reply of a fixed struct followed by data, replacing the last unsent image of the same request with a newer one
+    template <typename T>
+    void PostReply(Connection &connection, RenderServiceMessage type, const T &message, const void *data = nullptr, size_t size = 0)
+    {
+        std::vector<char> payload(sizeof(T) + size);
+        std::memcpy(payload.data(), &message, sizeof(T));
+        if (size > 0)
+            std::memcpy(payload.data() + sizeof(T), data, size);
+
+        std::lock_guard<std::mutex> lock(connection.Mutex);
+        if (type == RenderServiceMessage::Image)
+        {
+            for (Reply &reply : connection.Replies)
+            {
+                if (reply.Type == type && reply.Id == message.Id)
+                {
+                    reply.Payload = std::move(payload);
+                    return;
+                }
+            }
+        }
+        connection.Replies.push_back({type, message.Id, std::move(payload)});
+    }
+
+    void PostError(Connection &connection, uint32_t id, const std::string &error)
+    {
+        PostReply(connection, RenderServiceMessage::Error, RenderServiceRequest{id}, error.data(), error.size());
+    }
+
+    // A request being rendered
+    struct ActiveRequest
+    {
+        uint32_t Id = 0;
+        std::shared_ptr<Connection> Client;
+        RequestSettings Settings;
+        std::shared_ptr<const LoadedScene> Source;
+        Camera RenderCamera = CreateDefaultCamera();
+        Renderer ImageRenderer{true};
+        int Threads = 1;
+        uint32_t CachedFrames = 0; // Frames restored from the render cache
+        Walnut::Timer Age, SinceUpdate;
+        std::atomic<bool> Cancelled{false};
+
+        // Guarded by the service's mutex
+        double Usage = 0.0; // Thread-seconds rendered, which the threads share out evenly
+        bool Running = false;
+        bool Finished = false;
+    };
+
+    // The requests of every client, and the threads rendering them
+    struct Service
+    {
+        explicit Service(const RenderServiceSettings &settings) : Settings(settings) {}
+
+        const RenderServiceSettings &Settings;
+        SceneLibrary Scenes{Settings.CachedScenes};
+        RenderCache Results;
+        int ThreadCount = 1;
+
+        std::mutex Mutex;
+        std::condition_variable Changed; // A request arrived, finished its time slice or was cancelled
+        std::vector<std::shared_ptr<ActiveRequest>> Requests;
+        int FreeThreads = 0;
+        bool Stopping = false;
+    };
+
+    void PostImage(ActiveRequest &request, bool final)
+    {
+        const Renderer &renderer = request.ImageRenderer;
+        const RenderServiceImage image{request.Id, renderer.GetWidth(), renderer.GetHeight(),
+                                       renderer.GetAccumulatedFrames() * static_cast<uint32_t>(renderer.m_Samples), final ? 1u : 0u};
+        PostReply(*request.Client, RenderServiceMessage::Image, image, renderer.GetImageData(),
+                  static_cast<size_t>(image.Width) * image.Height * sizeof(uint32_t));
+    }
+
+    // Tells the client a request is done or cancelled, with the samples it got, and caches the frames it rendered
+    void FinishRequest(Service &service, ActiveRequest &request)
+    {
+        const Renderer &renderer = request.ImageRenderer;
+        const uint32_t samples = renderer.GetAccumulatedFrames() * static_cast<uint32_t>(renderer.m_Samples);
+        const float renderTime = request.Age.Elapsed();
+        PostReply(*request.Client, RenderServiceMessage::Done, RenderServiceDone{request.Id, samples, renderTime});
+        std::fprintf(stderr, "[client %u, request %u] %s, %u samples per pixel in %.1fs\n", request.Client->Number, request.Id,
+                     request.Cancelled ? "cancelled" : "done", samples, renderTime);
+
+        std::string error;
+        if (service.Results.IsOpen() && renderer.GetAccumulatedFrames() > request.CachedFrames &&
+            !service.Results.Store(renderer, request.Source->Hash, request.RenderCamera, error))
+            std::fprintf(stderr, "[client %u, request %u] not cached: %s\n", request.Client->Number, request.Id, error.c_str());
+    }
+
+    /**
+     * @brief Renders frames of a request for a time slice, sending its image back as it refines.
+     *
+     * @param service The service.
+     * @param request The request, which no other thread renders meanwhile.
+     * @return float The seconds rendered.
+     */
+    float RenderSlice(Service &service, ActiveRequest &request)
+    {
+        // Every thread has its own team size, so requests rendering side by side keep to their share
+        omp_set_num_threads(request.Threads);
+
+        Renderer &renderer = request.ImageRenderer;
+        const uint32_t frames = request.Settings.Job.Settings.Frames;
+        Walnut::Timer slice;
+        while (renderer.GetAccumulatedFrames() < frames && !request.Cancelled && !s_StopRequested && slice.Elapsed() < TimeSlice)
+        {
+            renderer.Render(request.Source->RenderScene, request.RenderCamera);
+            if (renderer.GetAccumulatedFrames() < frames && request.SinceUpdate.Elapsed() >= request.Settings.UpdateInterval)
+            {
+                PostImage(request, false);
+                request.SinceUpdate.Reset();
+            }
+        }
+
+        request.Finished = renderer.GetAccumulatedFrames() >= frames || request.Cancelled;
+        if (renderer.GetAccumulatedFrames() >= frames && !request.Cancelled)
+            PostImage(request, true);
+        if (request.Finished)
+            FinishRequest(service, request);
+        return slice.Elapsed();
+    }
+
+    /**
+     * @brief Renders requests on one of the service's threads until the service stops.
+     *
+     * The next request to render is the one that got the least thread-seconds so far, as long as the threads
+     * it needs are free. Waiting for them holds back the requests after it, so a large request is not starved
+     * by a stream of small ones.
+     */
+    void RunRenderThread(Service &service)
+    {
+        std::unique_lock<std::mutex> lock(service.Mutex);
+        while (!service.Stopping && !s_StopRequested)
+        {
+            std::shared_ptr<ActiveRequest> next;
+            for (const std::shared_ptr<ActiveRequest> &request : service.Requests)
+            {
+                if (!request->Running && (!next || request->Usage < next->Usage))
+                    next = request;
+            }
+            // Signals cannot wake the condition, so waiting stops to check for them
+            if (!next || next->Threads > service.FreeThreads)
+            {
+                service.Changed.wait_for(lock, std::chrono::milliseconds(100));
+                continue;
+            }
+
+            next->Running = true;
+            service.FreeThreads -= next->Threads;
+            lock.unlock();
+            const float seconds = RenderSlice(service, *next);
+            lock.lock();
+
+            next->Running = false;
+            next->Usage += static_cast<double>(seconds) * next->Threads;
+            service.FreeThreads += next->Threads;
+            if (next->Finished)
+                service.Requests.erase(std::find(service.Requests.begin(), service.Requests.end(), next));
+            service.Changed.notify_all();
+        }
+    }
+
+    /**
+     * @brief Reads a request, loads its scene and queues it for the render threads.
+     *
+     * @param service The service.
+     * @param connection The connection the request arrived on.
+     * @param id The client's id of the request.
+     * @param payload The request message, its JSON text after the id.
+     * @param error Output parameter for a description of the problem if the request is refused.
+     * @return bool Returns true if the request was queued; otherwise, returns false.
+     */
+    bool StartRequest(Service &service, const std::shared_ptr<Connection> &connection, uint32_t id, const std::vector<char> &payload, std::string &error)
+    {
+        if (id == 0)
+        {
+            error = "Request ids must not be 0";
+            return false;
+        }
+        {
+            // Only this connection's thread adds its requests, so the id stays free until it is queued below
+            std::lock_guard<std::mutex> lock(service.Mutex);
+            for (const std::shared_ptr<ActiveRequest> &request : service.Requests)
+            {
+                if (request->Client == connection && request->Id == id)
+                {
+                    error = "Request " + std::to_string(id) + " is still rendering";
+                    return false;
+                }
+            }
+        }
+
+        auto request = std::make_shared<ActiveRequest>();
+        request->Id = id;
+        request->Client = connection;
+        if (!ReadRequest(payload.data() + sizeof(RenderServiceRequest), payload.data() + payload.size(), request->Settings, error))
+            return false;
+        request->Source = service.Scenes.Acquire(request->Settings);
+        if (!request->Source->Error.empty())
+        {
+            error = request->Source->Error;
+            return false;
+        }
+
+        const RenderJob &job = request->Settings.Job;
+        request->RenderCamera = request->Source->SceneCamera;
+        ApplyJobCamera(job, request->RenderCamera);
+        SetupHeadlessRenderer(job.Settings, request->ImageRenderer, request->RenderCamera);
+        request->Threads = GetRenderThreadShare(job.Settings.Width, job.Settings.Height, service.Settings.PixelsPerThread, service.ThreadCount);
+        request->ImageRenderer.GetSettings().ThreadCount = request->Threads;
+        if (service.Results.IsOpen())
+            request->CachedFrames = service.Results.Restore(request->ImageRenderer, request->Source->Hash, request->RenderCamera, job.Settings.Frames);
+
+        const uint32_t samples = job.Settings.Frames * static_cast<uint32_t>(job.Settings.Samples);
+        PostReply(*connection, RenderServiceMessage::Accepted, RenderServiceAccepted{id, job.Settings.Width, job.Settings.Height, samples});
+        std::fprintf(stderr, "[client %u, request %u] %ux%u, %u samples per pixel of %s on %d threads, %u frames of %u cached\n", connection->Number,
+                     id, job.Settings.Width, job.Settings.Height, samples, job.Name.c_str(), request->Threads, request->CachedFrames, job.Settings.Frames);
+
+        // Starts even with the requests rendering, rather than ahead of them by all they rendered so far
+        std::lock_guard<std::mutex> lock(service.Mutex);
+        auto least = std::min_element(service.Requests.begin(), service.Requests.end(), [](const auto &a, const auto &b)
+                                      { return a->Usage < b->Usage; });
+        if (least != service.Requests.end())
+            request->Usage = (*least)->Usage;
+        request->Age.Reset();
+        request->SinceUpdate.Reset();
+        service.Requests.push_back(std::move(request));
+        service.Changed.notify_all();
+        return true;
+    }
+
+    // Cancels a request of a connection, or all of them for id 0
+    void CancelRequests(Service &service, const Connection &connection, uint32_t id)
+    {
+        std::vector<std::shared_ptr<ActiveRequest>> cancelled;
+        std::unique_lock<std::mutex> lock(service.Mutex);
+        for (auto request = service.Requests.begin(); request != service.Requests.end();)
+        {
+            ActiveRequest &active = **request;
+            if (active.Client.get() != &connection || (id != 0 && active.Id != id))
+            {
+                ++request;
+                continue;
+            }
+
+            // A request rendering is removed by its thread at the end of the frame
+            active.Cancelled = true;
+            if (active.Running)
+            {
+                ++request;
+                continue;
+            }
+            cancelled.push_back(std::move(*request));
+            request = service.Requests.erase(request);
+        }
+        service.Changed.notify_all();
+
+        // Caching their frames writes files, which the render threads need not wait for
+        lock.unlock();
+        for (const std::shared_ptr<ActiveRequest> &request : cancelled)
+            FinishRequest(service, *request);
+    }
+
+    bool SendReplies(Connection &connection)
+    {
+        std::vector<Reply> replies;
+        {
+            std::lock_guard<std::mutex> lock(connection.Mutex);
+            replies.swap(connection.Replies);
+        }
+        for (const Reply &reply : replies)
+        {
+            if (!SendMessage(connection.Client, reply.Type, reply.Payload.data(), reply.Payload.size()))
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Serves a client on its own thread: reads its requests, and sends the replies the render threads queue.
+     *
+     * Loading a request's scene happens on this thread too, so a large scene only holds back the requests of
+     * the client waiting for it.
+     */
+    void ServeConnection(Service &service, const std::shared_ptr<Connection> &connection)
+    {
+        Socket &client = connection->Client;
+        RenderServiceMessage type;
+        std::vector<char> payload;
+        RenderServiceHello hello;
+        client.SetReceiveTimeout(HandshakeTimeoutMs);
+        if (!ReceiveMessage(client, type, payload) || type != RenderServiceMessage::Hello || !ReadPayload(payload, hello) ||
+            std::memcmp(hello.Magic, ProtocolMagic, sizeof(ProtocolMagic)) != 0)
+        {
+            std::fprintf(stderr, "[client %u] refused, not a render client\n", connection->Number);
+            connection->Finished = true;
+            return;
+        }
+        if (hello.Version != RenderServiceProtocolVersion || hello.ByteOrder != ByteOrderMark)
+        {
+            const std::string error = "Protocol version " + std::to_string(hello.Version) + " or byte order differs from the service's";
+            PostError(*connection, 0, error);
+            SendReplies(*connection);
+            std::fprintf(stderr, "[client %u] refused, %s\n", connection->Number, error.c_str());
+            connection->Finished = true;
+            return;
+        }
+
+        client.SetReceiveTimeout(MessageTimeoutMs);
+        std::string error;
+        while (!s_StopRequested)
+        {
+            if (!SendReplies(*connection))
+                break;
+            if (!client.WaitReadable(PollMs))
+                continue;
+            if (!ReceiveMessage(client, type, payload))
+                break;
+
+            RenderServiceRequest request;
+            if (type == RenderServiceMessage::Request && ReadPayload(payload, request))
+            {
+                if (!StartRequest(service, connection, request.Id, payload, error))
+                    PostError(*connection, request.Id, error);
+            }
+            else if (type == RenderServiceMessage::Cancel && ReadPayload(payload, request))
+                CancelRequests(service, *connection, request.Id);
+            else
+            {
+                PostError(*connection, 0, "Unexpected message");
+                SendReplies(*connection);
+                break;
+            }
+        }
+
+        CancelRequests(service, *connection, 0);
+        std::fprintf(stderr, "[client %u] disconnected\n", connection->Number);
+        connection->Finished = true;
+    }
+}
+
+/**
+ * @brief Renders the requests of the clients connecting to an address, streaming back their images as they refine.
+ *
+ * Clients, such as the tools of an asset pipeline, send requests for images of a scene file or of a scene
+ * inline, with a camera and a number of samples, and get the image back every update interval until it
+ * reaches the samples. Requests of every client render side by side on one set of threads: each gets a
+ * share of them growing with its pixel count, as in the job queue, and they take turns of a time slice
+ * so that every request gets the same thread-seconds, a large image or a stream of small ones alike.
+ * Scenes are loaded once and shared by the requests rendering them, and kept loaded for the next ones.
+ *
+ * With a render cache, the frames of every request done or cancelled are kept on disk. A request of the same
+ * scene, view and sampling is answered from them at once when they reach its samples, and renders on from
+ * them when it asks for more.
+ *
+ * @param settings The address, threads and caches of the service.
+ * @param error Output parameter for a description of the problem if the service cannot start.
+ * @return bool Returns true if the service ran until it was stopped; otherwise, returns false.
+ */
+bool RunRenderService(const RenderServiceSettings &settings, std::string &error)
+{
+    // Requests name files to read, so only programs on this machine may send them
+    Socket listener = Socket::Listen(settings.Address, error, true);
+    if (!listener.IsValid())
+        return false;
+
+    SelectTunedKernels();
+
+    Service service(settings);
+    if (!settings.CacheDirectory.empty() && !service.Results.Open(settings.CacheDirectory, settings.CacheSize, error))
+        return false;
+    service.ThreadCount = settings.ThreadCount > 0 ? settings.ThreadCount : omp_get_max_threads();
+    service.FreeThreads = service.ThreadCount;
+
+    s_StopRequested = 0;
+    auto previousInterrupt = std::signal(SIGINT, RequestStop);
+    auto previousTerminate = std::signal(SIGTERM, RequestStop);
+    std::fprintf(stderr, "Serving render requests on %s with %d threads\n", settings.Address.c_str(), service.ThreadCount);
+
+    // As many render threads as requests of one thread each could use
+    std::vector<std::thread> renderThreads;
+    for (int i = 0; i < service.ThreadCount; i++)
+        renderThreads.emplace_back(RunRenderThread, std::ref(service));
+
+    std::list<std::pair<std::shared_ptr<Connection>, std::thread>> connections;
+    uint32_t connectionCount = 0;
+    while (!s_StopRequested)
+    {
+        for (auto connection = connections.begin(); connection != connections.end();)
+        {
+            if (!connection->first->Finished)
+            {
+                ++connection;
+                continue;
+            }
+            connection->second.join();
+            connection = connections.erase(connection);
+        }
+
+        if (!listener.WaitReadable(100))
+            continue;
+        Socket client = listener.Accept();
+        if (!client.IsValid())
+            continue;
+        auto connection = std::make_shared<Connection>();
+        connection->Number = ++connectionCount;
+        connection->Client = std::move(client);
+        std::thread thread(ServeConnection, std::ref(service), connection);
+        connections.emplace_back(std::move(connection), std::move(thread));
+    }
+
+    for (auto &connection : connections)
+        connection.second.join();
+    {
+        std::lock_guard<std::mutex> lock(service.Mutex);
+        service.Stopping = true;
+        service.Changed.notify_all();
+    }
+    for (std::thread &thread : renderThreads)
+        thread.join();
+
+    std::signal(SIGINT, previousInterrupt);
+    std::signal(SIGTERM, previousTerminate);
+    std::fprintf(stderr, "Stopped\n");
+    return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Render requests are JSON documents sent to a render service, each describing one image to render:
+ *
+ * {
+ *     "format": "raytracing-request",
+ *     "version": 1,
+ *     "scene": "scenes/hero.json",
+ *     "camera": {"position": [13, 2, 3], "fov": 30},
+ *     "width": 640, "height": 360, "samples": 256, "samplesPerFrame": 4, "bounces": 8, "antialiasing": true,
+ *     "updateInterval": 0.25
+ * }
+ *
+ * "scene" is required: the path of a scene file or cache on the service's machine, relative to its working
+ * directory and without "..", or a scene document inline, as in scene files. "samples" is the quality target, the samples
+ * per pixel after which the image is final, rendered in frames of "samplesPerFrame" samples. The image is
+ * sent back every "updateInterval" seconds while it refines. "camera" and the other members are those of
+ * job manifests (JobQueue.h), with the same defaults, and unknown members are skipped.
+ */
+
+constexpr int RenderRequestVersion = 1;
+
+// Increased whenever the messages exchanged between render services and their clients change
+constexpr uint32_t RenderServiceProtocolVersion = 1;
+
+/*
+ * Messages between a render service and its clients, framed as in Socket.h, in the byte order of the
+ * machine. A client opens with Hello, then sends any number of requests on the same connection, which
+ * render side by side. The service answers every request with Accepted or Error, then Image messages as
+ * it refines, the last one with Final set, then Done. Closing the connection cancels its requests.
+ */
+enum class RenderServiceMessage : uint32_t
+{
+    Hello = 1, // Client to service: RenderServiceHello
+    Request,   // Client to service: a RenderServiceRequest followed by the request's JSON text
+    Cancel,    // Client to service: a RenderServiceRequest, the id of the request to stop
+    Accepted,  // Service to client: RenderServiceAccepted
+    Image,     // Service to client: RenderServiceImage followed by Width * Height RGBA pixels, row by row from the bottom
+    Done,      // Service to client: RenderServiceDone, after the final image or a cancel
+    Error,     // Service to client: a RenderServiceRequest followed by a description of the problem, id 0 before closing the connection
+};
+
+// "RTSV", the protocol version and 0x01020304, to check both ends share the byte order
+struct RenderServiceHello
+{
+    char Magic[4];
+    uint32_t Version;
+    uint32_t ByteOrder;
+};
+
+struct RenderServiceRequest
+{
+    uint32_t Id; // Chosen by the client, not 0 and unique among its requests still rendering
+};
+
+struct RenderServiceAccepted
+{
+    uint32_t Id;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Samples; // Samples per pixel of the final image
+};
+
+struct RenderServiceImage
+{
+    uint32_t Id;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Samples; // Samples per pixel so far
+    uint32_t Final;   // 1 for the image at the quality target
+};
+
+struct RenderServiceDone
+{
+    uint32_t Id;
+    uint32_t Samples;
+    float RenderTime; // Seconds from the request's arrival to its last frame
+};
+
+struct RenderServiceSettings
+{
+    std::string Address;              // "unix:path", or a loopback "host:port" (":port" for 127.0.0.1) clients connect to
+    int ThreadCount = 0;              // Threads shared by the requests rendering, 0 for one per core
+    uint32_t PixelsPerThread = 16384; // A request gets a thread per this many pixels, so small ones render side by side
+    size_t CachedScenes = 8;          // Scenes kept loaded once no request renders them, for the next requests
+    std::string CacheDirectory;       // Keeps the frames of the requests rendered, to answer the same requests again, empty for none
+    uint64_t CacheSize = 4ull << 30;  // Bytes of frames the cache directory keeps
+};
+
+// Serves render requests until SIGINT or SIGTERM
+bool RunRenderService(const RenderServiceSettings &settings, std::string &error);
@@ -1,5 +1,166 @@
 #include "Renderer.h"
 #include "Utils.h"
+#include "RadixSort.h"
+#include "Kernels.h"
+#include "Numa.h"
+
+#include "Walnut/Timer.h"
+
+#include <atomic>
+#include <new>
+#include <omp.h>
+
+namespace
+{
+    struct RayCounters
+    {
+        uint64_t Rays = 0;
+        uint64_t OcclusionRays = 0;
+        uint64_t OcclusionHits = 0;
+        uint64_t CulledTiles = 0;
+        uint64_t TileCandidates = 0;
+        uint64_t Packets = 0;
+        uint64_t PacketRays = 0;
+    };
+
+    // Per thread ray counters, merged into the frame statistics at the end of Render
+    thread_local RayCounters t_Counters;
+
+    // Acceleration structure nodes reachable by the primary rays of the tile being rendered by this thread
+    thread_local std::vector<uint32_t> t_TileCandidates;
+    thread_local bool t_TileCandidatesValid = false;
+
+    // Adds the calling thread's counters to the statistics and resets them. Call at the end of every parallel region.
+    void MergeCounters(Renderer::Statistics &statistics)
+    {
+#pragma omp atomic
+        statistics.Rays += t_Counters.Rays;
+#pragma omp atomic
+        statistics.OcclusionRays += t_Counters.OcclusionRays;
+#pragma omp atomic
+        statistics.OcclusionHits += t_Counters.OcclusionHits;
+#pragma omp atomic
+        statistics.CulledTiles += t_Counters.CulledTiles;
+#pragma omp atomic
+        statistics.TileCandidates += t_Counters.TileCandidates;
+#pragma omp atomic
+        statistics.Packets += t_Counters.Packets;
+#pragma omp atomic
+        statistics.PacketRays += t_Counters.PacketRays;
+        t_Counters = RayCounters();
+    }
+
+    // Spreads the lowest 9 bits of v so there are two zero bits between each of them
+    uint32_t ExpandBits(uint32_t v)
+    {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    constexpr uint32_t RayKeyBits = 30;
+
+    // Scrambles the bits of v, so nearby values give unrelated results (the SplitMix64 finalizer)
+    uint64_t MixBits(uint64_t v)
+    {
+        v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+        v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+        return v ^ (v >> 31);
+    }
+
+    // Start of the part-th of `parts` even splits of [0, count)
+    uint32_t SplitStart(uint32_t part, uint32_t count, uint32_t parts)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(part) * count + parts - 1) / parts);
+    }
+
+    // Index of the split of [0, count) in `parts` even splits containing i
+    uint32_t SplitIndex(uint32_t i, uint32_t count, uint32_t parts)
+    {
+        return static_cast<uint32_t>(static_cast<uint64_t>(i) * parts / count);
+    }
+
+    /**
+     * @brief Binds the calling thread of a parallel region to its NUMA node, or unbinds it.
+     *
+     * The threads of the team are spread over the nodes in order, as evenly as possible.
+     *
+     * @param nodes The number of nodes to spread the threads over, 1 to leave them unbound.
+     * @return uint32_t The node of the thread.
+     */
+    uint32_t BindRenderThread(uint32_t nodes)
+    {
+        if (nodes <= 1)
+        {
+            BindThreadToNumaNode(-1);
+            return 0;
+        }
+
+        const uint32_t node = SplitIndex(omp_get_thread_num(), omp_get_num_threads(), nodes);
+        BindThreadToNumaNode(static_cast<int>(node));
+        return node;
+    }
+
+    /**
+     * @brief Hands out the tiles of a frame to the render threads.
+     *
+     * The rows of tiles are split into one band per NUMA node, matching how the image buffers are first
+     * touched, and each node's threads take the tiles of their own band first, so their pixels are in local
+     * memory. Once a band is done, its threads help with the other bands. With a single node, tiles are
+     * handed out in order like a dynamic schedule.
+     */
+    class TileQueue
+    {
+    public:
+        TileQueue(uint32_t tilesX, uint32_t tilesY, uint32_t nodes) : m_Bands(new Band[nodes]), m_BandCount(nodes)
+        {
+            for (uint32_t node = 0; node < nodes; node++)
+            {
+                m_Bands[node].Next = SplitStart(node, tilesY, nodes) * tilesX;
+                m_Bands[node].End = SplitStart(node + 1, tilesY, nodes) * tilesX;
+            }
+        }
+
+        bool Next(uint32_t node, uint32_t &tile)
+        {
+            for (uint32_t i = 0; i < m_BandCount; i++)
+            {
+                Band &band = m_Bands[(node + i) % m_BandCount];
+                if (band.Next.load(std::memory_order_relaxed) >= band.End)
+                    continue;
+
+                tile = band.Next.fetch_add(1, std::memory_order_relaxed);
+                if (tile < band.End)
+                    return true;
+            }
+            return false;
+        }
+
+    private:
+        struct alignas(64) Band
+        {
+            std::atomic<uint32_t> Next{0};
+            uint32_t End = 0;
+        };
+
+        std::unique_ptr<Band[]> m_Bands;
+        uint32_t m_BandCount;
+    };
+
+    /**
+     * @brief Computes the sort key of a ray: its direction octant, followed by the Morton code of its origin
+     * quantized to a 512^3 grid over the given bounds.
+     */
+    uint32_t ComputeRayKey(const Ray &ray, const AABB &originBounds)
+    {
+        const glm::vec3 scale = 511.0f / glm::max(originBounds.Extent(), glm::vec3(1e-6f));
+        const glm::uvec3 cell = glm::uvec3(glm::clamp((ray.Origin - originBounds.Min) * scale, glm::vec3(0.0f), glm::vec3(511.0f)));
+        const uint32_t octant = (ray.Direction.x < 0.0f) | ((ray.Direction.y < 0.0f) << 1) | ((ray.Direction.z < 0.0f) << 2);
+        return (octant << 27) | (ExpandBits(cell.x) << 2) | (ExpandBits(cell.y) << 1) | ExpandBits(cell.z);
+    }
+}
 
 /**
  * @brief Resizes the renderer's final image and associated data buffers.
@@ -13,66 +174,321 @@
  */
 void Renderer::OnResize(uint32_t width, uint32_t height)
 {
+    // No resize necessary
+    if (m_ImageData && m_Width == width && m_Height == height)
+        return;
+
+    m_Width = width;
+    m_Height = height;
+    ResetFrameIndex();
+
     if (m_FinalImage)
+        m_FinalImage->Resize(width, height);
+    else if (!m_Headless)
+        m_FinalImage = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
+
+    AllocateImageBuffers();
+
+    m_ImageHorizontalIter.resize(width);
+    m_ImageVerticalIter.resize(height);
+}
+
+Renderer::~Renderer()
+{
+    FreePages(m_ImageData, m_ImageBufferPixels * sizeof(uint32_t));
+    FreePages(m_AccumulationData, m_ImageBufferPixels * sizeof(glm::vec4));
+}
+
+/**
+ * @brief (Re)allocates the image and accumulation buffers for the size of the image.
+ *
+ * The buffers come straight from the OS, so no page is backed by memory until it is first written. They are
+ * then cleared in parallel, with the rows of each band of tiles written by the threads that `RenderFrame`
+ * renders that band with. With thread pinning enabled on a multi-socket machine, every band therefore ends
+ * up in the memory of the NUMA node whose threads render it, instead of all on the node of the main thread.
+ * Throws std::bad_alloc if the OS has no memory for them.
+ */
+void Renderer::AllocateImageBuffers()
+{
+    const uint32_t width = m_Width;
+    const uint32_t height = m_Height;
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+
+    // The image has already been resized, so the old buffers are freed with the size they were allocated with
+    FreePages(m_ImageData, m_ImageBufferPixels * sizeof(uint32_t));
+    FreePages(m_AccumulationData, m_ImageBufferPixels * sizeof(glm::vec4));
+
+    m_ImageData = static_cast<uint32_t *>(AllocatePages(pixelCount * sizeof(uint32_t), m_Settings.HugePages));
+    m_AccumulationData = static_cast<glm::vec4 *>(AllocatePages(pixelCount * sizeof(glm::vec4), m_Settings.HugePages));
+    m_ImageBufferPixels = pixelCount;
+    if (pixelCount > 0 && (!m_ImageData || !m_AccumulationData))
     {
-        // No resize necessary
-        if (m_FinalImage->GetWidth() == width && m_FinalImage->GetHeight() == height)
-            return;
+        // Fails as new[] would, leaving no buffer half allocated
+        FreePages(m_ImageData, pixelCount * sizeof(uint32_t));
+        FreePages(m_AccumulationData, pixelCount * sizeof(glm::vec4));
+        m_ImageData = nullptr;
+        m_AccumulationData = nullptr;
+        m_ImageBufferPixels = 0;
+        throw std::bad_alloc();
+    }
+    m_ImageBuffersPinned = m_Settings.PinThreads;
+    m_ImageBuffersHugePages = m_Settings.HugePages;
+    m_ImageBuffersTileSize = m_TileSize;
 
-        m_FinalImage->Resize(width, height);
-        ResetFrameIndex();
+    const uint32_t tilesY = (height + m_TileSize - 1) / m_TileSize;
+    const uint32_t nodes = m_Settings.PinThreads ? static_cast<uint32_t>(GetNumaNodeCount()) : 1;
+
+#pragma omp parallel
+    {
+        const uint32_t node = BindRenderThread(nodes);
+
+        // The threads of a node split the rows of its band evenly
+        const uint32_t threads = omp_get_num_threads();
+        const uint32_t firstThread = SplitStart(node, threads, nodes);
+        const uint32_t nodeThreads = SplitStart(node + 1, threads, nodes) - firstThread;
+        const uint32_t rank = omp_get_thread_num() - firstThread;
+
+        const uint32_t bandStart = glm::min(SplitStart(node, tilesY, nodes) * m_TileSize, height);
+        const uint32_t bandEnd = glm::min(SplitStart(node + 1, tilesY, nodes) * m_TileSize, height);
+        const uint32_t y0 = bandStart + SplitStart(rank, bandEnd - bandStart, nodeThreads);
+        const uint32_t y1 = bandStart + SplitStart(rank + 1, bandEnd - bandStart, nodeThreads);
+
+        const size_t first = static_cast<size_t>(y0) * width;
+        const size_t count = static_cast<size_t>(y1 - y0) * width;
+        memset(m_ImageData + first, 0, count * sizeof(uint32_t));
+        memset(m_AccumulationData + first, 0, count * sizeof(glm::vec4));
     }
-    else
+}
+
+// Whether the image buffers were placed for other NUMA settings, or other bands of tiles, than the current ones
+bool Renderer::ImageBuffersOutdated() const
+{
+    return m_Settings.PinThreads != m_ImageBuffersPinned || m_Settings.HugePages != m_ImageBuffersHugePages ||
+           (m_Settings.PinThreads && m_TileSize != m_ImageBuffersTileSize);
+}
+
+/**
+ * @brief Replaces the accumulated frames with ones saved earlier, so progressive rendering resumes from them.
+ *
+ * The buffers are first placed for the current settings, so the next frame adds to the restored sums instead
+ * of reallocating them. Rows are copied in parallel, and the displayed image resolved from them by the same
+ * kernel as after a frame, adding nothing, so it is exactly the image of the frame the sums were saved after.
+ *
+ * @param data The sums of the frames' colors, width * height pixels in row order.
+ * @param width The width of the image the frames were rendered at.
+ * @param height The height of the image the frames were rendered at.
+ * @param frames The number of frames summed in data.
+ * @return bool Returns false, leaving the accumulation alone, if the image has another size or accumulation is off.
+ */
+bool Renderer::RestoreAccumulation(const glm::vec4 *data, uint32_t width, uint32_t height, uint32_t frames)
+{
+    if (!m_ImageData || m_Width != width || m_Height != height || !m_Settings.Accumulate || frames == 0)
+        return false;
+
+    m_TileSize = glm::clamp(m_Settings.TileSize, 4u, MaxTileSize) & ~3u;
+    if (ImageBuffersOutdated())
+        AllocateImageBuffers();
+
+    const std::vector<glm::vec4> nothing(width, glm::vec4(0.0f));
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < static_cast<int>(height); y++)
     {
-        m_FinalImage = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
+        const size_t offset = static_cast<size_t>(y) * width;
+        memcpy(m_AccumulationData + offset, data + offset, width * sizeof(glm::vec4));
+        g_Kernels->ResolveSpan(reinterpret_cast<const float *>(nothing.data()), reinterpret_cast<float *>(m_AccumulationData + offset), m_ImageData + offset, width,
+                               frames, true);
     }
 
-    delete[] m_ImageData;
-    m_ImageData = new uint32_t[width * height];
+    m_FrameIndex = frames + 1;
+    return true;
+}
 
-    delete[] m_AccumulationData;
-    m_AccumulationData = new glm::vec4[width * height];
+/**
+ * @brief Copies the accumulation buffer as it is, the sums of the frames' colors, with the count of frames summed in every pixel.
+ *
+ * Unlike the displayed image, the sums are neither divided by the frame count nor clamped, so renders of
+ * other frames can be added to them before averaging. Every pixel of the image holds the same number of
+ * frames, 0 without accumulation. Rows are copied in parallel.
+ *
+ * @param sums Output buffer for the sums, width * height pixels in row order.
+ * @param counts Output buffer for the frames summed in each pixel, width * height pixels in row order.
+ */
+void Renderer::ExportAccumulation(glm::vec4 *sums, uint32_t *counts) const
+{
+    const uint32_t frames = GetAccumulatedFrames();
+    const uint32_t width = m_Width;
 
-    m_ImageHorizontalIter.resize(width);
-    m_ImageVerticalIter.resize(height);
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < static_cast<int>(m_Height); y++)
+    {
+        const size_t offset = static_cast<size_t>(y) * width;
+        if (frames > 0)
+            memcpy(sums + offset, m_AccumulationData + offset, width * sizeof(glm::vec4));
+        else
+            std::fill(sums + offset, sums + offset + width, glm::vec4(0.0f));
+        std::fill(counts + offset, counts + offset + width, frames);
+    }
+}
+
+/**
+ * @brief Renders auxiliary outputs (AOVs) for the image, to be written along with the color.
+ *
+ * One ray is traced through the center of every pixel, from the camera position, so the outputs are
+ * sharp even when the color is rendered with antialiasing or depth of field. These rays are not counted
+ * in the statistics of the frame.
+ *
+ * @param scene The scene to render.
+ * @param camera The camera to use for rendering, resized to the image.
+ * @param depth Output buffer for the distance along the ray to the first hit, infinity where nothing is hit.
+ * @param normals Output buffer for the world space shading normal facing the camera, zero where nothing is hit.
+ * @param albedo Output buffer for the albedo of the material hit (1 for dielectrics), the sky color where nothing is hit.
+ */
+void Renderer::RenderAOVs(const Scene &scene, const Camera &camera, float *depth, glm::vec3 *normals, glm::vec3 *albedo)
+{
+    m_ActiveScene = &scene;
+
+    const uint32_t width = m_Width;
+    const uint32_t height = m_Height;
+    const std::vector<glm::vec3> &directions = camera.GetRayDirections();
+
+#pragma omp parallel
+    {
+#pragma omp for schedule(dynamic, 4)
+        for (int y = 0; y < static_cast<int>(height); y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const size_t i = static_cast<size_t>(y) * width + x;
+                Ray ray;
+                ray.Origin = camera.GetPosition();
+                ray.Direction = directions[i];
+
+                const HitPayload payload = TraceRay(ray);
+                const bool hit = payload.HitDistance >= 0.0f;
+                if (depth)
+                    depth[i] = hit ? payload.HitDistance : std::numeric_limits<float>::infinity();
+                if (normals)
+                    normals[i] = hit ? payload.normal : glm::vec3(0.0f);
+                if (albedo)
+                {
+                    if (!hit)
+                        albedo[i] = scene.SkyColor;
+                    else
+                    {
+                        const MaterialData &material = scene.MaterialTable[payload.materialIndex];
+                        albedo[i] = material.Type == MaterialType::Dielectric ? glm::vec3(1.0f) : material.Albedo;
+                    }
+                }
+            }
+        }
+
+        // Leave the counters for the next frame to start from zero
+        t_Counters = RayCounters();
+    }
 }
 
 /**
  * @brief Renders the scene using the specified camera.
  *
- * This function renders the scene using the specified camera. It iterates over each pixel in the final image
- * and calculates the color of the pixel using the PerPixel function. The color is then accumulated over multiple
+ * This function renders the scene using the specified camera. It iterates over the final image in square tiles
+ * and calculates the color of each pixel using the PerPixel function. The color is then accumulated over multiple
  * frames if the accumulation setting is enabled. The final image is updated with the accumulated color data.
+ * The number of rays traced and the time spent are recorded in the renderer's statistics.
+ *
+ * With tile frustum culling enabled, the frustum enclosing the primary rays of each tile is computed from
+ * the camera and culled against the scene's acceleration structure once, and the tile's primary rays start
+ * traversal from the remaining nodes instead of the root. This requires a pinhole camera, since rays through
+ * an aperture do not share a single origin.
+ *
+ * With ray packets enabled, tiles are further split into small blocks of pixels (4x4 for 16 rays, 4x2 for 8)
+ * whose rays are traced together by `PerPacket`. With a ray batch size set, paths are instead traced bounce
+ * by bounce in batches of whole tiles by `RenderBatches`.
  *
  * @param scene The scene to render.
  * @param camera The camera to use for rendering.
  */
 void Renderer::Render(const Scene &scene, Camera &camera)
+{
+    RenderRegion(scene, camera, 0, 0, m_Width, m_Height);
+}
+
+/**
+ * @brief Renders a rectangle of the image, leaving the other pixels as they are.
+ *
+ * The rectangle is split into tiles and rendered like a whole image by `Render`, so regions rendered one
+ * after the other with the same frame index add up to a whole frame. The frame index moves on after every
+ * region, so regions of several frames must be rendered frame by frame, or one region at a time after
+ * `ResetFrameIndex`, as distributed workers do.
+ *
+ * @param scene The scene to render.
+ * @param camera The camera to use for rendering, resized to the whole image.
+ * @param x0 The x-coordinate of the first pixel column of the region.
+ * @param y0 The y-coordinate of the first pixel row of the region.
+ * @param x1 The x-coordinate one past the last pixel column of the region.
+ * @param y1 The y-coordinate one past the last pixel row of the region.
+ */
+void Renderer::RenderRegion(const Scene &scene, Camera &camera, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
 {
     m_ActiveScene = &scene;
     m_ActiveCamera = &camera;
 
-    if (m_FrameIndex == 1)
-        memset(m_AccumulationData, 0, m_FinalImage->GetWidth() * m_FinalImage->GetHeight() * sizeof(glm::vec4));
+    // Tiles are split into 4 pixel wide packet blocks and resolved one row at a time
+    m_TileSize = glm::clamp(m_Settings.TileSize, 4u, MaxTileSize) & ~3u;
 
-#pragma omp parallel for
+    // Restore the default when the thread count goes back to 0
+    static const int defaultThreadCount = omp_get_max_threads();
+    omp_set_num_threads(m_Settings.ThreadCount > 0 ? m_Settings.ThreadCount : defaultThreadCount);
 
-    for (uint32_t y = 0; y < m_FinalImage->GetHeight(); y++)
+    // Place the image buffers again for the new NUMA settings, or the new bands of tiles
+    if (ImageBuffersOutdated())
     {
-        for (uint32_t x = 0; x < m_FinalImage->GetWidth(); x++)
-        {
-            glm::vec4 color = PerPixel(x, y);
-            m_AccumulationData[x + y * m_FinalImage->GetWidth()] += color;
+        AllocateImageBuffers();
+        ResetFrameIndex();
+    }
 
-            glm::vec4 accumulatedColor = m_AccumulationData[x + y * m_FinalImage->GetWidth()];
-            accumulatedColor /= (float)m_FrameIndex;
+    m_RegionX0 = glm::min(x0, m_Width);
+    m_RegionY0 = glm::min(y0, m_Height);
+    m_RegionX1 = glm::clamp(x1, m_RegionX0, m_Width);
+    m_RegionY1 = glm::clamp(y1, m_RegionY0, m_Height);
 
-            accumulatedColor = glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
-            m_ImageData[x + y * m_FinalImage->GetWidth()] = Utils::ConvertToRGBA(accumulatedColor);
-        }
+    // Without accumulation, kernels write the new color straight to the image and never read this buffer
+    if (m_FrameIndex == 1 && m_Settings.Accumulate)
+    {
+        for (uint32_t y = m_RegionY0; y < m_RegionY1; y++)
+            memset(m_AccumulationData + static_cast<size_t>(y) * m_Width + m_RegionX0, 0, (m_RegionX1 - m_RegionX0) * sizeof(glm::vec4));
     }
 
-    m_FinalImage->SetData(m_ImageData);
+    Walnut::Timer timer;
+    m_Statistics = Statistics();
+    m_Statistics.Triangles = scene.TriangleCount;
+
+    const uint32_t width = m_Width;
+    const uint32_t height = m_Height;
+    const uint32_t tilesX = (m_RegionX1 - m_RegionX0 + m_TileSize - 1) / m_TileSize;
+    const uint32_t tilesY = (m_RegionY1 - m_RegionY0 + m_TileSize - 1) / m_TileSize;
+
+    const bool cullTiles = m_Settings.TileFrustumCulling && scene.AccelerationStructure && camera.getAperatureSize() == 0.0f;
+
+    // Antialiasing jitters rays by up to one pixel of the shorter viewport side, in both directions
+    const float jitter = m_Settings.EnableAntialiasing ? (float)glm::max(width, height) / (float)glm::max(glm::min(width, height), 1u) : 0.0f;
+
+    uint32_t features = 0;
+    if (m_Settings.EnableAntialiasing)
+        features |= KernelAntialiasing;
+    if (camera.getAperatureSize() > 0.0f)
+        features |= KernelDepthOfField;
+    if (m_Settings.Accumulate)
+        features |= KernelAccumulate;
+    if (scene.MaterialTypes == (1u << static_cast<uint32_t>(MaterialType::Lambertian)))
+        features |= KernelDiffuseOnly;
+
+    static constexpr auto frameKernels = MakeFrameKernels(std::make_integer_sequence<uint32_t, KernelVariantCount>());
+    (this->*frameKernels[features])(tilesX, tilesY, cullTiles, jitter);
+
+    m_Statistics.RenderTime = timer.ElapsedMillis();
+
+    if (m_FinalImage)
+        m_FinalImage->SetData(m_ImageData);
 
     if (m_Settings.Accumulate)
         m_FrameIndex++;
@@ -80,6 +496,336 @@ void Renderer::Render(const Scene &scene, Camera &camera)
         m_FrameIndex = 1;
 }
 
+/**
+ * @brief Renders a frame with the kernel specialised for one combination of features.
+ *
+ * Every function called per pixel or per bounce is instantiated for the same `Features`, so checks for
+ * antialiasing, depth of field, accumulation and the kinds of materials in the scene are resolved at compile
+ * time and disabled features cost nothing. `Render` selects the instantiation matching the current settings,
+ * camera and scene from a table holding one per combination.
+ *
+ * Tiles are handed out by a `TileQueue`. With thread pinning enabled, each NUMA node's threads render the
+ * band of tiles whose pixels `AllocateImageBuffers` placed in that node's memory.
+ *
+ * @param tilesX The number of tiles along the width of the region being rendered.
+ * @param tilesY The number of tiles along the height of the region being rendered.
+ * @param cull True if the camera rays of each tile should start from frustum culled nodes.
+ * @param jitter The antialiasing jitter to pad the tile frusta with, in pixels.
+ */
+template <uint32_t Features>
+void Renderer::RenderFrame(uint32_t tilesX, uint32_t tilesY, bool cull, float jitter)
+{
+    if (m_Settings.RayBatchSize > 0 && !m_Settings.AmbientOcclusion)
+    {
+        RenderBatches<Features>(tilesX, tilesY, cull, jitter);
+        return;
+    }
+
+    // Packets need an acceleration structure to share traversal in; ambient occlusion is traced per pixel
+    const bool usePackets = m_Settings.PacketSize > 0 && m_ActiveScene->AccelerationStructure && !m_Settings.AmbientOcclusion;
+    const uint32_t blockWidth = 4;
+    const uint32_t blockHeight = m_Settings.PacketSize > 8 ? 4 : 2;
+
+    const uint32_t nodes = m_Settings.PinThreads ? static_cast<uint32_t>(GetNumaNodeCount()) : 1;
+    TileQueue tiles(tilesX, tilesY, nodes);
+
+#pragma omp parallel
+    {
+        const uint32_t node = BindRenderThread(nodes);
+
+        uint32_t tile;
+        while (tiles.Next(node, tile))
+        {
+            uint32_t x0, y0, x1, y1;
+            GetTileBounds(tile, tilesX, x0, y0, x1, y1);
+
+            PrepareTile(x0, y0, x1, y1, cull, jitter);
+
+            if (usePackets)
+            {
+                for (uint32_t by = y0; by < y1; by += blockHeight)
+                {
+                    for (uint32_t bx = x0; bx < x1; bx += blockWidth)
+                    {
+                        const uint32_t w = glm::min(blockWidth, x1 - bx);
+                        const uint32_t h = glm::min(blockHeight, y1 - by);
+
+                        glm::vec4 colors[RayPacket::MaxSize];
+                        PerPacket<Features>(bx, by, w, h, colors);
+                        for (uint32_t row = 0; row < h; row++)
+                            AccumulateSpan<Features>(bx, by + row, w, colors + row * w);
+                    }
+                }
+                continue;
+            }
+
+            for (uint32_t y = y0; y < y1; y++)
+            {
+                glm::vec4 colors[MaxTileSize];
+                for (uint32_t x = x0; x < x1; x++)
+                    colors[x - x0] = PerPixel<Features>(x, y);
+                AccumulateSpan<Features>(x0, y, x1 - x0, colors);
+            }
+        }
+        t_TileCandidatesValid = false;
+
+        MergeCounters(m_Statistics);
+    }
+}
+
+/**
+ * @brief Renders the image by tracing paths bounce by bounce in large batches.
+ *
+ * The tiles are processed in batches of about `RayBatchSize` paths (at least one tile). For each batch, the
+ * camera rays of every tile are traced and shaded as usual, then each further bounce of all paths still
+ * active in the batch is traced at once by `TraceBatchBounce`, which can reorder the rays for coherence.
+ * Finally, the samples of each pixel are averaged and accumulated.
+ *
+ * @param tilesX The number of tiles along the width of the region being rendered.
+ * @param tilesY The number of tiles along the height of the region being rendered.
+ * @param cull True if the camera rays of each tile should start from frustum culled nodes.
+ * @param jitter The antialiasing jitter to pad the tile frusta with, in pixels.
+ */
+template <uint32_t Features>
+void Renderer::RenderBatches(uint32_t tilesX, uint32_t tilesY, bool cull, float jitter)
+{
+    const uint32_t tileCount = tilesX * tilesY;
+    const uint32_t samples = static_cast<uint32_t>(glm::max(m_Samples, 1));
+    const uint32_t pathsPerTile = m_TileSize * m_TileSize * samples;
+    const uint32_t tilesPerBatch = glm::max(m_Settings.RayBatchSize / pathsPerTile, 1u);
+
+    m_Paths.resize(static_cast<size_t>(tilesPerBatch) * pathsPerTile);
+
+    // Paths move between threads from bounce to bounce, so batches only pin threads for their scene replicas
+    const uint32_t nodes = m_Settings.PinThreads ? static_cast<uint32_t>(GetNumaNodeCount()) : 1;
+
+    for (uint32_t firstTile = 0; firstTile < tileCount; firstTile += tilesPerBatch)
+    {
+        const uint32_t batchTiles = glm::min(tilesPerBatch, tileCount - firstTile);
+
+#pragma omp parallel
+        {
+            BindRenderThread(nodes);
+
+#pragma omp for schedule(dynamic)
+            for (uint32_t i = 0; i < batchTiles; i++)
+            {
+                uint32_t x0, y0, x1, y1;
+                GetTileBounds(firstTile + i, tilesX, x0, y0, x1, y1);
+
+                PrepareTile(x0, y0, x1, y1, cull, jitter);
+
+                PathState *paths = &m_Paths[static_cast<size_t>(i) * pathsPerTile];
+                uint32_t p = 0;
+                for (uint32_t y = y0; y < y1; y++)
+                {
+                    for (uint32_t x = x0; x < x1; x++)
+                    {
+                        for (uint32_t s = 0; s < samples; s++, p++)
+                        {
+                            PathState &path = paths[p];
+                            path.Stream = GetSampleStream(x, y, static_cast<int>(s));
+                            SeedSample(path.Stream, 0);
+                            path.PathRay = GenerateCameraRay<Features>(x, y);
+                            path.Contribution = glm::vec3(1.0f);
+                            path.Color = glm::vec3(0.0f);
+
+                            HitPayload payload = TracePrimaryRay(path.PathRay);
+                            SeedSample(path.Stream, 1);
+                            path.Active = Scatter<Features>(path.PathRay, payload, path.Contribution, path.Color);
+                        }
+                    }
+                }
+                for (; p < pathsPerTile; p++)
+                    paths[p].Active = false;
+            }
+            t_TileCandidatesValid = false;
+
+            MergeCounters(m_Statistics);
+        }
+
+        for (int bounce = 1; bounce < m_Bounces; bounce++)
+        {
+            if (!TraceBatchBounce<Features>(static_cast<size_t>(batchTiles) * pathsPerTile, bounce))
+                break;
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (uint32_t i = 0; i < batchTiles; i++)
+        {
+            uint32_t x0, y0, x1, y1;
+            GetTileBounds(firstTile + i, tilesX, x0, y0, x1, y1);
+
+            const PathState *path = &m_Paths[static_cast<size_t>(i) * pathsPerTile];
+            for (uint32_t y = y0; y < y1; y++)
+            {
+                glm::vec4 colors[MaxTileSize];
+                for (uint32_t x = x0; x < x1; x++)
+                {
+                    glm::vec3 color(0.0f);
+                    for (uint32_t s = 0; s < samples; s++, path++)
+                        color += path->Color;
+                    colors[x - x0] = glm::vec4(color / static_cast<float>(samples), 1.0f);
+                }
+                AccumulateSpan<Features>(x0, y, x1 - x0, colors);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Traces and shades the next bounce of every active path of a batch.
+ *
+ * The active paths are gathered first. With secondary ray sorting enabled, they are then sorted by their
+ * direction octant and the Morton code of their origin within the bounds of all origins, so rays traced one
+ * after the other start close together and head the same way, and touch the same parts of the acceleration
+ * structure. The rays are copied out in that order and traced, and each result is scattered back to its
+ * path for shading. Time spent gathering and sorting, and time spent tracing, are recorded separately so the benefit
+ * of sorting can be weighed against its cost.
+ *
+ * @param pathCount The number of paths in the batch, starting at the beginning of `m_Paths`.
+ * @param bounce The number of bounces the paths have already taken.
+ * @return bool Returns false if no path was active; otherwise, returns true.
+ */
+template <uint32_t Features>
+bool Renderer::TraceBatchBounce(size_t pathCount, int bounce)
+{
+    Walnut::Timer sortTimer;
+
+    AABB originBounds;
+    m_SortIndices.clear();
+    for (size_t i = 0; i < pathCount; i++)
+    {
+        if (!m_Paths[i].Active)
+            continue;
+
+        m_SortIndices.push_back(static_cast<uint32_t>(i));
+        originBounds.Grow(m_Paths[i].PathRay.Origin);
+    }
+    if (m_SortIndices.empty())
+        return false;
+
+    const int64_t rayCount = static_cast<int64_t>(m_SortIndices.size());
+    if (m_Settings.SortSecondaryRays)
+    {
+        m_SortKeys.resize(rayCount);
+
+#pragma omp parallel for
+        for (int64_t i = 0; i < rayCount; i++)
+            m_SortKeys[i] = ComputeRayKey(m_Paths[m_SortIndices[i]].PathRay, originBounds);
+
+        RadixSort(m_SortKeys, m_SortIndices, m_SortScratchKeys, m_SortScratchIndices, RayKeyBits);
+    }
+
+    // Gather the rays in tracing order so they are read and their results written sequentially
+    m_BatchRays.resize(rayCount);
+    m_BatchHits.resize(rayCount);
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < rayCount; i++)
+        m_BatchRays[i] = m_Paths[m_SortIndices[i]].PathRay;
+
+    m_Statistics.BatchSortTime += sortTimer.ElapsedMillis();
+
+    Walnut::Timer traceTimer;
+#pragma omp parallel
+    {
+#pragma omp for schedule(dynamic, 64)
+        for (int64_t i = 0; i < rayCount; i++)
+            m_BatchHits[i] = TraceRay(m_BatchRays[i]);
+
+        MergeCounters(m_Statistics);
+    }
+    m_Statistics.BatchTraceTime += traceTimer.ElapsedMillis();
+    m_Statistics.BatchRays += rayCount;
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int64_t i = 0; i < rayCount; i++)
+    {
+        PathState &path = m_Paths[m_SortIndices[i]];
+        SeedSample(path.Stream, bounce + 1);
+        path.Active = Scatter<Features>(path.PathRay, m_BatchHits[i], path.Contribution, path.Color);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Restarts the random sequence of the calling thread for one step of a sample, with deterministic sampling.
+ *
+ * Every step of every sample gets its own sequence, picked by the sample's stream (its pixel and index
+ * within the frame), the frame it belongs to and the step. A sample is then drawn the same by the pixel,
+ * packet and batch kernels, on any thread and in any process, whatever the order the rays are traced in.
+ * Without deterministic sampling the thread's sequence just goes on.
+ *
+ * @param stream The GetSampleStream of the sample.
+ * @param step 0 for the camera ray, b + 1 for the scattering after bounce b.
+ */
+void Renderer::SeedSample(uint64_t stream, int step) const
+{
+    if (!m_Settings.DeterministicSampling)
+        return;
+
+    const uint64_t frame = static_cast<uint64_t>(m_FirstFrame) + m_FrameIndex - 1;
+    Utils::SeedStream(MixBits(MixBits(frame) + static_cast<uint64_t>(step)), stream);
+}
+
+// Pixel bounds of a tile of the region being rendered, whose tiles are numbered row by row
+void Renderer::GetTileBounds(uint32_t tile, uint32_t tilesX, uint32_t &x0, uint32_t &y0, uint32_t &x1, uint32_t &y1) const
+{
+    x0 = m_RegionX0 + (tile % tilesX) * m_TileSize;
+    y0 = m_RegionY0 + (tile / tilesX) * m_TileSize;
+    x1 = glm::min(x0 + m_TileSize, m_RegionX1);
+    y1 = glm::min(y0 + m_TileSize, m_RegionY1);
+}
+
+/**
+ * @brief Sets up the calling thread for rendering a tile.
+ *
+ * If culling is requested, the frustum enclosing the tile's camera rays is culled against the scene's
+ * acceleration structure, and `TracePrimaryRay` starts from the remaining nodes until the next tile.
+ *
+ * @param x0 The x-coordinate of the first pixel column of the tile.
+ * @param y0 The y-coordinate of the first pixel row of the tile.
+ * @param x1 The x-coordinate one past the last pixel column of the tile.
+ * @param y1 The y-coordinate one past the last pixel row of the tile.
+ * @param cull True to frustum cull the tile.
+ * @param jitter The antialiasing jitter to pad the tile frustum with, in pixels.
+ */
+void Renderer::PrepareTile(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, bool cull, float jitter)
+{
+    t_TileCandidatesValid = false;
+    if (!cull)
+        return;
+
+    Frustum frustum = m_ActiveCamera->GetTileFrustum((float)x0, (float)y0, x1 + jitter, y1 + jitter);
+    t_TileCandidatesValid = m_ActiveScene->GetAccelerator(GetThreadNumaNode())->CullFrustum(frustum, t_TileCandidates);
+    if (t_TileCandidatesValid)
+    {
+        t_Counters.CulledTiles++;
+        t_Counters.TileCandidates += t_TileCandidates.size();
+    }
+}
+
+/**
+ * @brief Adds new samples to a horizontal span of pixels and updates them in the final image.
+ *
+ * The span is resolved by the `ResolveSpan` kernel for the selected instruction set. Without accumulation,
+ * the new samples are written to the image as they are.
+ *
+ * @param x The x-coordinate of the first pixel of the span.
+ * @param y The y-coordinate of the span.
+ * @param count The number of pixels in the span.
+ * @param colors The colors of the new samples, one per pixel.
+ */
+template <uint32_t Features>
+void Renderer::AccumulateSpan(uint32_t x, uint32_t y, uint32_t count, const glm::vec4 *colors)
+{
+    const size_t offset = x + static_cast<size_t>(y) * m_Width;
+    g_Kernels->ResolveSpan(reinterpret_cast<const float *>(colors), reinterpret_cast<float *>(m_AccumulationData + offset), m_ImageData + offset, count,
+                           m_FrameIndex, (Features & KernelAccumulate) != 0);
+}
+
 /**
  * @brief Calculates the color of a pixel in the final rendered image.
  *
@@ -96,13 +842,15 @@ void Renderer::Render(const Scene &scene, Camera &camera)
  * the camera's focus distance.
  *
  * The function handles ray-object intersections and calculates the color contribution based on the
- * material of the intersected object. If a ray doesn't hit any object, the sky color is used.
+ * material of the intersected object. If a ray doesn't hit any object, the sky color is used. When the
+ * ambient occlusion setting is enabled, each camera ray is shaded by `AmbientOcclusion` instead.
  *
  * @param x The x-coordinate of the pixel.
  * @param y The y-coordinate of the pixel.
  * @return glm::vec4 The final color of the pixel. The color is a 4-component vector with red, green,
  * blue, and alpha values.
  */
+template <uint32_t Features>
 glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 {
     int numSamples = m_Samples;
@@ -110,74 +858,260 @@ glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 
     for (int s = 0; s < numSamples; s++)
     {
-        Ray ray;
-        ray.Origin = m_ActiveCamera->GetPosition();
-        if (m_Settings.EnableAntialiasing)
+        const uint64_t stream = GetSampleStream(x, y, s);
+        SeedSample(stream, 0);
+        Ray ray = GenerateCameraRay<Features>(x, y);
+
+        if (m_Settings.AmbientOcclusion)
         {
-            ray.Direction = m_ActiveCamera->GetRandomRayDirection(x, y);
+            SeedSample(stream, 1);
+            color += AmbientOcclusion(ray);
+            continue;
         }
-        else
+
+        color += TracePath<Features>(ray, glm::vec3(1.0f), 0, stream);
+    }
+    if (numSamples > 1)
+    {
+        color /= static_cast<float>(numSamples); // Average the accumulated color samples
+    }
+
+    return glm::vec4(color, 1.0f);
+}
+
+/**
+ * @brief Calculates the colors of a small block of pixels, tracing their rays as packets.
+ *
+ * For every sample, the camera rays of the block are traced together as one packet. After each bounce, the
+ * rays that hit a specular material (a perfect mirror) stay in the packet and are traced together again,
+ * while all other rays continue on their own with `TracePath`. Once the rays left in the packet are no
+ * longer coherent (see `RayPacket::IsCoherent`), they also continue on their own. Up to random sampling,
+ * the result is the same as calling `PerPixel` for every pixel of the block.
+ *
+ * @param x The x-coordinate of the top left pixel of the block.
+ * @param y The y-coordinate of the top left pixel of the block.
+ * @param width The width of the block.
+ * @param height The height of the block. `width * height` must not exceed `RayPacket::MaxSize`.
+ * @param colors Output parameter for the final colors of the pixels, in row-major order.
+ */
+template <uint32_t Features>
+void Renderer::PerPacket(uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec4 *colors)
+{
+    const int count = static_cast<int>(width * height);
+    glm::vec3 color[RayPacket::MaxSize];
+    for (int lane = 0; lane < count; lane++)
+        color[lane] = glm::vec3(0.0f);
+
+    for (int s = 0; s < m_Samples; s++)
+    {
+        RayPacket packet;
+        packet.Size = count;
+
+        Ray rays[RayPacket::MaxSize];
+        glm::vec3 contribution[RayPacket::MaxSize];
+        int bounces[RayPacket::MaxSize];
+        uint64_t streams[RayPacket::MaxSize];
+        for (int lane = 0; lane < count; lane++)
         {
-            ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_FinalImage->GetWidth()];
+            streams[lane] = GetSampleStream(x + lane % width, y + lane / width, s);
+            SeedSample(streams[lane], 0);
+            rays[lane] = GenerateCameraRay<Features>(x + lane % width, y + lane / width);
+            contribution[lane] = glm::vec3(1.0f);
+            bounces[lane] = 0;
+            packet.SetRay(lane, rays[lane]);
         }
-        glm::vec2 inUnitDisk = Utils::InUnitDisk();
-        glm::vec3 offset{inUnitDisk.x * 0.5f * m_ActiveCamera->getAperatureSize(),
-                         inUnitDisk.y * 0.5f * m_ActiveCamera->getAperatureSize(),
-                         0.0f};
-        ray.Origin += offset;
-        ray.Direction = glm::normalize(m_ActiveCamera->getFocusDistance() * ray.Direction - offset);
+        packet.ActiveMask = (1u << count) - 1u;
 
-        glm::vec3 contribution(1.0f);
+        // Lanes that left the packet and continue on their own from bounces[lane]
+        uint32_t singleMask = 0;
 
-        int bounces = m_Bounces;
-        int i = 0;
-        while (i < bounces)
+        for (int bounce = 0; bounce < m_Bounces && packet.ActiveMask != 0; bounce++)
         {
-            glm::vec3 attenuation(1.0f);
-            glm::vec3 scatteredDirection(0.0f);
-            HitPayload payload = TraceRay(ray);
-            if (payload.HitDistance < 0.0f)
+            if (!packet.IsCoherent(m_Settings.PacketCoherence))
             {
-                color += m_ActiveScene->SkyColor * contribution;
-                i = bounces; // Exit the loop
+                for (uint32_t lanes = packet.ActiveMask; lanes != 0; lanes &= lanes - 1)
+                    bounces[RayPacket::FirstLane(lanes)] = bounce;
+                singleMask |= packet.ActiveMask;
+                break;
             }
-            else
+
+            TracePacket(packet, bounce == 0);
+
+            uint32_t nextMask = 0;
+            for (uint32_t lanes = packet.ActiveMask; lanes != 0; lanes &= lanes - 1)
             {
-                const int materialIndex = payload.materialIndex;
-                const std::shared_ptr<Material> &material = m_ActiveScene->Materials.at(materialIndex);
+                const int lane = RayPacket::FirstLane(lanes);
 
-                if (material->scatter(ray, payload, attenuation, scatteredDirection))
-                {
-                    // ray.Origin = payload.position + payload.normal * 0.0001f;
-                    // ray.Origin = payload.position + ray.Direction * (-0.0001f);
-                    ray.Origin = payload.position + scatteredDirection * 0.0001f;
-                    ray.Direction = scatteredDirection;
+                HitPayload payload = (packet.HitMask >> lane) & 1u ? ClosestHit(rays[lane], packet.Hits[lane]) : Miss(rays[lane]);
+                const bool specular = payload.HitDistance >= 0.0f && m_ActiveScene->MaterialTable[payload.materialIndex].IsSpecular();
+                SeedSample(streams[lane], bounce + 1);
+                if (!Scatter<Features>(rays[lane], payload, contribution[lane], color[lane]))
+                    continue;
 
-                    contribution *= attenuation;
-                    i++;
+                if (specular)
+                {
+                    packet.SetRay(lane, rays[lane]);
+                    packet.Hits[lane] = HitPayload();
+                    nextMask |= 1u << lane;
                 }
                 else
                 {
-                    contribution = glm::vec3(0.0f);
-                    i = bounces; // Exit the loop
+                    bounces[lane] = bounce + 1;
+                    singleMask |= 1u << lane;
                 }
             }
+            packet.ActiveMask = nextMask;
+            packet.HitMask = 0;
+        }
+
+        for (uint32_t lanes = singleMask; lanes != 0; lanes &= lanes - 1)
+        {
+            const int lane = RayPacket::FirstLane(lanes);
+            color[lane] += TracePath<Features>(rays[lane], contribution[lane], bounces[lane], streams[lane]);
         }
     }
-    if (numSamples > 1)
+
+    for (int lane = 0; lane < count; lane++)
     {
-        color /= static_cast<float>(numSamples); // Average the accumulated color samples
+        if (m_Samples > 1)
+            color[lane] /= static_cast<float>(m_Samples); // Average the accumulated color samples
+        colors[lane] = glm::vec4(color[lane], 1.0f);
     }
+}
 
-    return glm::vec4(color, 1.0f);
+/**
+ * @brief Generates a camera ray through a pixel.
+ *
+ * If anti-aliasing is enabled, the direction of the ray is randomized slightly within the pixel; otherwise
+ * it is the camera's precomputed ray direction. The origin is then offset within a unit disk scaled by the
+ * camera's aperture to simulate depth of field, and the direction adjusted based on the focus distance.
+ *
+ * @param x The x-coordinate of the pixel.
+ * @param y The y-coordinate of the pixel.
+ * @return Ray The camera ray, with a normalized direction.
+ */
+template <uint32_t Features>
+Ray Renderer::GenerateCameraRay(uint32_t x, uint32_t y)
+{
+    Ray ray;
+    ray.Origin = m_ActiveCamera->GetPosition();
+    if constexpr ((Features & KernelAntialiasing) != 0)
+    {
+        const glm::vec2 offset{(Utils::UInt() % 100) / 100.0f, (Utils::UInt() % 100) / 100.0f};
+        ray.Direction = m_ActiveCamera->GetJitteredRayDirection(x, y, offset);
+    }
+    else
+    {
+        ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_Width];
+    }
+
+    // A pinhole camera shoots every ray from the camera position, along the precomputed direction
+    if constexpr ((Features & KernelDepthOfField) != 0)
+    {
+        glm::vec2 inUnitDisk = Utils::InUnitDisk();
+        glm::vec3 offset{inUnitDisk.x * 0.5f * m_ActiveCamera->getAperatureSize(),
+                         inUnitDisk.y * 0.5f * m_ActiveCamera->getAperatureSize(),
+                         0.0f};
+        ray.Origin += offset;
+        ray.Direction = glm::normalize(m_ActiveCamera->getFocusDistance() * ray.Direction - offset);
+    }
+    return ray;
+}
+
+/**
+ * @brief Follows a light path through the scene and returns the light it gathers.
+ *
+ * @param ray The ray to start from.
+ * @param contribution The attenuation accumulated by the path before this ray.
+ * @param bounce The number of bounces already taken. Rays of bounce 0 are camera rays of the current tile.
+ * @param stream The random stream of the path's sample, used with deterministic sampling.
+ * @return glm::vec3 The color gathered by the rest of the path, already scaled by its contribution.
+ */
+template <uint32_t Features>
+glm::vec3 Renderer::TracePath(Ray ray, glm::vec3 contribution, int bounce, uint64_t stream)
+{
+    glm::vec3 color(0.0f);
+    for (; bounce < m_Bounces; bounce++)
+    {
+        HitPayload payload = bounce == 0 ? TracePrimaryRay(ray) : TraceRay(ray);
+        SeedSample(stream, bounce + 1);
+        if (!Scatter<Features>(ray, payload, contribution, color))
+            break;
+    }
+    return color;
+}
+
+/**
+ * @brief Shades one bounce of a light path.
+ *
+ * If the ray missed every object, the sky color is added to the path's color. Otherwise the material of
+ * the object hit scatters the ray, which is replaced by the scattered ray and its attenuation applied to the
+ * path's contribution.
+ *
+ * @param ray The ray that was traced. Replaced by the scattered ray if the path continues.
+ * @param payload The closest hit of the ray, or the payload returned by `Miss`.
+ * @param contribution The path's contribution, attenuated if the path continues.
+ * @param color The path's color, to which the sky color is added on a miss.
+ * @return bool Returns true if the path continues with the scattered ray; otherwise, returns false.
+ */
+template <uint32_t Features>
+bool Renderer::Scatter(Ray &ray, HitPayload &payload, glm::vec3 &contribution, glm::vec3 &color)
+{
+    if (payload.HitDistance < 0.0f)
+    {
+        color += m_ActiveScene->SkyColor * contribution;
+        return false;
+    }
+
+    glm::vec3 attenuation(1.0f);
+    glm::vec3 scatteredDirection(0.0f);
+    const MaterialData &material = m_ActiveScene->MaterialTable[payload.materialIndex];
+    if (!ScatterMaterial<(Features & KernelDiffuseOnly) != 0>(material, ray, payload, attenuation, scatteredDirection))
+        return false;
+
+    // ray.Origin = payload.position + payload.normal * 0.0001f;
+    // ray.Origin = payload.position + ray.Direction * (-0.0001f);
+    ray.Origin = payload.position + scatteredDirection * 0.0001f;
+    ray.Direction = scatteredDirection;
+
+    contribution *= attenuation;
+    return true;
+}
+
+/**
+ * @brief Shades a camera ray with ambient occlusion.
+ *
+ * The ray is traced to its closest hit, from which a single cosine-distributed visibility probe is sent
+ * over the hemisphere around the normal. The result is white if the probe escapes within the ambient
+ * occlusion distance and black otherwise, so accumulating frames converges to the ambient occlusion term.
+ * Rays that miss the scene are white.
+ *
+ * @param ray The camera ray.
+ * @return glm::vec3 The ambient occlusion estimate for this sample.
+ */
+glm::vec3 Renderer::AmbientOcclusion(const Ray &ray)
+{
+    HitPayload payload = TracePrimaryRay(ray);
+    if (payload.HitDistance < 0.0f)
+        return glm::vec3(1.0f);
+
+    glm::vec3 probeDirection = payload.normal + Utils::UnitVector();
+    if (glm::all(glm::lessThan(glm::abs(probeDirection), glm::vec3(1e-8))))
+        probeDirection = payload.normal;
+
+    Ray probe;
+    probe.Origin = payload.position + payload.normal * 0.0001f;
+    probe.Direction = glm::normalize(probeDirection);
+
+    return TraceOcclusion(probe, m_Settings.AmbientOcclusionDistance) ? glm::vec3(0.0f) : glm::vec3(1.0f);
 }
 
 /**
  * @brief Traces a ray through the scene and returns the closest hit.
  *
- * This function traces a ray through the scene and returns the closest hit. It iterates over all objects
- * in the scene and checks for intersections with the ray. If an intersection is found, the function
- * returns the closest hit.
+ * This function traces a ray through the scene and returns the closest hit. The ray is tested against the
+ * scene's acceleration structure if one has been built, otherwise against every object in the scene. If an
+ * intersection is found, the function returns the closest hit.
  *
  * @param ray The ray to trace.
  * @return HitPayload The closest hit data.
@@ -185,9 +1119,11 @@ glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 HitPayload Renderer::TraceRay(const Ray &ray)
 {
 
+    t_Counters.Rays++;
+
     float hitDistance = std::numeric_limits<float>::max();
     HitPayload payload;
-    bool hitAnything = m_ActiveScene->Hittables.hit(ray, 0.001f, hitDistance, payload);
+    bool hitAnything = m_ActiveScene->GetWorld(GetThreadNumaNode()).hit(ray, 0.001f, hitDistance, payload);
 
     if (!hitAnything)
         return Miss(ray);
@@ -195,6 +1131,74 @@ HitPayload Renderer::TraceRay(const Ray &ray)
     return ClosestHit(ray, payload);
 }
 
+/**
+ * @brief Traces a camera ray of the tile being rendered and returns the closest hit.
+ *
+ * If the current tile was frustum culled, traversal starts from the acceleration structure nodes left
+ * after culling; otherwise this is the same as `TraceRay`.
+ *
+ * @param ray The camera ray to trace. Must belong to the tile being rendered by the calling thread.
+ * @return HitPayload The closest hit data.
+ */
+HitPayload Renderer::TracePrimaryRay(const Ray &ray)
+{
+    if (!t_TileCandidatesValid)
+        return TraceRay(ray);
+
+    t_Counters.Rays++;
+
+    float hitDistance = std::numeric_limits<float>::max();
+    HitPayload payload;
+    bool hitAnything = m_ActiveScene->GetAccelerator(GetThreadNumaNode())->hitFromCandidates(ray, 0.001f, hitDistance, payload, t_TileCandidates);
+
+    if (!hitAnything)
+        return Miss(ray);
+
+    return ClosestHit(ray, payload);
+}
+
+/**
+ * @brief Finds the closest hits of the active rays of a packet.
+ *
+ * Only the hit distance and the indices of the objects hit are filled in; `ClosestHit` must be called for
+ * every lane in `packet.HitMask` to get the full hit information.
+ *
+ * @param packet The rays to trace.
+ * @param primary True if the rays are camera rays of the tile being rendered by the calling thread, so
+ * traversal can start from the tile's frustum culled nodes.
+ */
+void Renderer::TracePacket(RayPacket &packet, bool primary)
+{
+    const uint32_t rayCount = static_cast<uint32_t>(glm::bitCount(packet.ActiveMask));
+    t_Counters.Rays += rayCount;
+    t_Counters.PacketRays += rayCount;
+    t_Counters.Packets++;
+
+    const std::vector<uint32_t> *candidates = primary && t_TileCandidatesValid ? &t_TileCandidates : nullptr;
+    m_ActiveScene->GetAccelerator(GetThreadNumaNode())->hitPacket(packet, 0.001f, candidates);
+}
+
+/**
+ * @brief Tests whether anything blocks a ray before the given distance.
+ *
+ * This function issues an any-hit query against the scene, which stops at the first intersection found
+ * and never computes hit information. Use it for shadow and visibility rays.
+ *
+ * @param ray The ray to trace.
+ * @param tMax The distance beyond which hits are ignored, e.g. the distance to a light.
+ * @return bool Returns true if the ray is blocked; otherwise, returns false.
+ */
+bool Renderer::TraceOcclusion(const Ray &ray, float tMax)
+{
+    t_Counters.OcclusionRays++;
+
+    bool occluded = m_ActiveScene->GetWorld(GetThreadNumaNode()).occluded(ray, 0.001f, tMax);
+    if (occluded)
+        t_Counters.OcclusionHits++;
+
+    return occluded;
+}
+
 /**
  * @brief Finds the closest hit for a ray and updates the hit payload.
  *
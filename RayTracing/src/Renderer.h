@@ -6,8 +6,11 @@
 #include "Ray.h"
 #include "Scene.h"
 #include "Hittable.h"
+#include "RayPacket.h"
 
+#include <array>
 #include <memory>
+#include <utility>
 #include <execution>
 #include <glm/glm.hpp>
 
@@ -18,31 +21,155 @@ public:
     {
         bool Accumulate = true;
         bool EnableAntialiasing = false;
+        bool TileFrustumCulling = true;
+        bool AmbientOcclusion = false;
+        float AmbientOcclusionDistance = 1.0f;
+        int PacketSize = 0;          // Rays per packet (8 or 16), 0 traces every ray on its own
+        float PacketCoherence = 0.9f; // Minimum cosine between a packet ray and the packet's mean direction
+        uint32_t RayBatchSize = 0;    // Paths traced bounce by bounce together, 0 traces each path on its own
+        bool SortSecondaryRays = true; // Reorder each bounce of a batch by ray origin and direction
+        bool PinThreads = false;       // Bind render threads to NUMA nodes, each rendering the tiles whose pixels live there
+        bool HugePages = false;        // Back the image buffers with transparent huge pages
+        uint32_t TileSize = 16;        // Width and height of the tiles the image is rendered in, a multiple of 4 up to MaxTileSize
+        int ThreadCount = 0;           // Render threads, 0 uses one per hardware thread
+        bool DeterministicSampling = false; // Draw each sample from a random stream picked by its pixel, index and bounce, whatever thread renders it
     };
+
+    struct Statistics
+    {
+        uint64_t Rays = 0;          // Closest hit queries traced in the last frame
+        uint64_t OcclusionRays = 0; // Any hit (visibility) queries traced in the last frame
+        uint64_t OcclusionHits = 0; // Visibility queries that found an occluder
+        uint64_t CulledTiles = 0;    // Tiles whose primary rays started from frustum culled nodes
+        uint64_t TileCandidates = 0; // Total nodes left after culling, over all culled tiles
+        uint64_t Packets = 0;        // Ray packets traced
+        uint64_t PacketRays = 0;     // Closest hit queries traced as part of a packet, included in Rays
+        uint64_t BatchRays = 0;      // Secondary rays traced in batches, included in Rays
+        float BatchSortTime = 0.0f;  // Milliseconds spent gathering and sorting batched rays
+        float BatchTraceTime = 0.0f; // Milliseconds spent tracing batched rays
+        float RenderTime = 0.0f;    // Milliseconds spent in the last call to Render
+        uint64_t Triangles = 0;     // Triangles of the meshes in the scene rendered
+
+        double GetRaysPerSecond() const { return RenderTime > 0.0f ? (Rays + OcclusionRays) / (RenderTime * 0.001) : 0.0; }
+    };
+    static constexpr uint32_t MaxTileSize = 64;
+
     int m_Bounces = 5;
     int m_Samples = 1;
 
 public:
     Renderer() = default;
+    // A headless renderer keeps its image in memory only, without the GPU image of the editor
+    explicit Renderer(bool headless) : m_Headless(headless) {}
+    ~Renderer();
 
     void OnResize(uint32_t width, uint32_t height);
     void Render(const Scene &scene, Camera &camera);
+    void RenderRegion(const Scene &scene, Camera &camera, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
 
+    // Null for headless renderers
     std::shared_ptr<Walnut::Image> GetFinalImage() const { return m_FinalImage; }
+    uint32_t GetWidth() const { return m_Width; }
+    uint32_t GetHeight() const { return m_Height; }
+    // RGBA8 pixels of the image, as displayed
+    const uint32_t *GetImageData() const { return m_ImageData; }
 
     void ResetFrameIndex() { m_FrameIndex = 1; }
     Settings &GetSettings() { return m_Settings; }
+    const Settings &GetSettings() const { return m_Settings; }
+
+    // Frames summed in the accumulation buffer, which holds width * height pixels
+    uint32_t GetAccumulatedFrames() const { return m_Settings.Accumulate ? m_FrameIndex - 1 : 0; }
+    const glm::vec4 *GetAccumulationData() const { return m_AccumulationData; }
+    bool RestoreAccumulation(const glm::vec4 *data, uint32_t width, uint32_t height, uint32_t frames);
+    // Copies the accumulated sums, and the frames summed in each pixel, without averaging or clamping them
+    void ExportAccumulation(glm::vec4 *sums, uint32_t *counts) const;
+
+    // Index of the first frame accumulated. With deterministic sampling, renders of disjoint frame ranges add up to one render of them all.
+    void SetFirstFrame(uint32_t frame) { m_FirstFrame = frame; ResetFrameIndex(); }
+    uint32_t GetFirstFrame() const { return m_FirstFrame; }
+
+    // Auxiliary outputs of the first hit through every pixel center, at the final image's size. Null buffers are skipped.
+    void RenderAOVs(const Scene &scene, const Camera &camera, float *depth, glm::vec3 *normals, glm::vec3 *albedo);
+    const Statistics &GetStatistics() const { return m_Statistics; }
 
 private:
+    // Features the render kernels are specialised on, combined into their Features template argument
+    enum KernelFeature : uint32_t
+    {
+        KernelAntialiasing = 1 << 0,
+        KernelDepthOfField = 1 << 1,
+        KernelAccumulate = 1 << 2,
+        KernelDiffuseOnly = 1 << 3, // Every material of the scene is Lambertian
+    };
+    static constexpr uint32_t KernelVariantCount = 16;
+
+    using FrameKernel = void (Renderer::*)(uint32_t tilesX, uint32_t tilesY, bool cull, float jitter);
+
+    template <uint32_t... Features>
+    static constexpr std::array<FrameKernel, sizeof...(Features)> MakeFrameKernels(std::integer_sequence<uint32_t, Features...>)
+    {
+        return {&Renderer::RenderFrame<Features>...};
+    }
+
+    template <uint32_t Features>
+    void RenderFrame(uint32_t tilesX, uint32_t tilesY, bool cull, float jitter);
+    template <uint32_t Features>
+    void RenderBatches(uint32_t tilesX, uint32_t tilesY, bool cull, float jitter);
+    template <uint32_t Features>
+    bool TraceBatchBounce(size_t pathCount, int bounce);
+
+    template <uint32_t Features>
     glm::vec4 PerPixel(uint32_t x, uint32_t y); // RayGen
+    template <uint32_t Features>
+    void PerPacket(uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec4 *colors);
+
+    template <uint32_t Features>
+    Ray GenerateCameraRay(uint32_t x, uint32_t y);
+    template <uint32_t Features>
+    glm::vec3 TracePath(Ray ray, glm::vec3 contribution, int bounce, uint64_t stream);
+    template <uint32_t Features>
+    bool Scatter(Ray &ray, HitPayload &payload, glm::vec3 &contribution, glm::vec3 &color);
+
+    // Random stream of a sample of a pixel, and the restart of its sequence for a step of the sample with deterministic sampling
+    uint64_t GetSampleStream(uint32_t x, uint32_t y, int sample) const { return ((static_cast<uint64_t>(y) * m_Width + x) << 16) + static_cast<uint64_t>(sample); }
+    void SeedSample(uint64_t stream, int step) const;
+
+    void AllocateImageBuffers();
+    bool ImageBuffersOutdated() const;
+    void GetTileBounds(uint32_t tile, uint32_t tilesX, uint32_t &x0, uint32_t &y0, uint32_t &x1, uint32_t &y1) const;
+    void PrepareTile(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, bool cull, float jitter);
+    template <uint32_t Features>
+    void AccumulateSpan(uint32_t x, uint32_t y, uint32_t count, const glm::vec4 *colors);
+
+    glm::vec3 AmbientOcclusion(const Ray &ray);
+
+    void TracePacket(RayPacket &packet, bool primary);
 
+    HitPayload TracePrimaryRay(const Ray &ray);
     HitPayload TraceRay(const Ray &ray);
+    bool TraceOcclusion(const Ray &ray, float tMax);
     HitPayload ClosestHit(const Ray &ray, HitPayload &payload);
     HitPayload Miss(const Ray &ray);
 
+private:
+    // A light path traced as part of a batch
+    struct PathState
+    {
+        Ray PathRay;
+        glm::vec3 Contribution{1.0f};
+        glm::vec3 Color{0.0f};
+        bool Active = false;
+        uint64_t Stream = 0; // GetSampleStream of the path's pixel and sample
+    };
+
 private:
     std::shared_ptr<Walnut::Image> m_FinalImage;
+    bool m_Headless = false;
+    uint32_t m_Width = 0, m_Height = 0;
+    uint32_t m_RegionX0 = 0, m_RegionY0 = 0, m_RegionX1 = 0, m_RegionY1 = 0; // Pixels rendered by the current frame
     Settings m_Settings;
+    Statistics m_Statistics;
 
     std::vector<uint32_t> m_ImageHorizontalIter, m_ImageVerticalIter;
 
@@ -51,7 +178,19 @@ private:
 
     uint32_t *m_ImageData = nullptr;
     glm::vec4 *m_AccumulationData = nullptr;
+    bool m_ImageBuffersPinned = false;     // The buffers were first touched by threads pinned to NUMA nodes
+    bool m_ImageBuffersHugePages = false;
+    size_t m_ImageBufferPixels = 0; // Size the buffers were allocated for
+    uint32_t m_ImageBuffersTileSize = 16;
+
+    uint32_t m_TileSize = 16; // Tile size of the current frame
 
     uint32_t m_FrameIndex = 1;
+    uint32_t m_FirstFrame = 0;
+
+    std::vector<PathState> m_Paths;
+    std::vector<uint32_t> m_SortKeys, m_SortIndices, m_SortScratchKeys, m_SortScratchIndices;
+    std::vector<Ray> m_BatchRays;
+    std::vector<HitPayload> m_BatchHits;
 
 };
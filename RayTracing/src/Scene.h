@@ -1,7 +1,9 @@
 #pragma once
 
 #include "HittableList.h"
+#include "Accelerator.h"
 #include "Material.h"
+#include "TriangleMesh.h"
 
 #include <glm/glm.hpp>
 #include <vector>
@@ -15,5 +17,63 @@ struct Scene
 
     std::vector<shared_ptr<Material>> Materials;
 
+    // Flattened copies of Materials read by the renderer, kept in sync with UpdateMaterial(s)
+    std::vector<MaterialData> MaterialTable;
+    uint32_t MaterialTypes = 0; // Bit 1 << type is set for every MaterialType in MaterialTable
+
     glm::vec3 SkyColor{0.6f, 0.7f, 0.9f};
+
+    // Built over Hittables, must be rebuilt whenever the objects change. Null traces Hittables directly.
+    shared_ptr<Accelerator> AccelerationStructure;
+
+    // Triangles of every TriangleMesh in Hittables, kept up to date with UpdateTriangleCount
+    size_t TriangleCount = 0;
+
+    // Optional copies of AccelerationStructure with their nodes allocated on each NUMA node, indexed by node
+    std::vector<shared_ptr<Accelerator>> AccelerationReplicas;
+
+    // Copies every material into the material table. Call after adding or removing materials.
+    void UpdateMaterials()
+    {
+        MaterialTable.resize(Materials.size());
+        MaterialTypes = 0;
+        for (size_t i = 0; i < Materials.size(); i++)
+        {
+            MaterialTable[i] = Materials[i]->GetData();
+            MaterialTypes |= 1u << static_cast<uint32_t>(MaterialTable[i].Type);
+        }
+    }
+
+    // Copies one edited material into the material table
+    void UpdateMaterial(size_t index)
+    {
+        MaterialTable[index] = Materials[index]->GetData();
+        MaterialTypes |= 1u << static_cast<uint32_t>(MaterialTable[index].Type);
+    }
+
+    // Counts the triangles of the meshes again. Call after adding or removing objects.
+    void UpdateTriangleCount()
+    {
+        TriangleCount = 0;
+        for (const shared_ptr<Hittable> &object : Hittables.objects)
+        {
+            if (const TriangleMesh *mesh = dynamic_cast<const TriangleMesh *>(object.get()))
+                TriangleCount += mesh->GetTriangleCount();
+        }
+    }
+
+    // The acceleration structure to trace from a thread on the given NUMA node (-1 if unknown)
+    const Accelerator *GetAccelerator(int node) const
+    {
+        if (node >= 0 && node < static_cast<int>(AccelerationReplicas.size()))
+            return AccelerationReplicas[node].get();
+        return AccelerationStructure.get();
+    }
+
+    const Hittable &GetWorld(int node = -1) const
+    {
+        if (const Accelerator *accelerator = GetAccelerator(node))
+            return *accelerator;
+        return Hittables;
+    }
 };
@@ -0,0 +1,406 @@
+#include "SceneCache.h"
+#include "BVH.h"
+#include "MappedFile.h"
+#include "Sphere.h"
+#include "TriangleMesh.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace
+{
+    constexpr char CacheMagic[8] = {'R', 'T', 'S', 'C', 'A', 'C', 'H', 'E'};
+    constexpr uint32_t ByteOrderMark = 0x01020304;
+
+    // Sections start at multiples of this, so their records are aligned wherever the file is mapped
+    constexpr uint64_t SectionAlignment = 64;
+
+    enum class SectionType : uint32_t
+    {
+        Materials = 1,         // MaterialData per material
+        MaterialNames,         // Zero terminated name per material
+        Objects,               // ObjectRecord per object of the scene, in order
+        Spheres,               // SphereRecord per sphere
+        Meshes,                // MeshRecord per mesh
+        MeshNodes,             // BVHNode per node of the hierarchy of mesh Item
+        MeshTriangles,         // TriangleMesh::Triangle per triangle of mesh Item, in leaf order
+        MeshNormalIndices,     // Three uint32_t per triangle of mesh Item, in leaf order
+        MeshNormals,           // glm::vec3 per normal of mesh Item
+        SceneNodes,            // BVHNode per node of the hierarchy over the objects
+        ScenePrimitiveIndices, // uint32_t object index per object, in leaf order
+    };
+
+    enum class ObjectType : uint32_t
+    {
+        Sphere = 0,
+        TriangleMesh,
+    };
+
+    struct CacheHeader
+    {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t ByteOrder;
+        uint32_t RecordSizes; // Sizes of the records stored in place, to reject files of other builds
+        uint32_t SectionCount;
+        uint64_t FileSize;
+        glm::vec3 SkyColor;
+        uint32_t LeafSize; // Maximum leaf size of the scene hierarchy
+    };
+
+    struct CacheSection
+    {
+        SectionType Type;
+        uint32_t Item; // Mesh index of mesh sections, 0 otherwise
+        uint64_t Offset;
+        uint64_t Size;
+    };
+
+    struct ObjectRecord
+    {
+        ObjectType Type;
+        uint32_t Index; // Index among the spheres or meshes
+    };
+
+    struct SphereRecord
+    {
+        glm::vec3 Position;
+        float Radius;
+        int32_t MaterialIndex;
+    };
+
+    struct MeshRecord
+    {
+        int32_t MaterialIndex;
+        uint32_t Padding;
+        uint64_t VertexCount;
+    };
+
+    static_assert(std::is_trivially_copyable<BVHNode>::value && std::is_trivially_copyable<TriangleMesh::Triangle>::value &&
+                      std::is_trivially_copyable<MaterialData>::value,
+                  "Records used in place must be trivially copyable");
+
+    uint32_t GetRecordSizes()
+    {
+        return static_cast<uint32_t>(sizeof(BVHNode) | sizeof(TriangleMesh::Triangle) << 8 | sizeof(MaterialData) << 16 |
+                                     sizeof(CacheHeader) << 24);
+    }
+
+    uint64_t Align(uint64_t offset)
+    {
+        return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+    }
+
+    // Sections to write, pointing at data owned by the caller
+    struct SectionData
+    {
+        SectionType Type;
+        uint32_t Item;
+        const void *Data;
+        uint64_t Size;
+    };
+
+    template <typename T>
+    void AddSection(std::vector<SectionData> &sections, SectionType type, uint32_t item, const T *data, size_t count)
+    {
+        sections.push_back({type, item, data, count * sizeof(T)});
+    }
+
+    // Sections of a mapped cache, with checked bounds
+    class CacheReader
+    {
+    public:
+        CacheReader(std::shared_ptr<const MappedFile> file, const CacheSection *sections, uint32_t sectionCount)
+            : m_File(std::move(file)), m_Sections(sections), m_SectionCount(sectionCount) {}
+
+        // Views the records of a section in place, or an empty array if the file has no such section
+        template <typename T>
+        SharedArray<T> Get(SectionType type, uint32_t item = 0) const
+        {
+            for (uint32_t i = 0; i < m_SectionCount; i++)
+            {
+                const CacheSection &section = m_Sections[i];
+                if (section.Type == type && section.Item == item)
+                    return SharedArray<T>(m_File, reinterpret_cast<const T *>(m_File->GetData() + section.Offset), section.Size / sizeof(T));
+            }
+            return SharedArray<T>();
+        }
+
+    private:
+        std::shared_ptr<const MappedFile> m_File;
+        const CacheSection *m_Sections;
+        uint32_t m_SectionCount;
+    };
+}
+
+/**
+ * @brief Writes a scene, its materials and its prebuilt hierarchies to a binary cache file.
+ *
+ * The file starts with a header and a table of sections, followed by the sections at aligned offsets.
+ * Sections hold flat arrays of records exactly as they are laid out in memory, and refer to each other by
+ * index only, so the file is relocatable and `LoadSceneCache` traces the hierarchies and meshes straight
+ * from the mapped file. The scene's hierarchy is stored if it is a `BVH`, otherwise one is built for the file.
+ *
+ * The file is written under a temporary name and renamed when complete, so processes loading it never see
+ * a partial file.
+ *
+ * @param path The path of the cache file.
+ * @param scene The scene to write. Only spheres and triangle meshes can be cached.
+ * @param materialNames The name of every material of the scene.
+ * @param error Output parameter for a description of the problem if writing fails.
+ * @return bool Returns true if the cache was written; otherwise, returns false.
+ */
+bool SaveSceneCache(const std::string &path, const Scene &scene, const std::vector<std::string> &materialNames, std::string &error)
+{
+    shared_ptr<const BVH> hierarchy = std::dynamic_pointer_cast<const BVH>(scene.AccelerationStructure);
+    if (!hierarchy)
+        hierarchy = std::make_shared<BVH>(scene.Hittables);
+
+    std::vector<ObjectRecord> objects;
+    std::vector<SphereRecord> spheres;
+    std::vector<MeshRecord> meshRecords;
+    std::vector<const TriangleMesh *> meshes;
+    for (const shared_ptr<Hittable> &object : scene.Hittables.objects)
+    {
+        if (const Sphere *sphere = dynamic_cast<const Sphere *>(object.get()))
+        {
+            objects.push_back({ObjectType::Sphere, static_cast<uint32_t>(spheres.size())});
+            spheres.push_back({sphere->Position, sphere->Radius, sphere->MaterialIndex});
+        }
+        else if (const TriangleMesh *mesh = dynamic_cast<const TriangleMesh *>(object.get()))
+        {
+            objects.push_back({ObjectType::TriangleMesh, static_cast<uint32_t>(meshes.size())});
+            meshRecords.push_back({mesh->MaterialIndex, 0, mesh->GetVertexCount()});
+            meshes.push_back(mesh);
+        }
+        else
+        {
+            error = std::string(object->getTypeName()) + " objects cannot be cached";
+            return false;
+        }
+    }
+
+    std::string names;
+    for (size_t i = 0; i < scene.Materials.size(); i++)
+    {
+        names += i < materialNames.size() ? materialNames[i] : "Material " + std::to_string(i + 1);
+        names += '\0';
+    }
+
+    std::vector<SectionData> sections;
+    AddSection(sections, SectionType::Materials, 0, scene.MaterialTable.data(), scene.MaterialTable.size());
+    AddSection(sections, SectionType::MaterialNames, 0, names.data(), names.size());
+    AddSection(sections, SectionType::Objects, 0, objects.data(), objects.size());
+    AddSection(sections, SectionType::Spheres, 0, spheres.data(), spheres.size());
+    AddSection(sections, SectionType::Meshes, 0, meshRecords.data(), meshRecords.size());
+    for (uint32_t i = 0; i < meshes.size(); i++)
+    {
+        AddSection(sections, SectionType::MeshNodes, i, meshes[i]->GetNodes().data(), meshes[i]->GetNodes().size());
+        AddSection(sections, SectionType::MeshTriangles, i, meshes[i]->GetTriangles().data(), meshes[i]->GetTriangles().size());
+        AddSection(sections, SectionType::MeshNormalIndices, i, meshes[i]->GetNormalIndices().data(), meshes[i]->GetNormalIndices().size());
+        AddSection(sections, SectionType::MeshNormals, i, meshes[i]->GetNormals().data(), meshes[i]->GetNormals().size());
+    }
+    AddSection(sections, SectionType::SceneNodes, 0, hierarchy->GetNodes().data(), hierarchy->GetNodes().size());
+    AddSection(sections, SectionType::ScenePrimitiveIndices, 0, hierarchy->GetPrimitiveIndices().data(), hierarchy->GetPrimitiveIndices().size());
+
+    CacheHeader header = {};
+    std::memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+    header.Version = SceneCacheVersion;
+    header.ByteOrder = ByteOrderMark;
+    header.RecordSizes = GetRecordSizes();
+    header.SectionCount = static_cast<uint32_t>(sections.size());
+    header.SkyColor = scene.SkyColor;
+    header.LeafSize = hierarchy->GetMaxLeafSize();
+
+    std::vector<CacheSection> table(sections.size());
+    uint64_t offset = Align(sizeof(CacheHeader) + table.size() * sizeof(CacheSection));
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+        table[i] = {sections[i].Type, sections[i].Item, offset, sections[i].Size};
+        offset = Align(offset + sections[i].Size);
+    }
+    header.FileSize = offset;
+
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            error = "Cannot write " + temporaryPath;
+            return false;
+        }
+
+        const char padding[SectionAlignment] = {};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(CacheSection));
+        uint64_t position = sizeof(header) + table.size() * sizeof(CacheSection);
+        for (size_t i = 0; i < sections.size(); i++)
+        {
+            file.write(padding, table[i].Offset - position);
+            file.write(static_cast<const char *>(sections[i].Data), sections[i].Size);
+            position = table[i].Offset + sections[i].Size;
+        }
+        file.write(padding, header.FileSize - position);
+
+        if (!file.flush())
+        {
+            error = "Cannot write " + temporaryPath;
+            return false;
+        }
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        error = "Cannot rename " + temporaryPath + " to " + path;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Replaces a scene with one written by `SaveSceneCache`.
+ *
+ * The file is mapped read only and its hierarchies, mesh triangles and normals are used in place: nothing
+ * is parsed or built, and pages are only read from disk once rays reach them. Processes loading the same
+ * file share a single copy of it in the OS file cache. The objects themselves are created from their
+ * records, and the scene's acceleration structure becomes the stored `BVH`, without NUMA replicas.
+ *
+ * The header, the section table and the bounds of every section are checked, but the records are trusted
+ * to be as `SaveSceneCache` wrote them.
+ *
+ * @param path The path of the cache file.
+ * @param scene The scene to replace. Left unchanged if loading fails.
+ * @param materialNames Output parameter for the name of every material of the scene.
+ * @param error Output parameter for a description of the problem if loading fails.
+ * @return bool Returns true if the scene was loaded; otherwise, returns false.
+ */
+bool LoadSceneCache(const std::string &path, Scene &scene, std::vector<std::string> &materialNames, std::string &error)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->Open(path))
+    {
+        error = "Cannot open " + path;
+        return false;
+    }
+
+    const size_t size = file->GetSize();
+    const CacheHeader *header = reinterpret_cast<const CacheHeader *>(file->GetData());
+    if (size < sizeof(CacheHeader) || std::memcmp(header->Magic, CacheMagic, sizeof(CacheMagic)) != 0)
+    {
+        error = path + " is not a scene cache";
+        return false;
+    }
+    if (header->Version != SceneCacheVersion || header->ByteOrder != ByteOrderMark || header->RecordSizes != GetRecordSizes())
+    {
+        error = path + " was written by another version of the renderer or for another machine";
+        return false;
+    }
+    if (header->FileSize != size || header->SectionCount > (size - sizeof(CacheHeader)) / sizeof(CacheSection))
+    {
+        error = path + " is truncated";
+        return false;
+    }
+
+    const CacheSection *sections = reinterpret_cast<const CacheSection *>(file->GetData() + sizeof(CacheHeader));
+    for (uint32_t i = 0; i < header->SectionCount; i++)
+    {
+        if (sections[i].Offset % SectionAlignment != 0 || sections[i].Offset > size || sections[i].Size > size - sections[i].Offset)
+        {
+            error = path + " has a damaged section table";
+            return false;
+        }
+    }
+
+    const CacheReader reader(file, sections, header->SectionCount);
+    const SharedArray<MaterialData> materials = reader.Get<MaterialData>(SectionType::Materials);
+    const SharedArray<char> names = reader.Get<char>(SectionType::MaterialNames);
+    const SharedArray<ObjectRecord> objects = reader.Get<ObjectRecord>(SectionType::Objects);
+    const SharedArray<SphereRecord> spheres = reader.Get<SphereRecord>(SectionType::Spheres);
+    const SharedArray<MeshRecord> meshRecords = reader.Get<MeshRecord>(SectionType::Meshes);
+
+    Scene loaded;
+    loaded.SkyColor = header->SkyColor;
+
+    std::vector<std::string> loadedNames;
+    const char *name = names.data();
+    for (size_t i = 0; i < materials.size(); i++)
+    {
+        const MaterialData &data = materials[i];
+        const size_t remaining = names.end() - name;
+        const size_t length = name ? strnlen(name, remaining) : 0;
+        loadedNames.push_back(length < remaining ? std::string(name, length) : "Material " + std::to_string(i + 1));
+        if (length < remaining)
+            name += length + 1;
+
+        if (data.Type == MaterialType::Metal)
+        {
+            auto material = make_shared<Metal>(loadedNames.back());
+            material->Albedo = data.Albedo;
+            material->Fuzz = data.Fuzz;
+            loaded.Materials.push_back(material);
+        }
+        else if (data.Type == MaterialType::Dielectric)
+        {
+            auto material = make_shared<Dielectric>(loadedNames.back());
+            material->IndexOfRefraction = data.IndexOfRefraction;
+            loaded.Materials.push_back(material);
+        }
+        else
+        {
+            auto material = make_shared<Lambertian>(loadedNames.back());
+            material->Albedo = data.Albedo;
+            material->Roughness = data.Roughness;
+            loaded.Materials.push_back(material);
+        }
+    }
+
+    std::vector<shared_ptr<TriangleMesh>> meshes;
+    for (uint32_t i = 0; i < meshRecords.size(); i++)
+    {
+        auto mesh = make_shared<TriangleMesh>(reader.Get<BVHNode>(SectionType::MeshNodes, i),
+                                              reader.Get<TriangleMesh::Triangle>(SectionType::MeshTriangles, i),
+                                              reader.Get<uint32_t>(SectionType::MeshNormalIndices, i),
+                                              reader.Get<glm::vec3>(SectionType::MeshNormals, i),
+                                              static_cast<size_t>(meshRecords[i].VertexCount));
+        mesh->MaterialIndex = meshRecords[i].MaterialIndex;
+        meshes.push_back(mesh);
+    }
+
+    loaded.Hittables.objects.reserve(objects.size());
+    for (const ObjectRecord &object : objects)
+    {
+        if (object.Type == ObjectType::Sphere && object.Index < spheres.size())
+        {
+            const SphereRecord &record = spheres[object.Index];
+            auto sphere = make_shared<Sphere>();
+            sphere->Position = record.Position;
+            sphere->Radius = record.Radius;
+            sphere->MaterialIndex = record.MaterialIndex;
+            loaded.Hittables.add(sphere);
+        }
+        else if (object.Type == ObjectType::TriangleMesh && object.Index < meshes.size())
+            loaded.Hittables.add(meshes[object.Index]);
+        else
+        {
+            error = path + " references a missing object";
+            return false;
+        }
+    }
+
+    const SharedArray<uint32_t> primitiveIndices = reader.Get<uint32_t>(SectionType::ScenePrimitiveIndices);
+    if (primitiveIndices.size() != loaded.Hittables.objects.size())
+    {
+        error = path + " has a hierarchy over other objects";
+        return false;
+    }
+    loaded.AccelerationStructure = make_shared<BVH>(loaded.Hittables, reader.Get<BVHNode>(SectionType::SceneNodes), primitiveIndices, header->LeafSize);
+
+    loaded.UpdateMaterials();
+    loaded.UpdateTriangleCount();
+    scene = std::move(loaded);
+    materialNames = std::move(loadedNames);
+    return true;
+}
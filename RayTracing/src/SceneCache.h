@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Scene.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Increased whenever the layout of the cache or of any record stored in it changes
+constexpr uint32_t SceneCacheVersion = 1;
+
+bool SaveSceneCache(const std::string &path, const Scene &scene, const std::vector<std::string> &materialNames, std::string &error);
+bool LoadSceneCache(const std::string &path, Scene &scene, std::vector<std::string> &materialNames, std::string &error);
@@ -0,0 +1,313 @@
+#include "SceneFile.h"
+#include "Json.h"
+#include "MappedFile.h"
+#include "Sphere.h"
+
+#include <cstdio>
+#include <limits>
+#include <optional>
+
+namespace
+{
+    // Camera settings read from a file, applied only once the whole file has been read
+    struct CameraData
+    {
+        bool Present = false;
+        glm::vec3 Position{0.0f};
+        glm::vec3 Direction{0.0f, 0.0f, -1.0f};
+        float VerticalFOV = 45.0f;
+        float Aperture = 0.0f;
+        float FocusDistance = 10.0f;
+    };
+
+    bool ReadCamera(JsonReader &reader, CameraData &camera)
+    {
+        camera.Present = true;
+        return reader.ReadObject([&](const std::string &key)
+                                 {
+            if (key == "position")
+                return reader.ReadVec3(camera.Position);
+            if (key == "direction")
+                return reader.ReadVec3(camera.Direction);
+            if (key == "fov")
+                return reader.ReadFloat(camera.VerticalFOV);
+            if (key == "aperture")
+                return reader.ReadFloat(camera.Aperture);
+            if (key == "focusDistance")
+                return reader.ReadFloat(camera.FocusDistance);
+            return reader.SkipValue(); });
+    }
+
+    // Replaces value with a member read from a file, if the file had it
+    template <typename T>
+    void Override(T &value, const std::optional<T> &read)
+    {
+        if (read)
+            value = *read;
+    }
+
+    bool ReadMaterial(JsonReader &reader, std::vector<shared_ptr<Material>> &materials, std::vector<std::string> &names)
+    {
+        // Members may come before "type", so they are kept aside until the material can be made with its own defaults
+        std::string name = "Material " + std::to_string(materials.size() + 1), type = "lambertian";
+        std::optional<glm::vec3> albedo;
+        std::optional<float> roughness, fuzz, indexOfRefraction;
+        const bool read = reader.ReadObject([&](const std::string &key)
+                                            {
+            if (key == "name")
+                return reader.ReadString(name);
+            if (key == "type")
+                return reader.ReadString(type);
+            if (key == "albedo")
+                return reader.ReadVec3(albedo.emplace());
+            if (key == "roughness")
+                return reader.ReadFloat(roughness.emplace());
+            if (key == "fuzz")
+                return reader.ReadFloat(fuzz.emplace());
+            if (key == "ior")
+                return reader.ReadFloat(indexOfRefraction.emplace());
+            return reader.SkipValue(); });
+        if (!read)
+            return false;
+
+        if (type == "lambertian")
+        {
+            auto material = make_shared<Lambertian>(name);
+            Override(material->Albedo, albedo);
+            Override(material->Roughness, roughness);
+            materials.push_back(material);
+        }
+        else if (type == "metal")
+        {
+            auto material = make_shared<Metal>(name);
+            Override(material->Albedo, albedo);
+            Override(material->Fuzz, fuzz);
+            materials.push_back(material);
+        }
+        else if (type == "dielectric")
+        {
+            auto material = make_shared<Dielectric>(name);
+            Override(material->IndexOfRefraction, indexOfRefraction);
+            materials.push_back(material);
+        }
+        else
+            return reader.Fail("unknown material type");
+
+        names.push_back(name);
+        return true;
+    }
+
+    bool ReadSphere(JsonReader &reader, Sphere &sphere)
+    {
+        return reader.ReadObject([&](const std::string &key)
+                                 {
+            if (key == "center")
+                return reader.ReadVec3(sphere.Position);
+            if (key == "radius")
+                return reader.ReadFloat(sphere.Radius);
+            if (key == "material")
+            {
+                long long index;
+                if (!reader.ReadInteger(index))
+                    return false;
+                if (index < 0 || index > std::numeric_limits<int>::max())
+                    return reader.Fail("invalid material index");
+                sphere.MaterialIndex = static_cast<int>(index);
+                return true;
+            }
+            return reader.SkipValue(); });
+    }
+}
+
+/**
+ * @brief Replaces a scene, and optionally the camera, with the contents of a scene file.
+ *
+ * The file is mapped into memory and read in a single pass by `ReadSceneText`.
+ *
+ * @param path The path of the scene file, in the format described in SceneFile.h.
+ * @param scene The scene to replace.
+ * @param camera The camera to place as described in the file, or nullptr to leave it alone.
+ * @param materialNames Output parameter for the name of every material of the scene.
+ * @param error Output parameter for a description of the problem, with its line, if loading fails.
+ * @return bool Returns true if the file was loaded; otherwise, returns false.
+ */
+bool LoadSceneFile(const std::string &path, Scene &scene, Camera *camera, std::vector<std::string> &materialNames, std::string &error)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = "Cannot open " + path;
+        return false;
+    }
+    return ReadSceneText(file.GetData(), file.GetData() + file.GetSize(), path, scene, camera, materialNames, error);
+}
+
+/**
+ * @brief Replaces a scene, and optionally the camera, with a scene document held in memory.
+ *
+ * The text is read in a single pass by a pull parser, which stores every value straight into its place
+ * without building a document tree. Spheres are parsed into one contiguous block and added to the scene
+ * with `HittableList::addBlock`, so a million spheres cost one allocation instead of a million.
+ *
+ * The scene and camera are only changed once the whole document has been read without errors. The scene's
+ * acceleration structure is cleared and must be rebuilt.
+ *
+ * @param begin The start of the document, in the format described in SceneFile.h.
+ * @param end The end of the document.
+ * @param source The name of the document in errors, such as its path.
+ * @param scene The scene to replace.
+ * @param camera The camera to place as described in the document, or nullptr to leave it alone.
+ * @param materialNames Output parameter for the name of every material of the scene.
+ * @param error Output parameter for a description of the problem, with its line, if reading fails.
+ * @return bool Returns true if the document was read; otherwise, returns false.
+ */
+bool ReadSceneText(const char *begin, const char *end, const std::string &source, Scene &scene, Camera *camera,
+                   std::vector<std::string> &materialNames, std::string &error)
+{
+    JsonReader reader(begin, end);
+    Scene loaded;
+    std::vector<std::string> names;
+    auto spheres = std::make_shared<std::vector<Sphere>>();
+    CameraData cameraData;
+    glm::vec3 sky = scene.SkyColor;
+
+    const bool read = reader.ReadObject([&](const std::string &key)
+                                        {
+        if (key == "format")
+        {
+            std::string format;
+            return reader.ReadString(format) && (format == "raytracing-scene" || reader.Fail("not a scene file"));
+        }
+        if (key == "version")
+        {
+            long long version;
+            return reader.ReadInteger(version) && (version <= SceneFileVersion || reader.Fail("scene file from a newer version"));
+        }
+        if (key == "sky")
+            return reader.ReadVec3(sky);
+        if (key == "camera")
+            return ReadCamera(reader, cameraData);
+        if (key == "materials")
+            return reader.ReadArray([&]()
+                                    { return ReadMaterial(reader, loaded.Materials, names); });
+        if (key == "spheres")
+            return reader.ReadArray([&]()
+                                    { spheres->emplace_back();
+                                      return ReadSphere(reader, spheres->back()); });
+        return reader.SkipValue(); });
+
+    if (!read || (!reader.AtEnd() && !reader.Fail("unexpected text after the scene")))
+    {
+        error = source + ", " + reader.GetError();
+        return false;
+    }
+    for (const Sphere &sphere : *spheres)
+    {
+        if (sphere.MaterialIndex >= static_cast<int>(loaded.Materials.size()))
+        {
+            error = source + ": sphere material " + std::to_string(sphere.MaterialIndex) + " does not exist";
+            return false;
+        }
+    }
+    if (cameraData.Present && glm::length(cameraData.Direction) == 0.0f)
+    {
+        error = source + ": camera direction is zero";
+        return false;
+    }
+
+    spheres->shrink_to_fit();
+    loaded.Hittables.addBlock(spheres);
+    loaded.SkyColor = sky;
+    loaded.UpdateMaterials();
+    loaded.UpdateTriangleCount();
+
+    scene = std::move(loaded);
+    materialNames = std::move(names);
+    if (camera && cameraData.Present)
+    {
+        camera->SetLens(cameraData.VerticalFOV, cameraData.Aperture, cameraData.FocusDistance);
+        camera->SetView(cameraData.Position, cameraData.Direction);
+    }
+    return true;
+}
+
+/**
+ * @brief Writes a scene, and optionally the camera, to a scene file.
+ *
+ * Numbers are written with the shortest text that reads back to the same float, so saving and loading
+ * a scene reproduces it exactly. Only spheres can be saved.
+ *
+ * @param path The path of the scene file.
+ * @param scene The scene to write.
+ * @param camera The camera to write, or nullptr to leave it out of the file.
+ * @param materialNames The name of every material of the scene.
+ * @param error Output parameter for a description of the problem if writing fails.
+ * @return bool Returns true if the file was written; otherwise, returns false.
+ */
+bool SaveSceneFile(const std::string &path, const Scene &scene, const Camera *camera, const std::vector<std::string> &materialNames, std::string &error)
+{
+    for (const shared_ptr<Hittable> &object : scene.Hittables.objects)
+    {
+        if (!dynamic_cast<const Sphere *>(object.get()))
+        {
+            error = std::string(object->getTypeName()) + " objects cannot be saved to scene files";
+            return false;
+        }
+    }
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        error = "Cannot write " + path;
+        return false;
+    }
+
+    bool written;
+    {
+        JsonWriter writer(file);
+        writer << "{\n    \"format\": \"raytracing-scene\",\n    \"version\": " << static_cast<long long>(SceneFileVersion) << ",\n";
+        writer << "    \"sky\": " << scene.SkyColor << ",\n";
+        if (camera)
+        {
+            writer << "    \"camera\": {\"position\": " << camera->GetPosition() << ", \"direction\": " << camera->GetDirection()
+                   << ", \"fov\": " << camera->GetVerticalFOV() << ", \"aperture\": " << camera->getAperatureSize()
+                   << ", \"focusDistance\": " << camera->getFocusDistance() << "},\n";
+        }
+
+        writer << "    \"materials\": [";
+        for (size_t i = 0; i < scene.MaterialTable.size(); i++)
+        {
+            const MaterialData &data = scene.MaterialTable[i];
+            writer << (i > 0 ? ",\n        {\"name\": " : "\n        {\"name\": ");
+            writer.WriteString(i < materialNames.size() ? materialNames[i] : "Material " + std::to_string(i + 1));
+            switch (data.Type)
+            {
+            case MaterialType::Lambertian:
+                writer << ", \"type\": \"lambertian\", \"albedo\": " << data.Albedo << ", \"roughness\": " << data.Roughness << "}";
+                break;
+            case MaterialType::Metal:
+                writer << ", \"type\": \"metal\", \"albedo\": " << data.Albedo << ", \"fuzz\": " << data.Fuzz << "}";
+                break;
+            case MaterialType::Dielectric:
+                writer << ", \"type\": \"dielectric\", \"ior\": " << data.IndexOfRefraction << "}";
+                break;
+            }
+        }
+        writer << "\n    ],\n";
+
+        writer << "    \"spheres\": [";
+        for (size_t i = 0; i < scene.Hittables.objects.size(); i++)
+        {
+            const Sphere &sphere = static_cast<const Sphere &>(*scene.Hittables.objects[i]);
+            writer << (i > 0 ? ",\n        {\"center\": " : "\n        {\"center\": ") << sphere.Position
+                   << ", \"radius\": " << sphere.Radius << ", \"material\": " << static_cast<long long>(sphere.MaterialIndex) << "}";
+        }
+        writer << "\n    ]\n}\n";
+        written = writer.Flush();
+    }
+
+    written &= fclose(file) == 0;
+    if (!written)
+        error = "Cannot write " + path;
+    return written;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Scene.h"
+#include "Camera.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Scene files are JSON documents describing the camera, the materials and the spheres of a scene:
+ *
+ * {
+ *     "format": "raytracing-scene",
+ *     "version": 1,
+ *     "sky": [0.6, 0.7, 0.9],
+ *     "camera": {"position": [13, 2, 3], "direction": [-0.96, -0.15, -0.22], "fov": 20, "aperture": 0, "focusDistance": 10},
+ *     "materials": [
+ *         {"name": "Ground", "type": "lambertian", "albedo": [0.5, 0.5, 0.5], "roughness": 1},
+ *         {"name": "Steel", "type": "metal", "albedo": [0.7, 0.6, 0.5], "fuzz": 0.1},
+ *         {"name": "Glass", "type": "dielectric", "ior": 1.5}
+ *     ],
+ *     "spheres": [
+ *         {"center": [0, -1000, 0], "radius": 1000, "material": 0},
+ *         {"center": [4, 1, 0], "radius": 1, "material": 2}
+ *     ]
+ * }
+ *
+ * Every member is optional, with the defaults of the editor for missing ones, and members may appear in any
+ * order. Colors are linear RGB, angles in degrees and "material" indexes the "materials" array. "direction"
+ * need not be normalized. Unknown members are skipped, so newer files with extra data still load.
+ */
+
+constexpr int SceneFileVersion = 1;
+
+// Replaces the scene (and camera, unless null) with a scene file. The scene's acceleration structure must be rebuilt after.
+bool LoadSceneFile(const std::string &path, Scene &scene, Camera *camera, std::vector<std::string> &materialNames, std::string &error);
+// Same as LoadSceneFile, from a document in memory named source in errors
+bool ReadSceneText(const char *begin, const char *end, const std::string &source, Scene &scene, Camera *camera,
+                   std::vector<std::string> &materialNames, std::string &error);
+
+bool SaveSceneFile(const std::string &path, const Scene &scene, const Camera *camera, const std::vector<std::string> &materialNames, std::string &error);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Read only array whose elements are either owned by it or by another object, such as a mapped file.
+ *
+ * Lets acceleration structures and meshes trace arrays loaded from a scene cache in place, without copying
+ * them, while arrays they build themselves are moved in from a vector. The owner is reference counted, so
+ * copies share the elements and keep them alive.
+ */
+template <typename T>
+class SharedArray
+{
+public:
+    SharedArray() = default;
+
+    SharedArray(std::vector<T> &&elements)
+    {
+        auto owner = std::make_shared<const std::vector<T>>(std::move(elements));
+        m_Data = owner->data();
+        m_Size = owner->size();
+        m_Owner = std::move(owner);
+    }
+
+    // Views size elements at data, kept alive by owner
+    SharedArray(std::shared_ptr<const void> owner, const T *data, size_t size)
+        : m_Owner(std::move(owner)), m_Data(data), m_Size(size) {}
+
+    const T &operator[](size_t index) const { return m_Data[index]; }
+    const T *data() const { return m_Data; }
+    size_t size() const { return m_Size; }
+    bool empty() const { return m_Size == 0; }
+
+    const T *begin() const { return m_Data; }
+    const T *end() const { return m_Data + m_Size; }
+
+private:
+    std::shared_ptr<const void> m_Owner;
+    const T *m_Data = nullptr;
+    size_t m_Size = 0;
+};
@@ -0,0 +1,338 @@
+#include "SharedFramebuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char FramebufferMagic[8] = {'R', 'T', 'F', 'R', 'A', 'M', 'E', '\0'};
+
+    // Copies of a tile a reader makes while the renderer rewrites it, before leaving it for its next call
+    constexpr int ReadAttempts = 4;
+
+    // The sequence numbers are shared between processes, which only works for lock free atomics
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared framebuffers need lock free atomics");
+
+    size_t AlignUp(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    std::string GetSystemName(const std::string &name)
+    {
+#ifdef _WIN32
+        return "Local\\" + name;
+#else
+        return "/" + name;
+#endif
+    }
+}
+
+// Start of the segment, followed by a sequence number per tile and the pixels, each 64 byte aligned
+struct SharedFramebuffer::Header
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Width, Height, TileSize;
+    uint32_t TilesX, TilesY;
+    uint32_t SequencesOffset, PixelsOffset;
+    uint64_t Size;
+    std::atomic<uint32_t> AccumulatedFrames;
+    std::atomic<uint32_t> FrameTime; // Bits of a float, in milliseconds
+};
+
+/**
+ * @brief Creates a shared framebuffer for an image, replacing any segment of the same name left by a crash.
+ *
+ * @param generation The number of images this process created before, which makes the name unique.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param tileSize The width and height of the tiles readers copy and compare.
+ * @param error Output parameter for a description of the problem if the segment cannot be created.
+ * @return bool Returns true if the segment was created, blank; otherwise, returns false.
+ */
+bool SharedFramebuffer::Create(uint32_t generation, uint32_t width, uint32_t height, uint32_t tileSize, std::string &error)
+{
+    Close();
+    if (width == 0 || height == 0 || tileSize == 0)
+    {
+        error = "Shared framebuffers need a size";
+        return false;
+    }
+
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+    const size_t sequencesOffset = AlignUp(sizeof(Header), 64);
+    const size_t pixelsOffset = AlignUp(sequencesOffset + static_cast<size_t>(tilesX) * tilesY * sizeof(uint32_t), 64);
+    const size_t size = pixelsOffset + static_cast<size_t>(width) * height * sizeof(uint32_t);
+
+#ifdef _WIN32
+    const unsigned long processId = GetCurrentProcessId();
+#else
+    const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+    m_Name = "raytracing-" + std::to_string(processId) + "-" + std::to_string(generation);
+    m_Owner = true;
+    if (!Map(size, true, error))
+        return false;
+
+    Header *header = new (m_Header) Header();
+    std::memcpy(header->Magic, FramebufferMagic, sizeof(FramebufferMagic));
+    header->Version = SharedFramebufferVersion;
+    header->Width = width;
+    header->Height = height;
+    header->TileSize = tileSize;
+    header->TilesX = tilesX;
+    header->TilesY = tilesY;
+    header->SequencesOffset = static_cast<uint32_t>(sequencesOffset);
+    header->PixelsOffset = static_cast<uint32_t>(pixelsOffset);
+    header->Size = size;
+    std::atomic<uint32_t> *sequences = reinterpret_cast<std::atomic<uint32_t> *>(reinterpret_cast<char *>(header) + sequencesOffset);
+    for (uint32_t tile = 0; tile < tilesX * tilesY; tile++)
+        new (&sequences[tile]) std::atomic<uint32_t>(0);
+    return true;
+}
+
+/**
+ * @brief Attaches to the shared framebuffer another process created.
+ *
+ * @param name The name the creator gave the segment.
+ * @param error Output parameter for a description of the problem if the segment cannot be attached.
+ * @return bool Returns true if the segment was attached; otherwise, returns false.
+ */
+bool SharedFramebuffer::Attach(const std::string &name, std::string &error)
+{
+    Close();
+    m_Name = name;
+    m_Owner = false;
+    if (!Map(0, false, error))
+        return false;
+
+    const Header &header = *m_Header;
+    if (m_Size < sizeof(Header) || std::memcmp(header.Magic, FramebufferMagic, sizeof(FramebufferMagic)) != 0 ||
+        header.Version != SharedFramebufferVersion || header.Size > m_Size ||
+        header.PixelsOffset + static_cast<uint64_t>(header.Width) * header.Height * sizeof(uint32_t) > header.Size ||
+        header.SequencesOffset + static_cast<uint64_t>(header.TilesX) * header.TilesY * sizeof(uint32_t) > header.PixelsOffset)
+    {
+        error = name + " is not a shared framebuffer of this version";
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SharedFramebuffer::Close()
+{
+    if (!m_Header)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_Header);
+    CloseHandle(m_Mapping);
+    m_Mapping = nullptr;
+#else
+    munmap(m_Header, m_Size);
+    if (m_Owner)
+        shm_unlink(GetSystemName(m_Name).c_str());
+#endif
+    m_Header = nullptr;
+    m_Size = 0;
+}
+
+uint32_t SharedFramebuffer::GetWidth() const { return m_Header ? m_Header->Width : 0; }
+uint32_t SharedFramebuffer::GetHeight() const { return m_Header ? m_Header->Height : 0; }
+uint32_t SharedFramebuffer::GetTileCount() const { return m_Header ? m_Header->TilesX * m_Header->TilesY : 0; }
+
+FramebufferTile SharedFramebuffer::GetTile(uint32_t tile) const
+{
+    const Header &header = *m_Header;
+    const uint32_t x0 = tile % header.TilesX * header.TileSize, y0 = tile / header.TilesX * header.TileSize;
+    return {x0, y0, glm::min(x0 + header.TileSize, header.Width), glm::min(y0 + header.TileSize, header.Height)};
+}
+
+/**
+ * @brief Publishes an image to the readers, rewriting only the tiles that changed since the last one.
+ *
+ * Every rewritten tile's sequence number goes odd before its pixels are written and even again after, so
+ * readers can tell a copy made meanwhile is torn. Tiles that converged to the same 8 bit pixels keep their
+ * number, and readers skip them.
+ *
+ * @param pixels The image, at the framebuffer's size, such as `Renderer::GetImageData`.
+ * @param accumulatedFrames The frames accumulated in the image, shown by readers.
+ * @param frameTime The milliseconds the last frame took to render, shown by readers.
+ * @return uint32_t The number of tiles rewritten.
+ */
+uint32_t SharedFramebuffer::Publish(const uint32_t *pixels, uint32_t accumulatedFrames, float frameTime)
+{
+    if (!m_Header || !m_Owner)
+        return 0;
+
+    Header &header = *m_Header;
+    std::atomic<uint32_t> *sequences = reinterpret_cast<std::atomic<uint32_t> *>(reinterpret_cast<char *>(m_Header) + header.SequencesOffset);
+    uint32_t *shared = GetPixels();
+    uint32_t changed = 0;
+    for (uint32_t tile = 0; tile < header.TilesX * header.TilesY; tile++)
+    {
+        const FramebufferTile bounds = GetTile(tile);
+        const size_t rowSize = (bounds.X1 - bounds.X0) * sizeof(uint32_t);
+        uint32_t y = bounds.Y0;
+        while (y < bounds.Y1 && std::memcmp(shared + static_cast<size_t>(y) * header.Width + bounds.X0, pixels + static_cast<size_t>(y) * header.Width + bounds.X0, rowSize) == 0)
+            y++;
+        if (y == bounds.Y1)
+            continue;
+
+        const uint32_t sequence = sequences[tile].load(std::memory_order_relaxed);
+        sequences[tile].store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (y = bounds.Y0; y < bounds.Y1; y++)
+            std::memcpy(shared + static_cast<size_t>(y) * header.Width + bounds.X0, pixels + static_cast<size_t>(y) * header.Width + bounds.X0, rowSize);
+        sequences[tile].store(sequence + 2, std::memory_order_release);
+        changed++;
+    }
+
+    header.AccumulatedFrames.store(accumulatedFrames, std::memory_order_relaxed);
+    uint32_t frameTimeBits;
+    std::memcpy(&frameTimeBits, &frameTime, sizeof(frameTimeBits));
+    header.FrameTime.store(frameTimeBits, std::memory_order_relaxed);
+    return changed;
+}
+
+/**
+ * @brief Copies the tiles published since a reader's last call into its copy of the image.
+ *
+ * A tile the renderer is rewriting, or rewrote during the copy, is copied again a few times, then left for
+ * the next call rather than waiting for the renderer.
+ *
+ * @param image The reader's copy of the image, at the framebuffer's size.
+ * @param sequences The sequence number of every tile in `image`, updated for the tiles copied. Zeros, the
+ *                  number of tiles never published, when `image` is new.
+ * @param changed Output parameter the tiles copied are appended to.
+ */
+void SharedFramebuffer::ReadChangedTiles(uint32_t *image, std::vector<uint32_t> &sequences, std::vector<FramebufferTile> &changed) const
+{
+    if (!m_Header)
+        return;
+
+    const Header &header = *m_Header;
+    const std::atomic<uint32_t> *shared = reinterpret_cast<const std::atomic<uint32_t> *>(reinterpret_cast<const char *>(m_Header) + header.SequencesOffset);
+    const uint32_t *pixels = GetPixels();
+    sequences.resize(GetTileCount(), 0);
+    for (uint32_t tile = 0; tile < GetTileCount(); tile++)
+    {
+        const FramebufferTile bounds = GetTile(tile);
+        const size_t rowSize = (bounds.X1 - bounds.X0) * sizeof(uint32_t);
+        for (int attempt = 0; attempt < ReadAttempts; attempt++)
+        {
+            const uint32_t sequence = shared[tile].load(std::memory_order_acquire);
+            if (sequence == sequences[tile])
+                break;
+            if (sequence & 1)
+                continue;
+
+            for (uint32_t y = bounds.Y0; y < bounds.Y1; y++)
+                std::memcpy(image + static_cast<size_t>(y) * header.Width + bounds.X0, pixels + static_cast<size_t>(y) * header.Width + bounds.X0, rowSize);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (shared[tile].load(std::memory_order_relaxed) == sequence)
+            {
+                sequences[tile] = sequence;
+                changed.push_back(bounds);
+                break;
+            }
+        }
+    }
+}
+
+uint32_t SharedFramebuffer::GetAccumulatedFrames() const
+{
+    return m_Header ? m_Header->AccumulatedFrames.load(std::memory_order_relaxed) : 0;
+}
+
+float SharedFramebuffer::GetFrameTime() const
+{
+    if (!m_Header)
+        return 0.0f;
+    const uint32_t bits = m_Header->FrameTime.load(std::memory_order_relaxed);
+    float frameTime;
+    std::memcpy(&frameTime, &bits, sizeof(frameTime));
+    return frameTime;
+}
+
+/**
+ * @brief Maps the segment named m_Name, creating it first with a size or attaching to it at the size it has.
+ */
+bool SharedFramebuffer::Map(size_t size, bool create, std::string &error)
+{
+    const std::string systemName = GetSystemName(m_Name);
+#ifdef _WIN32
+    m_Mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                            static_cast<DWORD>(size), systemName.c_str())
+                       : OpenFileMappingA(FILE_MAP_READ, FALSE, systemName.c_str());
+    void *data = m_Mapping ? MapViewOfFile(m_Mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (data && !create)
+    {
+        MEMORY_BASIC_INFORMATION region;
+        size = VirtualQuery(data, &region, sizeof(region)) ? region.RegionSize : 0;
+    }
+    if (!data)
+    {
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+        m_Mapping = nullptr;
+        error = "Cannot map shared framebuffer " + m_Name;
+        return false;
+    }
+#else
+    if (create)
+        shm_unlink(systemName.c_str());
+    const int file = shm_open(systemName.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDONLY, 0600);
+    struct stat status;
+    if (file < 0 || (create && ftruncate(file, static_cast<off_t>(size)) != 0) || (!create && fstat(file, &status) != 0))
+    {
+        if (file >= 0)
+        {
+            close(file);
+            if (create)
+                shm_unlink(systemName.c_str());
+        }
+        error = "Cannot open shared framebuffer " + m_Name + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!create)
+        size = static_cast<size_t>(status.st_size);
+
+    // The mapping keeps its own reference to the segment
+    void *data = size > 0 ? mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        if (create)
+            shm_unlink(systemName.c_str());
+        error = "Cannot map shared framebuffer " + m_Name;
+        return false;
+    }
+#endif
+
+    m_Header = static_cast<Header *>(data);
+    m_Size = size;
+    return true;
+}
+
+uint32_t *SharedFramebuffer::GetPixels() const
+{
+    return reinterpret_cast<uint32_t *>(reinterpret_cast<char *>(m_Header) + m_Header->PixelsOffset);
+}
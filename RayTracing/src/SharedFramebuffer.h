@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Increased whenever the layout of the shared memory changes
+constexpr uint32_t SharedFramebufferVersion = 1;
+
+// Pixels of a tile, in image coordinates
+struct FramebufferTile
+{
+    uint32_t X0, Y0, X1, Y1;
+};
+
+/**
+ * @brief Displayed image of a render, in memory shared between the process rendering it and the processes showing it.
+ *
+ * The image is split into tiles, each with a sequence number that is odd while the renderer writes it (a
+ * seqlock). Readers copy a tile without any lock and keep the copy only if the sequence number was even and
+ * unchanged around it, and compare it with the last one they copied to skip tiles that did not change. The
+ * renderer never waits for readers, and a reader that stops or crashes leaves nothing locked.
+ *
+ * Segments are named POSIX shared memory objects, or named file mappings on Windows. The creator removes the
+ * name when it closes, while processes that attached keep their mapping until they close it too.
+ */
+class SharedFramebuffer
+{
+public:
+    SharedFramebuffer() = default;
+    ~SharedFramebuffer() { Close(); }
+
+    SharedFramebuffer(const SharedFramebuffer &) = delete;
+    SharedFramebuffer &operator=(const SharedFramebuffer &) = delete;
+
+    // Creates a segment for an image, named after this process and a generation so every image it creates gets a new name
+    bool Create(uint32_t generation, uint32_t width, uint32_t height, uint32_t tileSize, std::string &error);
+    bool Attach(const std::string &name, std::string &error);
+    void Close();
+
+    bool IsOpen() const { return m_Header != nullptr; }
+    const std::string &GetName() const { return m_Name; }
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    uint32_t GetTileCount() const;
+    FramebufferTile GetTile(uint32_t tile) const;
+
+    // Writer: copies the tiles whose pixels differ from the shared ones, returning how many changed
+    uint32_t Publish(const uint32_t *pixels, uint32_t accumulatedFrames, float frameTime);
+
+    // Reader: copies the tiles published since their sequence numbers in `sequences` into `image`, appending them to `changed`
+    void ReadChangedTiles(uint32_t *image, std::vector<uint32_t> &sequences, std::vector<FramebufferTile> &changed) const;
+    uint32_t GetAccumulatedFrames() const;
+    float GetFrameTime() const; // Milliseconds the last frame published took to render
+
+private:
+    struct Header;
+
+    bool Map(size_t size, bool create, std::string &error);
+    uint32_t *GetPixels() const;
+
+private:
+    std::string m_Name;
+    Header *m_Header = nullptr;
+    size_t m_Size = 0;
+    bool m_Owner = false; // Created the segment, and removes its name when closing
+#ifdef _WIN32
+    void *m_Mapping = nullptr;
+#endif
+};
@@ -0,0 +1,387 @@
+#include "Socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    using NativeSocket = SOCKET;
+    constexpr int SendFlags = 0;
+
+    // Winsock must be started once before any socket is created
+    bool StartSockets()
+    {
+        static const bool started = []()
+        {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        return started;
+    }
+
+    void CloseNative(NativeSocket handle) { closesocket(handle); }
+#else
+    using NativeSocket = int;
+    constexpr int SendFlags = MSG_NOSIGNAL;
+
+    bool StartSockets() { return true; }
+    void CloseNative(NativeSocket handle) { close(handle); }
+#endif
+
+    NativeSocket Native(intptr_t handle) { return static_cast<NativeSocket>(handle); }
+
+    constexpr const char *UnixPrefix = "unix:";
+
+    bool IsUnixAddress(const std::string &address) { return address.rfind(UnixPrefix, 0) == 0; }
+
+    // Whether a resolved address is on the loopback interface, only reachable from this machine
+    bool IsLoopback(const addrinfo &candidate)
+    {
+        if (candidate.ai_family == AF_INET)
+            return (ntohl(reinterpret_cast<const sockaddr_in *>(candidate.ai_addr)->sin_addr.s_addr) >> 24) == 127;
+        if (candidate.ai_family == AF_INET6)
+            return IN6_IS_ADDR_LOOPBACK(&reinterpret_cast<const sockaddr_in6 *>(candidate.ai_addr)->sin6_addr);
+        return false;
+    }
+
+    /**
+     * @brief Resolves a "host:port" address, or ":port" and "port" for every local interface.
+     *
+     * With localOnly, ":port" and "port" are 127.0.0.1 instead, and hosts resolving to other addresses fail.
+     *
+     * @return addrinfo* The addresses to try in order, to free with freeaddrinfo, or null if none resolve.
+     */
+    addrinfo *ResolveTcpAddress(const std::string &address, bool passive, bool localOnly, std::string &error)
+    {
+        const size_t separator = address.rfind(':');
+        std::string host = separator == std::string::npos ? "" : address.substr(0, separator);
+        const std::string port = separator == std::string::npos ? address : address.substr(separator + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+        if (localOnly && host.empty())
+            host = "127.0.0.1";
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0 || !result)
+        {
+            error = "Cannot resolve " + address;
+            return nullptr;
+        }
+        for (const addrinfo *candidate = result; localOnly && candidate; candidate = candidate->ai_next)
+        {
+            if (!IsLoopback(*candidate))
+            {
+                freeaddrinfo(result);
+                error = address + " is not a loopback address, only local clients may connect";
+                return nullptr;
+            }
+        }
+        return result;
+    }
+
+#ifndef _WIN32
+    bool MakeUnixAddress(const std::string &address, sockaddr_un &unixAddress, std::string &error)
+    {
+        const std::string path = address.substr(std::strlen(UnixPrefix));
+        unixAddress = sockaddr_un{};
+        unixAddress.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(unixAddress.sun_path))
+        {
+            error = "Invalid Unix socket path " + path;
+            return false;
+        }
+        std::memcpy(unixAddress.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    /**
+     * @brief Removes the socket file at an address if it was left by a process that did not exit cleanly.
+     *
+     * Files that are not sockets, and sockets still accepting connections, are kept and make listening fail.
+     *
+     * @return bool Returns true if the path is free to bind; otherwise, returns false.
+     */
+    bool RemoveStaleSocket(const sockaddr_un &unixAddress, const std::string &address, std::string &error)
+    {
+        struct stat status;
+        if (lstat(unixAddress.sun_path, &status) != 0)
+            return true;
+        if (!S_ISSOCK(status.st_mode))
+        {
+            error = "Cannot listen on " + address + ": address in use by a file that is not a socket";
+            return false;
+        }
+
+        const int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool stale = probe >= 0 && connect(probe, reinterpret_cast<const sockaddr *>(&unixAddress), sizeof(unixAddress)) != 0 && errno == ECONNREFUSED;
+        if (probe >= 0)
+            close(probe);
+        if (!stale)
+        {
+            error = "Cannot listen on " + address + ": address in use";
+            return false;
+        }
+        unlink(unixAddress.sun_path);
+        return true;
+    }
+#endif
+}
+
+Socket::~Socket()
+{
+    Close();
+}
+
+Socket::Socket(Socket &&other) noexcept
+    : m_Handle(std::exchange(other.m_Handle, InvalidHandle)), m_UnixPath(std::move(other.m_UnixPath))
+{
+}
+
+Socket &Socket::operator=(Socket &&other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        m_Handle = std::exchange(other.m_Handle, InvalidHandle);
+        m_UnixPath = std::move(other.m_UnixPath);
+    }
+    return *this;
+}
+
+void Socket::Close()
+{
+    if (m_Handle != InvalidHandle)
+        CloseNative(Native(m_Handle));
+    m_Handle = InvalidHandle;
+
+#ifndef _WIN32
+    if (!m_UnixPath.empty())
+        unlink(m_UnixPath.c_str());
+#endif
+    m_UnixPath.clear();
+}
+
+void Socket::ShutdownSend()
+{
+#ifdef _WIN32
+    shutdown(Native(m_Handle), SD_SEND);
+#else
+    shutdown(Native(m_Handle), SHUT_WR);
+#endif
+}
+
+/**
+ * @brief Creates a socket listening for connections on an address.
+ *
+ * TCP sockets reuse the address, so a coordinator can be restarted at once on the same port. A stale Unix
+ * socket file left by a process that did not exit cleanly is replaced, but not a socket another process
+ * listens on, or a file that is not a socket.
+ *
+ * @param address "host:port", ":port" for every interface, or "unix:path".
+ * @param error Output parameter for a description of the problem if listening fails.
+ * @param localOnly Listens on loopback addresses only, ":port" being 127.0.0.1, and fails for other hosts.
+ * @return Socket The listening socket, invalid on failure.
+ */
+Socket Socket::Listen(const std::string &address, std::string &error, bool localOnly)
+{
+    if (!StartSockets())
+    {
+        error = "Cannot start sockets";
+        return Socket();
+    }
+
+    if (IsUnixAddress(address))
+    {
+#ifdef _WIN32
+        error = "Unix domain sockets are not supported on this platform";
+        return Socket();
+#else
+        sockaddr_un unixAddress;
+        if (!MakeUnixAddress(address, unixAddress, error))
+            return Socket();
+
+        if (!RemoveStaleSocket(unixAddress, address, error))
+            return Socket();
+
+        Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!socket.IsValid() || bind(Native(socket.m_Handle), reinterpret_cast<sockaddr *>(&unixAddress), sizeof(unixAddress)) != 0 ||
+            listen(Native(socket.m_Handle), SOMAXCONN) != 0)
+        {
+            error = "Cannot listen on " + address + ": " + std::strerror(errno);
+            return Socket();
+        }
+        socket.m_UnixPath = unixAddress.sun_path;
+        return socket;
+#endif
+    }
+
+    addrinfo *addresses = ResolveTcpAddress(address, true, localOnly, error);
+    if (!addresses)
+        return Socket();
+
+    Socket socket;
+    for (addrinfo *candidate = addresses; candidate && !socket.IsValid(); candidate = candidate->ai_next)
+    {
+        Socket attempt(static_cast<intptr_t>(::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol)));
+        if (!attempt.IsValid())
+            continue;
+
+        const int reuse = 1;
+        setsockopt(Native(attempt.m_Handle), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+        if (bind(Native(attempt.m_Handle), candidate->ai_addr, static_cast<int>(candidate->ai_addrlen)) == 0 &&
+            listen(Native(attempt.m_Handle), SOMAXCONN) == 0)
+            socket = std::move(attempt);
+    }
+    freeaddrinfo(addresses);
+
+    if (!socket.IsValid())
+        error = "Cannot listen on " + address;
+    return socket;
+}
+
+/**
+ * @brief Connects to a listening socket.
+ *
+ * TCP connections disable Nagle's algorithm, since the messages exchanged are requests waiting for replies.
+ *
+ * @param address "host:port" or "unix:path".
+ * @param error Output parameter for a description of the problem if connecting fails.
+ * @return Socket The connected socket, invalid on failure.
+ */
+Socket Socket::Connect(const std::string &address, std::string &error)
+{
+    if (!StartSockets())
+    {
+        error = "Cannot start sockets";
+        return Socket();
+    }
+
+    if (IsUnixAddress(address))
+    {
+#ifdef _WIN32
+        error = "Unix domain sockets are not supported on this platform";
+        return Socket();
+#else
+        sockaddr_un unixAddress;
+        if (!MakeUnixAddress(address, unixAddress, error))
+            return Socket();
+
+        Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!socket.IsValid() || connect(Native(socket.m_Handle), reinterpret_cast<sockaddr *>(&unixAddress), sizeof(unixAddress)) != 0)
+        {
+            error = "Cannot connect to " + address + ": " + std::strerror(errno);
+            return Socket();
+        }
+        return socket;
+#endif
+    }
+
+    addrinfo *addresses = ResolveTcpAddress(address, false, false, error);
+    if (!addresses)
+        return Socket();
+
+    Socket socket;
+    for (addrinfo *candidate = addresses; candidate && !socket.IsValid(); candidate = candidate->ai_next)
+    {
+        Socket attempt(static_cast<intptr_t>(::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol)));
+        if (attempt.IsValid() && connect(Native(attempt.m_Handle), candidate->ai_addr, static_cast<int>(candidate->ai_addrlen)) == 0)
+            socket = std::move(attempt);
+    }
+    freeaddrinfo(addresses);
+
+    if (!socket.IsValid())
+    {
+        error = "Cannot connect to " + address;
+        return socket;
+    }
+
+    const int noDelay = 1;
+    setsockopt(Native(socket.m_Handle), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+    return socket;
+}
+
+Socket Socket::Accept()
+{
+    const intptr_t handle = static_cast<intptr_t>(accept(Native(m_Handle), nullptr, nullptr));
+    Socket socket(handle);
+    if (socket.IsValid() && m_UnixPath.empty())
+    {
+        const int noDelay = 1;
+        setsockopt(Native(handle), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+    }
+    return socket;
+}
+
+bool Socket::WaitReadable(int timeoutMs)
+{
+#ifdef _WIN32
+    WSAPOLLFD descriptor{Native(m_Handle), POLLRDNORM, 0};
+    return WSAPoll(&descriptor, 1, timeoutMs) > 0;
+#else
+    pollfd descriptor{Native(m_Handle), POLLIN, 0};
+    return poll(&descriptor, 1, timeoutMs) > 0;
+#endif
+}
+
+bool Socket::SendAll(const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        const int chunk = static_cast<int>(size < (1u << 30) ? size : (1u << 30));
+        const auto sent = send(Native(m_Handle), bytes, chunk, SendFlags);
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool Socket::ReceiveAll(void *data, size_t size)
+{
+    char *bytes = static_cast<char *>(data);
+    while (size > 0)
+    {
+        const int chunk = static_cast<int>(size < (1u << 30) ? size : (1u << 30));
+        const auto received = recv(Native(m_Handle), bytes, chunk, 0);
+        if (received <= 0)
+            return false;
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+bool Socket::SetReceiveTimeout(int timeoutMs)
+{
+#ifdef _WIN32
+    const DWORD timeout = static_cast<DWORD>(timeoutMs);
+#else
+    timeval timeout{timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+#endif
+    return setsockopt(Native(m_Handle), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&timeout), sizeof(timeout)) == 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Blocking stream socket, over TCP ("host:port") or a Unix domain socket ("unix:/path/to/socket").
+ *
+ * Unix domain sockets are only available on POSIX systems. Sends never raise SIGPIPE; a closed peer makes
+ * them fail instead.
+ */
+class Socket
+{
+public:
+    Socket() = default;
+    ~Socket();
+
+    Socket(Socket &&other) noexcept;
+    Socket &operator=(Socket &&other) noexcept;
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    // With localOnly, TCP addresses must be loopback ones, ":port" listening on 127.0.0.1
+    static Socket Listen(const std::string &address, std::string &error, bool localOnly = false);
+    static Socket Connect(const std::string &address, std::string &error);
+    // Accepts a connection to a listening socket, invalid if none was pending
+    Socket Accept();
+
+    bool IsValid() const { return m_Handle != InvalidHandle; }
+    void Close();
+    // Tells the peer nothing more will be sent, while still receiving what it sends
+    void ShutdownSend();
+
+    // Waits until data (or a connection, for listening sockets) can be read without blocking
+    bool WaitReadable(int timeoutMs);
+
+    bool SendAll(const void *data, size_t size);
+    // Fails if the peer closes the connection, or nothing arrives for the receive timeout
+    bool ReceiveAll(void *data, size_t size);
+    bool SetReceiveTimeout(int timeoutMs);
+
+private:
+    static constexpr intptr_t InvalidHandle = -1;
+
+    explicit Socket(intptr_t handle) : m_Handle(handle) {}
+
+private:
+    intptr_t m_Handle = InvalidHandle;
+    std::string m_UnixPath; // Path of a listening Unix domain socket, removed when it closes
+};
+
+// Messages of the protocols over sockets: a type and a payload size, in the machine's byte order, then the payload
+struct MessageHeader
+{
+    uint32_t Type;
+    uint32_t Size; // Bytes of payload following the header
+};
+
+// Bounds the payloads accepted, so a corrupt header cannot make a process allocate without limit
+constexpr uint32_t MaxMessageSize = 1u << 30;
+
+// Sends a message of a protocol's type, its payload made of two parts so a fixed struct can precede variable data
+template <typename Type>
+bool SendMessage(Socket &socket, Type type, const void *payload = nullptr, size_t size = 0, const void *extra = nullptr, size_t extraSize = 0)
+{
+    const MessageHeader header{static_cast<uint32_t>(type), static_cast<uint32_t>(size + extraSize)};
+    return socket.SendAll(&header, sizeof(header)) && socket.SendAll(payload, size) && socket.SendAll(extra, extraSize);
+}
+
+template <typename Type>
+bool ReceiveMessage(Socket &socket, Type &type, std::vector<char> &payload)
+{
+    MessageHeader header;
+    if (!socket.ReceiveAll(&header, sizeof(header)) || header.Size > MaxMessageSize)
+        return false;
+    type = static_cast<Type>(header.Type);
+    payload.resize(header.Size);
+    return socket.ReceiveAll(payload.data(), payload.size());
+}
+
+// Reads the fixed struct at the start of a payload
+template <typename T>
+bool ReadPayload(const std::vector<char> &payload, T &value)
+{
+    if (payload.size() < sizeof(T))
+        return false;
+    std::memcpy(&value, payload.data(), sizeof(T));
+    return true;
+}
+
+// Reads the text of a payload after its first offset bytes
+inline std::string PayloadText(const std::vector<char> &payload, size_t offset = 0)
+{
+    return offset < payload.size() ? std::string(payload.data() + offset, payload.size() - offset) : std::string();
+}
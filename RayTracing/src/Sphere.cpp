@@ -1,4 +1,7 @@
 #include "Sphere.h"
+#include "Kernels.h"
+#include "RayPacket.h"
+#include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 
 /**
@@ -57,6 +60,58 @@ bool Sphere::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) co
     return true;
 }
 
+/**
+ * @brief Determines which rays of a packet hit the sphere, testing them all at once.
+ *
+ * Solves the same quadratic equation as `hit` for every lane with the vectorized packet kernel.
+ *
+ * @param packet The packet holding the rays. `Hits` and `TMax` are updated for every lane hit.
+ * @param mask The lanes to test.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @return uint32_t The mask of lanes that hit the sphere closer than their previous `TMax`.
+ */
+uint32_t Sphere::hitLanes(RayPacket &packet, uint32_t mask, float tMin) const
+{
+    float distances[RayPacket::MaxSize];
+    const uint32_t hitMask = g_Kernels->IntersectPacketSphere(packet, mask, glm::value_ptr(Position), Radius, tMin, distances);
+    for (uint32_t lanes = hitMask; lanes != 0; lanes &= lanes - 1)
+    {
+        const int lane = RayPacket::FirstLane(lanes);
+        packet.Hits[lane].HitDistance = distances[lane];
+        packet.TMax[lane] = distances[lane];
+    }
+    return hitMask;
+}
+
+/**
+ * @brief Determines if a ray hits the sphere between tMin and tMax.
+ *
+ * This function solves the same quadratic equation as `hit`, but only reports whether either root lies
+ * inside the interval, without writing any hit information.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @return bool Returns true if the ray hits the sphere; otherwise, returns false.
+ */
+bool Sphere::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    glm::vec3 origin = ray.Origin - Position;
+
+    float a = glm::dot(ray.Direction, ray.Direction);
+    float b = 2.0f * glm::dot(origin, ray.Direction);
+    float c = glm::dot(origin, origin) - Radius * Radius;
+
+    float discriminant = b * b - 4.0f * a * c;
+    if (discriminant < 0.0f)
+        return false;
+
+    float sqrtDiscriminant = glm::sqrt(discriminant);
+    float t0 = (-b - sqrtDiscriminant) / (2.0f * a);
+    float t1 = (-b + sqrtDiscriminant) / (2.0f * a);
+    return (tMin < t0 && t0 < tMax) || (tMin < t1 && t1 < tMax);
+}
+
 /**
  * @brief Calculates the closest hit point on the sphere and updates the hit payload.
  *
@@ -13,9 +13,18 @@ public:
     Sphere() = default;
 
     bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    uint32_t hitLanes(RayPacket &packet, uint32_t mask, float tMin) const override;
 
     void ClosestHit(const Ray &ray, HitPayload &payload) const override;
 
+    AABB getBoundingBox() const override
+    {
+        glm::vec3 extent(glm::abs(Radius));
+        return AABB(Position - extent, Position + extent);
+    }
+
+    const char *getTypeName() const override { return "Sphere"; }
     bool RenderObjectOptions(std::vector<std::string> &materialNames) override;
 
     void setMaterialIndex(int newMaterialIndex) override
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Fast parsers of numbers in text, independent of the locale. Each advances p past the number it parses.
+bool ParseFloat(const char *&p, const char *end, float &value);
+bool ParseInteger(const char *&p, const char *end, long long &value);
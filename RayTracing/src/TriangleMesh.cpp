@@ -0,0 +1,410 @@
+#include "TriangleMesh.h"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    /**
+     * @brief A ray prepared for watertight triangle intersection.
+     *
+     * The coordinate axes are permuted so the largest component of the direction becomes z, and a shear
+     * maps the direction onto the z axis. Triangles are then tested in 2D in the sheared space, where the
+     * edge functions of adjacent triangles are evaluated identically on their shared edges.
+     */
+    struct WatertightRay
+    {
+        glm::vec3 Origin;
+        int Kx, Ky, Kz;
+        float Sx, Sy, Sz;
+
+        explicit WatertightRay(const Ray &ray) : Origin(ray.Origin)
+        {
+            const glm::vec3 absDirection = glm::abs(ray.Direction);
+            Kz = absDirection.x > absDirection.y ? (absDirection.x > absDirection.z ? 0 : 2) : (absDirection.y > absDirection.z ? 1 : 2);
+            Kx = (Kz + 1) % 3;
+            Ky = (Kx + 1) % 3;
+
+            // Keep the winding of the triangles
+            if (ray.Direction[Kz] < 0.0f)
+                std::swap(Kx, Ky);
+
+            Sx = ray.Direction[Kx] / ray.Direction[Kz];
+            Sy = ray.Direction[Ky] / ray.Direction[Kz];
+            Sz = 1.0f / ray.Direction[Kz];
+        }
+    };
+
+    /**
+     * @brief Slab test of a ray against a node box that never misses a box the ray touches.
+     *
+     * Watertight triangle tests are of little use if traversal drops the nodes holding the triangles: a ray
+     * through a vertex or edge touches the boxes of its triangles exactly at their faces or corners, where
+     * rounding can put the entry distance past the exit distance. The exit distance is enlarged by the
+     * worst case rounding error of both (Ize, 2013), and `invDirection` must come from `RobustInverse`.
+     */
+    bool HitBox(const AABB &box, const glm::vec3 &origin, const glm::vec3 &invDirection, float tMin, float tMax, float &tEntry)
+    {
+        const glm::vec3 t0 = (box.Min - origin) * invDirection;
+        const glm::vec3 t1 = (box.Max - origin) * invDirection;
+        const glm::vec3 tNear = glm::min(t0, t1);
+        const glm::vec3 tFar = glm::max(t0, t1);
+
+        tEntry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+        const float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax)) * 1.0000008f;
+        return tEntry <= tExit;
+    }
+
+    // Reciprocal of a direction with zero components replaced by tiny ones, so box planes through the ray origin give 0 instead of NaN
+    glm::vec3 RobustInverse(const glm::vec3 &direction)
+    {
+        glm::vec3 inverse;
+        for (int axis = 0; axis < 3; axis++)
+            inverse[axis] = 1.0f / (std::abs(direction[axis]) > 1e-30f ? direction[axis] : std::copysign(1e-30f, direction[axis]));
+        return inverse;
+    }
+
+    /**
+     * @brief Watertight ray-triangle intersection (Woop, Benthin and Wald, 2013).
+     *
+     * The vertices are translated to the ray origin and sheared, then the signed 2D edge functions U, V
+     * and W of the origin are evaluated. The ray hits when all three have the same sign. If any of them is
+     * exactly zero, the edges are evaluated again in double precision so hits on edges and vertices are
+     * decided consistently for every triangle sharing them.
+     *
+     * @param ray The prepared ray.
+     * @param v0 The first vertex.
+     * @param v1 The second vertex.
+     * @param v2 The third vertex.
+     * @param tMin The minimum distance at which a hit can occur.
+     * @param tMax The maximum distance at which a hit can occur.
+     * @param t Output parameter for the distance of the hit. Only modified if a hit occurs.
+     * @param barycentrics Optional output parameter for the weights of the three vertices at the hit.
+     * @return bool Returns true if the ray hits the triangle; otherwise, returns false.
+     */
+    bool IntersectTriangle(const WatertightRay &ray, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2,
+                           float tMin, float tMax, float &t, glm::vec3 *barycentrics)
+    {
+        const glm::vec3 a = v0 - ray.Origin;
+        const glm::vec3 b = v1 - ray.Origin;
+        const glm::vec3 c = v2 - ray.Origin;
+
+        const float ax = a[ray.Kx] - ray.Sx * a[ray.Kz];
+        const float ay = a[ray.Ky] - ray.Sy * a[ray.Kz];
+        const float bx = b[ray.Kx] - ray.Sx * b[ray.Kz];
+        const float by = b[ray.Ky] - ray.Sy * b[ray.Kz];
+        const float cx = c[ray.Kx] - ray.Sx * c[ray.Kz];
+        const float cy = c[ray.Ky] - ray.Sy * c[ray.Kz];
+
+        float u = cx * by - cy * bx;
+        float v = ax * cy - ay * cx;
+        float w = bx * ay - by * ax;
+
+        if (u == 0.0f || v == 0.0f || w == 0.0f)
+        {
+            u = static_cast<float>((double)cx * by - (double)cy * bx);
+            v = static_cast<float>((double)ax * cy - (double)ay * cx);
+            w = static_cast<float>((double)bx * ay - (double)by * ax);
+        }
+
+        if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+            return false;
+
+        const float determinant = u + v + w;
+        if (determinant == 0.0f)
+            return false;
+
+        const float az = ray.Sz * a[ray.Kz];
+        const float bz = ray.Sz * b[ray.Kz];
+        const float cz = ray.Sz * c[ray.Kz];
+        const float distance = (u * az + v * bz + w * cz) / determinant;
+        if (distance <= tMin || tMax <= distance)
+            return false;
+
+        t = distance;
+        if (barycentrics)
+            *barycentrics = glm::vec3(u, v, w) / determinant;
+        return true;
+    }
+}
+
+/**
+ * @brief Builds the hierarchy over the triangles of the buffers and gathers their vertices in leaf order.
+ *
+ * The normal indices are gathered in leaf order as well, so the buffers are not needed once the mesh is built.
+ *
+ * @param buffers The vertex and index buffers of the mesh. Every index must be in range.
+ * @param maxLeafSize The maximum number of triangles stored in a leaf of the hierarchy.
+ */
+TriangleMesh::TriangleMesh(std::shared_ptr<const MeshBuffers> buffers, uint32_t maxLeafSize)
+    : m_VertexCount(buffers->Positions.size())
+{
+    const std::vector<glm::vec3> &positions = buffers->Positions;
+    const std::vector<uint32_t> &indices = buffers->Indices;
+    const int64_t count = static_cast<int64_t>(buffers->GetTriangleCount());
+
+    std::vector<AABB> boxes(count);
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < count; i++)
+    {
+        AABB box;
+        box.Grow(positions[indices[3 * i]]);
+        box.Grow(positions[indices[3 * i + 1]]);
+        box.Grow(positions[indices[3 * i + 2]]);
+        boxes[i] = box;
+    }
+
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> triangleIndices;
+    BVH::Build(boxes, maxLeafSize, nodes, triangleIndices);
+
+    const bool hasNormals = !buffers->Normals.empty();
+    const std::vector<uint32_t> &normalIndices = buffers->NormalIndices.empty() ? indices : buffers->NormalIndices;
+    std::vector<Triangle> triangles(count);
+    std::vector<uint32_t> leafNormalIndices(hasNormals ? 3 * count : 0);
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < count; i++)
+    {
+        const size_t first = 3 * size_t(triangleIndices[i]);
+        triangles[i] = {positions[indices[first]], positions[indices[first + 1]], positions[indices[first + 2]]};
+        if (hasNormals)
+        {
+            for (int j = 0; j < 3; j++)
+                leafNormalIndices[3 * i + j] = normalIndices[first + j];
+        }
+    }
+
+    if (!nodes.empty())
+        m_Bounds = nodes[0].Bounds;
+    m_Nodes = std::move(nodes);
+    m_Triangles = std::move(triangles);
+    m_NormalIndices = std::move(leafNormalIndices);
+    if (hasNormals)
+        m_Normals = std::vector<glm::vec3>(buffers->Normals);
+}
+
+/**
+ * @brief Uses a mesh built before, such as one loaded from a scene cache. The arrays are used in place.
+ *
+ * @param nodes The hierarchy over the triangles.
+ * @param triangles The vertices of every triangle, in leaf order.
+ * @param normalIndices Three normal indices per triangle in leaf order, or empty for flat shading.
+ * @param normals The vertex normals.
+ * @param vertexCount The number of vertices of the model the mesh was built from, for display.
+ */
+TriangleMesh::TriangleMesh(SharedArray<BVHNode> nodes, SharedArray<Triangle> triangles, SharedArray<uint32_t> normalIndices,
+                           SharedArray<glm::vec3> normals, size_t vertexCount)
+    : m_Nodes(std::move(nodes)), m_Triangles(std::move(triangles)), m_NormalIndices(std::move(normalIndices)),
+      m_Normals(std::move(normals)), m_VertexCount(vertexCount)
+{
+    if (!m_Nodes.empty())
+        m_Bounds = m_Nodes[0].Bounds;
+}
+
+/**
+ * @brief Finds the closest triangle hit by the ray.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for information about the hit. Only modified if a hit occurs.
+ * @return bool Returns true if the ray hits any triangle; otherwise, returns false.
+ */
+bool TriangleMesh::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+{
+    return Traverse<false>(ray, tMin, tMax, &payload);
+}
+
+/**
+ * @brief Determines if the ray hits any triangle between tMin and tMax.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @return bool Returns true if the ray hits any triangle; otherwise, returns false.
+ */
+bool TriangleMesh::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    return Traverse<true>(ray, tMin, tMax, nullptr);
+}
+
+/**
+ * @brief Traverses the hierarchy of the mesh.
+ *
+ * Works like `BVH::Traverse`, visiting the nearer child first and skipping pushed nodes that lie beyond
+ * the closest hit so far. For any-hit queries the first triangle hit ends the traversal.
+ *
+ * @tparam AnyHit Whether any hit is enough, as for `occluded`.
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for the distance and triangle of the closest hit, unused if AnyHit.
+ * @return bool Returns true if the ray hits any triangle; otherwise, returns false.
+ */
+template <bool AnyHit>
+bool TriangleMesh::Traverse(const Ray &ray, float tMin, float tMax, HitPayload *payload) const
+{
+    if (m_Nodes.empty())
+        return false;
+
+    const glm::vec3 invDirection = RobustInverse(ray.Direction);
+    float tEntry;
+    if (!HitBox(m_Nodes[0].Bounds, ray.Origin, invDirection, tMin, tMax, tEntry))
+        return false;
+
+    const WatertightRay watertight(ray);
+
+    struct StackEntry
+    {
+        uint32_t NodeIndex;
+        float Distance;
+    };
+    StackEntry stack[BVH::StackSize];
+    int stackSize = 0;
+
+    bool hitAnything = false;
+    float closestSoFar = tMax;
+    uint32_t nodeIndex = 0;
+
+    while (true)
+    {
+        const BVHNode &node = m_Nodes[nodeIndex];
+        if (node.IsLeaf())
+        {
+            for (uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+            {
+                const Triangle &triangle = m_Triangles[i];
+                float t;
+                if (IntersectTriangle(watertight, triangle.V0, triangle.V1, triangle.V2, tMin, closestSoFar, t, nullptr))
+                {
+                    if (AnyHit)
+                        return true;
+                    hitAnything = true;
+                    closestSoFar = t;
+                    payload->HitDistance = t;
+                    payload->primitiveIndex = static_cast<int>(i);
+                }
+            }
+        }
+        else
+        {
+            float tLeft, tRight;
+            bool hitLeft = HitBox(m_Nodes[node.LeftFirst].Bounds, ray.Origin, invDirection, tMin, closestSoFar, tLeft);
+            bool hitRight = HitBox(m_Nodes[node.LeftFirst + 1].Bounds, ray.Origin, invDirection, tMin, closestSoFar, tRight);
+
+            if (hitLeft && hitRight)
+            {
+                uint32_t nearIndex = node.LeftFirst, farIndex = node.LeftFirst + 1;
+                if (tRight < tLeft)
+                {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(tLeft, tRight);
+                }
+                stack[stackSize++] = {farIndex, tRight};
+                nodeIndex = nearIndex;
+                continue;
+            }
+            if (hitLeft || hitRight)
+            {
+                nodeIndex = hitLeft ? node.LeftFirst : node.LeftFirst + 1;
+                continue;
+            }
+        }
+
+        do
+        {
+            if (stackSize == 0)
+                return hitAnything;
+            --stackSize;
+        } while (stack[stackSize].Distance > closestSoFar);
+        nodeIndex = stack[stackSize].NodeIndex;
+    }
+}
+
+/**
+ * @brief Calculates the hit point and normal on the triangle found by `hit`.
+ *
+ * The barycentric coordinates of the hit are recomputed for the triangle in `payload.primitiveIndex`. If
+ * the mesh has vertex normals they are interpolated with them, otherwise the face normal is used. The
+ * front face is decided by the face normal, so interpolated normals never flip sides.
+ *
+ * @param ray The ray that hit the mesh.
+ * @param payload The hit payload containing information about the hit. Modified by this function.
+ */
+void TriangleMesh::ClosestHit(const Ray &ray, HitPayload &payload) const
+{
+    const Triangle &triangle = m_Triangles[payload.primitiveIndex];
+    payload.position = ray.Origin + ray.Direction * payload.HitDistance;
+    payload.materialIndex = MaterialIndex;
+
+    const glm::vec3 faceNormal = glm::normalize(glm::cross(triangle.V1 - triangle.V0, triangle.V2 - triangle.V0));
+    glm::vec3 shadingNormal = faceNormal;
+
+    float t;
+    glm::vec3 barycentrics;
+    if (!m_NormalIndices.empty() &&
+        IntersectTriangle(WatertightRay(ray), triangle.V0, triangle.V1, triangle.V2, -std::numeric_limits<float>::max(),
+                          std::numeric_limits<float>::max(), t, &barycentrics))
+    {
+        const uint32_t *normalIndices = &m_NormalIndices[3 * size_t(payload.primitiveIndex)];
+        const glm::vec3 normal = barycentrics.x * m_Normals[normalIndices[0]] +
+                                 barycentrics.y * m_Normals[normalIndices[1]] +
+                                 barycentrics.z * m_Normals[normalIndices[2]];
+        const float length = glm::length(normal);
+        if (length > 0.0f)
+        {
+            shadingNormal = normal / length;
+            if (glm::dot(shadingNormal, faceNormal) < 0.0f)
+                shadingNormal = -shadingNormal;
+        }
+    }
+
+    payload.frontFace = glm::dot(ray.Direction, faceNormal) < 0.0f;
+    payload.normal = payload.frontFace ? shadingNormal : -shadingNormal;
+}
+
+size_t TriangleMesh::GetMemoryUsage() const
+{
+    return m_Nodes.size() * sizeof(BVHNode) + m_Triangles.size() * sizeof(Triangle) +
+           m_NormalIndices.size() * sizeof(uint32_t) + m_Normals.size() * sizeof(glm::vec3);
+}
+
+/**
+ * @brief Renders the GUI options for the mesh.
+ *
+ * Shows the size of the mesh and lets the user select its material. The geometry itself cannot be edited.
+ *
+ * @param materialNames A vector of names of available materials.
+ * @return bool Returns true if any of the options were changed by the user; otherwise, returns false.
+ */
+bool TriangleMesh::RenderObjectOptions(std::vector<std::string> &materialNames)
+{
+    int optionChanged = 0;
+    ImGui::Text("Triangles: %zu, vertices: %zu", GetTriangleCount(), m_VertexCount);
+    ImGui::Text("Memory: %.1f MB", GetMemoryUsage() / (1024.0f * 1024.0f));
+
+    std::string combo_preview_value = materialNames.at(MaterialIndex);
+    if (ImGui::BeginCombo("Material", combo_preview_value.c_str()))
+    {
+        for (int n = 0; n < materialNames.size(); n++)
+        {
+            const bool is_selected = (MaterialIndex == n);
+            if (ImGui::Selectable(materialNames.at(n).c_str(), is_selected))
+            {
+                MaterialIndex = n;
+                optionChanged += 1;
+            }
+
+            if (is_selected)
+                ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+    }
+
+    return optionChanged > 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Hittable.h"
+#include "BVH.h"
+#include "SharedArray.h"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Vertex and index buffers of a triangle mesh, as loaded from a model.
+ *
+ * A `TriangleMesh` gathers what it traces from them in leaf order, so they can be released once it is built.
+ */
+struct MeshBuffers
+{
+    std::vector<glm::vec3> Positions;
+    std::vector<uint32_t> Indices; // Three position indices per triangle, counter-clockwise seen from the front
+
+    // Optional vertex normals. If NormalIndices is empty, normals are indexed like Positions, otherwise
+    // NormalIndices holds three normal indices per triangle. Without normals, triangles are shaded flat.
+    std::vector<glm::vec3> Normals;
+    std::vector<uint32_t> NormalIndices;
+
+    size_t GetTriangleCount() const { return Indices.size() / 3; }
+    size_t GetMemoryUsage() const
+    {
+        return (Positions.size() + Normals.size()) * sizeof(glm::vec3) + (Indices.size() + NormalIndices.size()) * sizeof(uint32_t);
+    }
+};
+
+/**
+ * @brief A mesh of triangles, with its own bounding volume hierarchy over them.
+ *
+ * The vertices of every triangle are gathered from the shared buffers into a flat array in leaf order when
+ * the mesh is built, so intersection reads contiguous memory instead of chasing indices. Triangles are
+ * intersected with the watertight algorithm of Woop, Benthin and Wald, so rays never slip between adjacent
+ * triangles through shared edges or vertices.
+ *
+ * The mesh acts as a single object in the scene. The index of the triangle hit (in leaf order) is kept in
+ * `payload.primitiveIndex` between `hit` and `ClosestHit`, so meshes cannot be placed inside an `Instance`.
+ */
+class TriangleMesh : public Hittable
+{
+public:
+    // Vertices of a triangle, gathered from the buffers
+    struct Triangle
+    {
+        glm::vec3 V0, V1, V2;
+    };
+
+    int MaterialIndex = 0;
+
+    TriangleMesh(std::shared_ptr<const MeshBuffers> buffers, uint32_t maxLeafSize = 4);
+    TriangleMesh(SharedArray<BVHNode> nodes, SharedArray<Triangle> triangles, SharedArray<uint32_t> normalIndices,
+                 SharedArray<glm::vec3> normals, size_t vertexCount);
+
+    bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    void ClosestHit(const Ray &ray, HitPayload &payload) const override;
+    AABB getBoundingBox() const override { return m_Bounds; }
+
+    const char *getTypeName() const override { return "Triangle Mesh"; }
+    bool RenderObjectOptions(std::vector<std::string> &materialNames) override;
+
+    void setMaterialIndex(int newMaterialIndex) override { MaterialIndex = newMaterialIndex; }
+    int getMaterialIndex() override { return MaterialIndex; }
+
+    size_t GetTriangleCount() const { return m_Triangles.size(); }
+    size_t GetVertexCount() const { return m_VertexCount; }
+    size_t GetMemoryUsage() const;
+
+    const SharedArray<BVHNode> &GetNodes() const { return m_Nodes; }
+    const SharedArray<Triangle> &GetTriangles() const { return m_Triangles; }
+    const SharedArray<uint32_t> &GetNormalIndices() const { return m_NormalIndices; }
+    const SharedArray<glm::vec3> &GetNormals() const { return m_Normals; }
+
+private:
+    template <bool AnyHit>
+    bool Traverse(const Ray &ray, float tMin, float tMax, HitPayload *payload) const;
+
+private:
+    SharedArray<BVHNode> m_Nodes;
+    SharedArray<Triangle> m_Triangles;       // Leaf order
+    SharedArray<uint32_t> m_NormalIndices;   // Three per triangle in leaf order, empty without normals
+    SharedArray<glm::vec3> m_Normals;
+    size_t m_VertexCount = 0;
+    AABB m_Bounds;
+};
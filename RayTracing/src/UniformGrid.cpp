@@ -0,0 +1,386 @@
+#include "UniformGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    /**
+     * @brief Walks the cells of a grid pierced by a ray segment (3D-DDA).
+     *
+     * Cells are visited front to back, starting with the one containing the point at `t0`, and restricted
+     * to the inclusive cell range [lo, hi]. The visitor receives the cell coordinates and the segment of the
+     * ray inside the cell, and stops the walk by returning true.
+     *
+     * @return bool Returns true if the visitor stopped the walk; otherwise, returns false.
+     */
+    template <typename Visitor>
+    bool WalkCells(const Ray &ray, const glm::vec3 &invDirection, const glm::vec3 &gridMin, const glm::vec3 &cellSize,
+                   const glm::ivec3 &lo, const glm::ivec3 &hi, float t0, float t1, Visitor &&visit)
+    {
+        const glm::vec3 start = ray.Origin + ray.Direction * t0;
+        glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor((start - gridMin) / cellSize)), lo, hi);
+
+        glm::ivec3 step;
+        glm::vec3 tNext, tDelta;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (ray.Direction[axis] > 0.0f)
+            {
+                step[axis] = 1;
+                tNext[axis] = (gridMin[axis] + (cell[axis] + 1) * cellSize[axis] - ray.Origin[axis]) * invDirection[axis];
+                tDelta[axis] = cellSize[axis] * invDirection[axis];
+            }
+            else if (ray.Direction[axis] < 0.0f)
+            {
+                step[axis] = -1;
+                tNext[axis] = (gridMin[axis] + cell[axis] * cellSize[axis] - ray.Origin[axis]) * invDirection[axis];
+                tDelta[axis] = -cellSize[axis] * invDirection[axis];
+            }
+            else
+            {
+                step[axis] = 0;
+                tNext[axis] = std::numeric_limits<float>::infinity();
+                tDelta[axis] = std::numeric_limits<float>::infinity();
+            }
+        }
+
+        float tCell = t0;
+        while (true)
+        {
+            int axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+            if (visit(cell, tCell, glm::min(tNext[axis], t1)))
+                return true;
+            if (tNext[axis] >= t1)
+                return false;
+
+            cell[axis] += step[axis];
+            if (cell[axis] < lo[axis] || cell[axis] > hi[axis])
+                return false;
+
+            tCell = tNext[axis];
+            tNext[axis] += tDelta[axis];
+        }
+    }
+
+    glm::ivec3 ComputeResolution(const glm::vec3 &extent, float targetCells)
+    {
+        // Find the cell size giving roughly targetCells cubic cells. Axes thinner than one cell get a single
+        // cell and are left out, so flat scenes are divided only along their two large axes.
+        bool flat[3] = {false, false, false};
+        float cellSize = 0.0f;
+        for (int iteration = 0; iteration < 3; iteration++)
+        {
+            float volume = 1.0f;
+            int dimensions = 0;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (!flat[axis])
+                {
+                    volume *= extent[axis];
+                    dimensions++;
+                }
+            }
+            if (dimensions == 0 || volume <= 0.0f)
+            {
+                for (int axis = 0; axis < 3; axis++)
+                    flat[axis] = flat[axis] || extent[axis] <= 0.0f;
+                continue;
+            }
+
+            cellSize = std::pow(volume / targetCells, 1.0f / dimensions);
+            bool changed = false;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (!flat[axis] && extent[axis] < cellSize)
+                {
+                    flat[axis] = true;
+                    changed = true;
+                }
+            }
+            if (!changed)
+                break;
+        }
+
+        glm::ivec3 resolution(1);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (!flat[axis] && cellSize > 0.0f)
+                resolution[axis] = glm::clamp((int)std::ceil(extent[axis] / cellSize), 1, UniformGrid::MaxResolution);
+        }
+        while ((uint64_t)resolution.x * resolution.y * resolution.z > UniformGrid::MaxCellCount)
+            resolution = glm::max(resolution / 2, glm::ivec3(1));
+        return resolution;
+    }
+}
+
+/**
+ * @brief Builds the grid over every object of the list.
+ *
+ * Objects much larger than the median object are moved to a separate outlier list. The grid resolution is
+ * chosen to give about `cellsPerObject` cells per remaining object, then the cell lists are filled with a
+ * parallel counting sort: every object counts itself into the cells it overlaps, a prefix sum over the
+ * counts gives each cell its range, and every object then writes its index into those ranges.
+ *
+ * @param list The objects to build the grid over.
+ * @param cellsPerObject The target ratio of grid cells to objects.
+ */
+UniformGrid::UniformGrid(const HittableList &list, float cellsPerObject)
+    : Accelerator(list)
+{
+    const uint32_t count = static_cast<uint32_t>(m_Objects.size());
+    if (count == 0)
+        return;
+
+    std::vector<AABB> boxes(count);
+    std::vector<float> sizes(count);
+#pragma omp parallel for
+    for (uint32_t i = 0; i < count; i++)
+    {
+        boxes[i] = m_Objects[i]->getBoundingBox();
+        glm::vec3 extent = boxes[i].Extent();
+        sizes[i] = glm::max(glm::max(extent.x, extent.y), extent.z);
+    }
+
+    std::vector<float> sortedSizes = sizes;
+    std::nth_element(sortedSizes.begin(), sortedSizes.begin() + count / 2, sortedSizes.end());
+    const float outlierSize = sortedSizes[count / 2] * OutlierScale;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        m_Bounds.Grow(boxes[i]);
+        if (sizes[i] > outlierSize)
+        {
+            m_Outliers.push_back(m_Objects[i].get());
+            m_OutlierIndices.push_back(i);
+        }
+        else
+        {
+            m_GridBounds.Grow(boxes[i]);
+            m_Primitives.push_back(m_Objects[i].get());
+            m_PrimitiveIndices.push_back(i);
+        }
+    }
+
+    const uint32_t primitiveCount = static_cast<uint32_t>(m_Primitives.size());
+    if (primitiveCount == 0)
+        return;
+
+    m_Resolution = ComputeResolution(m_GridBounds.Extent(), cellsPerObject * primitiveCount);
+    m_CellSize = m_GridBounds.Extent() / glm::vec3(m_Resolution);
+    m_CellSize = glm::max(m_CellSize, glm::vec3(std::numeric_limits<float>::min()));
+    m_MacroResolution = (m_Resolution + MacroCellSize - 1) / MacroCellSize;
+
+    const uint32_t cellCount = m_Resolution.x * m_Resolution.y * m_Resolution.z;
+    const uint32_t macroCellCount = m_MacroResolution.x * m_MacroResolution.y * m_MacroResolution.z;
+
+    std::vector<glm::ivec3> cellMin(primitiveCount), cellMax(primitiveCount);
+    std::vector<uint32_t> cellCounts(cellCount, 0);
+
+    // Count the objects overlapping each cell
+#pragma omp parallel for
+    for (uint32_t i = 0; i < primitiveCount; i++)
+    {
+        const AABB &box = boxes[m_PrimitiveIndices[i]];
+        cellMin[i] = glm::clamp(glm::ivec3(glm::floor((box.Min - m_GridBounds.Min) / m_CellSize)), glm::ivec3(0), m_Resolution - 1);
+        cellMax[i] = glm::clamp(glm::ivec3(glm::floor((box.Max - m_GridBounds.Min) / m_CellSize)), glm::ivec3(0), m_Resolution - 1);
+
+        for (int z = cellMin[i].z; z <= cellMax[i].z; z++)
+            for (int y = cellMin[i].y; y <= cellMax[i].y; y++)
+                for (int x = cellMin[i].x; x <= cellMax[i].x; x++)
+                {
+#pragma omp atomic
+                    cellCounts[CellIndex({x, y, z})]++;
+                }
+    }
+
+    // Exclusive prefix sum gives every cell the start of its range
+    m_CellStart.resize(cellCount + 1);
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < cellCount; i++)
+    {
+        m_CellStart[i] = offset;
+        offset += cellCounts[i];
+        cellCounts[i] = m_CellStart[i]; // Reused as the write cursor of the cell
+    }
+    m_CellStart[cellCount] = offset;
+    m_CellPrimitives.resize(offset);
+
+    // Scatter the object indices into their cells
+#pragma omp parallel for
+    for (uint32_t i = 0; i < primitiveCount; i++)
+    {
+        for (int z = cellMin[i].z; z <= cellMax[i].z; z++)
+            for (int y = cellMin[i].y; y <= cellMax[i].y; y++)
+                for (int x = cellMin[i].x; x <= cellMax[i].x; x++)
+                {
+                    uint32_t slot;
+#pragma omp atomic capture
+                    slot = cellCounts[CellIndex({x, y, z})]++;
+                    m_CellPrimitives[slot] = i;
+                }
+    }
+
+    // Keep every cell list in object order so results do not depend on thread scheduling
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (uint32_t i = 0; i < cellCount; i++)
+        std::sort(m_CellPrimitives.begin() + m_CellStart[i], m_CellPrimitives.begin() + m_CellStart[i + 1]);
+
+    m_Occupancy.assign((cellCount + 63) / 64, 0);
+    m_MacroOccupancy.assign((macroCellCount + 63) / 64, 0);
+    for (int z = 0; z < m_Resolution.z; z++)
+        for (int y = 0; y < m_Resolution.y; y++)
+            for (int x = 0; x < m_Resolution.x; x++)
+            {
+                const uint32_t cellIndex = CellIndex({x, y, z});
+                if (m_CellStart[cellIndex] == m_CellStart[cellIndex + 1])
+                    continue;
+                m_Occupancy[cellIndex >> 6] |= uint64_t(1) << (cellIndex & 63);
+                const uint32_t macroIndex = MacroCellIndex(glm::ivec3(x, y, z) / MacroCellSize);
+                m_MacroOccupancy[macroIndex >> 6] |= uint64_t(1) << (macroIndex & 63);
+            }
+}
+
+/**
+ * @brief Clips the interval [tMin, tMax] to the part of the ray inside the grid bounds.
+ *
+ * @return bool Returns true if the ray overlaps the grid inside the interval; otherwise, returns false.
+ */
+bool UniformGrid::ClipToGrid(const Ray &ray, const glm::vec3 &invDirection, float &tMin, float &tMax) const
+{
+    if (m_CellStart.empty())
+        return false;
+
+    glm::vec3 t0 = (m_GridBounds.Min - ray.Origin) * invDirection;
+    glm::vec3 t1 = (m_GridBounds.Max - ray.Origin) * invDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    tMin = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+    tMax = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+    return tMin <= tMax;
+}
+
+/**
+ * @brief Finds the closest object hit by the ray.
+ *
+ * The outliers are tested first, which usually shortens the interval left to search in the grid. The
+ * grid is then walked front to back at the macro cell level, descending to the fine cells only inside
+ * occupied macro cells. Objects can span several cells, so a hit found in a cell is only final once it
+ * lies before the cell's exit distance.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @param payload Output parameter for information about the hit. Only modified if a hit occurs.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool UniformGrid::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+{
+    bool hitAnything = false;
+    float closestSoFar = tMax;
+
+    for (size_t i = 0; i < m_Outliers.size(); i++)
+    {
+        if (m_Outliers[i]->hit(ray, tMin, closestSoFar, payload))
+        {
+            hitAnything = true;
+            closestSoFar = payload.HitDistance;
+            payload.objectIndex = m_OutlierIndices[i];
+        }
+    }
+
+    const glm::vec3 invDirection = 1.0f / ray.Direction;
+    float tStart = tMin, tEnd = closestSoFar;
+    if (!ClipToGrid(ray, invDirection, tStart, tEnd))
+        return hitAnything;
+
+    const glm::vec3 macroCellSize = m_CellSize * (float)MacroCellSize;
+    WalkCells(ray, invDirection, m_GridBounds.Min, macroCellSize, glm::ivec3(0), m_MacroResolution - 1, tStart, tEnd,
+              [&](const glm::ivec3 &macroCell, float macroEntry, float macroExit)
+              {
+                  if (!IsMacroOccupied(MacroCellIndex(macroCell)))
+                      return false;
+
+                  const glm::ivec3 lo = macroCell * MacroCellSize;
+                  const glm::ivec3 hi = glm::min(lo + MacroCellSize - 1, m_Resolution - 1);
+                  return WalkCells(ray, invDirection, m_GridBounds.Min, m_CellSize, lo, hi, macroEntry, macroExit,
+                                   [&](const glm::ivec3 &cell, float, float cellExit)
+                                   {
+                                       const uint32_t cellIndex = CellIndex(cell);
+                                       if (!IsOccupied(cellIndex))
+                                           return false;
+
+                                       for (uint32_t j = m_CellStart[cellIndex]; j < m_CellStart[cellIndex + 1]; j++)
+                                       {
+                                           const uint32_t primitive = m_CellPrimitives[j];
+                                           if (m_Primitives[primitive]->hit(ray, tMin, closestSoFar, payload))
+                                           {
+                                               hitAnything = true;
+                                               closestSoFar = payload.HitDistance;
+                                               payload.objectIndex = m_PrimitiveIndices[primitive];
+                                           }
+                                       }
+                                       return closestSoFar <= cellExit;
+                                   });
+              });
+
+    return hitAnything;
+}
+
+/**
+ * @brief Determines if the ray hits any object between tMin and tMax.
+ *
+ * Walks the outliers and the grid cells like `hit`, but returns at the first object hit.
+ *
+ * @param ray The ray to check for hits.
+ * @param tMin The minimum distance at which a hit can occur.
+ * @param tMax The maximum distance at which a hit can occur.
+ * @return bool Returns true if the ray hits any object; otherwise, returns false.
+ */
+bool UniformGrid::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    for (const Hittable *outlier : m_Outliers)
+    {
+        if (outlier->occluded(ray, tMin, tMax))
+            return true;
+    }
+
+    const glm::vec3 invDirection = 1.0f / ray.Direction;
+    float tStart = tMin, tEnd = tMax;
+    if (!ClipToGrid(ray, invDirection, tStart, tEnd))
+        return false;
+
+    const glm::vec3 macroCellSize = m_CellSize * (float)MacroCellSize;
+    return WalkCells(ray, invDirection, m_GridBounds.Min, macroCellSize, glm::ivec3(0), m_MacroResolution - 1, tStart, tEnd,
+                     [&](const glm::ivec3 &macroCell, float macroEntry, float macroExit)
+                     {
+                         if (!IsMacroOccupied(MacroCellIndex(macroCell)))
+                             return false;
+
+                         const glm::ivec3 lo = macroCell * MacroCellSize;
+                         const glm::ivec3 hi = glm::min(lo + MacroCellSize - 1, m_Resolution - 1);
+                         return WalkCells(ray, invDirection, m_GridBounds.Min, m_CellSize, lo, hi, macroEntry, macroExit,
+                                          [&](const glm::ivec3 &cell, float, float)
+                                          {
+                                              const uint32_t cellIndex = CellIndex(cell);
+                                              if (!IsOccupied(cellIndex))
+                                                  return false;
+
+                                              for (uint32_t j = m_CellStart[cellIndex]; j < m_CellStart[cellIndex + 1]; j++)
+                                              {
+                                                  if (m_Primitives[m_CellPrimitives[j]]->occluded(ray, tMin, tMax))
+                                                      return true;
+                                              }
+                                              return false;
+                                          });
+                     });
+}
+
+size_t UniformGrid::GetMemoryUsage() const
+{
+    return m_CellStart.size() * sizeof(uint32_t) +
+           m_CellPrimitives.size() * sizeof(uint32_t) +
+           (m_Occupancy.size() + m_MacroOccupancy.size()) * sizeof(uint64_t) +
+           (m_Primitives.size() + m_Outliers.size()) * sizeof(const Hittable *) +
+           (m_PrimitiveIndices.size() + m_OutlierIndices.size()) * sizeof(uint32_t);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Accelerator.h"
+#include "AABB.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Two-level uniform grid for scenes made of many similarly sized objects.
+ *
+ * Every cell stores the objects overlapping it in one compact array (cell `i` owns the range
+ * `[m_CellStart[i], m_CellStart[i + 1])`), with a bit per cell marking the occupied ones. Cells are grouped
+ * into macro cells of `MacroCellSize`^3 cells with their own occupancy bits, so rays skip large empty
+ * regions at the coarse level. Objects much larger than the typical object (e.g. a ground sphere) are kept
+ * out of the grid and tested separately.
+ */
+class UniformGrid : public Accelerator
+{
+public:
+    static constexpr int MacroCellSize = 4;
+    static constexpr int MaxResolution = 2048;
+    static constexpr uint64_t MaxCellCount = uint64_t(1) << 26;
+
+    // Objects whose largest extent exceeds this multiple of the median extent are treated as outliers
+    static constexpr float OutlierScale = 16.0f;
+
+    UniformGrid(const HittableList &list, float cellsPerObject = 2.0f);
+
+    bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    AABB getBoundingBox() const override { return m_Bounds; }
+
+    const char *GetName() const override { return "Uniform Grid"; }
+    size_t GetNodeCount() const override { return m_CellStart.empty() ? 0 : m_CellStart.size() - 1; }
+    size_t GetMemoryUsage() const override;
+
+    const glm::ivec3 &GetResolution() const { return m_Resolution; }
+    size_t GetOutlierCount() const { return m_Outliers.size(); }
+
+private:
+    uint32_t CellIndex(const glm::ivec3 &cell) const { return cell.x + m_Resolution.x * (cell.y + m_Resolution.y * cell.z); }
+    uint32_t MacroCellIndex(const glm::ivec3 &cell) const { return cell.x + m_MacroResolution.x * (cell.y + m_MacroResolution.y * cell.z); }
+
+    bool IsOccupied(uint32_t cellIndex) const { return (m_Occupancy[cellIndex >> 6] >> (cellIndex & 63)) & 1u; }
+    bool IsMacroOccupied(uint32_t macroIndex) const { return (m_MacroOccupancy[macroIndex >> 6] >> (macroIndex & 63)) & 1u; }
+
+    bool ClipToGrid(const Ray &ray, const glm::vec3 &invDirection, float &tMin, float &tMax) const;
+
+private:
+    AABB m_Bounds;     // Bounds of everything, outliers included
+    AABB m_GridBounds; // Bounds of the objects stored in the grid
+    glm::ivec3 m_Resolution{0};
+    glm::ivec3 m_MacroResolution{0};
+    glm::vec3 m_CellSize{0.0f};
+
+    std::vector<uint32_t> m_CellStart;      // Offsets into m_CellPrimitives, one per cell plus a sentinel
+    std::vector<uint32_t> m_CellPrimitives; // Indices into m_Primitives, grouped by cell
+    std::vector<uint64_t> m_Occupancy;      // One bit per cell
+    std::vector<uint64_t> m_MacroOccupancy; // One bit per macro cell
+
+    std::vector<const Hittable *> m_Primitives; // Objects stored in the grid
+    std::vector<uint32_t> m_PrimitiveIndices;   // Their index in the source list
+
+    std::vector<const Hittable *> m_Outliers;
+    std::vector<uint32_t> m_OutlierIndices;
+};
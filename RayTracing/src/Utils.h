@@ -50,6 +50,13 @@ namespace Utils
         pcg32_srandom_r(&pcg32_global, seed, seq);
     }
 
+    // Restarts this thread's generator on one of its streams, for sequences that must not depend on the thread drawing them
+    static void SeedStream(uint64_t seed, uint64_t stream)
+    {
+        pcg32_srandom_r(&pcg32_global, seed, stream);
+        initialized = true;
+    }
+
     static void seedGenereator()
     {
         int rounds = 5;
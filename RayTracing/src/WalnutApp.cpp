@@ -5,10 +5,24 @@
 #include "Walnut/Timer.h"
 
 #include <glm/gtc/type_ptr.hpp>
+#include <omp.h>
 
 #include "Renderer.h"
 #include "Camera.h"
 #include "Sphere.h"
+#include "Instance.h"
+#include "MeshLoader.h"
+#include "SceneCache.h"
+#include "SceneFile.h"
+#include "Kernels.h"
+#include "Numa.h"
+#include "Autotuner.h"
+#include "Checkpoint.h"
+#include "RenderOutput.h"
+#include "FrameStream.h"
+#include "Headless.h"
+#include "RenderEngine.h"
+#include "CommandLine.h"
 
 using namespace Walnut;
 using std::make_shared;
@@ -17,9 +31,33 @@ class RayTracing : public Walnut::Layer
 {
 public:
 
-	RayTracing() : m_Camera(20.0f, 0.1f, 100.0f, glm::vec3{13.0f, 2.0f, 3.0f})
+	RayTracing() : m_Camera(CreateDefaultCamera())
 	{
-		GenerateScene();
+		// Use the parameters tuned for this machine, if it has been tuned
+		m_HasTuningReport = LoadTuningProfile(GetTuningProfilePath(), m_TuningReport);
+		m_TuningProfileStatus = m_HasTuningReport ? "loaded" : "not found";
+		if (m_HasTuningReport)
+		{
+			ApplyTuningParameters(m_TuningReport.Tuned, m_Renderer.GetSettings());
+			m_LeafSize = static_cast<int>(m_TuningReport.Tuned.LeafSize);
+		}
+
+		// A scene cache named by RAYTRACING_SCENE_CACHE is used in place of the generated scene
+		const char *cachePath = std::getenv("RAYTRACING_SCENE_CACHE");
+		if (cachePath)
+			snprintf(m_CachePath, sizeof(m_CachePath), "%s", cachePath);
+		if (!cachePath || !LoadCache())
+		{
+			GenerateScene();
+			BuildAccelerationStructure();
+		}
+	}
+
+	// Writes a last checkpoint when the app closes, finished by the writer before it is destroyed
+	virtual void OnDetach() override
+	{
+		if (m_Checkpointing)
+			m_CheckpointWriter.Submit(m_CheckpointPath, m_Renderer, m_Scene, m_Camera);
 	}
 
 	/**
@@ -33,7 +71,12 @@ public:
 	virtual void OnUpdate(float ts) override
 	{
 		if (m_Camera.OnUpdate(ts))
-			m_Renderer.ResetFrameIndex();
+		{
+			if (m_Engine.IsConnected())
+				m_Engine.SendCamera(m_Camera);
+			else
+				m_Renderer.ResetFrameIndex();
+		}
 	}
 
 	/**
@@ -44,18 +87,63 @@ public:
 	virtual void OnUIRender() override
 	{
 		int optionsChanged = 0;
+		int sceneChanged = 0;
 		ImGui::Begin("Settings");
 		ImGui::Text("Last render time: %.3fms", m_LastRenderTime);
+		ImGui::Text("Kernels: %s", GetKernelISAName(GetKernelISA()));
+
+		const Renderer::Statistics &statistics = m_Renderer.GetStatistics();
+		ImGui::Text("Rays: %llu (%.2f Mrays/s)", (unsigned long long)statistics.Rays, statistics.GetRaysPerSecond() * 1e-6);
+		if (statistics.Triangles > 0)
+			ImGui::Text("Triangles: %llu", (unsigned long long)statistics.Triangles);
+		ImGui::Text("Occlusion rays: %llu (%llu occluded)", (unsigned long long)statistics.OcclusionRays,
+					(unsigned long long)statistics.OcclusionHits);
+		if (statistics.CulledTiles > 0)
+			ImGui::Text("Frustum culled tiles: %llu (%.1f nodes/tile)", (unsigned long long)statistics.CulledTiles,
+						(double)statistics.TileCandidates / statistics.CulledTiles);
+		if (statistics.Packets > 0)
+			ImGui::Text("Packets: %llu (%.1f rays/packet, %.1f%% of rays)", (unsigned long long)statistics.Packets,
+						(double)statistics.PacketRays / statistics.Packets, 100.0 * statistics.PacketRays / glm::max(statistics.Rays, uint64_t(1)));
+		if (statistics.BatchRays > 0)
+			ImGui::Text("Batched rays: %llu, sort %.2fms (%.1f ns/ray), trace %.2fms (%.1f ns/ray)", (unsigned long long)statistics.BatchRays,
+						statistics.BatchSortTime, 1e6 * statistics.BatchSortTime / statistics.BatchRays,
+						statistics.BatchTraceTime, 1e6 * statistics.BatchTraceTime / statistics.BatchRays);
+
+		if (ImGui::BeginCombo("Accelerator", GetAcceleratorName(m_AcceleratorType)))
+		{
+			for (int n = 0; n < AcceleratorTypeCount; n++)
+			{
+				const AcceleratorType type = static_cast<AcceleratorType>(n);
+				if (ImGui::Selectable(GetAcceleratorName(type), m_AcceleratorType == type))
+				{
+					m_AcceleratorType = type;
+					sceneChanged++;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if (m_Scene.AccelerationStructure)
+		{
+			const Accelerator &accelerator = *m_Scene.AccelerationStructure;
+			const size_t primitiveCount = glm::max(accelerator.GetPrimitiveCount(), size_t(1));
+			ImGui::Text("Nodes: %zu, build time: %.3fms", accelerator.GetNodeCount(), m_LastBuildTime);
+			ImGui::Text("Memory: %.2f MB (%.1f bytes/primitive)", accelerator.GetMemoryUsage() / (1024.0 * 1024.0),
+						(double)accelerator.GetMemoryUsage() / primitiveCount);
+		}
 		if (ImGui::Button("Render"))
 		{
 			Render();
 		}
 
 		ImGui::Checkbox("Accumulate", &m_Renderer.GetSettings().Accumulate);
+		optionsChanged += ImGui::Checkbox("Deterministic Sampling", &m_Renderer.GetSettings().DeterministicSampling);
 
 		if (ImGui::Button("Reset"))
 		{
-			m_Renderer.ResetFrameIndex();
+			if (m_Engine.IsConnected())
+				m_Engine.SendReset();
+			else
+				m_Renderer.ResetFrameIndex();
 		}
 		optionsChanged += ImGui::DragInt("Bounces", &m_Renderer.m_Bounces, 0.5f, 1, 64);
 
@@ -65,12 +153,74 @@ public:
 			optionsChanged += ImGui::DragInt("Samples", &m_Renderer.m_Samples, 0.5f, 1, 100);
 		}
 
+		ImGui::Checkbox("Tile Frustum Culling", &m_Renderer.GetSettings().TileFrustumCulling);
+
+		const char *packetSizes[] = {"Off", "8 rays", "16 rays"};
+		int packetSizeIndex = m_Renderer.GetSettings().PacketSize / 8;
+		if (ImGui::Combo("Ray Packets", &packetSizeIndex, packetSizes, IM_ARRAYSIZE(packetSizes)))
+			m_Renderer.GetSettings().PacketSize = packetSizeIndex * 8;
+		if (m_Renderer.GetSettings().PacketSize > 0)
+			ImGui::SliderFloat("Packet Coherence", &m_Renderer.GetSettings().PacketCoherence, 0.0f, 1.0f);
+
+		// Every ISA computes the same image, so switching kernels does not restart accumulation
+		if (ImGui::BeginCombo("Kernel ISA", GetKernelISAName(GetKernelISA())))
+		{
+			for (int i = 0; i < KernelISACount; i++)
+			{
+				KernelISA isa = static_cast<KernelISA>(i);
+				ImGuiSelectableFlags flags = IsKernelISASupported(isa) ? 0 : ImGuiSelectableFlags_Disabled;
+				if (ImGui::Selectable(GetKernelISAName(isa), GetKernelISA() == isa, flags))
+					SetKernelISA(isa);
+			}
+			ImGui::EndCombo();
+		}
+
+		ImGui::Text("NUMA nodes: %d", GetNumaNodeCount());
+		ImGui::Checkbox("Pin Threads to NUMA Nodes", &m_Renderer.GetSettings().PinThreads);
+		ImGui::Checkbox("Huge Pages", &m_Renderer.GetSettings().HugePages);
+		if (GetNumaNodeCount() > 1 && ImGui::Checkbox("Replicate Scene per NUMA Node", &m_ReplicateScene))
+			BuildAccelerationStructure();
+
+		const char *batchSizes[] = {"Off", "16K paths", "64K paths", "256K paths", "1M paths"};
+		const uint32_t batchSizeValues[] = {0, 1u << 14, 1u << 16, 1u << 18, 1u << 20};
+		int batchSizeIndex = 0;
+		while (batchSizeIndex + 1 < IM_ARRAYSIZE(batchSizeValues) && batchSizeValues[batchSizeIndex] < m_Renderer.GetSettings().RayBatchSize)
+			batchSizeIndex++;
+		if (ImGui::Combo("Ray Batches", &batchSizeIndex, batchSizes, IM_ARRAYSIZE(batchSizes)))
+			m_Renderer.GetSettings().RayBatchSize = batchSizeValues[batchSizeIndex];
+		if (m_Renderer.GetSettings().RayBatchSize > 0)
+			ImGui::Checkbox("Sort Secondary Rays", &m_Renderer.GetSettings().SortSecondaryRays);
+		optionsChanged += ImGui::Checkbox("Ambient Occlusion", &m_Renderer.GetSettings().AmbientOcclusion);
+		if (m_Renderer.GetSettings().AmbientOcclusion)
+		{
+			optionsChanged += ImGui::DragFloat("AO Distance", &m_Renderer.GetSettings().AmbientOcclusionDistance, 0.05f, 0.01f, 100.0f);
+		}
+
+		RenderTuningOptions();
+		RenderCheckpointOptions();
+		RenderOutputOptions();
+		RenderEngineOptions();
+
 		ImGui::End();
 		ImGui::Begin("Camera");
 		optionsChanged += m_Camera.RenderCameraOptions();
 		ImGui::End();
 
 		ImGui::Begin("Scene");
+		ImGui::DragInt("Scene Size", &m_SceneSize, 1.0f, 1, 1000);
+		ImGui::SameLine();
+		if (ImGui::Button("Regenerate"))
+		{
+			GenerateScene();
+			sceneChanged++;
+		}
+		ImGui::DragInt("Instances", &m_InstanceCount, 1.0f, 1, 100000);
+		ImGui::DragInt("Cluster Size", &m_ClusterSize, 10.0f, 1, 1000000);
+		if (ImGui::Button("Generate Instanced Scene"))
+		{
+			GenerateInstancedScene();
+			sceneChanged++;
+		}
 		ImGui::Separator();
 		optionsChanged += ImGui::ColorEdit3("Sky Color", &m_Scene.SkyColor.x);
 		ImGui::Text("Objects");
@@ -82,19 +232,77 @@ public:
 			sphere->Radius = 1.0f;
 			sphere->MaterialIndex = 0;
 			m_Scene.Hittables.add(sphere);
+			sceneChanged++;
+		}
+		ImGui::InputText("Mesh", m_MeshPath, sizeof(m_MeshPath));
+		ImGui::SameLine();
+		if (ImGui::Button("Load Mesh"))
+		{
+			LoadMeshObject();
+			sceneChanged++;
 		}
+		if (!m_MeshStatus.empty())
+			ImGui::TextWrapped("%s", m_MeshStatus.c_str());
 
-		for (size_t i = 0; i < m_Scene.Hittables.objects.size(); i++)
+		ImGui::InputText("Cache", m_CachePath, sizeof(m_CachePath));
+		if (ImGui::Button("Save Cache"))
+		{
+			Timer timer;
+			std::string error;
+			if (SaveSceneCache(m_CachePath, m_Scene, m_MaterialNames, error))
+				m_CacheStatus = "Saved in " + std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms";
+			else
+				m_CacheStatus = error;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load Cache") && LoadCache())
+			optionsChanged++;
+		if (!m_CacheStatus.empty())
+			ImGui::TextWrapped("%s", m_CacheStatus.c_str());
+
+		ImGui::InputText("Scene File", m_SceneFilePath, sizeof(m_SceneFilePath));
+		if (ImGui::Button("Save Scene"))
+		{
+			Timer timer;
+			std::string error;
+			if (SaveSceneFile(m_SceneFilePath, m_Scene, &m_Camera, m_MaterialNames, error))
+				m_SceneFileStatus = "Saved in " + std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms";
+			else
+				m_SceneFileStatus = error;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load Scene"))
+		{
+			Timer timer;
+			std::string error;
+			if (LoadSceneFile(m_SceneFilePath, m_Scene, &m_Camera, m_MaterialNames, error))
+			{
+				m_SceneFileStatus = "Loaded " + std::to_string(m_Scene.Hittables.objects.size()) + " spheres in " +
+									std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms";
+				sceneChanged++;
+			}
+			else
+				m_SceneFileStatus = error;
+		}
+		if (!m_SceneFileStatus.empty())
+			ImGui::TextWrapped("%s", m_SceneFileStatus.c_str());
+
+		// Listing every object of the large benchmark scenes would stall the UI
+		const size_t listedObjects = std::min(m_Scene.Hittables.objects.size(), MaxListedItems);
+		if (listedObjects < m_Scene.Hittables.objects.size())
+			ImGui::Text("Showing %zu of %zu objects", listedObjects, m_Scene.Hittables.objects.size());
+
+		for (size_t i = 0; i < std::min(m_Scene.Hittables.objects.size(), MaxListedItems); i++)
 		{
 			ImGui::PushID(static_cast<int>(i));
-			if (ImGui::TreeNode(("Sphere " + std::to_string(i + 1)).c_str()))
+			if (ImGui::TreeNode((std::string(m_Scene.Hittables.objects[i]->getTypeName()) + " " + std::to_string(i + 1)).c_str()))
 			{
-				optionsChanged += m_Scene.Hittables.objects[i]->RenderObjectOptions(m_MaterialNames);
+				sceneChanged += m_Scene.Hittables.objects[i]->RenderObjectOptions(m_MaterialNames);
 				if (ImGui::Button("Delete"))
 				{
 					m_Scene.Hittables.objects.erase(m_Scene.Hittables.objects.begin() + i);
 					i--; // Decrement i to account for the erased element
-					optionsChanged++;
+					sceneChanged++;
 				}
 				ImGui::TreePop();
 			}
@@ -112,6 +320,7 @@ public:
 			auto material = make_shared<Lambertian>("Lambertian " + std::to_string(m_Scene.Materials.size() + 1));
 			m_Scene.Materials.push_back(material);
 			m_MaterialNames.push_back(material->Name);
+			m_Scene.UpdateMaterials();
 		}
 
 		if (ImGui::Button("Add Metal Material"))
@@ -119,16 +328,25 @@ public:
 			auto material = make_shared<Metal>("Metal " + std::to_string(m_Scene.Materials.size() + 1));
 			m_Scene.Materials.push_back(material);
 			m_MaterialNames.push_back(material->Name);
+			m_Scene.UpdateMaterials();
 		}
 
-		for (size_t i = 0; i < m_Scene.Materials.size(); i++)
+		const size_t listedMaterials = std::min(m_Scene.Materials.size(), MaxListedItems);
+		if (listedMaterials < m_Scene.Materials.size())
+			ImGui::Text("Showing %zu of %zu materials", listedMaterials, m_Scene.Materials.size());
+
+		for (size_t i = 0; i < listedMaterials; i++)
 		{
 			ImGui::PushID(static_cast<int>(i));
 			if (ImGui::TreeNode((m_MaterialNames.at(i).c_str())))
 			{
 				auto material = m_Scene.Materials[i];
 				ImGui::PushID(static_cast<int>(i));
-				optionsChanged += material->RenderObjectOptions();
+				if (material->RenderObjectOptions())
+				{
+					m_Scene.UpdateMaterial(i);
+					optionsChanged++;
+				}
 
 				ImGui::TreePop();
 			}
@@ -144,10 +362,22 @@ public:
 		m_ViewportWidth = ImGui::GetContentRegionAvail().x;
 		m_ViewportHeight = ImGui::GetContentRegionAvail().y;
 
-		if (optionsChanged)
+		if (sceneChanged)
+		{
+			BuildAccelerationStructure();
+			optionsChanged++;
+		}
+
+		// The engine renders its own copy of the scene, so only the camera and render options reach it
+		if (optionsChanged && m_Engine.IsConnected())
+		{
+			m_Engine.SendCamera(m_Camera);
+			m_Engine.SendOptions(m_Renderer);
+		}
+		else if (optionsChanged)
 			m_Renderer.ResetFrameIndex();
 
-		auto image = m_Renderer.GetFinalImage();
+		auto image = m_Engine.IsConnected() && m_EngineImage ? m_EngineImage : m_Renderer.GetFinalImage();
 		if (image)
 		{
 			ImGui::Image(image->GetDescriptorSet(),
@@ -161,29 +391,374 @@ public:
 		Render();
 	}
 
+	/**
+	 * @brief Shows the machine specific performance parameters, and the autotuner with its last report.
+	 */
+	void RenderTuningOptions()
+	{
+		if (!ImGui::CollapsingHeader("Tuning"))
+			return;
+
+		const char *tileSizes[] = {"8", "16", "32", "64"};
+		int tileSizeIndex = 0;
+		while (tileSizeIndex < 3 && (8u << tileSizeIndex) < m_Renderer.GetSettings().TileSize)
+			tileSizeIndex++;
+		if (ImGui::Combo("Tile Size", &tileSizeIndex, tileSizes, IM_ARRAYSIZE(tileSizes)))
+			m_Renderer.GetSettings().TileSize = 8u << tileSizeIndex;
+		ImGui::SliderInt("Threads (0 = all)", &m_Renderer.GetSettings().ThreadCount, 0, omp_get_num_procs());
+		if (ImGui::SliderInt("BVH Leaf Size", &m_LeafSize, 1, 8))
+			BuildAccelerationStructure();
+
+		if (ImGui::Button("Autotune"))
+		{
+			// Blocks the UI while every configuration renders a few frames
+			m_TuningReport = Autotune(m_Renderer, m_Scene, m_Camera, m_AcceleratorType);
+			m_HasTuningReport = true;
+			ApplyTuningParameters(m_TuningReport.Tuned, m_Renderer.GetSettings());
+			m_LeafSize = static_cast<int>(m_TuningReport.Tuned.LeafSize);
+			BuildAccelerationStructure();
+			m_Renderer.ResetFrameIndex();
+			m_TuningProfileStatus = SaveTuningProfile(GetTuningProfilePath(), m_TuningReport) ? "saved" : "could not be saved";
+		}
+		ImGui::TextWrapped("Profile: %s (%s)", GetTuningProfilePath().c_str(), m_TuningProfileStatus);
+		if (!m_HasTuningReport)
+			return;
+
+		auto isaName = [](int isa)
+		{ return isa >= 0 ? GetKernelISAName(static_cast<KernelISA>(isa)) : "Startup"; };
+
+		if (ImGui::BeginTable("TuningReport", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingStretchProp))
+		{
+			const TuningParameters &d = m_TuningReport.Default;
+			const TuningParameters &t = m_TuningReport.Tuned;
+			ImGui::TableSetupColumn("Parameter");
+			ImGui::TableSetupColumn("Default");
+			ImGui::TableSetupColumn("Tuned");
+			ImGui::TableHeadersRow();
+
+			auto row = [](const char *name, const std::string &defaultValue, const std::string &tunedValue)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(name);
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(defaultValue.c_str());
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(tunedValue.c_str());
+			};
+			row("Tile size", std::to_string(d.TileSize), std::to_string(t.TileSize));
+			row("Threads", d.ThreadCount > 0 ? std::to_string(d.ThreadCount) : "All", t.ThreadCount > 0 ? std::to_string(t.ThreadCount) : "All");
+			row("Ray packets", std::to_string(d.PacketSize), std::to_string(t.PacketSize));
+			row("Ray batch size", std::to_string(d.RayBatchSize), std::to_string(t.RayBatchSize));
+			row("BVH leaf size", std::to_string(d.LeafSize), std::to_string(t.LeafSize));
+			row("Kernel ISA", isaName(d.ISA), isaName(t.ISA));
+
+			char defaultTime[32], tunedTime[32];
+			snprintf(defaultTime, sizeof(defaultTime), "%.2fms", m_TuningReport.DefaultTime);
+			snprintf(tunedTime, sizeof(tunedTime), "%.2fms (%.2fx)", m_TuningReport.TunedTime,
+					 m_TuningReport.DefaultTime / glm::max(m_TuningReport.TunedTime, 1e-6f));
+			row("Frame time", defaultTime, tunedTime);
+			ImGui::EndTable();
+		}
+		ImGui::Text("%d configurations tried on %s", m_TuningReport.Configurations, m_TuningReport.Host.c_str());
+	}
+
+	/**
+	 * @brief Shows the checkpoint settings, and resumes rendering from a checkpoint on request.
+	 */
+	void RenderCheckpointOptions()
+	{
+		if (!ImGui::CollapsingHeader("Checkpoints"))
+			return;
+
+		ImGui::InputText("Checkpoint", m_CheckpointPath, sizeof(m_CheckpointPath));
+		if (ImGui::Checkbox("Periodic Checkpoints", &m_Checkpointing))
+			m_CheckpointTimer.Reset();
+		if (m_Checkpointing)
+			ImGui::DragFloat("Interval (minutes)", &m_CheckpointInterval, 0.1f, 0.1f, 600.0f);
+
+		if (ImGui::Button("Save Checkpoint"))
+		{
+			if (m_CheckpointWriter.Submit(m_CheckpointPath, m_Renderer, m_Scene, m_Camera))
+				m_CheckpointTimer.Reset();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Resume"))
+		{
+			// The scene, camera and viewport must be set up as they were when the checkpoint was saved
+			std::string error;
+			if (ResumeCheckpoint(m_CheckpointPath, m_Renderer, m_Scene, m_Camera, error))
+				m_CheckpointStatus = "Resumed " + std::to_string(m_Renderer.GetAccumulatedFrames()) + " frames";
+			else
+				m_CheckpointStatus = error;
+		}
+
+		ImGui::Text("Frames: %u", m_Renderer.GetAccumulatedFrames());
+		const std::string writerStatus = m_CheckpointWriter.IsBusy() ? "Writing..." : m_CheckpointWriter.GetStatus();
+		if (!writerStatus.empty())
+			ImGui::TextWrapped("Last checkpoint: %s", writerStatus.c_str());
+		if (!m_CheckpointStatus.empty())
+			ImGui::TextWrapped("%s", m_CheckpointStatus.c_str());
+	}
+
+	/**
+	 * @brief Shows the EXR output settings, and writes the render to a file on request.
+	 */
+	void RenderOutputOptions()
+	{
+		if (!ImGui::CollapsingHeader("Output"))
+			return;
+
+		ImGui::InputText("EXR File", m_OutputPath, sizeof(m_OutputPath));
+		ImGui::CheckboxFlags("Depth", &m_OutputLayers, RenderLayerDepth);
+		ImGui::SameLine();
+		ImGui::CheckboxFlags("Normal", &m_OutputLayers, RenderLayerNormal);
+		ImGui::SameLine();
+		ImGui::CheckboxFlags("Albedo", &m_OutputLayers, RenderLayerAlbedo);
+		ImGui::SameLine();
+		ImGui::CheckboxFlags("Samples", &m_OutputLayers, RenderLayerSamples);
+		ImGui::Checkbox("RLE Compression", &m_OutputCompressed);
+
+		if (ImGui::Button("Save EXR"))
+		{
+			const ExrCompression compression = m_OutputCompressed ? ExrCompression::RLE : ExrCompression::None;
+			m_OutputStatus = m_OutputWriter.Submit(m_OutputPath, m_Renderer, m_Scene, m_Camera, m_OutputLayers, compression)
+								 ? ""
+								 : "Nothing accumulated yet, or the last image is still being written";
+		}
+
+		const std::string writerStatus = m_OutputWriter.IsBusy() ? "Writing..." : m_OutputWriter.GetStatus();
+		if (!writerStatus.empty())
+			ImGui::TextWrapped("%s", writerStatus.c_str());
+		if (!m_OutputStatus.empty())
+			ImGui::TextWrapped("%s", m_OutputStatus.c_str());
+
+		ImGui::Separator();
+		ImGui::InputText("Stream To", m_StreamPath, sizeof(m_StreamPath));
+		ImGui::Combo("Stream Format", &m_StreamFormat, "YUV4MPEG2\0Raw RGBA\0");
+		ImGui::DragInt("Stream Rate", &m_StreamRate, 1.0f, 1, 240);
+		if (!m_FrameStream.IsOpen())
+		{
+			if (ImGui::Button("Start Streaming"))
+			{
+				const FrameStreamFormat format = m_StreamFormat == 0 ? FrameStreamFormat::Y4M : FrameStreamFormat::RGBA;
+				if (m_FrameStream.Open(m_StreamPath, m_Renderer.GetWidth(), m_Renderer.GetHeight(), format, static_cast<float>(m_StreamRate), m_StreamStatus))
+					m_StreamStatus.clear();
+			}
+		}
+		else
+		{
+			if (ImGui::Button("Stop Streaming"))
+				m_FrameStream.Close();
+			ImGui::TextWrapped("Frames are dropped while the encoder is behind, or the viewport is not %ux%u", m_FrameStream.GetWidth(), m_FrameStream.GetHeight());
+		}
+
+		const std::string streamStatus = m_FrameStream.GetStatus();
+		if (!streamStatus.empty())
+			ImGui::TextWrapped("%s", streamStatus.c_str());
+		if (!m_StreamStatus.empty())
+			ImGui::TextWrapped("%s", m_StreamStatus.c_str());
+	}
+
+	/**
+	 * @brief Attaches to a render engine running in another process, and shows its state once attached.
+	 */
+	void RenderEngineOptions()
+	{
+		if (!ImGui::CollapsingHeader("Engine"))
+			return;
+
+		ImGui::InputText("Engine Address", m_EngineAddress, sizeof(m_EngineAddress));
+		if (!m_Engine.IsConnected())
+		{
+			if (ImGui::Button("Attach"))
+			{
+				std::string error;
+				m_EngineStatus = m_Engine.Connect(m_EngineAddress, error) ? "" : error;
+			}
+			ImGui::TextWrapped("Start one with: RayTracing --engine ADDRESS --scene PATH");
+		}
+		else
+		{
+			// The engine renders on alone, and a later attach picks up where it is
+			if (ImGui::Button("Detach"))
+				DetachEngine();
+			ImGui::SameLine();
+			if (ImGui::Button("Stop Engine"))
+			{
+				m_Engine.SendStop();
+				DetachEngine();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Resize to Viewport"))
+				m_Engine.SendResize(m_ViewportWidth, m_ViewportHeight);
+
+			ImGui::Text("Image: %ux%u, %u frames, %.3fms per frame", m_Engine.GetWidth(), m_Engine.GetHeight(),
+						m_Engine.GetAccumulatedFrames(), m_Engine.GetFrameTime());
+			ImGui::Text("Uploaded %zu of %u tiles", m_EngineTiles.size(), m_Engine.GetTileCount());
+		}
+		if (!m_EngineStatus.empty())
+			ImGui::TextWrapped("%s", m_EngineStatus.c_str());
+	}
+
+	void DetachEngine()
+	{
+		m_Engine.Disconnect();
+		m_EngineImage.reset();
+	}
+
+	/**
+	 * @brief Shows the attached engine's image, uploading only the tiles it published since the last frame.
+	 *
+	 * The camera and options the engine sends on attach replace the editor's, so attaching never restarts
+	 * the engine's render. The editor goes back to rendering itself if the engine goes away.
+	 */
+	void UpdateEngineImage()
+	{
+		std::string error;
+		if (!m_Engine.Update(m_EngineTiles, error))
+		{
+			m_EngineStatus = error;
+			DetachEngine();
+			return;
+		}
+		m_Engine.TakeState(m_Camera, m_Renderer);
+
+		const uint32_t width = m_Engine.GetWidth(), height = m_Engine.GetHeight();
+		if (width == 0 || height == 0)
+			return;
+		if (!m_EngineImage || m_EngineImage->GetWidth() != width || m_EngineImage->GetHeight() != height)
+		{
+			m_EngineImage = make_shared<Image>(width, height, ImageFormat::RGBA, m_Engine.GetImageData());
+			return;
+		}
+
+		m_EngineRegions.clear();
+		for (const FramebufferTile &tile : m_EngineTiles)
+			m_EngineRegions.push_back({tile.X0, tile.Y0, tile.X1 - tile.X0, tile.Y1 - tile.Y0});
+		m_EngineImage->SetData(m_Engine.GetImageData(), m_EngineRegions.data(), static_cast<uint32_t>(m_EngineRegions.size()));
+	}
+
 	/**
 	 * @brief Renders the scene.
 	 *
-	 * This function is called when the user clicks the "Render" button or when the scene changes.
+	 * This function is called when the user clicks the "Render" button or when the scene changes. With
+	 * periodic checkpoints enabled, the accumulated frames are checkpointed every interval, and before a
+	 * resize discards them, so they can be resumed at that size later. While attached to an engine, the
+	 * engine's image is shown instead.
 	 */
 	void Render()
 	{
+		if (m_Engine.IsConnected())
+		{
+			UpdateEngineImage();
+			return;
+		}
+
 		Timer timer;
 
+		auto image = m_Renderer.GetFinalImage();
+		if (m_Checkpointing && image && (image->GetWidth() != m_ViewportWidth || image->GetHeight() != m_ViewportHeight))
+		{
+			// The writer holds its own copy, but must be done with the previous checkpoint to take this one
+			m_CheckpointWriter.Wait();
+			m_CheckpointWriter.Submit(m_CheckpointPath, m_Renderer, m_Scene, m_Camera);
+		}
+
 		m_Renderer.OnResize(m_ViewportWidth, m_ViewportHeight);
 		m_Camera.OnResize(m_ViewportWidth, m_ViewportHeight);
 		m_Renderer.Render(m_Scene, m_Camera);
 
 		m_LastRenderTime = timer.ElapsedMillis();
+
+		// Previews never slow the editor down, frames the writer has no room for are dropped
+		if (m_FrameStream.IsOpen())
+			m_FrameStream.Submit(m_Renderer.GetImageData(), m_Renderer.GetWidth(), m_Renderer.GetHeight(), true);
+
+		if (m_Checkpointing && m_CheckpointTimer.Elapsed() >= m_CheckpointInterval * 60.0f &&
+			m_CheckpointWriter.Submit(m_CheckpointPath, m_Renderer, m_Scene, m_Camera))
+			m_CheckpointTimer.Reset();
+	}
+
+	/**
+	 * @brief Rebuilds the scene's acceleration structure with the selected accelerator type.
+	 *
+	 * This function must be called whenever objects are added, removed or edited.
+	 */
+	void BuildAccelerationStructure()
+	{
+		Timer timer;
+		m_Scene.UpdateTriangleCount();
+		const uint32_t leafSize = static_cast<uint32_t>(m_LeafSize);
+		m_Scene.AccelerationStructure = CreateAccelerator(m_AcceleratorType, m_Scene.Hittables, leafSize);
+		m_Scene.AccelerationReplicas.clear();
+		if (m_ReplicateScene)
+			m_Scene.AccelerationReplicas = CreateAcceleratorReplicas(m_AcceleratorType, m_Scene.Hittables, leafSize);
+		m_LastBuildTime = timer.ElapsedMillis();
+	}
+
+	/**
+	 * @brief Replaces the scene with the scene cache at m_CachePath, and uses its prebuilt BVH.
+	 *
+	 * @return bool Returns false if the cache cannot be loaded, leaving the scene unchanged.
+	 */
+	bool LoadCache()
+	{
+		Timer timer;
+		std::string error;
+		if (!LoadSceneCache(m_CachePath, m_Scene, m_MaterialNames, error))
+		{
+			m_CacheStatus = error;
+			return false;
+		}
+		m_AcceleratorType = AcceleratorType::BVH;
+		m_LastBuildTime = 0.0f;
+		m_CacheStatus = "Loaded " + std::to_string(m_Scene.Hittables.objects.size()) + " objects in " +
+						std::to_string(static_cast<int>(timer.ElapsedMillis())) + "ms";
+		return true;
+	}
+
+	/**
+	 * @brief Loads the OBJ or PLY model at m_MeshPath and adds it to the scene as a triangle mesh.
+	 *
+	 * The mesh uses the first material. The load and build times are reported in m_MeshStatus.
+	 */
+	void LoadMeshObject()
+	{
+		Timer timer;
+		std::string error;
+		shared_ptr<MeshBuffers> buffers = LoadMesh(m_MeshPath, error);
+		if (!buffers)
+		{
+			m_MeshStatus = error;
+			return;
+		}
+		const float loadTime = timer.ElapsedMillis();
+
+		timer.Reset();
+		auto mesh = make_shared<TriangleMesh>(buffers, static_cast<uint32_t>(m_LeafSize));
+		m_Scene.Hittables.add(mesh);
+		const float buildTime = timer.ElapsedMillis();
+
+		char status[256];
+		snprintf(status, sizeof(status), "Loaded %zu triangles, %zu vertices in %.0fms, hierarchy built in %.0fms",
+				 mesh->GetTriangleCount(), buffers->Positions.size(), loadTime, buildTime);
+		m_MeshStatus = status;
 	}
 
 	/**
 	 * @brief Generates the scene.
 	 *
-	 * This function generates the scene by adding spheres with random materials to the scene.
+	 * This function generates the scene by adding spheres with random materials to the scene. Small spheres
+	 * are scattered over a (2 * m_SceneSize)^2 grid on the ground, so large values give benchmark scenes with
+	 * millions of equal-radius spheres. Any previous content of the scene is discarded.
 	 */
 	void GenerateScene()
 	{
+		m_Scene.Hittables.clear();
+		m_Scene.Materials.clear();
+		m_MaterialNames.clear();
+
 		auto materialGround = make_shared<Lambertian>("Ground");
 		materialGround->Albedo = {0.5f, 0.5f, 0.5f};
 		m_Scene.Materials.push_back(materialGround);
@@ -197,9 +772,9 @@ public:
 		}
 
 		int materialIndex = 0;
-		for (int a = -5; a < 5; a++)
+		for (int a = -m_SceneSize; a < m_SceneSize; a++)
 		{
-			for (int b = -5; b < 5; b++)
+			for (int b = -m_SceneSize; b < m_SceneSize; b++)
 			{
 				float choose_mat = Utils::RandomFloat();
 				glm::vec3 center{a + 0.9f * Utils::RandomFloat(), 0.2, b + 0.9f * Utils::RandomFloat()};
@@ -297,6 +872,70 @@ public:
 			sphere->MaterialIndex = m_Scene.Materials.size() - 1;
 			m_Scene.Hittables.add(sphere);
 		}
+
+		m_Scene.UpdateMaterials();
+	}
+
+	/**
+	 * @brief Generates a scene made of instances of one shared sphere cluster.
+	 *
+	 * A single cluster of m_ClusterSize small spheres is built once, wrapped in its own acceleration
+	 * structure (the bottom level) and placed m_InstanceCount times over the ground with random rotations.
+	 * The scene's acceleration structure over the instances is the top level, so the scene shows
+	 * m_InstanceCount * m_ClusterSize spheres while storing a single cluster.
+	 */
+	void GenerateInstancedScene()
+	{
+		m_Scene.Hittables.clear();
+		m_Scene.Materials.clear();
+		m_MaterialNames.clear();
+
+		auto materialGround = make_shared<Lambertian>("Ground");
+		materialGround->Albedo = {0.5f, 0.5f, 0.5f};
+		m_Scene.Materials.push_back(materialGround);
+		m_MaterialNames.push_back(materialGround->Name);
+		{
+			auto sphere = make_shared<Sphere>();
+			sphere->Position = {0.0f, -1000.0f, 0.0f};
+			sphere->Radius = 1000.0f;
+			sphere->MaterialIndex = 0;
+			m_Scene.Hittables.add(sphere);
+		}
+
+		const int clusterMaterialCount = 8;
+		for (int i = 0; i < clusterMaterialCount; i++)
+		{
+			auto material = make_shared<Lambertian>("Cluster " + std::to_string(i + 1));
+			material->Albedo = Utils::Vec3() * Utils::Vec3();
+			m_Scene.Materials.push_back(material);
+			m_MaterialNames.push_back(material->Name);
+		}
+
+		HittableList cluster;
+		for (int i = 0; i < m_ClusterSize; i++)
+		{
+			auto sphere = make_shared<Sphere>();
+			sphere->Position = Utils::InUnitSphere() + glm::vec3(0.0f, 1.0f, 0.0f);
+			sphere->Radius = 0.03f;
+			sphere->MaterialIndex = 1 + Utils::UInt() % clusterMaterialCount;
+			cluster.add(sphere);
+		}
+
+		shared_ptr<Hittable> sharedCluster = CreateAccelerator(m_AcceleratorType, cluster);
+		if (!sharedCluster)
+			sharedCluster = make_shared<HittableList>(cluster);
+
+		const int side = (int)glm::ceil(glm::sqrt((float)m_InstanceCount));
+		for (int i = 0; i < m_InstanceCount; i++)
+		{
+			auto instance = make_shared<Instance>(sharedCluster);
+			instance->Translation = {(i % side - side / 2) * 2.5f, 0.0f, (i / side - side / 2) * 2.5f};
+			instance->Rotation = {0.0f, Utils::RandomFloat(0.0f, 360.0f), 0.0f};
+			instance->UpdateTransform();
+			m_Scene.Hittables.add(instance);
+		}
+
+		m_Scene.UpdateMaterials();
 	}
 
 private:
@@ -305,13 +944,59 @@ private:
 	Scene m_Scene;
 	uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
 	std::vector<std::string> m_MaterialNames;
+	AcceleratorType m_AcceleratorType = AcceleratorType::BVH;
+	bool m_ReplicateScene = false; // Build a copy of the acceleration structure on every NUMA node
+	int m_LeafSize = 4;
+
+	TuningReport m_TuningReport; // Loaded from this machine's profile at startup, or from the last autotune
+	bool m_HasTuningReport = false;
+	const char *m_TuningProfileStatus = "";
+	char m_MeshPath[512] = "";
+	std::string m_MeshStatus; // Result of the last mesh load
+	char m_CachePath[512] = "RayTracing.scene";
+	std::string m_CacheStatus; // Result of the last scene cache load or save
+	char m_SceneFilePath[512] = "scene.json";
+	std::string m_SceneFileStatus; // Result of the last scene file load or save
+	CheckpointWriter m_CheckpointWriter;
+	bool m_Checkpointing = false;
+	float m_CheckpointInterval = 5.0f; // Minutes between periodic checkpoints
+	Timer m_CheckpointTimer;
+	char m_CheckpointPath[512] = "render.checkpoint";
+	std::string m_CheckpointStatus; // Result of the last resume
+	RenderOutputWriter m_OutputWriter;
+	char m_OutputPath[512] = "render.exr";
+	unsigned int m_OutputLayers = RenderLayerDepth | RenderLayerNormal | RenderLayerAlbedo | RenderLayerSamples;
+	bool m_OutputCompressed = true;
+	std::string m_OutputStatus; // Why the last image could not be saved
+	FrameStream m_FrameStream;
+	char m_StreamPath[512] = "render.y4m";
+	int m_StreamFormat = 0; // Index in the format combo, Y4M or RGBA
+	int m_StreamRate = 30;
+	std::string m_StreamStatus; // Why the last stream could not be started
+	RenderEngineClient m_Engine;
+	char m_EngineAddress[512] = "127.0.0.1:7878";
+	std::string m_EngineStatus; // Why the last attach failed, or the engine was lost
+	shared_ptr<Image> m_EngineImage; // The engine's image, while attached
+	std::vector<FramebufferTile> m_EngineTiles; // Tiles uploaded in the last frame
+	std::vector<ImageRegion> m_EngineRegions;
+	int m_SceneSize = 5;
+	int m_InstanceCount = 1000;
+	int m_ClusterSize = 10000;
+
+	static constexpr size_t MaxListedItems = 1000;
 
 	float m_LastRenderTime = 0.0f;
+	float m_LastBuildTime = 0.0f;
 };
 
 
 Walnut::Application *Walnut::CreateApplication(int argc, char **argv)
 {
+	// Headless modes exit here, before the window and GPU are created
+	int exitCode = 0;
+	if (RunCommandLine(argc, argv, exitCode))
+		std::exit(exitCode);
+
 	Walnut::ApplicationSpecification spec;
 	spec.Name = "Raytracing";
 
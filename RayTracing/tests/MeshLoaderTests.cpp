@@ -0,0 +1,144 @@
+#include "MeshLoader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace
+{
+    int s_Failures = 0;
+
+    void Check(bool condition, const char *test, const std::string &detail)
+    {
+        if (condition)
+            return;
+        std::fprintf(stderr, "FAILED %s: %s\n", test, detail.c_str());
+        s_Failures++;
+    }
+
+    // A little endian binary PLY of four vertices and one face, with the face list count type and count given
+    std::string MakePLY(const char *countType, int8_t faceVertices, size_t faces = 1, const char *faceCount = nullptr)
+    {
+        std::string text = "ply\nformat binary_little_endian 1.0\nelement vertex 4\n"
+                           "property float x\nproperty float y\nproperty float z\n";
+        text += "element face " + std::string(faceCount ? faceCount : std::to_string(faces)) + "\n";
+        text += "property list " + std::string(countType) + " int vertex_indices\nend_header\n";
+
+        const float positions[4][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+        text.append(reinterpret_cast<const char *>(positions), sizeof(positions));
+        for (size_t face = 0; face < faces; face++)
+        {
+            text.push_back(static_cast<char>(faceVertices));
+            for (int32_t index = 0; index < 4; index++)
+                text.append(reinterpret_cast<const char *>(&index), sizeof(index));
+        }
+        return text;
+    }
+
+    // Loads text as a model of the format given by extension, ".ply" or ".obj"
+    std::shared_ptr<MeshBuffers> LoadText(const std::string &text, std::string &error, const char *extension = ".ply")
+    {
+        const std::string path = (std::filesystem::temp_directory_path() / ("RayTracingMeshLoaderTest" + std::string(extension))).string();
+        std::ofstream(path, std::ios::binary).write(text.data(), static_cast<std::streamsize>(text.size()));
+        error.clear();
+        auto mesh = LoadMesh(path, error);
+        std::remove(path.c_str());
+        return mesh;
+    }
+
+    // Replaces the last vertex index of a PLY made by MakePLY
+    std::string SetLastIndex(std::string text, int32_t index)
+    {
+        std::memcpy(&text[text.size() - sizeof(index)], &index, sizeof(index));
+        return text;
+    }
+
+    bool HasTriangle(const std::vector<uint32_t> &indices, size_t triangle, uint32_t a, uint32_t b, uint32_t c)
+    {
+        return indices.size() >= 3 * triangle + 3 && indices[3 * triangle] == a && indices[3 * triangle + 1] == b && indices[3 * triangle + 2] == c;
+    }
+
+    // An OBJ of triangles that each follow their own three vertices and normal, referenced by negative indices.
+    // A chunk of the parser starts inside the first triangle past 1 MiB, so its face refers back to an earlier chunk.
+    std::string MakeStraddlingOBJ(size_t &triangles)
+    {
+        const size_t chunkSize = 1 << 20;
+        std::string text;
+        triangles = 0;
+        auto addTriangle = [&]()
+        {
+            const std::string x = std::to_string(triangles);
+            text += "v " + x + " 0 0\nv " + x + " 1 0\nv " + x + " 0 1\nvn 0 0 1\nf -3//-1 -2//-1 -1//-1\n";
+            triangles++;
+        };
+        while (text.size() < chunkSize - 100)
+            addTriangle();
+
+        // Pads up to the byte before the chunk size, so the split lands in the first vertex of the next triangle
+        text += "#" + std::string(chunkSize - 1 - text.size() - 2, ' ') + "\n";
+        while (text.size() < 2 * chunkSize + 100)
+            addTriangle();
+        return text;
+    }
+}
+
+int main()
+{
+    std::string error;
+
+    // A quad is not a triangle, so its faces are scanned before they are split into fans
+    auto mesh = LoadText(MakePLY("uchar", 4, 2), error);
+    Check(mesh && mesh->Indices.size() == 12, "quad faces", error);
+
+    // Cut inside the second face: the scan used to stop early and fan the rest from the file header
+    const std::string quads = MakePLY("uchar", 4, 2);
+    mesh = LoadText(quads.substr(0, quads.size() - 10), error);
+    Check(!mesh && error == "PLY file is truncated", "truncated faces", error);
+
+    // Cut before the count of the last face
+    mesh = LoadText(quads.substr(0, quads.size() - 17), error);
+    Check(!mesh && error == "PLY file is truncated", "truncated face count", error);
+
+    mesh = LoadText(MakePLY("char", -1), error);
+    Check(!mesh && error == "PLY face has a negative vertex count", "negative vertex count", error);
+
+    // More faces than the file could hold, including counts that wrap when multiplied by the face size
+    mesh = LoadText(MakePLY("uchar", 4, 1, "1000"), error);
+    Check(!mesh && error == "PLY file is truncated", "face count beyond the file", error);
+    mesh = LoadText(MakePLY("uchar", 4, 1, "9223372036854775808"), error);
+    Check(!mesh, "face count of 2^63", error);
+
+    // Indices are checked before they are cast, a negative one used to be undefined behavior
+    mesh = LoadText(SetLastIndex(MakePLY("uchar", 4), -1), error);
+    Check(!mesh && error == "PLY face references a missing vertex", "negative vertex index", error);
+    mesh = LoadText(SetLastIndex(MakePLY("uchar", 4), 4), error);
+    Check(!mesh && error == "PLY face references a missing vertex", "vertex index past the last vertex", error);
+
+    // Negative OBJ indices count back from the last vertex defined before the face
+    mesh = LoadText("v 0 0 0\nv 1 0 0\nv 1 1 0\nf -3 -2 -1\nv 0 1 0\nf -4 -2 -1\n", error, ".obj");
+    Check(mesh && mesh->Indices.size() == 6 && HasTriangle(mesh->Indices, 0, 0, 1, 2) && HasTriangle(mesh->Indices, 1, 0, 2, 3),
+          "negative OBJ indices", error);
+    mesh = LoadText("v 0 0 0\nv 1 0 0\nf -3 -2 -1\nv 1 1 0\n", error, ".obj");
+    Check(!mesh && error.rfind("Invalid face vertex index", 0) == 0, "negative OBJ index before the first vertex", error);
+
+    // Faces without texture coordinates keep their normals, a quad splits into a fan of two triangles
+    mesh = LoadText("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvn 0 0 1\nvn 0 0 -1\nf 1//2 2//1 3//1 4//2\n", error, ".obj");
+    Check(mesh && HasTriangle(mesh->Indices, 0, 0, 1, 2) && HasTriangle(mesh->Indices, 1, 0, 2, 3) && mesh->Normals.size() == 2 &&
+              HasTriangle(mesh->NormalIndices, 0, 1, 0, 0) && HasTriangle(mesh->NormalIndices, 1, 1, 0, 1),
+          "OBJ v//vn faces", error);
+
+    size_t triangles = 0;
+    mesh = LoadText(MakeStraddlingOBJ(triangles), error, ".obj");
+    bool straddling = mesh && mesh->GetTriangleCount() == triangles && mesh->NormalIndices.size() == 3 * triangles;
+    for (uint32_t i = 0; straddling && i < triangles; i++)
+        straddling = HasTriangle(mesh->Indices, i, 3 * i, 3 * i + 1, 3 * i + 2) && HasTriangle(mesh->NormalIndices, i, i, i, i) &&
+                     mesh->Positions[3 * i].x == static_cast<float>(i);
+    Check(straddling, "OBJ faces across chunks", error);
+
+    if (s_Failures == 0)
+        std::printf("All mesh loader tests passed\n");
+    return s_Failures == 0 ? 0 : 1;
+}
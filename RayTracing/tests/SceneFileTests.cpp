@@ -0,0 +1,62 @@
+#include "SceneFile.h"
+
+#include <cstdio>
+#include <string>
+
+namespace
+{
+    int s_Failures = 0;
+
+    void Check(bool condition, const char *test, const std::string &detail)
+    {
+        if (condition)
+            return;
+        std::fprintf(stderr, "FAILED %s: %s\n", test, detail.c_str());
+        s_Failures++;
+    }
+
+    bool ReadText(const std::string &text, Scene &scene, std::string &error)
+    {
+        std::vector<std::string> names;
+        error.clear();
+        return ReadSceneText(text.data(), text.data() + text.size(), "test", scene, nullptr, names, error);
+    }
+}
+
+int main()
+{
+    std::string error;
+
+    // Omitted members take the defaults of the materials made in the editor, not those of MaterialData
+    Scene scene;
+    bool loaded = ReadText(R"({"materials": [{"type": "metal"}, {"type": "lambertian"}, {"type": "dielectric"}, {}]})", scene, error);
+    Check(loaded && scene.MaterialTable.size() == 4, "materials with omitted members", error);
+    if (loaded && scene.MaterialTable.size() == 4)
+    {
+        const Metal editorMetal("");
+        const Lambertian editorLambertian("");
+        const Dielectric editorDielectric("");
+        Check(scene.MaterialTable[0].Type == MaterialType::Metal && scene.MaterialTable[0].Fuzz == editorMetal.Fuzz &&
+                  scene.MaterialTable[0].Albedo == editorMetal.Albedo,
+              "metal defaults", "fuzz " + std::to_string(scene.MaterialTable[0].Fuzz));
+        Check(scene.MaterialTable[1].Albedo == editorLambertian.Albedo && scene.MaterialTable[1].Roughness == editorLambertian.Roughness,
+              "lambertian defaults", "");
+        Check(scene.MaterialTable[2].IndexOfRefraction == editorDielectric.IndexOfRefraction, "dielectric defaults", "");
+        Check(scene.MaterialTable[3].Type == MaterialType::Lambertian, "default type", "");
+    }
+
+    // Members given in the file replace the defaults, whether they come before or after "type"
+    scene = Scene();
+    loaded = ReadText(R"({"materials": [{"fuzz": 0, "type": "metal", "albedo": [0.5, 0.25, 1]}]})", scene, error);
+    Check(loaded && scene.MaterialTable.size() == 1 && scene.MaterialTable[0].Fuzz == 0.0f &&
+              scene.MaterialTable[0].Albedo == glm::vec3(0.5f, 0.25f, 1.0f),
+          "metal members", error);
+
+    scene = Scene();
+    loaded = ReadText(R"({"materials": [{"type": "plastic"}]})", scene, error);
+    Check(!loaded, "unknown material type", "loaded");
+
+    if (s_Failures == 0)
+        std::printf("All scene file tests passed\n");
+    return s_Failures == 0 ? 0 : 1;
+}